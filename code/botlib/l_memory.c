@@ -96,13 +96,13 @@ void UnlinkMemoryBlock(memoryblock_t *block)
 #ifdef MEMDEBUG
 void *GetMemoryDebug(unsigned long size, char *label, char *file, int line)
 #else
-void *GetMemory(unsigned long size)
+void *GetMemorySite(unsigned long size, char *file, int line)
 #endif //MEMDEBUG
 {
 	void *ptr;
 	memoryblock_t *block;
 	assert(botimport.GetMemory);
-	ptr = botimport.GetMemory(size + sizeof(memoryblock_t));
+	ptr = (botimport.GetMemory)(size + sizeof(memoryblock_t), file, line);
 	block = (memoryblock_t *) ptr;
 	block->id = MEM_ID;
 	block->ptr = (char *) ptr + sizeof(memoryblock_t);
@@ -127,14 +127,14 @@ void *GetMemory(unsigned long size)
 #ifdef MEMDEBUG
 void *GetClearedMemoryDebug(unsigned long size, char *label, char *file, int line)
 #else
-void *GetClearedMemory(unsigned long size)
+void *GetClearedMemorySite(unsigned long size, char *file, int line)
 #endif //MEMDEBUG
 {
 	void *ptr;
 #ifdef MEMDEBUG
 	ptr = GetMemoryDebug(size, label, file, line);
 #else
-	ptr = GetMemory(size);
+	ptr = GetMemorySite(size, file, line);
 #endif //MEMDEBUG
 	Com_Memset(ptr, 0, size);
 	return ptr;
@@ -340,13 +340,13 @@ void DumpMemory(void)
 #ifdef MEMDEBUG
 void *GetMemoryDebug(unsigned long size, char *label, char *file, int line)
 #else
-void *GetMemory(unsigned long size)
+void *GetMemorySite(unsigned long size, char *file, int line)
 #endif //MEMDEBUG
 {
 	void *ptr;
 	unsigned long int *memid;
 
-	ptr = botimport.GetMemory(size + sizeof(unsigned long int));
+	ptr = (botimport.GetMemory)(size + sizeof(unsigned long int), file, line);
 	if (!ptr) return NULL;
 	memid = (unsigned long int *) ptr;
 	*memid = MEM_ID;
@@ -361,14 +361,14 @@ void *GetMemory(unsigned long size)
 #ifdef MEMDEBUG
 void *GetClearedMemoryDebug(unsigned long size, char *label, char *file, int line)
 #else
-void *GetClearedMemory(unsigned long size)
+void *GetClearedMemorySite(unsigned long size, char *file, int line)
 #endif //MEMDEBUG
 {
 	void *ptr;
 #ifdef MEMDEBUG
 	ptr = GetMemoryDebug(size, label, file, line);
 #else
-	ptr = GetMemory(size);
+	ptr = GetMemorySite(size, file, line);
 #endif //MEMDEBUG
 	Com_Memset(ptr, 0, size);
 	return ptr;
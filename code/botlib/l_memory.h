@@ -46,10 +46,14 @@ void *GetHunkMemoryDebug(unsigned long size, char *label, char *file, int line);
 //allocate a memory block of the given size and clear it
 void *GetClearedHunkMemoryDebug(unsigned long size, char *label, char *file, int line);
 #else
+//the call site is passed on to botimport.GetMemory so the engine's
+//allocation tracing shows the botlib code that asked for the memory
+#define GetMemory(size)				GetMemorySite(size, __FILE__, __LINE__)
+#define GetClearedMemory(size)		GetClearedMemorySite(size, __FILE__, __LINE__)
 //allocate a memory block of the given size
-void *GetMemory(unsigned long size);
+void *GetMemorySite(unsigned long size, char *file, int line);
 //allocate a memory block of the given size and clear it
-void *GetClearedMemory(unsigned long size);
+void *GetClearedMemorySite(unsigned long size, char *file, int line);
 //
 #ifdef BSPC
 #define GetHunkMemory GetMemory
@@ -1112,7 +1112,7 @@ void CL_InitUI( void ) {
 	if(cl_connectedToPureServer)
 	{
 		// if sv_pure is set we only allow qvms to be loaded
-		if(interpret != VMI_COMPILED && interpret != VMI_BYTECODE)
+		if(interpret != VMI_COMPILED && interpret != VMI_OPTIMIZED && interpret != VMI_BYTECODE)
 			interpret = VMI_COMPILED;
 	}
 
@@ -2816,19 +2816,58 @@ qboolean InFieldOfVision(vec3_t viewangles, float fov, vec3_t angles)
 	return qtrue;
 }
 
+/*
+==================
+BotVisibilityRequest
+
+sets up the trace from the eye to a point of the entity
+==================
+*/
+static void BotVisibilityRequest(traceRequest_t *req, vec3_t eye, vec3_t point, int viewer, int ent, int inwater) {
+	int contents_mask, passent;
+
+	contents_mask = CONTENTS_SOLID|CONTENTS_PLAYERCLIP;
+	passent = viewer;
+	VectorCopy(eye, req->start);
+	VectorCopy(point, req->end);
+	//if the entity is in water, lava or slime
+	if (trap_AAS_PointContents(point) & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
+		contents_mask |= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
+	}
+	//if eye is in water, lava or slime
+	if (inwater) {
+		if (!(contents_mask & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER))) {
+			passent = ent;
+			VectorCopy(point, req->start);
+			VectorCopy(eye, req->end);
+		}
+		contents_mask ^= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
+	}
+	VectorClear(req->mins);
+	VectorClear(req->maxs);
+	req->passEntityNum = passent;
+	req->contentmask = contents_mask;
+	req->capsule = qfalse;
+}
+
 /*
 ==================
 BotEntityVisible
 
-returns visibility in the range [0, 1] taking fog and water surfaces into account
+returns visibility in the range [0, 1] taking fog and water surfaces into account,
+the middle of the bounding box is traced first, its bottom and top together
+only when the middle isn't clearly visible
 ==================
 */
 float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int ent) {
 	int i, contents_mask, passent, hitent, infog, inwater, otherinfog, pc;
 	float squaredfogdist, waterfactor, vis, bestvis;
-	bsp_trace_t trace;
+	bsp_trace_t trace, traces[3];
+	trace_t batchtraces[2];
+	traceRequest_t requests[3], *req;
 	aas_entityinfo_t entinfo;
 	vec3_t dir, entangles, start, end, middle;
+	vec3_t middles[3];
 
 	BotEntityInfo(ent, &entinfo);
 	if (!entinfo.valid) {
@@ -2848,32 +2887,40 @@ float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int
 	infog = (pc & CONTENTS_FOG);
 	inwater = (pc & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER));
 	//
+	//the middle, bottom and top of the bounding box
+	VectorCopy(middle, middles[0]);
+	VectorCopy(middle, middles[1]);
+	middles[1][2] += entinfo.mins[2];
+	VectorCopy(middles[1], middles[2]);
+	middles[2][2] += entinfo.maxs[2] - entinfo.mins[2];
+	BotVisibilityRequest(&requests[0], eye, middles[0], viewer, ent, inwater);
+	//
 	bestvis = 0;
 	for (i = 0; i < 3; i++) {
 		//if the point is not in potential visible sight
 		//if (!AAS_inPVS(eye, middle)) continue;
 		//
-		contents_mask = CONTENTS_SOLID|CONTENTS_PLAYERCLIP;
-		passent = viewer;
-		hitent = ent;
-		VectorCopy(eye, start);
-		VectorCopy(middle, end);
-		//if the entity is in water, lava or slime
-		if (trap_AAS_PointContents(middle) & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
-			contents_mask |= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
-		}
-		//if eye is in water, lava or slime
-		if (inwater) {
-			if (!(contents_mask & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER))) {
-				passent = ent;
-				hitent = viewer;
-				VectorCopy(middle, start);
-				VectorCopy(eye, end);
-			}
-			contents_mask ^= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
-		}
+		if (i == 1) {
+			//the middle wasn't clearly visible, set up the bottom and top
+			BotVisibilityRequest(&requests[1], eye, middles[1], viewer, ent, inwater);
+			BotVisibilityRequest(&requests[2], eye, middles[2], viewer, ent, inwater);
+		}
+		req = &requests[i];
+		VectorCopy(middles[i], middle);
+		VectorCopy(req->start, start);
+		VectorCopy(req->end, end);
+		passent = req->passEntityNum;
+		hitent = (passent == viewer) ? ent : viewer;
+		contents_mask = req->contentmask;
 		//trace from start to end
-		BotAI_Trace(&trace, start, NULL, NULL, end, passent, contents_mask);
+		if (i == 0) {
+			BotAI_Trace(&traces[0], start, NULL, NULL, end, passent, contents_mask);
+		}
+		else if (i == 1) {
+			//the bottom and top go through the world together
+			BotAI_TraceBatch(&traces[1], batchtraces, &requests[1], 2);
+		}
+		trace = traces[i];
 		//if water was hit
 		waterfactor = 1.0;
 		//note: trace.contents is always 0, see BotAI_Trace
@@ -2920,9 +2967,6 @@ float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int
 			//if pretty much no fog
 			if (bestvis >= 0.95) return bestvis;
 		}
-		//check bottom and top of bounding box as well
-		if (i == 0) middle[2] += entinfo.mins[2];
-		else if (i == 1) middle[2] += entinfo.maxs[2] - entinfo.mins[2];
 	}
 	return bestvis;
 }
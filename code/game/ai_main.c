@@ -127,6 +127,28 @@ void QDECL BotAI_Print(int type, char *fmt, ...) {
 }
 
 
+/*
+==================
+BotAI_CopyTrace
+==================
+*/
+static void BotAI_CopyTrace(bsp_trace_t *bsptrace, const trace_t *trace) {
+	bsptrace->allsolid = trace->allsolid;
+	bsptrace->startsolid = trace->startsolid;
+	bsptrace->fraction = trace->fraction;
+	VectorCopy(trace->endpos, bsptrace->endpos);
+	bsptrace->plane.dist = trace->plane.dist;
+	VectorCopy(trace->plane.normal, bsptrace->plane.normal);
+	bsptrace->plane.signbits = trace->plane.signbits;
+	bsptrace->plane.type = trace->plane.type;
+	bsptrace->surface.value = 0;
+	bsptrace->surface.flags = trace->surfaceFlags;
+	bsptrace->ent = trace->entityNum;
+	bsptrace->exp_dist = 0;
+	bsptrace->sidenum = 0;
+	bsptrace->contents = 0;
+}
+
 /*
 ==================
 BotAI_Trace
@@ -137,20 +159,24 @@ void BotAI_Trace(bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, vec3_t maxs,
 
 	trap_Trace(&trace, start, mins, maxs, end, passent, contentmask);
 	//copy the trace information
-	bsptrace->allsolid = trace.allsolid;
-	bsptrace->startsolid = trace.startsolid;
-	bsptrace->fraction = trace.fraction;
-	VectorCopy(trace.endpos, bsptrace->endpos);
-	bsptrace->plane.dist = trace.plane.dist;
-	VectorCopy(trace.plane.normal, bsptrace->plane.normal);
-	bsptrace->plane.signbits = trace.plane.signbits;
-	bsptrace->plane.type = trace.plane.type;
-	bsptrace->surface.value = 0;
-	bsptrace->surface.flags = trace.surfaceFlags;
-	bsptrace->ent = trace.entityNum;
-	bsptrace->exp_dist = 0;
-	bsptrace->sidenum = 0;
-	bsptrace->contents = 0;
+	BotAI_CopyTrace(bsptrace, &trace);
+}
+
+/*
+==================
+BotAI_TraceBatch
+
+traces the requests with one trap_TraceBatch, traces holds numTraces results
+==================
+*/
+void BotAI_TraceBatch(bsp_trace_t *bsptraces, trace_t *traces, const traceRequest_t *requests, int numTraces) {
+	int i;
+
+	trap_TraceBatch(requests, traces, numTraces);
+	//copy the trace information
+	for (i = 0; i < numTraces; i++) {
+		BotAI_CopyTrace(&bsptraces[i], &traces[i]);
+	}
 }
 
 /*
@@ -53,8 +53,8 @@ typedef struct {
 	int			previous_waterlevel;
 } pml_t;
 
-extern	pmove_t		*pm;
-extern	pml_t		pml;
+extern	Q_THREADLOCAL pmove_t	*pm;
+extern	Q_THREADLOCAL pml_t		pml;
 
 // movement parameters
 extern	float	pm_stopspeed;
@@ -70,7 +70,7 @@ extern	float	pm_friction;
 extern	float	pm_waterfriction;
 extern	float	pm_flightfriction;
 
-extern	int		c_pmove;
+extern	Q_THREADLOCAL int	c_pmove;
 
 void PM_ClipVelocity( vec3_t in, vec3_t normal, vec3_t out, float overbounce );
 void PM_AddTouchEnt( int entityNum );
@@ -27,8 +27,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "bg_public.h"
 #include "bg_local.h"
 
-pmove_t		*pm;
-pml_t		pml;
+// per thread, the game may move several clients at once
+Q_THREADLOCAL pmove_t	*pm;
+Q_THREADLOCAL pml_t		pml;
 
 // movement parameters
 float	pm_stopspeed = 100.0f;
@@ -45,7 +46,7 @@ float	pm_waterfriction = 1.0f;
 float	pm_flightfriction = 3.0f;
 float	pm_spectatorfriction = 5.0f;
 
-int		c_pmove = 0;
+Q_THREADLOCAL int	c_pmove = 0;
 
 
 /*
@@ -740,6 +740,21 @@ void SendPendingPredictableEvents( playerState_t *ps ) {
 	}
 }
 
+// a client think is split around its Pmove so the moves of several
+// clients can run at once, this keeps what the parts share
+typedef struct {
+	pmove_t		pm;
+	int			oldEventSequence;
+	int			msec;
+
+	// the client before a move that runs ahead of the clients before it,
+	// for ClientMoveCancel
+	gentity_t	savedEnt;
+	gclient_t	savedClient;
+} clientMove_t;
+
+static clientMove_t	g_clientMoves[MAX_CLIENTS];
+
 /*
 ==============
 ClientThink
@@ -752,17 +767,126 @@ once for each server frame, which makes for smooth demo recording.
 ==============
 */
 void ClientThink_real( gentity_t *ent ) {
+	if ( ClientMoveBegin( ent, qfalse ) ) {
+		ClientMove( ent );
+		ClientMoveEnd( ent );
+	}
+}
+
+/*
+==============
+ClientMoveLocal
+
+Returns qfalse if the part of the think that is still to come can change
+more than the client and what is within its move: before the move, a
+possible inactivity drop, a gauntlet hit or letting go of the hook; after
+it, a fired weapon, a used item, a fall that hurts, a trigger other than
+a jump pad or a plain item, a touched entity with a touch function, or a
+respawn.  The engine doesn't let other clients move ahead of such a think.
+==============
+*/
+qboolean ClientMoveLocal( gentity_t *ent, qboolean moved ) {
 	gclient_t	*client;
-	pmove_t		pm;
-	int			oldEventSequence;
+	clientMove_t	*move;
+	usercmd_t	*ucmd;
+	gentity_t	*hit;
+	int			touch[MAX_GENTITIES];
+	vec3_t		mins, maxs;
+	static vec3_t	range = { 40, 40, 52 };
+	int			i, num, event;
+
+	client = ent->client;
+	move = &g_clientMoves[ent - g_entities];
+	ucmd = &client->pers.cmd;
+
+	if ( !moved ) {
+		if ( g_inactivity.integer && !client->pers.localClient && !ucmd->forwardmove
+			&& !ucmd->rightmove && !ucmd->upmove && !( ucmd->buttons & BUTTON_ATTACK ) ) {
+			return qfalse;
+		}
+		if ( client->ps.weapon == WP_GAUNTLET && ( ucmd->buttons & BUTTON_ATTACK ) ) {
+			return qfalse;
+		}
+		if ( client->ps.weapon == WP_GRAPPLING_HOOK && client->hook ) {
+			return qfalse;
+		}
+#ifdef MISSIONPACK
+		if ( client->ps.powerups[PW_INVULNERABILITY] || level.intermissionQueued ) {
+			return qfalse;
+		}
+#endif
+		return qtrue;
+	}
+
+	// dead clients may respawn at a spawn point anywhere
+	if ( client->ps.stats[STAT_HEALTH] <= 0 ) {
+		return qfalse;
+	}
+
+	// the events ClientEvents acts on
+	i = move->oldEventSequence;
+	if ( i < client->ps.eventSequence - MAX_PS_EVENTS ) {
+		i = client->ps.eventSequence - MAX_PS_EVENTS;
+	}
+	for ( ; i < client->ps.eventSequence ; i++ ) {
+		event = client->ps.events[ i & (MAX_PS_EVENTS-1) ];
+		if ( event == EV_FALL_MEDIUM || event == EV_FALL_FAR || event == EV_FIRE_WEAPON
+			|| ( event >= EV_USE_ITEM0 && event <= EV_USE_ITEM15 ) ) {
+			return qfalse;
+		}
+	}
+
+	// what ClientImpacts touches
+	for ( i = 0 ; i < move->pm.numtouch ; i++ ) {
+		if ( g_entities[ move->pm.touchents[i] ].touch ) {
+			return qfalse;
+		}
+	}
+
+	// what G_TouchTriggers can touch
+	VectorSubtract( client->ps.origin, range, mins );
+	VectorAdd( client->ps.origin, range, maxs );
+	num = trap_EntitiesInBox( mins, maxs, touch, MAX_GENTITIES );
+	for ( i = 0 ; i < num ; i++ ) {
+		hit = &g_entities[touch[i]];
+		if ( !hit->touch || !( hit->r.contents & CONTENTS_TRIGGER ) ) {
+			continue;
+		}
+		if ( hit->s.eType == ET_PUSH_TRIGGER ) {
+			continue;
+		}
+		if ( hit->s.eType == ET_ITEM && !hit->target && ( hit->item->giType == IT_WEAPON
+			|| hit->item->giType == IT_AMMO || hit->item->giType == IT_ARMOR
+			|| hit->item->giType == IT_HEALTH || hit->item->giType == IT_HOLDABLE ) ) {
+			continue;
+		}
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+==============
+ClientMoveBegin_real
+
+Everything up to the Pmove, returns qfalse if the client doesn't move
+==============
+*/
+static qboolean ClientMoveBegin_real( gentity_t *ent ) {
+	gclient_t	*client;
+	clientMove_t	*move;
+	pmove_t		*pm;
 	int			msec;
 	usercmd_t	*ucmd;
 
 	client = ent->client;
+	move = &g_clientMoves[ent - g_entities];
+	pm = &move->pm;
 
 	// don't think if the client is not yet connected (and thus not yet spawned in)
 	if (client->pers.connected != CON_CONNECTED) {
-		return;
+		return qfalse;
 	}
 	// mark the time, so the connection sprite can be removed
 	ucmd = &ent->client->pers.cmd;
@@ -781,7 +905,7 @@ void ClientThink_real( gentity_t *ent ) {
 	// following others may result in bad times, but we still want
 	// to check for follow toggles
 	if ( msec < 1 && client->sess.spectatorState != SPECTATOR_FOLLOW ) {
-		return;
+		return qfalse;
 	}
 	if ( msec > 200 ) {
 		msec = 200;
@@ -807,21 +931,21 @@ void ClientThink_real( gentity_t *ent ) {
 	//
 	if ( level.intermissiontime ) {
 		ClientIntermissionThink( client );
-		return;
+		return qfalse;
 	}
 
 	// spectators don't do much
 	if ( client->sess.sessionTeam == TEAM_SPECTATOR ) {
 		if ( client->sess.spectatorState == SPECTATOR_SCOREBOARD ) {
-			return;
+			return qfalse;
 		}
 		SpectatorThink( ent, ucmd );
-		return;
+		return qfalse;
 	}
 
 	// check for inactivity timer, but never drop the local client of a non-dedicated server
 	if ( !ClientInactivityTimer( client ) ) {
-		return;
+		return qfalse;
 	}
 
 	// clear the rewards if time
@@ -859,15 +983,16 @@ void ClientThink_real( gentity_t *ent ) {
 	}
 
 	// set up for pmove
-	oldEventSequence = client->ps.eventSequence;
+	move->oldEventSequence = client->ps.eventSequence;
+	move->msec = msec;
 
-	memset (&pm, 0, sizeof(pm));
+	memset (pm, 0, sizeof(*pm));
 
 	// check for the hit-scan gauntlet, don't let the action
 	// go through as an attack unless it actually hits something
 	if ( client->ps.weapon == WP_GAUNTLET && !( ucmd->buttons & BUTTON_TALK ) &&
 		( ucmd->buttons & BUTTON_ATTACK ) && client->ps.weaponTime <= 0 ) {
-		pm.gauntletHit = CheckGauntletAttack( ent );
+		pm->gauntletHit = CheckGauntletAttack( ent );
 	}
 
 	if ( ent->flags & FL_FORCE_GESTURE ) {
@@ -902,47 +1027,128 @@ void ClientThink_real( gentity_t *ent ) {
 	}
 #endif
 
-	pm.ps = &client->ps;
-	pm.cmd = *ucmd;
-	if ( pm.ps->pm_type == PM_DEAD ) {
-		pm.tracemask = MASK_PLAYERSOLID & ~CONTENTS_BODY;
+	pm->ps = &client->ps;
+	pm->cmd = *ucmd;
+	if ( pm->ps->pm_type == PM_DEAD ) {
+		pm->tracemask = MASK_PLAYERSOLID & ~CONTENTS_BODY;
 	}
 	else if ( ent->r.svFlags & SVF_BOT ) {
-		pm.tracemask = MASK_PLAYERSOLID | CONTENTS_BOTCLIP;
+		pm->tracemask = MASK_PLAYERSOLID | CONTENTS_BOTCLIP;
 	}
 	else {
-		pm.tracemask = MASK_PLAYERSOLID;
+		pm->tracemask = MASK_PLAYERSOLID;
 	}
-	pm.trace = trap_Trace;
-	pm.pointcontents = trap_PointContents;
-	pm.debugLevel = g_debugMove.integer;
-	pm.noFootsteps = ( g_dmflags.integer & DF_NO_FOOTSTEPS ) > 0;
+	pm->trace = trap_Trace;
+	pm->pointcontents = trap_PointContents;
+	pm->debugLevel = g_debugMove.integer;
+	pm->noFootsteps = ( g_dmflags.integer & DF_NO_FOOTSTEPS ) > 0;
 
-	pm.pmove_fixed = pmove_fixed.integer | client->pers.pmoveFixed;
-	pm.pmove_msec = pmove_msec.integer;
+	pm->pmove_fixed = pmove_fixed.integer | client->pers.pmoveFixed;
+	pm->pmove_msec = pmove_msec.integer;
 
 	VectorCopy( client->ps.origin, client->oldOrigin );
 
 #ifdef MISSIONPACK
 		if (level.intermissionQueued != 0 && g_singlePlayer.integer) {
 			if ( level.time - level.intermissionQueued >= 1000  ) {
-				pm.cmd.buttons = 0;
-				pm.cmd.forwardmove = 0;
-				pm.cmd.rightmove = 0;
-				pm.cmd.upmove = 0;
+				pm->cmd.buttons = 0;
+				pm->cmd.forwardmove = 0;
+				pm->cmd.rightmove = 0;
+				pm->cmd.upmove = 0;
 				if ( level.time - level.intermissionQueued >= 2000 && level.time - level.intermissionQueued <= 2500 ) {
 					trap_SendConsoleCommand( EXEC_APPEND, "centerview\n");
 				}
 				ent->client->ps.pm_type = PM_SPINTERMISSION;
 			}
 		}
-		Pmove (&pm);
-#else
-		Pmove (&pm);
 #endif
 
+	return qtrue;
+}
+
+/*
+==============
+ClientMoveBegin
+
+Returns qfalse if the client doesn't move.  A move that runs ahead of
+the clients before it has to be undone by ClientMoveCancel if one of
+them can reach it, so it is only begun for a think ClientMoveLocal
+allows, and leaves no trace when it returns qfalse.
+==============
+*/
+qboolean ClientMoveBegin( gentity_t *ent, qboolean ahead ) {
+	gclient_t	*client;
+	clientMove_t	*move;
+
+	if ( !ahead ) {
+		return ClientMoveBegin_real( ent );
+	}
+
+	client = ent->client;
+	move = &g_clientMoves[ent - g_entities];
+
+	if ( client->pers.connected != CON_CONNECTED || level.intermissiontime
+		|| client->sess.sessionTeam == TEAM_SPECTATOR || !ClientMoveLocal( ent, qfalse ) ) {
+		return qfalse;
+	}
+
+	move->savedEnt = *ent;
+	move->savedClient = *client;
+
+	if ( !ClientMoveBegin_real( ent ) ) {
+		ClientMoveCancel( ent );
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+==============
+ClientMoveCancel
+
+Puts the client back to before a ClientMoveBegin that ran ahead
+==============
+*/
+void ClientMoveCancel( gentity_t *ent ) {
+	clientMove_t	*move;
+
+	move = &g_clientMoves[ent - g_entities];
+	*ent->client = move->savedClient;
+	*ent = move->savedEnt;
+}
+
+/*
+==============
+ClientMove
+
+Only the Pmove, which may run on another thread while other clients
+move, see G_RUN_CLIENT_MOVES
+==============
+*/
+void ClientMove( gentity_t *ent ) {
+	Pmove( &g_clientMoves[ent - g_entities].pm );
+}
+
+/*
+==============
+ClientMoveEnd
+
+Everything that follows the Pmove
+==============
+*/
+void ClientMoveEnd( gentity_t *ent ) {
+	gclient_t	*client;
+	clientMove_t	*move;
+	pmove_t		*pm;
+	usercmd_t	*ucmd;
+
+	client = ent->client;
+	move = &g_clientMoves[ent - g_entities];
+	pm = &move->pm;
+	ucmd = &client->pers.cmd;
+
 	// save results of pmove
-	if ( ent->client->ps.eventSequence != oldEventSequence ) {
+	if ( ent->client->ps.eventSequence != move->oldEventSequence ) {
 		ent->eventTime = level.time;
 	}
 	if (g_smoothClients.integer) {
@@ -960,14 +1166,14 @@ void ClientThink_real( gentity_t *ent ) {
 	// use the snapped origin for linking so it matches client predicted versions
 	VectorCopy( ent->s.pos.trBase, ent->r.currentOrigin );
 
-	VectorCopy (pm.mins, ent->r.mins);
-	VectorCopy (pm.maxs, ent->r.maxs);
+	VectorCopy (pm->mins, ent->r.mins);
+	VectorCopy (pm->maxs, ent->r.maxs);
 
-	ent->waterlevel = pm.waterlevel;
-	ent->watertype = pm.watertype;
+	ent->waterlevel = pm->waterlevel;
+	ent->watertype = pm->watertype;
 
 	// execute client events
-	ClientEvents( ent, oldEventSequence );
+	ClientEvents( ent, move->oldEventSequence );
 
 	// link entity now, after any personal teleporters have been used
 	trap_LinkEntity (ent);
@@ -982,10 +1188,10 @@ void ClientThink_real( gentity_t *ent ) {
 	BotTestAAS(ent->r.currentOrigin);
 
 	// touch other objects
-	ClientImpacts( ent, &pm );
+	ClientImpacts( ent, pm );
 
 	// save results of triggers and client events
-	if (ent->client->ps.eventSequence != oldEventSequence) {
+	if (ent->client->ps.eventSequence != move->oldEventSequence) {
 		ent->eventTime = level.time;
 	}
 
@@ -1014,7 +1220,7 @@ void ClientThink_real( gentity_t *ent ) {
 	}
 
 	// perform once-a-second actions
-	ClientTimerActions( ent, msec );
+	ClientTimerActions( ent, move->msec );
 }
 
 /*
@@ -1045,9 +1251,39 @@ void G_RunClient( gentity_t *ent ) {
 		return;
 	}
 	ent->client->pers.cmd.serverTime = level.time;
+
+	if ( level.numMoveClients >= 0 ) {
+		level.moveClients[level.numMoveClients++] = ent - g_entities;
+		return;
+	}
+
 	ClientThink_real( ent );
 }
 
+/*
+==================
+G_RunClientMoves
+
+Thinks the clients queued by G_RunClient, the engine runs the moves of
+clients that can't touch each other on several threads
+==================
+*/
+void G_RunClientMoves( void ) {
+	int		i;
+
+	if ( level.numMoveClients <= 0 ) {
+		return;
+	}
+
+	if ( !trap_RunClientMoves( level.moveClients, level.numMoveClients ) ) {
+		for ( i = 0 ; i < level.numMoveClients ; i++ ) {
+			ClientThink_real( g_entities + level.moveClients[i] );
+		}
+	}
+
+	level.numMoveClients = 0;
+}
+
 
 /*
 ==================
@@ -344,6 +344,11 @@ typedef struct {
 	int			time;					// in msec
 	int			previousTime;			// so movers can back up when blocked
 
+	// clients queued by G_RunClient for G_RunClientMoves,
+	// -1 when they think one at a time
+	int			numMoveClients;
+	int			moveClients[MAX_CLIENTS];
+
 	int			startTime;				// level.time the map was started
 
 	int			teamScores[TEAM_NUM_TEAMS];
@@ -622,8 +627,14 @@ void ClientCommand( int clientNum );
 // g_active.c
 //
 void ClientThink( int clientNum );
+qboolean ClientMoveLocal( gentity_t *ent, qboolean moved );
+qboolean ClientMoveBegin( gentity_t *ent, qboolean ahead );
+void ClientMoveCancel( gentity_t *ent );
+void ClientMove( gentity_t *ent );
+void ClientMoveEnd( gentity_t *ent );
 void ClientEndFrame( gentity_t *ent );
 void G_RunClient( gentity_t *ent );
+void G_RunClientMoves( void );
 
 //
 // g_team.c
@@ -737,6 +748,7 @@ extern	vmCvar_t	g_cubeTimeout;
 extern	vmCvar_t	g_redteam;
 extern	vmCvar_t	g_blueteam;
 extern	vmCvar_t	g_smoothClients;
+extern	vmCvar_t	g_moveThreads;
 extern	vmCvar_t	pmove_fixed;
 extern	vmCvar_t	pmove_msec;
 extern	vmCvar_t	g_rankings;
@@ -776,6 +788,8 @@ void	trap_SetUserinfo( int num, const char *buffer );
 void	trap_GetServerinfo( char *buffer, int bufferSize );
 void	trap_SetBrushModel( gentity_t *ent, const char *name );
 void	trap_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask );
+void	trap_TraceBatch( const traceRequest_t *requests, trace_t *results, int numTraces );
+qboolean trap_RunClientMoves( const int *clientNums, int numClients );
 int		trap_PointContents( const vec3_t point, int passEntityNum );
 qboolean trap_InPVS( const vec3_t p1, const vec3_t p2 );
 qboolean trap_InPVSIgnorePortals( const vec3_t p1, const vec3_t p2 );
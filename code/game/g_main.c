@@ -77,6 +77,7 @@ vmCvar_t	g_teamForceBalance;
 vmCvar_t	g_banIPs;
 vmCvar_t	g_filterBan;
 vmCvar_t	g_smoothClients;
+vmCvar_t	g_moveThreads;
 vmCvar_t	pmove_fixed;
 vmCvar_t	pmove_msec;
 vmCvar_t	g_rankings;
@@ -174,6 +175,7 @@ static cvarTable_t		gameCvarTable[] = {
 	{ &g_proxMineTimeout, "g_proxMineTimeout", "20000", 0, 0, qfalse },
 #endif
 	{ &g_smoothClients, "g_smoothClients", "1", 0, 0, qfalse},
+	{ &g_moveThreads, "sv_moveThreads", "0", 0, 0, qfalse},
 	{ &pmove_fixed, "pmove_fixed", "0", CVAR_SYSTEMINFO, 0, qfalse},
 	{ &pmove_msec, "pmove_msec", "8", CVAR_SYSTEMINFO, 0, qfalse},
 
@@ -231,6 +233,19 @@ Q_EXPORT intptr_t vmMain( int command, int arg0, int arg1, int arg2, int arg3, i
 		return ConsoleCommand();
 	case BOTAI_START_FRAME:
 		return BotAIStartFrame( arg0 );
+	case GAME_CLIENT_MOVE_BEGIN:
+		return ClientMoveBegin( g_entities + arg0, arg1 );
+	case GAME_CLIENT_MOVE:
+		ClientMove( g_entities + arg0 );
+		return 0;
+	case GAME_CLIENT_MOVE_END:
+		ClientMoveEnd( g_entities + arg0 );
+		return 0;
+	case GAME_CLIENT_MOVE_LOCAL:
+		return ClientMoveLocal( g_entities + arg0, arg1 );
+	case GAME_CLIENT_MOVE_CANCEL:
+		ClientMoveCancel( g_entities + arg0 );
+		return 0;
 	}
 
 	return -1;
@@ -1798,11 +1813,24 @@ void G_RunFrame( int levelTime ) {
 	// get any cvar changes
 	G_UpdateCvars();
 
+	// queue the clients that think here so the engine can move
+	// them together, the moves print when debugging them
+	if ( g_moveThreads.integer > 1 && !g_debugMove.integer ) {
+		level.numMoveClients = 0;
+	} else {
+		level.numMoveClients = -1;
+	}
+
 	//
 	// go through all allocated objects
 	//
 	ent = &g_entities[0];
 	for (i=0 ; i<level.num_entities ; i++, ent++) {
+		if ( i == MAX_CLIENTS ) {
+			// the clients go before everything else
+			G_RunClientMoves();
+		}
+
 		if ( !ent->inuse ) {
 			continue;
 		}
@@ -1860,6 +1888,8 @@ void G_RunFrame( int levelTime ) {
 
 		G_RunThink( ent );
 	}
+	G_RunClientMoves();		// if nothing followed the clients
+	level.numMoveClients = -1;
 
 	// perform final fixups on the players
 	ent = &g_entities[0];
@@ -98,6 +98,21 @@ typedef struct {
 } sharedEntity_t;
 
 
+// one trace of a G_TRACE_BATCH, the vectors are stored in place because
+// the request lives in the game module's memory
+#define	MAX_TRACE_BATCH		256
+
+typedef struct {
+	vec3_t		start;
+	vec3_t		mins;
+	vec3_t		maxs;
+	vec3_t		end;
+	int			passEntityNum;
+	int			contentmask;
+	qboolean	capsule;
+} traceRequest_t;
+
+
 
 //===============================================================
 
@@ -230,6 +245,16 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACE_BATCH,	// ( const traceRequest_t *requests, trace_t *results, int numTraces );
+	// the same as a G_TRACE for each request, with the linked entities
+	// gathered once for the whole batch
+
+	G_RUN_CLIENT_MOVES,	// qboolean ( const int *clientNums, int numClients );
+	// runs GAME_CLIENT_MOVE_BEGIN / GAME_CLIENT_MOVE / GAME_CLIENT_MOVE_END
+	// for the clients, with the moves of clients that can't touch each other
+	// on several threads.  Returns qfalse without doing anything if the
+	// engine won't run them, the game has to think the clients itself then
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
@@ -425,6 +450,26 @@ typedef enum {
 	// The game can issue trap_argc() / trap_argv() commands to get the command
 	// and parameters.  Return qfalse if the game doesn't recognize it as a command.
 
-	BOTAI_START_FRAME				// ( int time );
+	BOTAI_START_FRAME,				// ( int time );
+
+	// the parts of a client think for G_RUN_CLIENT_MOVES
+	GAME_CLIENT_MOVE_BEGIN,			// qboolean ( int clientNum, qboolean ahead );
+	// everything before the Pmove, returns qfalse if there is nothing to move.
+	// An ahead move runs before the thinks of the clients before it, it may
+	// be refused and is then left untouched, or undone by GAME_CLIENT_MOVE_CANCEL
+
+	GAME_CLIENT_MOVE,				// ( int clientNum );
+	// only the Pmove, may run on any thread at the same time as other clients'
+	// moves, so it may only trace, test point contents and snap vectors
+
+	GAME_CLIENT_MOVE_END,			// ( int clientNum );
+	// linking, triggers, touches and events after the Pmove
+
+	GAME_CLIENT_MOVE_LOCAL,			// qboolean ( int clientNum, qboolean moved );
+	// qfalse if the rest of the think, from the begin or from the end, can
+	// change more than the client and what is within its move
+
+	GAME_CLIENT_MOVE_CANCEL			// ( int clientNum );
+	// undoes an ahead GAME_CLIENT_MOVE_BEGIN and its GAME_CLIENT_MOVE
 } gameExport_t;
 
@@ -153,6 +153,14 @@ void trap_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const
 	syscall( G_TRACE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
+void trap_TraceBatch( const traceRequest_t *requests, trace_t *results, int numTraces ) {
+	syscall( G_TRACE_BATCH, requests, results, numTraces );
+}
+
+qboolean trap_RunClientMoves( const int *clientNums, int numClients ) {
+	return syscall( G_RUN_CLIENT_MOVES, clientNums, numClients );
+}
+
 void trap_TraceCapsule( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask ) {
 	syscall( G_TRACECAPSULE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
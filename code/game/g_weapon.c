@@ -267,8 +267,15 @@ SHOTGUN
 // client predicts same spreads
 #define	DEFAULT_SHOTGUN_DAMAGE	10
 
-qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
-	trace_t		tr;
+/*
+================
+ShotgunPellet
+
+tr is the trace of the pellet from start to end, returns qtrue if it hit
+an enemy client
+================
+*/
+qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent, trace_t *tr ) {
 	int			damage, i, passent;
 	gentity_t	*traceEnt;
 #ifdef MISSIONPACK
@@ -281,11 +288,13 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 	VectorCopy( start, tr_start );
 	VectorCopy( end, tr_end );
 	for (i = 0; i < 10; i++) {
-		trap_Trace (&tr, tr_start, NULL, NULL, tr_end, passent, MASK_SHOT);
-		traceEnt = &g_entities[ tr.entityNum ];
+		if ( i ) {
+			trap_Trace (tr, tr_start, NULL, NULL, tr_end, passent, MASK_SHOT);
+		}
+		traceEnt = &g_entities[ tr->entityNum ];
 
 		// send bullet impact
-		if (  tr.surfaceFlags & SURF_NOIMPACT ) {
+		if (  tr->surfaceFlags & SURF_NOIMPACT ) {
 			return qfalse;
 		}
 
@@ -293,14 +302,14 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 			damage = DEFAULT_SHOTGUN_DAMAGE * s_quadFactor;
 #ifdef MISSIONPACK
 			if ( traceEnt->client && traceEnt->client->invulnerabilityTime > level.time ) {
-				if (G_InvulnerabilityEffect( traceEnt, forward, tr.endpos, impactpoint, bouncedir )) {
+				if (G_InvulnerabilityEffect( traceEnt, forward, tr->endpos, impactpoint, bouncedir )) {
 					G_BounceProjectile( tr_start, impactpoint, bouncedir, tr_end );
 					VectorCopy( impactpoint, tr_start );
 					// the player can hit him/herself with the bounced rail
 					passent = ENTITYNUM_NONE;
 				}
 				else {
-					VectorCopy( tr.endpos, tr_start );
+					VectorCopy( tr->endpos, tr_start );
 					passent = traceEnt->s.number;
 				}
 				continue;
@@ -309,7 +318,7 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 			if( LogAccuracyHit( traceEnt, ent ) ) {
 				hitClient = qtrue;
 			}
-			G_Damage( traceEnt, ent, ent, forward, tr.endpos, damage, 0, MOD_SHOTGUN);
+			G_Damage( traceEnt, ent, ent, forward, tr->endpos, damage, 0, MOD_SHOTGUN);
 			return hitClient;
 		}
 		return qfalse;
@@ -317,13 +326,27 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 	return qfalse;
 }
 
-// this should match CG_ShotgunPattern
+/*
+================
+ShotgunPattern
+
+This should match CG_ShotgunPattern.  The pellets are traced together
+with one trap_TraceBatch, a pellet is only traced again if an earlier one
+killed or moved what it hit, so the result is the same as tracing them
+one after another.
+================
+*/
 void ShotgunPattern( vec3_t origin, vec3_t origin2, int seed, gentity_t *ent ) {
 	int			i;
 	float		r, u;
-	vec3_t		end;
 	vec3_t		forward, right, up;
 	qboolean	hitClient = qfalse;
+	qboolean	stale = qfalse;
+	traceRequest_t	requests[DEFAULT_SHOTGUN_COUNT];
+	trace_t		traces[DEFAULT_SHOTGUN_COUNT];
+	traceRequest_t	*req;
+	gentity_t	*traceEnt;
+	int			entityNum, linkcount, contents;
 
 	// derive the right and up vectors from the forward vector, because
 	// the client won't have any other information
@@ -333,15 +356,48 @@ void ShotgunPattern( vec3_t origin, vec3_t origin2, int seed, gentity_t *ent ) {
 
 	// generate the "random" spread pattern
 	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
+		req = &requests[i];
 		r = Q_crandom( &seed ) * DEFAULT_SHOTGUN_SPREAD * 16;
 		u = Q_crandom( &seed ) * DEFAULT_SHOTGUN_SPREAD * 16;
-		VectorMA( origin, 8192 * 16, forward, end);
-		VectorMA (end, r, right, end);
-		VectorMA (end, u, up, end);
-		if( ShotgunPellet( origin, end, ent ) && !hitClient ) {
+		VectorCopy( origin, req->start );
+		VectorMA( origin, 8192 * 16, forward, req->end);
+		VectorMA (req->end, r, right, req->end);
+		VectorMA (req->end, u, up, req->end);
+		VectorClear( req->mins );
+		VectorClear( req->maxs );
+		req->passEntityNum = ent->s.number;
+		req->contentmask = MASK_SHOT;
+		req->capsule = qfalse;
+	}
+
+	trap_TraceBatch( requests, traces, DEFAULT_SHOTGUN_COUNT );
+
+	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
+		req = &requests[i];
+		if ( stale ) {
+			trap_Trace( &traces[i], req->start, NULL, NULL, req->end, req->passEntityNum, MASK_SHOT );
+		}
+
+		// damage can relink or free the entity, the pellets after that
+		// could see the world differently than the batch did
+		entityNum = traces[i].entityNum;
+		traceEnt = &g_entities[ entityNum ];
+		linkcount = traceEnt->r.linkcount;
+		contents = traceEnt->r.contents;
+
+		if( ShotgunPellet( req->start, req->end, ent, &traces[i] ) && !hitClient ) {
 			hitClient = qtrue;
 			ent->client->accuracy_hits++;
 		}
+
+		if ( entityNum < ENTITYNUM_MAX_NORMAL && ( !traceEnt->inuse
+			|| traceEnt->r.linkcount != linkcount || traceEnt->r.contents != contents ) ) {
+			stale = qtrue;
+		}
+		// a pellet that bounced may have damaged anything
+		if ( traces[i].entityNum != entityNum ) {
+			stale = qtrue;
+		}
 	}
 }
 
@@ -0,0 +1,1294 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// null_cmbench.c -- headless collision benchmark
+//
+// Links only the collision model and replaces the rest of the engine with
+// stubs.  Loads a bsp, from disk or from a pk3, and runs a seeded set of
+// point, box, capsule and transformed traces and point contents queries,
+// and bundles of rays from a shared origin traced one by one and through
+// CM_TraceBatch, or replays a .tlog captured with the server "tracelog" command.
+// Prints throughput, latency percentiles and a checksum of the results
+// for every workload, so the same seed on the same map must always print
+// the same checksums.  With -threads, the workloads then run again from
+// that many threads at once, each in its own collision model thread slot,
+// and every thread must reproduce the single thread checksums.
+// -patchplanes instead loads the map with the linear and the hashed plane
+// search of the patch collision and compares the planes and facets of
+// every patch.  -entities links that many moving boxes into the server's
+// world tree, sv_world.c is linked in as well, and times linking them,
+// SV_AreaEntities and SV_Trace against them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#endif
+
+#include "../qcommon/cm_local.h"
+#include "../qcommon/cm_patch.h"
+#include "../qcommon/unzip.h"
+#include "../server/server.h"
+
+static qboolean	bench_verbose;
+static char		*bench_pk3;
+
+/*
+==============================================================================
+
+ENGINE STUBS
+
+==============================================================================
+*/
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	if ( !bench_verbose ) {
+		return;
+	}
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+
+	exit( 1 );
+}
+
+// nothing is ever freed, -patchplanes relies on that to keep the first load
+void *Hunk_Alloc( int size, ha_pref preference ) {
+	void	*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Hunk_Alloc failed on %i", size );
+	}
+	return buf;
+}
+
+void *Hunk_AllocateTempMemory( int size ) {
+	return Hunk_Alloc( size, h_high );
+}
+
+void Hunk_FreeTempMemory( void *buf ) {
+	free( buf );
+}
+
+void *Z_Malloc( int size ) {
+	return Hunk_Alloc( size, h_high );
+}
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+/*
+==================
+Cvar_Get
+
+Cvars are plain values, -set changes them before the map is loaded
+==================
+*/
+#define	MAX_BENCH_CVARS		64
+
+static cvar_t	bench_cvars[MAX_BENCH_CVARS];
+static int		bench_numCvars;
+
+static cvar_t *Bench_FindCvar( const char *name, const char *value ) {
+	cvar_t	*var;
+	int		i;
+
+	for ( i = 0 ; i < bench_numCvars ; i++ ) {
+		if ( !Q_stricmp( bench_cvars[i].name, name ) ) {
+			return &bench_cvars[i];
+		}
+	}
+
+	if ( bench_numCvars == MAX_BENCH_CVARS ) {
+		Com_Error( ERR_FATAL, "MAX_BENCH_CVARS" );
+	}
+	var = &bench_cvars[bench_numCvars++];
+	var->name = strdup( name );
+	var->string = strdup( value );
+	var->value = atof( value );
+	var->integer = atoi( value );
+	return var;
+}
+
+cvar_t *Cvar_Get( const char *var_name, const char *value, int flags ) {
+	return Bench_FindCvar( var_name, value );
+}
+
+static void Bench_SetCvar( const char *name, const char *value ) {
+	cvar_t	*var;
+
+	var = Bench_FindCvar( name, value );
+	var->string = strdup( value );
+	var->value = atof( value );
+	var->integer = atoi( value );
+}
+
+/*
+==================
+FS_ReadFile
+
+Reads a plain file, or a file inside the -pk3 archive
+==================
+*/
+long FS_ReadFile( const char *qpath, void **buffer ) {
+	unzFile			zf;
+	unz_file_info	info;
+	FILE			*f;
+	byte			*buf;
+	long			len;
+
+	*buffer = NULL;
+
+	if ( bench_pk3 ) {
+		zf = unzOpen( bench_pk3 );
+		if ( !zf ) {
+			Com_Error( ERR_FATAL, "Couldn't open %s", bench_pk3 );
+		}
+		if ( unzLocateFile( zf, qpath, 2 ) != UNZ_OK
+			|| unzGetCurrentFileInfo( zf, &info, NULL, 0, NULL, 0, NULL, 0 ) != UNZ_OK
+			|| unzOpenCurrentFile( zf ) != UNZ_OK ) {
+			unzClose( zf );
+			return -1;
+		}
+		len = info.uncompressed_size;
+		buf = Hunk_AllocateTempMemory( len + 1 );
+		if ( unzReadCurrentFile( zf, buf, len ) != len ) {
+			Com_Error( ERR_FATAL, "Couldn't read %s from %s", qpath, bench_pk3 );
+		}
+		unzCloseCurrentFile( zf );
+		unzClose( zf );
+	} else {
+		f = fopen( qpath, "rb" );
+		if ( !f ) {
+			return -1;
+		}
+		fseek( f, 0, SEEK_END );
+		len = ftell( f );
+		fseek( f, 0, SEEK_SET );
+		buf = Hunk_AllocateTempMemory( len + 1 );
+		if ( fread( buf, 1, len, f ) != len ) {
+			Com_Error( ERR_FATAL, "Couldn't read %s", qpath );
+		}
+		fclose( f );
+	}
+
+	buf[len] = 0;
+	*buffer = buf;
+	return len;
+}
+
+void FS_FreeFile( void *buffer ) {
+	Hunk_FreeTempMemory( buffer );
+}
+
+// the patch collision cache is never used
+long FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
+	*fp = 0;
+	return -1;
+}
+
+fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+int FS_Read( void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+int FS_Write( const void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+void FS_FCloseFile( fileHandle_t f ) {
+}
+
+// the server trace log is never started
+fileHandle_t FS_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+int Cmd_Argc( void ) {
+	return 0;
+}
+
+char *Cmd_Argv( int arg ) {
+	return "";
+}
+
+// what sv_world.c needs of the server
+server_t			sv;
+Q_THREADLOCAL int	sv_threadSlot;
+cvar_t				*sv_traceCache;
+cvar_t				*sv_mapname;
+cvar_t				*sv_mapChecksum;
+cvar_t				*com_sv_running;
+
+sharedEntity_t *SV_GentityNum( int num ) {
+	return (sharedEntity_t *)( (byte *)sv.gentities + sv.gentitySize * num );
+}
+
+svEntity_t *SV_SvEntityForGentity( sharedEntity_t *gEnt ) {
+	if ( !gEnt || gEnt->s.number < 0 || gEnt->s.number >= MAX_GENTITIES ) {
+		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+	}
+	return &sv.svEntities[gEnt->s.number];
+}
+
+sharedEntity_t *SV_GEntityForSvEntity( svEntity_t *svEnt ) {
+	return SV_GentityNum( svEnt - sv.svEntities );
+}
+
+// CM_DrawDebugSurface is never called
+void BotDrawDebugPolygons( void (*drawPoly)(int color, int numPoints, float *points), int value ) {
+}
+
+/*
+==================
+Bench_Nanoseconds
+==================
+*/
+static long long Bench_Nanoseconds( void ) {
+#ifdef _WIN32
+	static LARGE_INTEGER	frequency;
+	LARGE_INTEGER			count;
+
+	if ( !frequency.QuadPart ) {
+		QueryPerformanceFrequency( &frequency );
+	}
+	QueryPerformanceCounter( &count );
+	return (long long)( (double)count.QuadPart * 1e9 / frequency.QuadPart );
+#else
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+int Sys_Milliseconds( void ) {
+	return (int)( Bench_Nanoseconds() / 1000000 );
+}
+
+/*
+==============================================================================
+
+WORKLOADS
+
+==============================================================================
+*/
+
+typedef enum {
+	QUERY_TRACE,
+	QUERY_TRANSFORMED,
+	QUERY_CONTENTS
+} queryType_t;
+
+typedef struct {
+	queryType_t	type;
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	clipHandle_t	model;
+	vec3_t		origin, angles;
+	int			contentmask;
+	int			capsule;
+} query_t;
+
+typedef struct {
+	const char	*name;
+	int			numQueries;
+	query_t		*queries;
+	int			batchSize;		// queries passed to CM_TraceBatch at once, 0 traces them one by one
+	unsigned int	checksum;	// of the single thread run
+} workload_t;
+
+#define	MAX_WORKLOADS		8
+#define	BUNDLE_SIZE			16	// rays per bundle, like a shotgun blast
+
+// MASK_PLAYERSOLID from the game code
+#define	BENCH_CONTENTMASK	( CONTENTS_SOLID | CONTENTS_PLAYERCLIP | CONTENTS_BODY )
+
+static workload_t	bench_workloads[MAX_WORKLOADS];
+static int			bench_numWorkloads;
+
+static unsigned int	bench_seed;
+
+static int Bench_Rand( void ) {
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return ( bench_seed >> 16 ) & 0x7fff;
+}
+
+static float Bench_Random( float low, float high ) {
+	return low + ( high - low ) * ( Bench_Rand() / 32767.0f );
+}
+
+/*
+==================
+Bench_RandomQuery
+
+A move of up to 256 units from a random point in the world bounds, one in
+five are position tests
+==================
+*/
+static void Bench_RandomQuery( query_t *q, int index, queryType_t type, qboolean box, qboolean capsule ) {
+	vec3_t	mins, maxs;
+	int		i;
+
+	Com_Memset( q, 0, sizeof( *q ) );
+	q->type = type;
+	q->contentmask = BENCH_CONTENTMASK;
+	q->capsule = capsule;
+
+	CM_ModelBounds( 0, mins, maxs );
+	for ( i = 0 ; i < 3 ; i++ ) {
+		q->start[i] = Bench_Random( mins[i], maxs[i] );
+		q->end[i] = ( index % 5 == 0 ) ? q->start[i] : q->start[i] + Bench_Random( -256, 256 );
+		if ( box ) {
+			q->mins[i] = -Bench_Random( 1, 24 );
+			q->maxs[i] = Bench_Random( 1, 32 );
+		}
+	}
+
+	if ( type == QUERY_TRANSFORMED ) {
+		// move a random inline model around, or spin the world
+		// if there are none
+		if ( CM_NumInlineModels() > 1 ) {
+			q->model = CM_InlineModel( 1 + Bench_Rand() % ( CM_NumInlineModels() - 1 ) );
+		}
+		for ( i = 0 ; i < 3 ; i++ ) {
+			q->origin[i] = Bench_Random( -64, 64 );
+		}
+		q->angles[YAW] = Bench_Random( 0, 360 );
+	}
+}
+
+/*
+==================
+Bench_RandomBundle
+
+BUNDLE_SIZE rays of 1024 units in a cone around a random direction from a
+random point, the spread of a shotgun blast, alternating between point and box bundles, every fourth one a capsule
+==================
+*/
+static void Bench_RandomBundle( query_t *q, int count ) {
+	vec3_t	mins, maxs, forward, dir;
+	int		i, j;
+
+	CM_ModelBounds( 0, mins, maxs );
+	for ( i = 0 ; i < count ; i++, q++ ) {
+		Com_Memset( q, 0, sizeof( *q ) );
+		q->type = QUERY_TRACE;
+		q->contentmask = BENCH_CONTENTMASK;
+
+		q->capsule = ( i / BUNDLE_SIZE ) % 4 == 3;
+
+		if ( i % BUNDLE_SIZE == 0 ) {
+			for ( j = 0 ; j < 3 ; j++ ) {
+				q->start[j] = Bench_Random( mins[j], maxs[j] );
+				if ( ( i / BUNDLE_SIZE ) & 1 ) {
+					q->mins[j] = -Bench_Random( 1, 8 );
+					q->maxs[j] = Bench_Random( 1, 8 );
+				}
+				forward[j] = Bench_Random( -1, 1 );
+			}
+			VectorNormalize( forward );
+		} else {
+			VectorCopy( q[-1].start, q->start );
+			VectorCopy( q[-1].mins, q->mins );
+			VectorCopy( q[-1].maxs, q->maxs );
+		}
+
+		for ( j = 0 ; j < 3 ; j++ ) {
+			dir[j] = forward[j] + Bench_Random( -0.1f, 0.1f );
+		}
+		VectorNormalize( dir );
+		VectorMA( q->start, 1024, dir, q->end );
+	}
+}
+
+/*
+==================
+Bench_AddWorkload
+==================
+*/
+static workload_t *Bench_AddWorkload( const char *name, int numQueries ) {
+	workload_t	*w;
+
+	if ( bench_numWorkloads == MAX_WORKLOADS ) {
+		Com_Error( ERR_FATAL, "MAX_WORKLOADS" );
+	}
+	w = &bench_workloads[bench_numWorkloads++];
+	w->name = name;
+	w->numQueries = numQueries;
+	w->queries = Hunk_Alloc( numQueries * sizeof( *w->queries ), h_high );
+	w->batchSize = 0;
+	return w;
+}
+
+/*
+==================
+Bench_BuildRandomWorkloads
+==================
+*/
+static void Bench_BuildRandomWorkloads( int count ) {
+	workload_t	*w;
+	int			i;
+
+	w = Bench_AddWorkload( "point", count );
+	for ( i = 0 ; i < count ; i++ ) {
+		Bench_RandomQuery( &w->queries[i], i, QUERY_TRACE, qfalse, qfalse );
+	}
+
+	w = Bench_AddWorkload( "box", count );
+	for ( i = 0 ; i < count ; i++ ) {
+		Bench_RandomQuery( &w->queries[i], i, QUERY_TRACE, qtrue, qfalse );
+	}
+
+	w = Bench_AddWorkload( "capsule", count );
+	for ( i = 0 ; i < count ; i++ ) {
+		Bench_RandomQuery( &w->queries[i], i, QUERY_TRACE, qtrue, qtrue );
+	}
+
+	w = Bench_AddWorkload( "transformed", count );
+	for ( i = 0 ; i < count ; i++ ) {
+		Bench_RandomQuery( &w->queries[i], i, QUERY_TRANSFORMED, qtrue, qfalse );
+	}
+
+	w = Bench_AddWorkload( "contents", count );
+	for ( i = 0 ; i < count ; i++ ) {
+		Bench_RandomQuery( &w->queries[i], i, QUERY_CONTENTS, qfalse, qfalse );
+	}
+
+	// the same bundles twice, the checksums must match
+	w = Bench_AddWorkload( "bundle", count );
+	Bench_RandomBundle( w->queries, count );
+
+	bench_workloads[bench_numWorkloads] = *w;
+	w = &bench_workloads[bench_numWorkloads++];
+	w->name = "bundle batch";
+	w->batchSize = BUNDLE_SIZE;
+}
+
+/*
+==================
+Bench_LoadTraceLog
+
+Traces and point contents from a server trace log, replayed against the
+world only, the entities of the logged game aren't available
+==================
+*/
+static void Bench_LoadTraceLog( const char *filename, int mapChecksum ) {
+	FILE			*f;
+	tlogHeader_t	header;
+	tlogRecord_t	record;
+	workload_t		*traces, *contents, *w;
+	query_t			*q;
+	long			length;
+	int				count, type;
+	int				i, j;
+
+	f = fopen( filename, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "Couldn't open %s", filename );
+	}
+
+	if ( fread( &header, sizeof( header ), 1, f ) != 1
+		|| LittleLong( header.ident ) != TLOG_IDENT
+		|| LittleLong( header.version ) != TLOG_VERSION ) {
+		Com_Error( ERR_FATAL, "%s is not a version %i trace log", filename, TLOG_VERSION );
+	}
+	header.mapname[sizeof( header.mapname ) - 1] = 0;
+	if ( LittleLong( header.checksum ) != mapChecksum ) {
+		Com_Printf( "WARNING: %s was recorded on a different version of %s\n", filename, header.mapname );
+	}
+
+	fseek( f, 0, SEEK_END );
+	length = ftell( f );
+	fseek( f, sizeof( header ), SEEK_SET );
+	count = ( length - sizeof( header ) ) / sizeof( record );
+
+	traces = Bench_AddWorkload( "log traces", count );
+	contents = Bench_AddWorkload( "log contents", count );
+	traces->numQueries = contents->numQueries = 0;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( fread( &record, sizeof( record ), 1, f ) != 1 ) {
+			break;
+		}
+
+		type = LittleLong( record.type );
+		w = ( type == TLOG_POINTCONTENTS ) ? contents : traces;
+		q = &w->queries[w->numQueries++];
+
+		Com_Memset( q, 0, sizeof( *q ) );
+		q->type = ( type == TLOG_POINTCONTENTS ) ? QUERY_CONTENTS : QUERY_TRACE;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			q->start[j] = LittleFloat( record.start[j] );
+			q->end[j] = LittleFloat( record.end[j] );
+			q->mins[j] = LittleFloat( record.mins[j] );
+			q->maxs[j] = LittleFloat( record.maxs[j] );
+		}
+		q->contentmask = LittleLong( record.contentmask );
+		q->capsule = LittleLong( record.capsule );
+	}
+
+	fclose( f );
+	Com_Printf( "%s: %i traces, %i point contents on %s\n", filename,
+		traces->numQueries, contents->numQueries, header.mapname );
+}
+
+/*
+==============================================================================
+
+RUNNING
+
+==============================================================================
+*/
+
+static unsigned int Bench_HashBytes( unsigned int hash, const void *data, int size ) {
+	const byte	*p;
+	int			i;
+
+	p = (const byte *)data;
+	for ( i = 0 ; i < size ; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619u;
+	}
+	return hash;
+}
+
+static unsigned int Bench_HashTrace( unsigned int hash, const trace_t *tr ) {
+	hash = Bench_HashBytes( hash, &tr->allsolid, sizeof( tr->allsolid ) );
+	hash = Bench_HashBytes( hash, &tr->startsolid, sizeof( tr->startsolid ) );
+	hash = Bench_HashBytes( hash, &tr->fraction, sizeof( tr->fraction ) );
+	hash = Bench_HashBytes( hash, tr->endpos, sizeof( tr->endpos ) );
+	hash = Bench_HashBytes( hash, tr->plane.normal, sizeof( tr->plane.normal ) );
+	hash = Bench_HashBytes( hash, &tr->plane.dist, sizeof( tr->plane.dist ) );
+	hash = Bench_HashBytes( hash, &tr->surfaceFlags, sizeof( tr->surfaceFlags ) );
+	hash = Bench_HashBytes( hash, &tr->contents, sizeof( tr->contents ) );
+	return hash;
+}
+
+static int Bench_CompareTimes( const void *a, const void *b ) {
+	int		ta, tb;
+
+	ta = *(const int *)a;
+	tb = *(const int *)b;
+	return ( ta > tb ) - ( ta < tb );
+}
+
+/*
+==================
+Bench_RunQueries
+==================
+*/
+static long long Bench_RunQueries( const workload_t *w, int *times, unsigned int *hash, int *hits ) {
+	const query_t	*q;
+	trace_t			tr;
+	long long		start, total;
+	int				contents;
+	int				i;
+
+	total = 0;
+	for ( i = 0, q = w->queries ; i < w->numQueries ; i++, q++ ) {
+		switch ( q->type ) {
+		case QUERY_TRACE:
+			start = Bench_Nanoseconds();
+			CM_BoxTrace( &tr, q->start, q->end, (float *)q->mins, (float *)q->maxs,
+				q->model, q->contentmask, q->capsule );
+			times[i] = (int)( Bench_Nanoseconds() - start );
+			*hash = Bench_HashTrace( *hash, &tr );
+			*hits += ( tr.fraction < 1.0f || tr.startsolid );
+			break;
+		case QUERY_TRANSFORMED:
+			start = Bench_Nanoseconds();
+			CM_TransformedBoxTrace( &tr, q->start, q->end, (float *)q->mins, (float *)q->maxs,
+				q->model, q->contentmask, q->origin, q->angles, q->capsule );
+			times[i] = (int)( Bench_Nanoseconds() - start );
+			*hash = Bench_HashTrace( *hash, &tr );
+			*hits += ( tr.fraction < 1.0f || tr.startsolid );
+			break;
+		case QUERY_CONTENTS:
+			start = Bench_Nanoseconds();
+			contents = CM_PointContents( q->start, q->model );
+			times[i] = (int)( Bench_Nanoseconds() - start );
+			*hash = Bench_HashBytes( *hash, &contents, sizeof( contents ) );
+			*hits += ( contents != 0 );
+			break;
+		}
+		total += times[i];
+	}
+
+	return total;
+}
+
+/*
+==================
+Bench_RunBatches
+
+Traces runs of batchSize queries with CM_TraceBatch, each query is
+timed as an equal share of its batch
+==================
+*/
+static long long Bench_RunBatches( const workload_t *w, int *times, unsigned int *hash, int *hits ) {
+	const query_t	*q;
+	vec3_t			starts[BUNDLE_SIZE], ends[BUNDLE_SIZE];
+	trace_t			results[BUNDLE_SIZE];
+	long long		start, total;
+	int				i, j, n, t;
+
+	total = 0;
+	for ( i = 0 ; i < w->numQueries ; i += n ) {
+		q = &w->queries[i];
+		n = w->numQueries - i;
+		if ( n > w->batchSize ) {
+			n = w->batchSize;
+		}
+		for ( j = 0 ; j < n ; j++ ) {
+			VectorCopy( q[j].start, starts[j] );
+			VectorCopy( q[j].end, ends[j] );
+		}
+
+		start = Bench_Nanoseconds();
+		CM_TraceBatch( results, (const vec3_t *)starts, (const vec3_t *)ends, n,
+			(float *)q->mins, (float *)q->maxs, q->model, q->contentmask, q->capsule );
+		t = (int)( Bench_Nanoseconds() - start );
+		total += t;
+
+		for ( j = 0 ; j < n ; j++ ) {
+			times[i + j] = t / n;
+			*hash = Bench_HashTrace( *hash, &results[j] );
+			*hits += ( results[j].fraction < 1.0f || results[j].startsolid );
+		}
+	}
+
+	return total;
+}
+
+/*
+==================
+Bench_PrintResults
+
+Sorts the times and prints one line of the results table
+==================
+*/
+static void Bench_PrintResults( const char *name, int count, int *times, long long total, int hits, unsigned int hash ) {
+	qsort( times, count, sizeof( *times ), Bench_CompareTimes );
+
+	Com_Printf( "%-13s %8i %9.1f %10.0f %8.2f %8.2f %8.2f %8.2f %8i  %08x\n",
+		name, count, total / 1e6, count / ( total / 1e9 ),
+		times[count / 2] / 1e3, times[count * 9 / 10] / 1e3,
+		times[count * 99 / 100] / 1e3, times[count - 1] / 1e3,
+		hits, hash );
+}
+
+/*
+==================
+Bench_RunWorkload
+==================
+*/
+static void Bench_RunWorkload( workload_t *w ) {
+	int				*times;
+	long long		total;
+	unsigned int	hash;
+	int				hits;
+
+	if ( !w->numQueries ) {
+		return;
+	}
+
+	times = Hunk_AllocateTempMemory( w->numQueries * sizeof( *times ) );
+	hash = 2166136261u;
+	hits = 0;
+
+	if ( w->batchSize ) {
+		total = Bench_RunBatches( w, times, &hash, &hits );
+	} else {
+		total = Bench_RunQueries( w, times, &hash, &hits );
+	}
+
+	w->checksum = hash;
+
+	Bench_PrintResults( w->name, w->numQueries, times, total, hits, hash );
+
+	Hunk_FreeTempMemory( times );
+}
+
+/*
+==============================================================================
+
+ENTITIES
+
+==============================================================================
+*/
+
+#define	ENTITY_FRAMES		100
+
+static sharedEntity_t	bench_entities[MAX_GENTITIES];
+static vec3_t			bench_velocities[MAX_GENTITIES];
+
+/*
+==================
+Bench_SpawnEntities
+
+Player sized boxes at random points with random velocities, with
+-platforms every fourth one is a long platform across the middle of the
+map instead, the entities that crossed the splits of the old sector tree
+==================
+*/
+static void Bench_SpawnEntities( int count, qboolean platforms ) {
+	sharedEntity_t	*ent;
+	vec3_t			mins, maxs;
+	int				i, j;
+
+	Com_Memset( sv.svEntities, 0, sizeof( sv.svEntities ) );
+	Com_Memset( bench_entities, 0, sizeof( bench_entities ) );
+	sv.gentities = bench_entities;
+	sv.gentitySize = sizeof( bench_entities[0] );
+	sv.num_entities = count;
+	SV_ClearWorld();
+
+	CM_ModelBounds( 0, mins, maxs );
+	for ( i = 0 ; i < count ; i++ ) {
+		ent = &bench_entities[i];
+		ent->s.number = i;
+		ent->r.contents = CONTENTS_BODY;
+		ent->r.ownerNum = ENTITYNUM_NONE;
+		for ( j = 0 ; j < 3 ; j++ ) {
+			ent->r.currentOrigin[j] = Bench_Random( mins[j] + 64, maxs[j] - 64 );
+			ent->r.mins[j] = -15;
+			ent->r.maxs[j] = 15;
+			bench_velocities[i][j] = Bench_Random( -20, 20 );
+		}
+		bench_velocities[i][2] *= 0.2f;
+
+		if ( platforms && !( i & 3 ) ) {
+			ent->r.currentOrigin[0] = ( mins[0] + maxs[0] ) * 0.5f + Bench_Random( -100, 100 );
+			ent->r.mins[0] = -Bench_Random( 0, 1500 );
+			ent->r.maxs[0] = Bench_Random( 0, 1500 );
+		}
+	}
+}
+
+/*
+==================
+Bench_MoveEntities
+
+Moves every entity by its velocity, bouncing off the world bounds, and
+links it again
+==================
+*/
+static void Bench_MoveEntities( int count, int *times ) {
+	sharedEntity_t	*ent;
+	vec3_t			mins, maxs;
+	long long		start;
+	int				i, j;
+
+	CM_ModelBounds( 0, mins, maxs );
+	for ( i = 0 ; i < count ; i++ ) {
+		ent = &bench_entities[i];
+		for ( j = 0 ; j < 3 ; j++ ) {
+			ent->r.currentOrigin[j] += bench_velocities[i][j];
+			if ( ent->r.currentOrigin[j] < mins[j] + 64 || ent->r.currentOrigin[j] > maxs[j] - 64 ) {
+				bench_velocities[i][j] = -bench_velocities[i][j];
+				ent->r.currentOrigin[j] += 2 * bench_velocities[i][j];
+			}
+		}
+
+		start = Bench_Nanoseconds();
+		SV_LinkEntity( ent );
+		times[i] = (int)( Bench_Nanoseconds() - start );
+	}
+}
+
+/*
+==================
+Bench_RunEntities
+
+Every frame moves all entities, then runs area queries around random
+entities, one in ten of them large, and player sized traces from random
+entities.  The area checksum doesn't depend on the order of the results,
+so it stays comparable with other world trees.
+==================
+*/
+static void Bench_RunEntities( int count, int numQueries, qboolean platforms, unsigned int seed ) {
+	int				*linkTimes, *areaTimes, *traceTimes;
+	int				list[MAX_GENTITIES];
+	vec3_t			mins, maxs, start, end;
+	trace_t			tr;
+	long long		t, linkTotal, areaTotal, traceTotal;
+	unsigned int	areaHash, traceHash;
+	int				areaHits, traceHits;
+	int				perFrame, frame, num, size;
+	int				i, j, k, q;
+
+	perFrame = numQueries / ENTITY_FRAMES;
+	if ( perFrame < 1 ) {
+		perFrame = 1;
+	}
+
+	sv_traceCache = Bench_FindCvar( "sv_traceCache", "0" );
+	bench_seed = seed;
+	Bench_SpawnEntities( count, platforms );
+
+	linkTimes = Hunk_AllocateTempMemory( count * ENTITY_FRAMES * sizeof( *linkTimes ) );
+	areaTimes = Hunk_AllocateTempMemory( perFrame * ENTITY_FRAMES * sizeof( *areaTimes ) );
+	traceTimes = Hunk_AllocateTempMemory( perFrame * ENTITY_FRAMES * sizeof( *traceTimes ) );
+
+	linkTotal = areaTotal = traceTotal = 0;
+	areaHash = traceHash = 2166136261u;
+	areaHits = traceHits = 0;
+
+	for ( frame = 0 ; frame < ENTITY_FRAMES ; frame++ ) {
+		Bench_MoveEntities( count, &linkTimes[frame * count] );
+
+		for ( i = 0 ; i < perFrame ; i++ ) {
+			q = frame * perFrame + i;
+			k = Bench_Rand() % count;
+			size = ( i % 10 == 0 ) ? 600 : 80;
+			for ( j = 0 ; j < 3 ; j++ ) {
+				mins[j] = bench_entities[k].r.currentOrigin[j] - size;
+				maxs[j] = bench_entities[k].r.currentOrigin[j] + size;
+			}
+
+			t = Bench_Nanoseconds();
+			num = SV_AreaEntities( mins, maxs, list, MAX_GENTITIES );
+			areaTimes[q] = (int)( Bench_Nanoseconds() - t );
+
+			areaHits += num;
+			for ( j = 0 ; j < num ; j++ ) {
+				areaHash += ( list[j] + 1 ) * 2654435761u ^ q;
+			}
+		}
+
+		for ( i = 0 ; i < perFrame ; i++ ) {
+			q = frame * perFrame + i;
+			k = Bench_Rand() % count;
+			for ( j = 0 ; j < 3 ; j++ ) {
+				start[j] = bench_entities[k].r.currentOrigin[j];
+				end[j] = start[j] + Bench_Random( -256, 256 );
+				mins[j] = -15;
+				maxs[j] = 15;
+			}
+
+			t = Bench_Nanoseconds();
+			SV_Trace( &tr, start, mins, maxs, end, k, BENCH_CONTENTMASK, qfalse );
+			traceTimes[q] = (int)( Bench_Nanoseconds() - t );
+
+			traceHash = Bench_HashTrace( traceHash, &tr );
+			traceHash = Bench_HashBytes( traceHash, &tr.entityNum, sizeof( tr.entityNum ) );
+			traceHits += ( tr.entityNum != ENTITYNUM_NONE && tr.entityNum != ENTITYNUM_WORLD );
+		}
+	}
+
+	for ( i = 0 ; i < count * ENTITY_FRAMES ; i++ ) {
+		linkTotal += linkTimes[i];
+	}
+	for ( i = 0 ; i < perFrame * ENTITY_FRAMES ; i++ ) {
+		areaTotal += areaTimes[i];
+		traceTotal += traceTimes[i];
+	}
+
+	Com_Printf( "%i entities%s, %i frames\n", count, platforms ? ", a quarter of them platforms" : "", ENTITY_FRAMES );
+	Bench_PrintResults( "entity link", count * ENTITY_FRAMES, linkTimes, linkTotal, 0, 0 );
+	Bench_PrintResults( "entity area", perFrame * ENTITY_FRAMES, areaTimes, areaTotal, areaHits, areaHash );
+	Bench_PrintResults( "entity trace", perFrame * ENTITY_FRAMES, traceTimes, traceTotal, traceHits, traceHash );
+
+	Hunk_FreeTempMemory( traceTimes );
+	Hunk_FreeTempMemory( areaTimes );
+	Hunk_FreeTempMemory( linkTimes );
+}
+
+/*
+==============================================================================
+
+THREADS
+
+==============================================================================
+*/
+
+typedef struct {
+	int		slot;
+	int		repeat;
+	int		mismatches[MAX_WORKLOADS];
+} benchThread_t;
+
+static benchThread_t	bench_threads[CM_MAX_THREADS];
+
+/*
+==================
+Bench_ThreadWork
+
+Runs every workload in the thread's own slot and counts the checksums
+that differ from the single thread run
+==================
+*/
+static void Bench_ThreadWork( benchThread_t *t ) {
+	const workload_t	*w;
+	int				*times;
+	unsigned int	hash;
+	int				hits;
+	int				i, j;
+
+	CM_SetThreadSlot( t->slot );
+
+	for ( j = 0 ; j < t->repeat ; j++ ) {
+		for ( i = 0 ; i < bench_numWorkloads ; i++ ) {
+			w = &bench_workloads[i];
+			if ( !w->numQueries ) {
+				continue;
+			}
+
+			times = Hunk_AllocateTempMemory( w->numQueries * sizeof( *times ) );
+			hash = 2166136261u;
+			hits = 0;
+
+			if ( w->batchSize ) {
+				Bench_RunBatches( w, times, &hash, &hits );
+			} else {
+				Bench_RunQueries( w, times, &hash, &hits );
+			}
+			if ( hash != w->checksum ) {
+				t->mismatches[i]++;
+			}
+
+			Hunk_FreeTempMemory( times );
+		}
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI Bench_ThreadMain( LPVOID arg ) {
+	Bench_ThreadWork( arg );
+	return 0;
+}
+#else
+static void *Bench_ThreadMain( void *arg ) {
+	Bench_ThreadWork( arg );
+	return NULL;
+}
+#endif
+
+/*
+==================
+Bench_RunThreads
+
+Runs all workloads from count threads at once, returns how many of the
+thread checksums differ from the single thread run
+==================
+*/
+static int Bench_RunThreads( int count, int repeat ) {
+#ifdef _WIN32
+	HANDLE			handles[CM_MAX_THREADS];
+#else
+	pthread_t		handles[CM_MAX_THREADS];
+#endif
+	const workload_t	*w;
+	long long		start, total;
+	double			queries;
+	int				mismatches, failures;
+	int				i, t;
+
+	CM_ReserveThreads( count );
+
+	start = Bench_Nanoseconds();
+	for ( t = 0 ; t < count ; t++ ) {
+		Com_Memset( &bench_threads[t], 0, sizeof( bench_threads[t] ) );
+		bench_threads[t].slot = t;
+		bench_threads[t].repeat = repeat;
+#ifdef _WIN32
+		handles[t] = CreateThread( NULL, 0, Bench_ThreadMain, &bench_threads[t], 0, NULL );
+		if ( !handles[t] ) {
+#else
+		if ( pthread_create( &handles[t], NULL, Bench_ThreadMain, &bench_threads[t] ) ) {
+#endif
+			Com_Error( ERR_FATAL, "Couldn't start thread %i", t );
+		}
+	}
+	for ( t = 0 ; t < count ; t++ ) {
+#ifdef _WIN32
+		WaitForSingleObject( handles[t], INFINITE );
+		CloseHandle( handles[t] );
+#else
+		pthread_join( handles[t], NULL );
+#endif
+	}
+	total = Bench_Nanoseconds() - start;
+
+	queries = 0;
+	failures = 0;
+	Com_Printf( "%-13s %8s %9s  %s\n", "workload", "threads", "differ", "checksum" );
+	for ( i = 0 ; i < bench_numWorkloads ; i++ ) {
+		w = &bench_workloads[i];
+		if ( !w->numQueries ) {
+			continue;
+		}
+
+		mismatches = 0;
+		for ( t = 0 ; t < count ; t++ ) {
+			mismatches += bench_threads[t].mismatches[i];
+		}
+		failures += mismatches;
+		queries += (double)w->numQueries * count * repeat;
+
+		Com_Printf( "%-13s %8i %9i  %08x\n", w->name, count, mismatches, w->checksum );
+	}
+	Com_Printf( "%i threads: %.0f queries in %.1f ms, %.0f per sec, %i checksums differ\n",
+		count, queries, total / 1e6, queries / ( total / 1e9 ), failures );
+
+	return failures;
+}
+
+/*
+==============================================================================
+
+PATCH PLANES
+
+==============================================================================
+*/
+
+/*
+==================
+Bench_SamePatchCollide
+==================
+*/
+static qboolean Bench_SamePatchCollide( const patchCollide_t *a, const patchCollide_t *b ) {
+	const facet_t	*fa, *fb;
+	int				i;
+
+	if ( memcmp( a->bounds, b->bounds, sizeof( a->bounds ) )
+		|| a->numPlanes != b->numPlanes || a->numFacets != b->numFacets ) {
+		return qfalse;
+	}
+	if ( memcmp( a->planes, b->planes, a->numPlanes * sizeof( *a->planes ) ) ) {
+		return qfalse;
+	}
+
+	for ( i = 0 ; i < a->numFacets ; i++ ) {
+		fa = &a->facets[i];
+		fb = &b->facets[i];
+		if ( fa->surfacePlane != fb->surfacePlane || fa->numBorders != fb->numBorders
+			|| memcmp( fa->borderPlanes, fb->borderPlanes, fa->numBorders * sizeof( fa->borderPlanes[0] ) )
+			|| memcmp( fa->borderInward, fb->borderInward, fa->numBorders * sizeof( fa->borderInward[0] ) )
+			|| memcmp( fa->borderNoAdjust, fb->borderNoAdjust, fa->numBorders * sizeof( fa->borderNoAdjust[0] ) ) ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+Bench_CheckPatchPlanes
+
+Loads the map with the linear CM_FindPlane2 search and again with the
+hashed one, returns how many patches came out different
+==================
+*/
+static int Bench_CheckPatchPlanes( const char *mapname ) {
+	patchCollide_t	**linear;
+	long long		start, linearTime, hashTime;
+	int				numSurfaces, patches, failures, checksum;
+	int				i;
+
+	Bench_SetCvar( "cm_planeHash", "0" );
+	start = Bench_Nanoseconds();
+	CM_LoadMap( mapname, qfalse, &checksum );
+	linearTime = Bench_Nanoseconds() - start;
+
+	numSurfaces = cm.numSurfaces;
+	linear = Hunk_AllocateTempMemory( numSurfaces * sizeof( *linear ) );
+	for ( i = 0 ; i < numSurfaces ; i++ ) {
+		linear[i] = cm.surfaces[i] ? cm.surfaces[i]->pc : NULL;
+	}
+
+	Bench_SetCvar( "cm_planeHash", "1" );
+	start = Bench_Nanoseconds();
+	CM_LoadMap( mapname, qfalse, &checksum );
+	hashTime = Bench_Nanoseconds() - start;
+
+	patches = failures = 0;
+	for ( i = 0 ; i < numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		patches++;
+		if ( !Bench_SamePatchCollide( linear[i], cm.surfaces[i]->pc ) ) {
+			Com_Printf( "surface %i: the hashed plane search built a different patch\n", i );
+			failures++;
+		}
+	}
+
+	Hunk_FreeTempMemory( linear );
+
+	Com_Printf( "%s: %i patches, %i differ, loaded in %.1f ms with the linear plane search, %.1f ms hashed\n",
+		mapname, patches, failures, linearTime / 1e6, hashTime / 1e6 );
+
+	return failures;
+}
+
+/*
+==================
+Bench_Usage
+==================
+*/
+static void Bench_Usage( void ) {
+	printf( "usage: cmbench [options] <map>\n"
+		"  <map>              a .bsp file, or maps/<name>.bsp inside the -pk3 archive\n"
+		"  -pk3 <file>        read the map from a pk3\n"
+		"  -n <count>         queries per seeded workload (default 100000)\n"
+		"  -seed <number>     seed for the generated queries (default 1)\n"
+		"  -log <file>        replay a .tlog from the server tracelog command\n"
+		"                     instead of the seeded workloads\n"
+		"  -repeat <count>    run every workload this many times (default 1)\n"
+		"  -threads <count>   run the workloads again from this many threads at\n"
+		"                     once and compare the checksums\n"
+		"  -entities <count>  also link this many moving boxes in the server world\n"
+		"                     and time area queries and traces against them\n"
+		"  -platforms         make every fourth of those a long platform\n"
+		"  -patchplanes       compare the patches built with the linear and the\n"
+		"                     hashed plane search instead of running workloads\n"
+		"  -set <cvar> <val>  set a cm_ cvar before loading\n"
+		"  -v                 print developer messages\n" );
+	exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+	char		*mapname, *logname;
+	qboolean	patchPlanes, platforms;
+	char		name[MAX_QPATH];
+	int			count, repeat, threads, entities, checksum;
+	unsigned int	entitySeed;
+	long long	start;
+	int			i, j;
+
+	mapname = logname = NULL;
+	count = 100000;
+	repeat = 1;
+	threads = 0;
+	entities = 0;
+	patchPlanes = platforms = qfalse;
+	bench_seed = 1;
+
+	// never read or write the patch collision cache
+	Bench_SetCvar( "cm_patchCache", "0" );
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		if ( !strcmp( argv[i], "-pk3" ) && i + 1 < argc ) {
+			bench_pk3 = argv[++i];
+		} else if ( !strcmp( argv[i], "-n" ) && i + 1 < argc ) {
+			count = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-seed" ) && i + 1 < argc ) {
+			bench_seed = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-log" ) && i + 1 < argc ) {
+			logname = argv[++i];
+		} else if ( !strcmp( argv[i], "-repeat" ) && i + 1 < argc ) {
+			repeat = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-threads" ) && i + 1 < argc ) {
+			threads = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-entities" ) && i + 1 < argc ) {
+			entities = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-platforms" ) ) {
+			platforms = qtrue;
+		} else if ( !strcmp( argv[i], "-patchplanes" ) ) {
+			patchPlanes = qtrue;
+		} else if ( !strcmp( argv[i], "-set" ) && i + 2 < argc ) {
+			Bench_SetCvar( argv[i + 1], argv[i + 2] );
+			i += 2;
+		} else if ( !strcmp( argv[i], "-v" ) ) {
+			bench_verbose = qtrue;
+		} else if ( argv[i][0] == '-' || mapname ) {
+			Bench_Usage();
+		} else {
+			mapname = argv[i];
+		}
+	}
+	if ( !mapname || count <= 0 || repeat <= 0 || threads < 0 || threads > CM_MAX_THREADS
+		|| entities < 0 || entities > MAX_GENTITIES - 2 ) {
+		Bench_Usage();
+	}
+
+	if ( bench_pk3 && Q_stricmpn( mapname, "maps/", 5 ) ) {
+		Com_sprintf( name, sizeof( name ), "maps/%s", mapname );
+		COM_DefaultExtension( name, sizeof( name ), ".bsp" );
+		mapname = name;
+	}
+
+	if ( patchPlanes ) {
+		return Bench_CheckPatchPlanes( mapname ) ? 1 : 0;
+	}
+
+	start = Bench_Nanoseconds();
+	CM_LoadMap( mapname, qfalse, &checksum );
+	Com_Printf( "%s: checksum %i, %i inline models, %i clusters, loaded in %.1f ms\n",
+		mapname, checksum, CM_NumInlineModels(), CM_NumClusters(),
+		( Bench_Nanoseconds() - start ) / 1e6 );
+
+	entitySeed = bench_seed;
+	if ( logname ) {
+		Bench_LoadTraceLog( logname, checksum );
+	} else {
+		Bench_BuildRandomWorkloads( count );
+	}
+
+	Com_Printf( "%-13s %8s %9s %10s %8s %8s %8s %8s %8s  %s\n", "workload", "count",
+		"total ms", "per sec", "p50 us", "p90 us", "p99 us", "max us", "hits", "checksum" );
+	for ( j = 0 ; j < repeat ; j++ ) {
+		for ( i = 0 ; i < bench_numWorkloads ; i++ ) {
+			Bench_RunWorkload( &bench_workloads[i] );
+		}
+		if ( entities ) {
+			Bench_RunEntities( entities, count, platforms, entitySeed );
+		}
+	}
+
+	if ( threads && Bench_RunThreads( threads, repeat ) ) {
+		return 1;
+	}
+
+	return 0;
+}
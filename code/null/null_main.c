@@ -55,6 +55,18 @@ int		Sys_Milliseconds (void) {
 	return 0;
 }
 
+int64_t	Sys_Nanoseconds( void ) {
+	return 0;
+}
+
+void	Sys_RunThreads( int count, void (*func)( int thread ) ) {
+	int		i;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		func( i );
+	}
+}
+
 FILE	*Sys_FOpen(const char *ospath, const char *mode) {
 	return fopen( ospath, mode );
 }
@@ -0,0 +1,480 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// null_msgtest.c -- MSG_WriteBits / MSG_ReadBits fuzz test
+//
+// Links only msg.c and huffman.c and replaces the rest of the engine with
+// stubs.  Keeps the original bit at a time MSG_WriteBits and MSG_ReadBits
+// on a Huffman tree of its own, built from the same msg_hData, and runs
+// seeded random sequences of field widths, values and buffer sizes through
+// both, including overflowing buffers and reads past a truncated cursize.
+// The buffers, the read values and the bit, cursize, readcount and
+// overflowed state must all match.  Exits with 1 if anything differs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../qcommon/q_shared.h"
+#include "../qcommon/qcommon.h"
+
+#define TEST_MAX_OPS		4000
+#define TEST_MAX_SIZE		16000
+#define TEST_MAX_FAILURES	10
+
+extern int		msg_hData[256];
+
+static huffman_t	ref_huff;
+
+static unsigned	test_seed;
+static int		test_sequences;
+static int		test_failures;
+
+cvar_t			*cl_shownet;
+
+/*
+==============================================================================
+
+ENGINE STUBS
+
+==============================================================================
+*/
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+
+	exit( 1 );
+}
+
+static long long Test_Nanoseconds( void ) {
+#ifdef _WIN32
+	static LARGE_INTEGER	frequency;
+	LARGE_INTEGER			count;
+
+	if ( !frequency.QuadPart ) {
+		QueryPerformanceFrequency( &frequency );
+	}
+	QueryPerformanceCounter( &count );
+	return (long long)( (double)count.QuadPart * 1e9 / frequency.QuadPart );
+#else
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static unsigned Test_Rand( void ) {
+	test_seed ^= test_seed << 13;
+	test_seed ^= test_seed >> 17;
+	test_seed ^= test_seed << 5;
+	return test_seed;
+}
+
+/*
+==============================================================================
+
+REFERENCE
+
+The bit functions as they were before the lookup tables
+
+==============================================================================
+*/
+
+static void Ref_Init( void ) {
+	int		i, j;
+
+	Huff_Init( &ref_huff );
+	for ( i = 0 ; i < 256 ; i++ ) {
+		for ( j = 0 ; j < msg_hData[i] ; j++ ) {
+			Huff_addRef( &ref_huff.compressor, (byte)i );
+			Huff_addRef( &ref_huff.decompressor, (byte)i );
+		}
+	}
+}
+
+static void Ref_WriteBits( msg_t *msg, int value, int bits ) {
+	int	i;
+
+	if ( msg->overflowed ) {
+		return;
+	}
+
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+
+	if ( msg->oob ) {
+		if ( msg->cursize + ( bits >> 3 ) > msg->maxsize ) {
+			msg->overflowed = qtrue;
+			return;
+		}
+
+		if ( bits == 8 ) {
+			msg->data[msg->cursize] = value;
+			msg->cursize += 1;
+			msg->bit += 8;
+		} else if ( bits == 16 ) {
+			short temp = value;
+
+			CopyLittleShort( &msg->data[msg->cursize], &temp );
+			msg->cursize += 2;
+			msg->bit += 16;
+		} else {
+			CopyLittleLong( &msg->data[msg->cursize], &value );
+			msg->cursize += 4;
+			msg->bit += 32;
+		}
+	} else {
+		value &= (0xffffffff >> (32 - bits));
+		if ( bits&7 ) {
+			int nbits;
+			nbits = bits&7;
+			if ( msg->bit + nbits > msg->maxsize << 3 ) {
+				msg->overflowed = qtrue;
+				return;
+			}
+			for( i = 0; i < nbits; i++ ) {
+				Huff_putBit( (value & 1), msg->data, &msg->bit );
+				value = (value >> 1);
+			}
+			bits = bits - nbits;
+		}
+		if ( bits ) {
+			for( i = 0; i < bits; i += 8 ) {
+				Huff_offsetTransmit( &ref_huff.compressor, (value & 0xff), msg->data, &msg->bit, msg->maxsize << 3 );
+				value = (value >> 8);
+
+				if ( msg->bit > msg->maxsize << 3 ) {
+					msg->overflowed = qtrue;
+					return;
+				}
+			}
+		}
+		msg->cursize = (msg->bit >> 3) + 1;
+	}
+}
+
+static int Ref_ReadBits( msg_t *msg, int bits ) {
+	int			value;
+	int			get;
+	qboolean	sgn;
+	int			i, nbits;
+
+	if ( msg->readcount > msg->cursize ) {
+		return 0;
+	}
+
+	value = 0;
+
+	if ( bits < 0 ) {
+		bits = -bits;
+		sgn = qtrue;
+	} else {
+		sgn = qfalse;
+	}
+
+	if (msg->oob) {
+		if (msg->readcount + (bits>>3) > msg->cursize) {
+			msg->readcount = msg->cursize + 1;
+			return 0;
+		}
+
+		if(bits==8)
+		{
+			value = msg->data[msg->readcount];
+			msg->readcount += 1;
+			msg->bit += 8;
+		}
+		else if(bits==16)
+		{
+			short temp;
+
+			CopyLittleShort(&temp, &msg->data[msg->readcount]);
+			value = temp;
+			msg->readcount += 2;
+			msg->bit += 16;
+		}
+		else
+		{
+			CopyLittleLong(&value, &msg->data[msg->readcount]);
+			msg->readcount += 4;
+			msg->bit += 32;
+		}
+	} else {
+		nbits = 0;
+		if (bits&7) {
+			nbits = bits&7;
+			if (msg->bit + nbits > msg->cursize << 3) {
+				msg->readcount = msg->cursize + 1;
+				return 0;
+			}
+			for(i=0;i<nbits;i++) {
+				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
+			}
+			bits = bits - nbits;
+		}
+		if (bits) {
+			for(i=0;i<bits;i+=8) {
+				Huff_offsetReceive (ref_huff.decompressor.tree, &get, msg->data, &msg->bit, msg->cursize<<3);
+				value = (unsigned int)value | ((unsigned int)get<<(i+nbits));
+
+				if (msg->bit > msg->cursize<<3) {
+					msg->readcount = msg->cursize + 1;
+					return 0;
+				}
+			}
+		}
+		msg->readcount = (msg->bit>>3)+1;
+	}
+	if ( sgn && bits > 0 && bits < 32 ) {
+		if ( value & ( 1 << ( bits - 1 ) ) ) {
+			value |= -1 ^ ( ( 1 << bits ) - 1 );
+		}
+	}
+
+	return value;
+}
+
+/*
+==============================================================================
+
+FUZZING
+
+==============================================================================
+*/
+
+/*
+==================
+Test_Fail
+==================
+*/
+static void Test_Fail( const char *what, int op, int got, int expected ) {
+	test_failures++;
+	if ( test_failures <= TEST_MAX_FAILURES ) {
+		printf( "sequence %i op %i: %s %i, expected %i\n", test_sequences, op, what, got, expected );
+	}
+}
+
+/*
+==================
+Test_Sequence
+
+Writes and reads one random sequence with both implementations
+==================
+*/
+static void Test_Sequence( void ) {
+	static byte		data[TEST_MAX_SIZE + 8], refData[TEST_MAX_SIZE + 8];
+	static int		widths[TEST_MAX_OPS], values[TEST_MAX_OPS];
+	static const int	oobWidths[3] = { 8, 16, 32 };
+	msg_t		msg, ref;
+	qboolean	oob;
+	int			size, numOps, cursize;
+	int			i, j, value, refValue;
+
+	oob = ( Test_Rand() & 7 ) == 0;
+	size = 1 + Test_Rand() % ( ( Test_Rand() % 10 ) ? 64 : TEST_MAX_SIZE );
+	numOps = Test_Rand() % TEST_MAX_OPS;
+
+	Com_Memset( data, Test_Rand() & 0xff, sizeof( data ) );
+	Com_Memcpy( refData, data, sizeof( data ) );
+
+	if ( oob ) {
+		MSG_InitOOB( &msg, data, size );
+		MSG_InitOOB( &ref, refData, size );
+	} else {
+		MSG_Init( &msg, data, size );
+		MSG_Init( &ref, refData, size );
+	}
+
+	for ( i = 0 ; i < numOps ; i++ ) {
+		if ( oob ) {
+			widths[i] = oobWidths[Test_Rand() % 3];
+		} else {
+			do {
+				widths[i] = (int)( Test_Rand() % 64 ) - 31;
+			} while ( !widths[i] || widths[i] > 32 );
+		}
+		values[i] = ( Test_Rand() & 3 ) ? (int)Test_Rand() : (int)( Test_Rand() % 8 );
+
+		MSG_WriteBits( &msg, values[i], widths[i] );
+		Ref_WriteBits( &ref, values[i], widths[i] );
+		if ( ref.overflowed ) {
+			break;
+		}
+	}
+
+	if ( msg.bit != ref.bit ) {
+		Test_Fail( "write bit", i, msg.bit, ref.bit );
+	}
+	if ( msg.cursize != ref.cursize ) {
+		Test_Fail( "write cursize", i, msg.cursize, ref.cursize );
+	}
+	if ( msg.overflowed != ref.overflowed ) {
+		Test_Fail( "write overflowed", i, msg.overflowed, ref.overflowed );
+	}
+	for ( j = 0 ; j < sizeof( data ) ; j++ ) {
+		if ( data[j] != refData[j] ) {
+			Test_Fail( va( "written byte %i", j ), i, data[j], refData[j] );
+			break;
+		}
+	}
+
+	// read back everything, sometimes from a truncated message
+	cursize = ( Test_Rand() % 3 ) ? ref.cursize : (int)( Test_Rand() % ( size + 1 ) );
+	Com_Memcpy( data, refData, sizeof( data ) );
+	msg.cursize = ref.cursize = cursize;
+	if ( oob ) {
+		MSG_BeginReadingOOB( &msg );
+		MSG_BeginReadingOOB( &ref );
+	} else {
+		MSG_BeginReading( &msg );
+		MSG_BeginReading( &ref );
+	}
+
+	for ( i = 0 ; i < numOps + 5 ; i++ ) {
+		value = MSG_ReadBits( &msg, i < numOps ? widths[i] : 8 );
+		refValue = Ref_ReadBits( &ref, i < numOps ? widths[i] : 8 );
+		if ( value != refValue ) {
+			Test_Fail( "read value", i, value, refValue );
+		}
+		if ( msg.bit != ref.bit ) {
+			Test_Fail( "read bit", i, msg.bit, ref.bit );
+		}
+		if ( msg.readcount != ref.readcount ) {
+			Test_Fail( "read readcount", i, msg.readcount, ref.readcount );
+		}
+	}
+
+	test_sequences++;
+}
+
+/*
+==================
+Test_Speed
+
+Times a mixed 5, 8, 16 and 32 bit write and read loop, the shape of
+delta compressed entities and player states
+==================
+*/
+static void Test_Speed( int count ) {
+	static const int	widths[4] = { 5, 8, 16, 32 };
+	static byte		data[MAX_MSGLEN];
+	msg_t		msg;
+	long long	start, msec[2];
+	unsigned	sum[2];
+	int			pass, i, j;
+
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		test_seed = 1;
+		sum[pass] = 0;
+		start = Test_Nanoseconds();
+		for ( i = 0 ; i < count ; i++ ) {
+			MSG_Init( &msg, data, sizeof( data ) );
+			for ( j = 0 ; j < 1024 ; j++ ) {
+				if ( pass ) {
+					Ref_WriteBits( &msg, Test_Rand() & 0xffff, widths[j & 3] );
+				} else {
+					MSG_WriteBits( &msg, Test_Rand() & 0xffff, widths[j & 3] );
+				}
+			}
+			MSG_BeginReading( &msg );
+			for ( j = 0 ; j < 1024 ; j++ ) {
+				sum[pass] += pass ? Ref_ReadBits( &msg, widths[j & 3] ) : MSG_ReadBits( &msg, widths[j & 3] );
+			}
+		}
+		msec[pass] = ( Test_Nanoseconds() - start ) / 1000000;
+	}
+
+	if ( sum[0] != sum[1] ) {
+		Test_Fail( "speed loop sum", 0, sum[0], sum[1] );
+	}
+	printf( "%i x 1024 mixed fields: %lli ms, reference %lli ms\n", count, msec[0], msec[1] );
+}
+
+/*
+==================
+Test_Usage
+==================
+*/
+static void Test_Usage( void ) {
+	printf( "usage: msgtest [options]\n"
+		"  -n <count>       number of random sequences (default 20000)\n"
+		"  -seed <seed>     random seed (default 12345)\n"
+		"  -speed <count>   also time this many mixed field loops\n" );
+	exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+	int		count, speed;
+	int		i;
+
+	count = 20000;
+	speed = 0;
+	test_seed = 12345;
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		if ( !strcmp( argv[i], "-n" ) && i + 1 < argc ) {
+			count = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-seed" ) && i + 1 < argc ) {
+			test_seed = strtoul( argv[++i], NULL, 0 );
+		} else if ( !strcmp( argv[i], "-speed" ) && i + 1 < argc ) {
+			speed = atoi( argv[++i] );
+		} else {
+			Test_Usage();
+		}
+	}
+	if ( !test_seed ) {
+		Test_Usage();
+	}
+
+	Ref_Init();
+
+	for ( i = 0 ; i < count ; i++ ) {
+		Test_Sequence();
+	}
+
+	if ( speed > 0 ) {
+		Test_Speed( speed );
+	}
+
+	printf( "msgtest: %i sequences, %i differ\n", test_sequences, test_failures );
+	return test_failures ? 1 : 0;
+}
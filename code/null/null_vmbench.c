@@ -0,0 +1,468 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// null_vmbench.c -- interpreter against compiler tiers benchmark
+//
+// Links the bytecode interpreter and the x86 compiler and replaces the rest
+// of the engine with stubs.  Loads vmtest.qvm, built from vmtest_module.c,
+// once for the interpreter (vm_* 0), the first tier compiler (vm_* 2) and
+// the second tier compiler (vm_* 3), runs the same seeded mix of its
+// commands on each and prints the time and a checksum of the results.
+// Exits with 1 if the checksums of the tiers differ.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../qcommon/vm_local.h"
+
+// commands of vmtest_module.c
+enum {
+	VMT_DIVI,
+	VMT_MODI,
+	VMT_DIVU,
+	VMT_MODU,
+	VMT_CVFI,
+	VMT_CVIF,
+	VMT_FLOAT,
+	VMT_COMPARE,
+	VMT_SHIFT,
+	VMT_INTEGER,
+	VMT_MEMORY,
+	VMT_CALLS,
+	VMT_SYSCALL
+};
+
+static const vmInterpret_t	bench_tiers[] = { VMI_BYTECODE, VMI_COMPILED, VMI_OPTIMIZED };
+static const char			*bench_tierNames[] = { "interpreted", "compiled", "optimized" };
+
+#define	NUM_TIERS	ARRAY_LEN( bench_tiers )
+
+static vm_t		bench_vms[NUM_TIERS];
+
+/*
+==============================================================================
+
+ENGINE STUBS
+
+==============================================================================
+*/
+
+vm_t	*currentVM;
+int		vm_debugLevel;
+void	*vm_sampleStackTop;
+
+#if idx64
+	int (*Q_VMftol)(void) = qvmftolsse;
+#elif id386
+	int (QDECL *Q_VMftol)(void) = qvmftolsse;
+#endif
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_DPrintf( const char *fmt, ... ) {
+}
+
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+
+	exit( 1 );
+}
+
+// nothing is ever freed, a run only loads the qvm once per tier
+void *Hunk_Alloc( int size, ha_pref preference ) {
+	void	*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Hunk_Alloc failed on %i", size );
+	}
+	return buf;
+}
+
+void *Z_Malloc( int size ) {
+	return Hunk_Alloc( size, h_high );
+}
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+// vm_cache is off, the compiled code cache is never read or written
+int Cvar_VariableIntegerValue( const char *var_name ) {
+	return 0;
+}
+
+long FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
+	*fp = 0;
+	return -1;
+}
+
+fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
+	return 0;
+}
+
+int FS_Read( void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+int FS_Write( const void *buffer, int len, fileHandle_t f ) {
+	return 0;
+}
+
+void FS_FCloseFile( fileHandle_t f ) {
+}
+
+cpuFeatures_t Sys_GetProcessorFeatures( void ) {
+	return CF_SSE | CF_SSE2;
+}
+
+void VM_RecordSample( void *pc, void **sp ) {
+}
+
+void VM_BlockCopy( unsigned int dest, unsigned int src, size_t n ) {
+	unsigned int	dataMask = currentVM->dataMask;
+
+	if ( ( dest & dataMask ) != dest || ( src & dataMask ) != src
+		|| ( ( dest + n ) & dataMask ) != dest + n || ( ( src + n ) & dataMask ) != src + n ) {
+		Com_Error( ERR_DROP, "OP_BLOCK_COPY out of range!" );
+	}
+
+	memmove( currentVM->dataBase + dest, currentVM->dataBase + src, n );
+}
+
+void VM_Debug( int level ) {
+}
+
+const char *VM_ValueToSymbol( vm_t *vm, int value ) {
+	static char		text[16];
+
+	Com_sprintf( text, sizeof( text ), "%i", value );
+	return text;
+}
+
+vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value ) {
+	static vmSymbol_t	sym;
+
+	return &sym;
+}
+
+static long long Bench_Nanoseconds( void ) {
+#ifdef _WIN32
+	static LARGE_INTEGER	frequency;
+	LARGE_INTEGER			count;
+
+	if ( !frequency.QuadPart ) {
+		QueryPerformanceFrequency( &frequency );
+	}
+	QueryPerformanceCounter( &count );
+	return (long long)( (double)count.QuadPart * 1e9 / frequency.QuadPart );
+#else
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+==============================================================================
+
+MODULE
+
+==============================================================================
+*/
+
+/*
+==================
+Bench_SystemCall
+
+trap_Combine, the only syscall of the module
+==================
+*/
+static intptr_t Bench_SystemCall( intptr_t *args ) {
+	if ( args[0] != 0 ) {
+		Com_Error( ERR_DROP, "bad syscall %i", (int)args[0] );
+	}
+	return (int)args[1] * 31 + ( (int)args[2] ^ 0x5a5a );
+}
+
+/*
+==================
+Bench_LoadQVM
+
+The part of VM_Create and VM_LoadQVM the interpreter and the compiler need
+==================
+*/
+static void Bench_LoadQVM( vm_t *vm, const char *filename, int tier ) {
+	vmInterpret_t	interpret;
+	vmHeader_t		*header;
+	FILE			*f;
+	long			length;
+	int				dataLength;
+	int				i;
+
+	interpret = bench_tiers[tier];
+
+	f = fopen( filename, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "couldn't open %s", filename );
+	}
+	fseek( f, 0, SEEK_END );
+	length = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	header = Hunk_Alloc( length, h_high );
+	if ( fread( header, 1, length, f ) != length ) {
+		Com_Error( ERR_FATAL, "couldn't read %s", filename );
+	}
+	fclose( f );
+
+	for ( i = 0 ; i < sizeof( vmHeader_t ) / 4 ; i++ ) {
+		( (int *)header )[i] = LittleLong( ( (int *)header )[i] );
+	}
+	if ( header->vmMagic != VM_MAGIC_VER2
+		|| header->codeLength <= 0 || header->dataLength < 0 || header->litLength < 0
+		|| header->bssLength < 0 || header->jtrgLength < 0
+		|| header->codeOffset + header->codeLength > length
+		|| header->dataOffset + header->dataLength + header->litLength + header->jtrgLength > length ) {
+		Com_Error( ERR_FATAL, "%s is not a qvm with jump table targets", filename );
+	}
+
+	dataLength = header->dataLength + header->litLength + header->bssLength;
+	for ( i = 0 ; dataLength > ( 1 << i ) ; i++ ) {
+	}
+	dataLength = 1 << i;
+
+	Q_strncpyz( vm->name, "vmtest", sizeof( vm->name ) );
+	vm->systemCall = Bench_SystemCall;
+	vm->dataMask = dataLength - 1;
+	vm->dataAlloc = dataLength + 4;
+	vm->dataBase = Hunk_Alloc( vm->dataAlloc, h_high );
+	memcpy( vm->dataBase, (byte *)header + header->dataOffset, header->dataLength + header->litLength );
+	for ( i = 0 ; i < header->dataLength ; i += 4 ) {
+		*(int *)( vm->dataBase + i ) = LittleLong( *(int *)( vm->dataBase + i ) );
+	}
+
+	vm->numJumpTableTargets = header->jtrgLength >> 2;
+	vm->jumpTableTargets = Hunk_Alloc( header->jtrgLength + 4, h_high );
+	memcpy( vm->jumpTableTargets, (byte *)header + header->dataOffset + header->dataLength
+		+ header->litLength, header->jtrgLength );
+	for ( i = 0 ; i < header->jtrgLength ; i += 4 ) {
+		*(int *)( vm->jumpTableTargets + i ) = LittleLong( *(int *)( vm->jumpTableTargets + i ) );
+	}
+
+	vm->instructionCount = header->instructionCount;
+	vm->instructionPointers = Hunk_Alloc( vm->instructionCount * sizeof( *vm->instructionPointers ), h_high );
+	vm->codeLength = header->codeLength;
+
+	currentVM = vm;
+	if ( interpret != VMI_BYTECODE ) {
+		vm->compiled = qtrue;
+		vm->optimize = ( interpret == VMI_OPTIMIZED );
+		VM_Compile( vm, header );
+		if ( !vm->compiled || ( interpret == VMI_OPTIMIZED && !vm->optimize ) ) {
+			Com_Error( ERR_FATAL, "%s: no %s code", filename, bench_tierNames[tier] );
+		}
+	} else {
+		VM_PrepareInterpreter( vm, header );
+	}
+
+	vm->programStack = vm->dataMask + 1;
+	vm->stackBottom = vm->programStack - PROGRAM_STACK_SIZE;
+}
+
+/*
+==============================================================================
+
+BENCHMARK
+
+==============================================================================
+*/
+
+static unsigned	bench_seed;
+
+static int Bench_Rand( void ) {
+	bench_seed = bench_seed * 1103515245u + 12345u;
+	return ( bench_seed >> 16 ) & 0x7fff;
+}
+
+// a finite float around zero, NaN results differ between the tiers already
+static int Bench_RandFloat( void ) {
+	floatint_t	fi;
+
+	fi.f = ( Bench_Rand() - 16384 ) / 64.0f;
+	return fi.i;
+}
+
+/*
+==================
+Bench_Run
+
+Calls the module count times with the seeded mix of commands.  Most of the
+time goes to the recursive calls and the memory loops, like in game code.
+==================
+*/
+static void Bench_Run( vm_t *vm, int count, unsigned seed, double *msec, unsigned *checksum ) {
+	int			args[MAX_VMMAIN_ARGS];
+	unsigned	sum;
+	long long	start;
+	int			i;
+
+	currentVM = vm;
+	bench_seed = seed;
+	sum = 0;
+
+	start = Bench_Nanoseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		Com_Memset( args, 0, sizeof( args ) );
+		switch ( Bench_Rand() & 7 ) {
+		case 0:
+		case 1:
+		case 2:
+			args[0] = VMT_CALLS;
+			args[1] = Bench_Rand();
+			args[2] = Bench_Rand();
+			break;
+		case 3:
+		case 4:
+			args[0] = VMT_MEMORY;
+			args[1] = Bench_Rand();
+			args[2] = Bench_Rand();
+			break;
+		case 5:
+			args[0] = VMT_FLOAT;
+			args[1] = Bench_RandFloat();
+			args[2] = Bench_RandFloat() | 0x3f800000;	// keep divisors away from zero
+			args[3] = Bench_Rand();
+			break;
+		case 6:
+			args[0] = VMT_INTEGER;
+			args[1] = Bench_Rand() * 0x10001;
+			args[2] = Bench_Rand();
+			break;
+		default:
+			args[0] = VMT_SYSCALL;
+			args[1] = Bench_Rand();
+			args[2] = Bench_Rand();
+			args[3] = Bench_Rand();
+			break;
+		}
+
+		if ( vm->compiled ) {
+			sum = sum * 31 + VM_CallCompiled( vm, args );
+		} else {
+			sum = sum * 31 + VM_CallInterpreted( vm, args );
+		}
+	}
+
+	*msec = ( Bench_Nanoseconds() - start ) / 1e6;
+	*checksum = sum;
+}
+
+/*
+==================
+Bench_Usage
+==================
+*/
+static void Bench_Usage( void ) {
+	printf( "usage: vmbench [options] <vmtest.qvm>\n"
+		"  -n <count>         calls into the module per tier (default 200000)\n"
+		"  -seed <number>     seed for the command mix (default 1)\n"
+		"  -repeat <count>    run every tier this many times (default 1)\n" );
+	exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+	char		*filename;
+	int			count, repeat, seed;
+	double		msec, best[NUM_TIERS];	// fastest run of each tier
+	unsigned	checksum, checksums[NUM_TIERS];
+	int			i, j;
+
+	filename = NULL;
+	count = 200000;
+	repeat = 1;
+	seed = 1;
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		if ( !strcmp( argv[i], "-n" ) && i + 1 < argc ) {
+			count = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-seed" ) && i + 1 < argc ) {
+			seed = atoi( argv[++i] );
+		} else if ( !strcmp( argv[i], "-repeat" ) && i + 1 < argc ) {
+			repeat = atoi( argv[++i] );
+		} else if ( argv[i][0] == '-' || filename ) {
+			Bench_Usage();
+		} else {
+			filename = argv[i];
+		}
+	}
+	if ( !filename || count <= 0 || repeat <= 0 ) {
+		Bench_Usage();
+	}
+
+	for ( i = 0 ; i < NUM_TIERS ; i++ ) {
+		Bench_LoadQVM( &bench_vms[i], filename, i );
+		best[i] = 0;
+	}
+
+	// every run continues from the data the previous one left behind, so
+	// each repetition has its own checksum, but the same one on every tier
+	Com_Printf( "%-12s %8s %9s %10s %8s  %s\n", "tier", "calls", "total ms", "per sec", "vs vm 0", "checksum" );
+	for ( j = 0 ; j < repeat ; j++ ) {
+		for ( i = 0 ; i < NUM_TIERS ; i++ ) {
+			Bench_Run( &bench_vms[i], count, seed + j, &msec, &checksum );
+			if ( !best[i] || msec < best[i] ) {
+				best[i] = msec;
+			}
+			checksums[i] = checksum;
+			Com_Printf( "%-12s %8i %9.1f %10.0f %7.2fx  %08x\n", bench_tierNames[i], count, msec,
+				count * 1000.0 / msec, best[0] / msec, checksum );
+		}
+		for ( i = 1 ; i < NUM_TIERS ; i++ ) {
+			if ( checksums[i] != checksums[0] ) {
+				Com_Printf( "vmbench: %s checksum %08x differs from %s %08x\n",
+					bench_tierNames[i], checksums[i], bench_tierNames[0], checksums[0] );
+				return 1;
+			}
+		}
+	}
+
+	Com_Printf( "vmbench: optimized %.2fx the speed of compiled\n", best[1] / best[2] );
+	return 0;
+}
@@ -0,0 +1,492 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// null_vmtest.c -- interpreter against qvm2c equivalence test
+//
+// Links only the bytecode interpreter and replaces the rest of the engine
+// with stubs.  Loads vmtest.qvm, built from vmtest_module.c, into the
+// interpreter and the shared object qvm2c made from the same qvm, calls
+// every command of the module on both with the edge cases of its opcodes,
+// and compares the results, the errors and the data segments.  Exits with
+// 1 if anything differs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "../qcommon/vm_local.h"
+
+// commands of vmtest_module.c
+enum {
+	VMT_DIVI,
+	VMT_MODI,
+	VMT_DIVU,
+	VMT_MODU,
+	VMT_CVFI,
+	VMT_CVIF,
+	VMT_FLOAT,
+	VMT_COMPARE,
+	VMT_SHIFT,
+	VMT_INTEGER,
+	VMT_MEMORY,
+	VMT_CALLS,
+	VMT_SYSCALL,
+
+	VMT_NUM_COMMANDS
+};
+
+static const char *test_commandNames[VMT_NUM_COMMANDS] = {
+	"DIVI", "MODI", "DIVU", "MODU", "CVFI", "CVIF", "FLOAT",
+	"COMPARE", "SHIFT", "INTEGER", "MEMORY", "CALLS", "SYSCALL"
+};
+
+typedef intptr_t ( *dllSyscall_t )( intptr_t, ... );
+
+static vm_t		test_vm;
+static intptr_t	( *test_vmMain )( int command, ... );
+static byte		*test_dllData;
+static int		test_dllMask;
+
+static jmp_buf	*test_abort;
+static char		test_error[1024];
+
+static int		test_calls;
+static int		test_failures;
+
+/*
+==============================================================================
+
+ENGINE STUBS
+
+==============================================================================
+*/
+
+vm_t	*currentVM;
+int		vm_debugLevel;
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+// errors of a call are part of its result
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( test_error, sizeof( test_error ), fmt, argptr );
+	va_end( argptr );
+
+	if ( test_abort ) {
+		longjmp( *test_abort, 1 );
+	}
+
+	printf( "ERROR: %s\n", test_error );
+	exit( 1 );
+}
+
+void *Hunk_Alloc( int size, ha_pref preference ) {
+	void	*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Hunk_Alloc failed on %i", size );
+	}
+	return buf;
+}
+
+void VM_BlockCopy( unsigned int dest, unsigned int src, size_t n ) {
+	unsigned int	dataMask = currentVM->dataMask;
+
+	if ( ( dest & dataMask ) != dest || ( src & dataMask ) != src
+		|| ( ( dest + n ) & dataMask ) != dest + n || ( ( src + n ) & dataMask ) != src + n ) {
+		Com_Error( ERR_DROP, "OP_BLOCK_COPY out of range!" );
+	}
+
+	memmove( currentVM->dataBase + dest, currentVM->dataBase + src, n );
+}
+
+void VM_Debug( int level ) {
+}
+
+const char *VM_ValueToSymbol( vm_t *vm, int value ) {
+	static char		text[16];
+
+	Com_sprintf( text, sizeof( text ), "%i", value );
+	return text;
+}
+
+vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value ) {
+	static vmSymbol_t	sym;
+
+	return &sym;
+}
+
+/*
+==============================================================================
+
+MODULES
+
+==============================================================================
+*/
+
+/*
+==================
+Test_Combine
+
+The only syscall of the module, mixes its arguments
+==================
+*/
+static int Test_Combine( int a, int b ) {
+	return a * 31 + ( b ^ 0x5a5a );
+}
+
+static intptr_t Test_InterpretedSyscall( intptr_t *args ) {
+	if ( args[0] != 0 ) {
+		Com_Error( ERR_DROP, "bad syscall %i", (int)args[0] );
+	}
+	return Test_Combine( args[1], args[2] );
+}
+
+static intptr_t QDECL Test_DllSyscall( intptr_t arg, ... ) {
+	va_list		ap;
+	int			a, b;
+
+	va_start( ap, arg );
+	a = va_arg( ap, intptr_t );
+	b = va_arg( ap, intptr_t );
+	va_end( ap );
+
+	if ( arg != 0 ) {
+		Com_Error( ERR_DROP, "bad syscall %i", (int)arg );
+	}
+	return Test_Combine( a, b );
+}
+
+static void Test_DllError( const char *message ) {
+	Com_Error( ERR_DROP, "%s", message );
+}
+
+/*
+==================
+Test_LoadQVM
+
+The part of VM_Create and VM_LoadQVM the interpreter needs
+==================
+*/
+static void Test_LoadQVM( const char *filename ) {
+	vmHeader_t	*header;
+	FILE		*f;
+	long		length;
+	int			dataLength;
+	int			i;
+
+	f = fopen( filename, "rb" );
+	if ( !f ) {
+		Com_Error( ERR_FATAL, "couldn't open %s", filename );
+	}
+	fseek( f, 0, SEEK_END );
+	length = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	header = Hunk_Alloc( length, h_high );
+	if ( fread( header, 1, length, f ) != length ) {
+		Com_Error( ERR_FATAL, "couldn't read %s", filename );
+	}
+	fclose( f );
+
+	for ( i = 0 ; i < sizeof( vmHeader_t ) / 4 ; i++ ) {
+		( (int *)header )[i] = LittleLong( ( (int *)header )[i] );
+	}
+	if ( ( header->vmMagic != VM_MAGIC && header->vmMagic != VM_MAGIC_VER2 )
+		|| header->codeLength <= 0 || header->dataLength < 0 || header->litLength < 0
+		|| header->bssLength < 0 || header->codeOffset + header->codeLength > length
+		|| header->dataOffset + header->dataLength + header->litLength > length ) {
+		Com_Error( ERR_FATAL, "%s is not a qvm", filename );
+	}
+
+	dataLength = header->dataLength + header->litLength + header->bssLength;
+	for ( i = 0 ; dataLength > ( 1 << i ) ; i++ ) {
+	}
+	dataLength = 1 << i;
+
+	Q_strncpyz( test_vm.name, "vmtest", sizeof( test_vm.name ) );
+	test_vm.systemCall = Test_InterpretedSyscall;
+	test_vm.dataMask = dataLength - 1;
+	test_vm.dataAlloc = dataLength + 4;
+	test_vm.dataBase = Hunk_Alloc( test_vm.dataAlloc, h_high );
+	memcpy( test_vm.dataBase, (byte *)header + header->dataOffset, header->dataLength + header->litLength );
+	for ( i = 0 ; i < header->dataLength ; i += 4 ) {
+		*(int *)( test_vm.dataBase + i ) = LittleLong( *(int *)( test_vm.dataBase + i ) );
+	}
+
+	test_vm.instructionCount = header->instructionCount;
+	test_vm.instructionPointers = Hunk_Alloc( test_vm.instructionCount * sizeof( *test_vm.instructionPointers ), h_high );
+	test_vm.codeLength = header->codeLength;
+	VM_PrepareInterpreter( &test_vm, header );
+
+	test_vm.programStack = test_vm.dataMask + 1;
+	test_vm.stackBottom = test_vm.programStack - PROGRAM_STACK_SIZE;
+	currentVM = &test_vm;
+}
+
+/*
+==================
+Test_LoadDll
+==================
+*/
+static void Test_LoadDll( const char *filename ) {
+	void	( *dllEntry )( dllSyscall_t syscallptr );
+	void	( *dllSandbox )( void ( *error )( const char *message ), byte **dataBase, int *dataMask );
+#ifdef _WIN32
+	HMODULE	handle;
+
+	handle = LoadLibraryA( filename );
+#define	Test_DllFunction( name )	(void *)GetProcAddress( handle, name )
+#else
+	void	*handle;
+
+	handle = dlopen( filename, RTLD_NOW | RTLD_LOCAL );
+#define	Test_DllFunction( name )	dlsym( handle, name )
+#endif
+	if ( !handle ) {
+		Com_Error( ERR_FATAL, "couldn't load %s", filename );
+	}
+
+	dllEntry = Test_DllFunction( "dllEntry" );
+	dllSandbox = Test_DllFunction( "dllSandbox" );
+	test_vmMain = Test_DllFunction( "vmMain" );
+	if ( !dllEntry || !dllSandbox || !test_vmMain ) {
+		Com_Error( ERR_FATAL, "%s is not a module translated by qvm2c", filename );
+	}
+
+	dllEntry( Test_DllSyscall );
+	dllSandbox( Test_DllError, &test_dllData, &test_dllMask );
+
+	if ( test_dllMask != test_vm.dataMask ) {
+		Com_Error( ERR_FATAL, "data mask %x of %s doesn't match %x of the qvm", test_dllMask, filename, test_vm.dataMask );
+	}
+}
+
+/*
+==============================================================================
+
+TESTS
+
+==============================================================================
+*/
+
+typedef struct {
+	int			value;
+	qboolean	error;
+	char		message[1024];
+} testResult_t;
+
+/*
+==================
+Test_Call
+==================
+*/
+static void Test_Call( qboolean translated, int *args, testResult_t *result ) {
+	jmp_buf		abort;
+
+	result->value = 0;
+	result->error = qfalse;
+	result->message[0] = 0;
+
+	if ( setjmp( abort ) ) {
+		test_abort = NULL;
+		result->error = qtrue;
+		Q_strncpyz( result->message, test_error, sizeof( result->message ) );
+		return;
+	}
+	test_abort = &abort;
+
+	if ( translated ) {
+		result->value = test_vmMain( args[0], args[1], args[2], args[3], args[4], args[5], args[6],
+			args[7], args[8], args[9], args[10], args[11], args[12] );
+	} else {
+		result->value = VM_CallInterpreted( &test_vm, args );
+	}
+
+	test_abort = NULL;
+}
+
+/*
+==================
+Test_Compare
+
+Runs a command on both modules, the stack above stackBottom is left out of
+the data comparison because the interpreter keeps return addresses there
+==================
+*/
+static void Test_Compare( int command, int a, int b, int c ) {
+	testResult_t	interpreted, translated;
+	int				args[MAX_VMMAIN_ARGS];
+	int				i;
+
+	Com_Memset( args, 0, sizeof( args ) );
+	args[0] = command;
+	args[1] = a;
+	args[2] = b;
+	args[3] = c;
+	args[MAX_VMMAIN_ARGS - 1] = a ^ b;
+
+	Test_Call( qfalse, args, &interpreted );
+	Test_Call( qtrue, args, &translated );
+	test_calls++;
+
+	if ( interpreted.error != translated.error
+		|| ( !interpreted.error && interpreted.value != translated.value ) ) {
+		if ( ++test_failures <= 20 ) {
+			printf( "%s( 0x%08x, 0x%08x, %i ): interpreted %s, translated %s\n",
+				test_commandNames[command], a, b, c,
+				interpreted.error ? interpreted.message : va( "0x%08x", interpreted.value ),
+				translated.error ? translated.message : va( "0x%08x", translated.value ) );
+		}
+		return;
+	}
+
+	for ( i = 0 ; i < test_vm.stackBottom ; i++ ) {
+		if ( test_vm.dataBase[i] != test_dllData[i] ) {
+			if ( ++test_failures <= 20 ) {
+				printf( "%s( 0x%08x, 0x%08x, %i ): data differs at 0x%x\n",
+					test_commandNames[command], a, b, c, i );
+			}
+			return;
+		}
+	}
+}
+
+static int	test_ints[] = {
+	0, 1, -1, 2, -2, 3, -3, 7, -7, 31, 32, 100, -100, 12345, -54321,
+	0x7fff, 0x8000, 0xffff, -65536, 0x40000000, 0x7fffffff, 0x80000001, 0x80000000
+};
+
+static float	test_floats[] = {
+	0.0f, -0.0f, 0.25f, -0.25f, 0.5f, -0.5f, 0.75f, 1.0f, -1.0f, 1.5f, -1.5f, 2.5f, -2.5f,
+	1e-40f, 16777217.0f, 1e9f, -1e9f, 2147483520.0f, -2147483520.0f, 2147483648.0f,
+	-2147483648.0f, -2147483904.0f, 3e9f, -3e9f, 1e30f, -1e30f
+};
+
+/*
+==================
+Test_FloatBits
+
+Values of test_floats followed by infinities and a NaN
+==================
+*/
+static int Test_FloatBits( int index ) {
+	floatint_t	fi;
+
+	if ( index < ARRAY_LEN( test_floats ) ) {
+		fi.f = test_floats[index];
+		return fi.i;
+	}
+	switch ( index - ARRAY_LEN( test_floats ) ) {
+	case 0: return 0x7f800000;		// +inf
+	case 1: return (int)0xff800000;	// -inf
+	default: return 0x7fc00000;		// NaN
+	}
+}
+
+#define	NUM_FLOAT_BITS	( ARRAY_LEN( test_floats ) + 3 )
+
+static qboolean Test_IsNaN( int bits ) {
+	return ( bits & 0x7f800000 ) == 0x7f800000 && ( bits & 0x007fffff );
+}
+
+/*
+==================
+Test_Run
+==================
+*/
+static void Test_Run( void ) {
+	int		command;
+	int		i, j, k;
+
+	for ( command = VMT_DIVI ; command <= VMT_MODU ; command++ ) {
+		for ( i = 0 ; i < ARRAY_LEN( test_ints ) ; i++ ) {
+			for ( j = 0 ; j < ARRAY_LEN( test_ints ) ; j++ ) {
+				Test_Compare( command, test_ints[i], test_ints[j], 0 );
+			}
+		}
+	}
+
+	for ( i = 0 ; i < NUM_FLOAT_BITS ; i++ ) {
+		Test_Compare( VMT_CVFI, Test_FloatBits( i ), 0, 0 );
+	}
+	for ( i = 0 ; i < ARRAY_LEN( test_ints ) ; i++ ) {
+		Test_Compare( VMT_CVFI, test_ints[i], 0, 0 );
+		Test_Compare( VMT_CVIF, test_ints[i], 0, 0 );
+	}
+
+	// comparisons with a NaN are left out, the interpreter is built with
+	// -ffast-math and vm_x86 ignores the parity flag, so they differ already
+	for ( i = 0 ; i < NUM_FLOAT_BITS ; i++ ) {
+		for ( j = 0 ; j < NUM_FLOAT_BITS ; j++ ) {
+			for ( k = 0 ; k < 4 ; k++ ) {
+				Test_Compare( VMT_FLOAT, Test_FloatBits( i ), Test_FloatBits( j ), k );
+			}
+			if ( i < NUM_FLOAT_BITS - 1 && j < NUM_FLOAT_BITS - 1 ) {
+				Test_Compare( VMT_COMPARE, Test_FloatBits( i ), Test_FloatBits( j ), 0 );
+			}
+		}
+	}
+
+	for ( i = 0 ; i < ARRAY_LEN( test_ints ) ; i++ ) {
+		for ( j = 0 ; j < ARRAY_LEN( test_ints ) ; j++ ) {
+			if ( !Test_IsNaN( test_ints[i] ) && !Test_IsNaN( test_ints[j] ) ) {
+				Test_Compare( VMT_COMPARE, test_ints[i], test_ints[j], 0 );
+			}
+			Test_Compare( VMT_INTEGER, test_ints[i], test_ints[j], 0 );
+			Test_Compare( VMT_MEMORY, test_ints[i], test_ints[j], 0 );
+			Test_Compare( VMT_CALLS, test_ints[i], test_ints[j], 0 );
+			Test_Compare( VMT_SYSCALL, test_ints[i], test_ints[j], i - j );
+		}
+		for ( j = 0 ; j < 32 ; j++ ) {
+			Test_Compare( VMT_SHIFT, test_ints[i], j, 0 );
+		}
+	}
+}
+
+int main( int argc, char **argv ) {
+	if ( argc != 3 ) {
+		printf( "usage: vmtest <vmtest.qvm> <translated vmtest module>\n" );
+		return 1;
+	}
+
+	Test_LoadQVM( argv[1] );
+	Test_LoadDll( argv[2] );
+
+	Test_Run();
+
+	printf( "vmtest: %i calls, %i differ\n", test_calls, test_failures );
+	return test_failures ? 1 : 0;
+}
@@ -0,0 +1,394 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// null_zbench.c -- pk3 inflate and crc32 benchmark
+//
+// Links only unzip and zlib and replaces the rest of the engine with stubs.
+// Inflates every file of a pk3 the way the file system reads them and
+// times it, then checks the round trip: every file again with small and
+// odd output chunk sizes, which take the other inffast.c copy paths, must
+// give the same bytes and pass the crc check of unzip.  crc32 over the
+// whole data, which takes the folding path where the cpu has it, must
+// match crc32 fed in pieces too short to fold.  Exits with 1 on any
+// mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../qcommon/q_shared.h"
+#include "../qcommon/qcommon.h"
+#include "../qcommon/unzip.h"
+
+typedef struct {
+	char		name[MAX_QPATH];
+	byte		*data;
+	int			size;
+	int			compressedSize;
+} benchFile_t;
+
+static benchFile_t	*bench_files;
+static int			bench_numFiles;
+static int			bench_failures;
+
+/*
+==============================================================================
+
+ENGINE STUBS
+
+==============================================================================
+*/
+
+void QDECL Com_Printf( const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void QDECL Com_Error( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	printf( "ERROR: " );
+	va_start( argptr, fmt );
+	vprintf( fmt, argptr );
+	va_end( argptr );
+	printf( "\n" );
+
+	exit( 1 );
+}
+
+void *Z_Malloc( int size ) {
+	void	*buf;
+
+	buf = calloc( 1, size );
+	if ( !buf ) {
+		Com_Error( ERR_FATAL, "Z_Malloc failed on %i", size );
+	}
+	return buf;
+}
+
+void Z_Free( void *ptr ) {
+	free( ptr );
+}
+
+static long long Bench_Nanoseconds( void ) {
+#ifdef _WIN32
+	static LARGE_INTEGER	frequency;
+	LARGE_INTEGER			count;
+
+	if ( !frequency.QuadPart ) {
+		QueryPerformanceFrequency( &frequency );
+	}
+	QueryPerformanceCounter( &count );
+	return (long long)( (double)count.QuadPart * 1e9 / frequency.QuadPart );
+#else
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+==============================================================================
+
+INFLATE
+
+==============================================================================
+*/
+
+/*
+==================
+Bench_ReadFile
+
+Reads the current file of the pk3 in chunks of at most chunk bytes, false
+if unzip reports an error or a crc mismatch
+==================
+*/
+static qboolean Bench_ReadFile( unzFile zf, byte *buf, int size, int chunk ) {
+	int		ofs, len;
+
+	if ( unzOpenCurrentFile( zf ) != UNZ_OK ) {
+		return qfalse;
+	}
+
+	for ( ofs = 0 ; ofs < size ; ofs += len ) {
+		len = MIN( chunk, size - ofs );
+		if ( unzReadCurrentFile( zf, buf + ofs, len ) != len ) {
+			unzCloseCurrentFile( zf );
+			return qfalse;
+		}
+	}
+
+	return unzCloseCurrentFile( zf ) == UNZ_OK;
+}
+
+/*
+==================
+Bench_LoadPk3
+
+Inflates every file in one piece, like FS_ReadFile
+==================
+*/
+static void Bench_LoadPk3( const char *filename, double *msec ) {
+	unzFile			zf;
+	unz_global_info	gi;
+	unz_file_info	info;
+	benchFile_t		*file;
+	long long		start;
+	int				err;
+
+	zf = unzOpen( filename );
+	if ( !zf ) {
+		Com_Error( ERR_FATAL, "Couldn't open %s", filename );
+	}
+	if ( unzGetGlobalInfo( zf, &gi ) != UNZ_OK ) {
+		Com_Error( ERR_FATAL, "%s is not a pk3", filename );
+	}
+
+	bench_files = Z_Malloc( ( gi.number_entry + 1 ) * sizeof( *bench_files ) );
+	bench_numFiles = 0;
+	*msec = 0;
+
+	for ( err = unzGoToFirstFile( zf ) ; err == UNZ_OK ; err = unzGoToNextFile( zf ) ) {
+		file = &bench_files[bench_numFiles];
+		if ( unzGetCurrentFileInfo( zf, &info, file->name, sizeof( file->name ), NULL, 0, NULL, 0 ) != UNZ_OK ) {
+			Com_Error( ERR_FATAL, "Couldn't read the directory of %s", filename );
+		}
+		if ( !info.uncompressed_size ) {
+			continue;
+		}
+
+		file->size = info.uncompressed_size;
+		file->compressedSize = info.compressed_size;
+		file->data = Z_Malloc( file->size );
+
+		start = Bench_Nanoseconds();
+		if ( !Bench_ReadFile( zf, file->data, file->size, file->size ) ) {
+			Com_Printf( "%s: inflate or crc check failed\n", file->name );
+			bench_failures++;
+		}
+		*msec += ( Bench_Nanoseconds() - start ) / 1e6;
+
+		bench_numFiles++;
+	}
+
+	unzClose( zf );
+}
+
+/*
+==================
+Bench_Inflate
+
+Times inflating the whole pk3 again and compares the output of every
+chunk size with the first read
+==================
+*/
+static double Bench_Inflate( const char *filename, int chunk ) {
+	unzFile			zf;
+	benchFile_t		*file;
+	byte			*buf;
+	long long		start;
+	double			msec;
+	int				i;
+
+	zf = unzOpen( filename );
+	if ( !zf ) {
+		Com_Error( ERR_FATAL, "Couldn't open %s", filename );
+	}
+
+	msec = 0;
+	for ( i = 0 ; i < bench_numFiles ; i++ ) {
+		file = &bench_files[i];
+		if ( unzLocateFile( zf, file->name, 1 ) != UNZ_OK ) {
+			Com_Error( ERR_FATAL, "Couldn't find %s in %s", file->name, filename );
+		}
+
+		buf = Z_Malloc( file->size );
+		start = Bench_Nanoseconds();
+		if ( !Bench_ReadFile( zf, buf, file->size, chunk ? chunk : file->size ) ) {
+			Com_Printf( "%s: inflate or crc check failed with %i byte reads\n", file->name, chunk );
+			bench_failures++;
+		} else if ( memcmp( buf, file->data, file->size ) ) {
+			Com_Printf( "%s: output differs with %i byte reads\n", file->name, chunk );
+			bench_failures++;
+		}
+		msec += ( Bench_Nanoseconds() - start ) / 1e6;
+		Z_Free( buf );
+	}
+
+	unzClose( zf );
+	return msec;
+}
+
+/*
+==============================================================================
+
+CRC32
+
+==============================================================================
+*/
+
+/*
+==================
+Bench_CrcPieces
+
+crc32 fed in pieces of 1 to 63 bytes, all shorter than the folding path takes
+==================
+*/
+static uLong Bench_CrcPieces( const byte *data, int size, unsigned *seed ) {
+	uLong	crc;
+	int		ofs, len;
+
+	crc = crc32( 0L, Z_NULL, 0 );
+	for ( ofs = 0 ; ofs < size ; ofs += len ) {
+		*seed = *seed * 1103515245u + 12345u;
+		len = MIN( 1 + ( ( *seed >> 16 ) % 63 ), size - ofs );
+		crc = crc32( crc, data + ofs, len );
+	}
+
+	return crc;
+}
+
+/*
+==================
+Bench_Crc
+
+Checks the whole buffer crc of every file, also at every start alignment,
+against the crc of short pieces, and times both
+==================
+*/
+static void Bench_Crc( int repeat ) {
+	benchFile_t		*file;
+	uLong			whole, pieces;
+	long long		start;
+	double			wholeMsec, piecesMsec;
+	double			bytes;
+	unsigned		seed;
+	int				i, j, align;
+
+	seed = 1;
+	wholeMsec = piecesMsec = 0;
+	bytes = 0;
+
+	for ( i = 0 ; i < bench_numFiles ; i++ ) {
+		file = &bench_files[i];
+
+		for ( align = 0 ; align < 16 && align < file->size ; align++ ) {
+			whole = crc32( crc32( 0L, Z_NULL, 0 ), file->data + align, file->size - align );
+			pieces = Bench_CrcPieces( file->data + align, file->size - align, &seed );
+			if ( whole != pieces ) {
+				Com_Printf( "%s: crc32 %08lx of the whole file at offset %i, %08lx in pieces\n",
+					file->name, whole, align, pieces );
+				bench_failures++;
+			}
+		}
+
+		for ( j = 0 ; j < repeat ; j++ ) {
+			start = Bench_Nanoseconds();
+			crc32( crc32( 0L, Z_NULL, 0 ), file->data, file->size );
+			wholeMsec += ( Bench_Nanoseconds() - start ) / 1e6;
+
+			start = Bench_Nanoseconds();
+			Bench_CrcPieces( file->data, file->size, &seed );
+			piecesMsec += ( Bench_Nanoseconds() - start ) / 1e6;
+
+			bytes += file->size;
+		}
+	}
+
+	Com_Printf( "%-24s %9.1f %10.1f\n", "crc32 whole files", wholeMsec, bytes / 1e3 / wholeMsec );
+	Com_Printf( "%-24s %9.1f %10.1f\n", "crc32 in short pieces", piecesMsec, bytes / 1e3 / piecesMsec );
+}
+
+/*
+==================
+Bench_Usage
+==================
+*/
+static void Bench_Usage( void ) {
+	printf( "usage: zbench [options] <file.pk3>\n"
+		"  -repeat <count>    inflate and crc every file this many times (default 5)\n" );
+	exit( 1 );
+}
+
+int main( int argc, char **argv ) {
+	static const int	chunks[] = { 1, 7, 64, 1000, 4096 };
+	char		*filename;
+	double		msec, best, bytes, compressed;
+	int			repeat;
+	int			i, j;
+
+	filename = NULL;
+	repeat = 5;
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		if ( !strcmp( argv[i], "-repeat" ) && i + 1 < argc ) {
+			repeat = atoi( argv[++i] );
+		} else if ( argv[i][0] == '-' || filename ) {
+			Bench_Usage();
+		} else {
+			filename = argv[i];
+		}
+	}
+	if ( !filename || repeat <= 0 ) {
+		Bench_Usage();
+	}
+
+	Bench_LoadPk3( filename, &msec );
+
+	bytes = compressed = 0;
+	for ( i = 0 ; i < bench_numFiles ; i++ ) {
+		bytes += bench_files[i].size;
+		compressed += bench_files[i].compressedSize;
+	}
+	Com_Printf( "%s: %i files, %.0f bytes, %.0f compressed, first read in %.1f ms\n",
+		filename, bench_numFiles, bytes, compressed, msec );
+
+	Com_Printf( "%-24s %9s %10s\n", "workload", "ms", "MB/s" );
+
+	// the best of the whole file reads is the inflate speed
+	best = 0;
+	for ( j = 0 ; j < repeat ; j++ ) {
+		msec = Bench_Inflate( filename, 0 );
+		if ( !j || msec < best ) {
+			best = msec;
+		}
+	}
+	Com_Printf( "%-24s %9.1f %10.1f\n", "inflate whole files", best, bytes / 1e3 / best );
+
+	for ( i = 0 ; i < ARRAY_LEN( chunks ) ; i++ ) {
+		msec = Bench_Inflate( filename, chunks[i] );
+		Com_Printf( "%-24s %9.1f %10.1f\n", va( "inflate %i byte reads", chunks[i] ), msec, bytes / 1e3 / msec );
+	}
+
+	Bench_Crc( repeat );
+
+	Com_Printf( "zbench: %i files, %i failures\n", bench_numFiles, bench_failures );
+	return bench_failures ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vmtest_module.c -- qvm that vmtest runs interpreted and translated by qvm2c
+//
+// Built with q3lcc and q3asm like a game module, without any of the game.
+// Every command exercises a group of opcodes on the arguments, so the
+// caller can feed it the edge cases of each one.
+
+int trap_Combine( int a, int b );
+
+typedef union {
+	int		i;
+	float	f;
+} floatint_t;
+
+typedef struct {
+	int		a, b;
+	short	s[3];
+	char	c[5];
+	int		v[7];
+} block_t;
+
+enum {
+	VMT_DIVI,
+	VMT_MODI,
+	VMT_DIVU,
+	VMT_MODU,
+	VMT_CVFI,
+	VMT_CVIF,
+	VMT_FLOAT,
+	VMT_COMPARE,
+	VMT_SHIFT,
+	VMT_INTEGER,
+	VMT_MEMORY,
+	VMT_CALLS,
+	VMT_SYSCALL
+};
+
+static int Memory( int a, int b );
+static int Calls( int a, int b );
+
+/*
+================
+vmMain
+
+The first function of the qvm
+================
+*/
+int vmMain( int command, int arg0, int arg1, int arg2, int arg3, int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 ) {
+	floatint_t	x, y, r;
+	int			bits;
+
+	switch ( command ) {
+	case VMT_DIVI:
+		return arg0 / arg1;
+	case VMT_MODI:
+		return arg0 % arg1;
+	case VMT_DIVU:
+		return (unsigned)arg0 / (unsigned)arg1;
+	case VMT_MODU:
+		return (unsigned)arg0 % (unsigned)arg1;
+	case VMT_CVFI:
+		x.i = arg0;
+		return (int)x.f;
+	case VMT_CVIF:
+		r.f = (float)arg0;
+		return r.i;
+	case VMT_FLOAT:
+		x.i = arg0;
+		y.i = arg1;
+		switch ( arg2 & 3 ) {
+		case 0: r.f = x.f + y.f; break;
+		case 1: r.f = x.f - y.f; break;
+		case 2: r.f = x.f * y.f; break;
+		default: r.f = -x.f / y.f; break;
+		}
+		return r.i;
+	case VMT_COMPARE:
+		x.i = arg0;
+		y.i = arg1;
+		bits = 0;
+		if ( arg0 == arg1 ) bits |= 1;
+		if ( arg0 != arg1 ) bits |= 2;
+		if ( arg0 < arg1 ) bits |= 4;
+		if ( arg0 <= arg1 ) bits |= 8;
+		if ( arg0 > arg1 ) bits |= 16;
+		if ( arg0 >= arg1 ) bits |= 32;
+		if ( (unsigned)arg0 < (unsigned)arg1 ) bits |= 64;
+		if ( (unsigned)arg0 <= (unsigned)arg1 ) bits |= 128;
+		if ( (unsigned)arg0 > (unsigned)arg1 ) bits |= 256;
+		if ( (unsigned)arg0 >= (unsigned)arg1 ) bits |= 512;
+		if ( x.f == y.f ) bits |= 1024;
+		if ( x.f != y.f ) bits |= 2048;
+		if ( x.f < y.f ) bits |= 4096;
+		if ( x.f <= y.f ) bits |= 8192;
+		if ( x.f > y.f ) bits |= 16384;
+		if ( x.f >= y.f ) bits |= 32768;
+		return bits;
+	case VMT_SHIFT:
+		arg1 &= 31;
+		return ( arg0 << arg1 ) ^ ( arg0 >> arg1 ) ^ (int)( (unsigned)arg0 >> arg1 ) * 3;
+	case VMT_INTEGER:
+		return -arg0 + ( arg0 * arg1 ) - ( ~arg1 & arg0 ) + ( ( arg0 | arg1 ) ^ (int)( (unsigned)arg0 * (unsigned)arg1 ) );
+	case VMT_MEMORY:
+		return Memory( arg0, arg1 );
+	case VMT_CALLS:
+		return Calls( arg0, arg1 );
+	case VMT_SYSCALL:
+		return trap_Combine( arg0, trap_Combine( arg1, arg2 ) ) + arg11;
+	}
+
+	return -1;
+}
+
+static block_t	blocks[4];
+static char		bytes[64];
+static short	shorts[32];
+static int		words[16] = { 1, -1, 0x7fffffff, -2147483647 - 1, 12345, -54321 };
+static const char	*strings[] = { "", "qvm", "translated" };
+
+/*
+================
+Memory
+
+Loads and stores of every size, sign extension and block copies
+================
+*/
+static int Memory( int a, int b ) {
+	block_t	local;
+	int		i, sum;
+
+	for ( i = 0 ; i < 64 ; i++ ) {
+		bytes[i] = (char)( a + i * b );
+	}
+	for ( i = 0 ; i < 32 ; i++ ) {
+		shorts[i] = (short)( a * i - b );
+	}
+
+	local.a = a;
+	local.b = b;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		local.s[i] = shorts[i + ( b & 7 )];
+	}
+	for ( i = 0 ; i < 5 ; i++ ) {
+		local.c[i] = bytes[i + ( a & 15 )];
+	}
+	for ( i = 0 ; i < 7 ; i++ ) {
+		local.v[i] = words[( a + i ) & 15];
+	}
+	blocks[a & 3] = local;
+	blocks[( a + 1 ) & 3] = blocks[a & 3];
+
+	sum = 0;
+	for ( i = 0 ; i < 64 ; i++ ) {
+		sum = sum * 31 + bytes[i] + ( bytes[63 - i] & 0xff );
+	}
+	for ( i = 0 ; i < 32 ; i++ ) {
+		sum = sum * 17 + shorts[i] + ( shorts[31 - i] & 0xffff );
+	}
+	for ( i = 0 ; i < 4 ; i++ ) {
+		sum += blocks[i].a * 3 + blocks[i].b + blocks[i].s[2] + blocks[i].c[4] + blocks[i].v[6];
+	}
+	for ( i = 0 ; strings[b & 1][i] ; i++ ) {
+		sum += strings[2][i] * strings[b & 1][i];
+	}
+	return sum;
+}
+
+static int Add( int a, int b ) { return a + b; }
+static int Sub( int a, int b ) { return a - b; }
+static int Mul( int a, int b ) { return a * b; }
+static int Xor( int a, int b ) { return a ^ b; }
+
+static int ( *operations[4] )( int a, int b ) = { Add, Sub, Mul, Xor };
+
+static int Fib( int n ) {
+	if ( n < 2 ) {
+		return n;
+	}
+	return Fib( n - 1 ) + Fib( n - 2 );
+}
+
+/*
+================
+Calls
+
+Recursion, calls through pointers and a switch that lcc turns into a
+jump table
+================
+*/
+static int Calls( int a, int b ) {
+	int		r;
+
+	r = Fib( a & 15 );
+	r = operations[b & 3]( r, b );
+
+	switch ( a & 15 ) {
+	case 0: r += 11; break;
+	case 1: r -= 7; break;
+	case 2: r *= 5; break;
+	case 3: r ^= 0x5555; break;
+	case 4: r = -r; break;
+	case 5: r += b; break;
+	case 6: r -= b * 2; break;
+	case 7: r |= 0x100; break;
+	case 8: r &= 0xff; break;
+	case 9: r = ~r; break;
+	default: r += 1000; break;
+	}
+	return r;
+}
@@ -0,0 +1,3 @@
+code
+
+equ	trap_Combine			-1
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
 
 #ifdef BSPC
 
@@ -42,16 +43,18 @@ void SetPlaneSignbits (cplane_t *out) {
 #endif //BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
+// some extra indexes along with those needed by the map, one
+// box for each thread slot
+#define	BOX_BRUSHES		CM_MAX_THREADS
+#define	BOX_SIDES		( 6 * CM_MAX_THREADS )
 #define	BOX_LEAFS		2
-#define	BOX_PLANES		12
+#define	BOX_PLANES		( 12 * CM_MAX_THREADS )
 
 #define	LL(x) x=LittleLong(x)
 
 
 clipMap_t	cm;
+Q_THREADLOCAL int	cm_threadSlot;		// index into cm.threads for the calling thread
 int			c_pointcontents;
 int			c_traces, c_brush_traces, c_patch_traces;
 
@@ -62,14 +65,10 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_patchCache;
+cvar_t		*cm_planeHash;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
-
-
-
 void	CM_InitBoxHull (void);
 void	CM_FloodAreaConnections (void);
 
@@ -152,12 +151,13 @@ void CMod_LoadSubmodels( lump_t *l ) {
 			continue;	// world model doesn't need other info
 		}
 
-		// make a "leaf" just to hold the model's brushes and surfaces
+		// make a "leaf" just to hold the model's brushes and surfaces,
+		// the brushes are placed after the world's by CMod_LoadLeafBrushes
 		out->leaf.numLeafBrushes = LittleLong( in->numBrushes );
-		indexes = Hunk_Alloc( out->leaf.numLeafBrushes * 4, h_high );
-		out->leaf.firstLeafBrush = indexes - cm.leafbrushes;
-		for ( j = 0 ; j < out->leaf.numLeafBrushes ; j++ ) {
-			indexes[j] = LittleLong( in->firstBrush ) + j;
+		out->leaf.firstLeafBrush = LittleLong( in->firstBrush );
+		if ( out->leaf.numLeafBrushes < 0 || out->leaf.firstLeafBrush < 0
+			|| out->leaf.firstLeafBrush + out->leaf.numLeafBrushes > cm.numBrushes ) {
+			Com_Error( ERR_DROP, "CMod_LoadSubmodels: bad brushes" );
 		}
 
 		out->leaf.numLeafSurfaces = LittleLong( in->numSurfaces );
@@ -345,30 +345,78 @@ void CMod_LoadPlanes (lump_t *l)
 	}
 }
 
+/*
+=================
+CM_SetLeafBrushBounds
+=================
+*/
+static void CM_SetLeafBrushBounds( int index, int brushnum ) {
+	cLeafBrush_t	*out;
+	cbrush_t		*b;
+	int				i;
+
+	out = &cm.leafBrushBounds[index];
+	b = &cm.brushes[brushnum];
+
+	// exact for any coordinate inside the world
+	for ( i = 0 ; i < 3 ; i++ ) {
+		out->mins[i] = b->bounds[0][i] - SURFACE_CLIP_EPSILON;
+		out->maxs[i] = b->bounds[1][i] + SURFACE_CLIP_EPSILON;
+	}
+	out->contents = b->contents;
+	out->brushNum = brushnum;
+}
+
 /*
 =================
 CMod_LoadLeafBrushes
+
+The submodel leafs get their brushes after the world's, and every
+entry gets a copy of its brush bounds and contents
 =================
 */
 void CMod_LoadLeafBrushes (lump_t *l)
 {
-	int			i;
+	int			i, j;
 	int			*out;
 	int		 	*in;
-	int			count;
+	int			count, total;
+	cLeaf_t		*leaf;
 	
 	in = (void *)(cmod_base + l->fileofs);
 	if (l->filelen % sizeof(*in))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
-	cm.numLeafBrushes = count;
+	total = count;
+	for ( i = 1 ; i < cm.numSubModels ; i++ ) {
+		total += cm.cmodels[i].leaf.numLeafBrushes;
+	}
+
+	cm.leafbrushes = Hunk_Alloc( (total + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafBrushBounds = Hunk_Alloc( (total + BOX_BRUSHES) * sizeof( *cm.leafBrushBounds ), h_high );
+	cm.numLeafBrushes = total;
 
 	out = cm.leafbrushes;
 
 	for ( i=0 ; i<count ; i++, in++, out++) {
 		*out = LittleLong (*in);
+		if ( *out < 0 || *out >= cm.numBrushes ) {
+			Com_Error( ERR_DROP, "CMod_LoadLeafBrushes: bad brush number %i", *out );
+		}
+	}
+
+	// submodel leafs hold their first brush number until now
+	for ( i = 1 ; i < cm.numSubModels ; i++ ) {
+		leaf = &cm.cmodels[i].leaf;
+		for ( j = 0 ; j < leaf->numLeafBrushes ; j++, out++ ) {
+			*out = leaf->firstLeafBrush + j;
+		}
+		leaf->firstLeafBrush = out - leaf->numLeafBrushes - cm.leafbrushes;
+	}
+
+	for ( i = 0 ; i < total ; i++ ) {
+		CM_SetLeafBrushBounds( i, cm.leafbrushes[i] );
 	}
 }
 
@@ -421,6 +469,11 @@ void CMod_LoadBrushSides (lump_t *l)
 	cm.brushsides = Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
 	cm.numBrushSides = count;
 
+	for ( i = 0 ; i < 3 ; i++ ) {
+		cm.sideNormals[i] = Hunk_Alloc( ( BOX_SIDES + count + SIDE_PLANES_PAD ) * sizeof( float ), h_high );
+	}
+	cm.sideDists = Hunk_Alloc( ( BOX_SIDES + count + SIDE_PLANES_PAD ) * sizeof( float ), h_high );
+
 	out = cm.brushsides;	
 
 	for ( i=0 ; i<count ; i++, in++, out++) {
@@ -431,6 +484,11 @@ void CMod_LoadBrushSides (lump_t *l)
 			Com_Error( ERR_DROP, "CMod_LoadBrushSides: bad shaderNum: %i", out->shaderNum );
 		}
 		out->surfaceFlags = cm.shaders[out->shaderNum].surfaceFlags;
+
+		cm.sideNormals[0][i] = out->plane->normal[0];
+		cm.sideNormals[1][i] = out->plane->normal[1];
+		cm.sideNormals[2][i] = out->plane->normal[2];
+		cm.sideDists[i] = out->plane->dist;
 	}
 }
 
@@ -475,13 +533,278 @@ void CMod_LoadVisibility( lump_t *l ) {
 //==================================================================
 
 
+/*
+===============================================================================
+
+PATCH COLLISION CACHE
+
+With cm_patchCache set, the facets and planes built by
+CM_GeneratePatchCollide are written to patchcache/<map>-<checksum>-<arch>.pcc
+under the home path, and read back on later loads of the same bsp instead of
+subdividing and bevelling every patch again.  The floats depend on the
+compiler and its flags, so a file is only used by the build that wrote it.
+All values are stored as little endian 32 bit words, and each facet only
+stores the borders it uses.
+
+===============================================================================
+*/
+
+#define	PATCHCACHE_IDENT		(('C'<<24)+('C'<<16)+('P'<<8)+'P')	// "PPCC"
+#define	PATCHCACHE_VERSION		2	// bump when CM_GeneratePatchCollide output changes
+
+#define	PATCHCACHE_HEADER_WORDS	6	// ident, version, build, checksum, numSurfaces, numPatches
+
+// the build that wrote the file
+#ifdef __VERSION__
+#define	PATCHCACHE_BUILD		ARCH_STRING " " Q3_VERSION " " __VERSION__
+#else
+#define	PATCHCACHE_BUILD		ARCH_STRING " " Q3_VERSION
+#endif
+#define	PATCHCACHE_PATCH_WORDS	9	// surfaceNum, bounds[2][3], numPlanes, numFacets
+
+#ifndef BSPC
+/*
+=================
+CM_PatchCachePath
+=================
+*/
+static void CM_PatchCachePath( const char *name, unsigned checksum, char *path, int size ) {
+	char	base[MAX_QPATH];
+
+	COM_StripExtension( COM_SkipPath( (char *)name ), base, sizeof( base ) );
+	Com_sprintf( path, size, "patchcache/%s-%08x-%s.pcc", base, checksum, ARCH_STRING );
+}
+
+/*
+=================
+CM_PatchCacheBuild
+=================
+*/
+static int CM_PatchCacheBuild( void ) {
+	return Com_BlockChecksum( PATCHCACHE_BUILD, strlen( PATCHCACHE_BUILD ) );
+}
+
+/*
+=================
+CM_ReadCacheWords
+
+Reads and byte swaps numWords words, returns qfalse on a short read
+=================
+*/
+static qboolean CM_ReadCacheWords( fileHandle_t f, void *data, int numWords ) {
+	int		*words;
+	int		i;
+
+	if ( FS_Read( data, numWords * 4, f ) != numWords * 4 ) {
+		return qfalse;
+	}
+
+	words = (int *)data;
+	for ( i = 0 ; i < numWords ; i++ ) {
+		words[i] = LittleLong( words[i] );
+	}
+	return qtrue;
+}
+
+/*
+=================
+CM_WriteCacheWords
+=================
+*/
+static void CM_WriteCacheWords( fileHandle_t f, const void *data, int numWords ) {
+	int			buffer[256];
+	const int	*words;
+	int			i, c;
+
+	words = (const int *)data;
+	while ( numWords > 0 ) {
+		c = numWords > ARRAY_LEN( buffer ) ? ARRAY_LEN( buffer ) : numWords;
+		for ( i = 0 ; i < c ; i++ ) {
+			buffer[i] = LittleLong( words[i] );
+		}
+		FS_Write( buffer, c * 4, f );
+		words += c;
+		numWords -= c;
+	}
+}
+
+/*
+=================
+CM_OpenPatchCache
+
+Returns a handle positioned at the first patch, or 0 if there is no
+usable cache for this bsp
+=================
+*/
+static fileHandle_t CM_OpenPatchCache( const char *path, unsigned checksum, int numPatches ) {
+	fileHandle_t	f;
+	int				header[PATCHCACHE_HEADER_WORDS];
+
+	if ( FS_SV_FOpenFileRead( path, &f ) < 0 || !f ) {
+		return 0;
+	}
+
+	if ( !CM_ReadCacheWords( f, header, PATCHCACHE_HEADER_WORDS )
+		|| header[0] != PATCHCACHE_IDENT || header[1] != PATCHCACHE_VERSION
+		|| header[2] != CM_PatchCacheBuild() || (unsigned)header[3] != checksum
+		|| header[4] != cm.numSurfaces || header[5] != numPatches ) {
+		Com_DPrintf( "CM_OpenPatchCache: %s is stale\n", path );
+		FS_FCloseFile( f );
+		return 0;
+	}
+
+	return f;
+}
+
+/*
+=================
+CM_ReadCachedPatchFacets
+
+Reads the planes and facets of a record into pc, returns qfalse if they
+are cut short or any index is out of range
+=================
+*/
+static qboolean CM_ReadCachedPatchFacets( fileHandle_t f, patchCollide_t *pc ) {
+	facet_t			*facet;
+	int				i, j;
+
+	if ( !CM_ReadCacheWords( f, pc->planes, pc->numPlanes * sizeof( *pc->planes ) / 4 ) ) {
+		return qfalse;
+	}
+	for ( i = 0 ; i < pc->numPlanes ; i++ ) {
+		if ( pc->planes[i].signbits & ~7 ) {
+			return qfalse;
+		}
+	}
+
+	// facets only store the borders in use, and the indexes aren't trusted
+	for ( i = 0, facet = pc->facets ; i < pc->numFacets ; i++, facet++ ) {
+		if ( !CM_ReadCacheWords( f, &facet->surfacePlane, 2 )
+			|| facet->surfacePlane < 0 || facet->surfacePlane >= pc->numPlanes
+			|| facet->numBorders < 0 || facet->numBorders > ARRAY_LEN( facet->borderPlanes ) ) {
+			return qfalse;
+		}
+		if ( !CM_ReadCacheWords( f, facet->borderPlanes, facet->numBorders )
+			|| !CM_ReadCacheWords( f, facet->borderInward, facet->numBorders )
+			|| !CM_ReadCacheWords( f, facet->borderNoAdjust, facet->numBorders ) ) {
+			return qfalse;
+		}
+		for ( j = 0 ; j < facet->numBorders ; j++ ) {
+			if ( facet->borderPlanes[j] < 0 || facet->borderPlanes[j] >= pc->numPlanes ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CM_ReadCachedPatchCollide
+
+Loads the collision data for surface surfaceNum, or returns NULL if
+the cache doesn't hold a valid record for it.  The record is read into
+temp memory and only copied to the hunk once all of it checked out.
+=================
+*/
+static patchCollide_t *CM_ReadCachedPatchCollide( fileHandle_t f, int surfaceNum ) {
+	patchCollide_t	temp, *pc;
+	int				header[PATCHCACHE_PATCH_WORDS];
+	int				planesSize, facetsSize;
+	qboolean		valid;
+
+	if ( !CM_ReadCacheWords( f, header, PATCHCACHE_PATCH_WORDS ) ) {
+		return NULL;
+	}
+
+	temp.numPlanes = header[7];
+	temp.numFacets = header[8];
+	if ( header[0] != surfaceNum || temp.numPlanes < 0 || temp.numPlanes > MAX_PATCH_PLANES
+		|| temp.numFacets < 0 || temp.numFacets > MAX_FACETS ) {
+		return NULL;
+	}
+	Com_Memcpy( temp.bounds, &header[1], sizeof( temp.bounds ) );
+
+	planesSize = temp.numPlanes * sizeof( *temp.planes );
+	facetsSize = temp.numFacets * sizeof( *temp.facets );
+	temp.planes = Hunk_AllocateTempMemory( planesSize + facetsSize );
+	temp.facets = (facet_t *)( (byte *)temp.planes + planesSize );
+
+	valid = CM_ReadCachedPatchFacets( f, &temp );
+	if ( valid ) {
+		pc = Hunk_Alloc( sizeof( *pc ), h_high );
+		*pc = temp;
+		pc->planes = Hunk_Alloc( planesSize, h_high );
+		pc->facets = Hunk_Alloc( facetsSize, h_high );
+		Com_Memcpy( pc->planes, temp.planes, planesSize );
+		Com_Memcpy( pc->facets, temp.facets, facetsSize );
+	}
+
+	Hunk_FreeTempMemory( temp.planes );
+
+	return valid ? pc : NULL;
+}
+
+/*
+=================
+CM_WritePatchCache
+=================
+*/
+static void CM_WritePatchCache( const char *path, unsigned checksum, int numPatches ) {
+	fileHandle_t	f;
+	patchCollide_t	*pc;
+	facet_t			*facet;
+	int				header[PATCHCACHE_HEADER_WORDS];
+	int				patchHeader[PATCHCACHE_PATCH_WORDS];
+	int				i, j;
+
+	f = FS_SV_FOpenFileWrite( path );
+	if ( !f ) {
+		Com_Printf( "WARNING: couldn't write %s\n", path );
+		return;
+	}
+
+	header[0] = PATCHCACHE_IDENT;
+	header[1] = PATCHCACHE_VERSION;
+	header[2] = CM_PatchCacheBuild();
+	header[3] = checksum;
+	header[4] = cm.numSurfaces;
+	header[5] = numPatches;
+	CM_WriteCacheWords( f, header, PATCHCACHE_HEADER_WORDS );
+
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( !cm.surfaces[i] ) {
+			continue;
+		}
+		pc = cm.surfaces[i]->pc;
+
+		patchHeader[0] = i;
+		Com_Memcpy( &patchHeader[1], pc->bounds, sizeof( pc->bounds ) );
+		patchHeader[7] = pc->numPlanes;
+		patchHeader[8] = pc->numFacets;
+		CM_WriteCacheWords( f, patchHeader, PATCHCACHE_PATCH_WORDS );
+		CM_WriteCacheWords( f, pc->planes, pc->numPlanes * sizeof( *pc->planes ) / 4 );
+		for ( j = 0, facet = pc->facets ; j < pc->numFacets ; j++, facet++ ) {
+			CM_WriteCacheWords( f, &facet->surfacePlane, 2 );
+			CM_WriteCacheWords( f, facet->borderPlanes, facet->numBorders );
+			CM_WriteCacheWords( f, facet->borderInward, facet->numBorders );
+			CM_WriteCacheWords( f, facet->borderNoAdjust, facet->numBorders );
+		}
+	}
+
+	FS_FCloseFile( f );
+	Com_DPrintf( "wrote %s\n", path );
+}
+#endif
+
 /*
 =================
 CMod_LoadPatches
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( const char *name, unsigned checksum, lump_t *surfs, lump_t *verts ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
@@ -491,6 +814,12 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	vec3_t		points[MAX_PATCH_VERTS];
 	int			width, height;
 	int			shaderNum;
+	int			numPatches;
+#ifndef BSPC
+	char		cachePath[MAX_QPATH];
+	fileHandle_t	cache;
+	qboolean	rewrite;
+#endif
 
 	in = (void *)(cmod_base + surfs->fileofs);
 	if (surfs->filelen % sizeof(*in))
@@ -502,6 +831,23 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	if (verts->filelen % sizeof(*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+	numPatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) == MST_PATCH ) {
+			numPatches++;
+		}
+	}
+
+#ifndef BSPC
+	cache = 0;
+	rewrite = qfalse;
+	CM_PatchCachePath( name, checksum, cachePath, sizeof( cachePath ) );
+	if ( cm_patchCache->integer && numPatches ) {
+		cache = CM_OpenPatchCache( cachePath, checksum, numPatches );
+		rewrite = !cache;
+	}
+#endif
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
 	for ( i = 0 ; i < count ; i++, in++ ) {
@@ -512,6 +858,24 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 
 		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
 
+		shaderNum = LittleLong( in->shaderNum );
+		patch->contents = cm.shaders[shaderNum].contentFlags;
+		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
+
+#ifndef BSPC
+		if ( cache ) {
+			patch->pc = CM_ReadCachedPatchCollide( cache, i );
+			if ( patch->pc ) {
+				continue;
+			}
+			// regenerate the rest and replace the file
+			Com_Printf( "WARNING: %s is corrupt\n", cachePath );
+			FS_FCloseFile( cache );
+			cache = 0;
+			rewrite = qtrue;
+		}
+#endif
+
 		// load the full drawverts onto the stack
 		width = LittleLong( in->patchWidth );
 		height = LittleLong( in->patchHeight );
@@ -527,13 +891,18 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 			points[j][2] = LittleFloat( dv_p->xyz[2] );
 		}
 
-		shaderNum = LittleLong( in->shaderNum );
-		patch->contents = cm.shaders[shaderNum].contentFlags;
-		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
-
 		// create the internal facet structure
 		patch->pc = CM_GeneratePatchCollide( width, height, points );
 	}
+
+#ifndef BSPC
+	if ( cache ) {
+		FS_FCloseFile( cache );
+	}
+	if ( rewrite ) {
+		CM_WritePatchCache( cachePath, checksum, numPatches );
+	}
+#endif
 }
 
 //==================================================================
@@ -584,6 +953,8 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_patchCache = Cvar_Get ("cm_patchCache", "0", CVAR_ARCHIVE);
+	cm_planeHash = Cvar_Get ("cm_planeHash", "1", CVAR_CHEAT);
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -593,6 +964,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	}
 
 	// free old stuff
+	CM_FreeThreads();
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 
@@ -636,16 +1008,23 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load into heap
 	CMod_LoadShaders( &header.lumps[LUMP_SHADERS] );
 	CMod_LoadLeafs (&header.lumps[LUMP_LEAFS]);
-	CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES]);
 	CMod_LoadLeafSurfaces (&header.lumps[LUMP_LEAFSURFACES]);
 	CMod_LoadPlanes (&header.lumps[LUMP_PLANES]);
 	CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES]);
 	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
 	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
+	CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES]);	// needs the brushes and submodels
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadPatches( name, last_checksum, &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+
+	// marks for queries from the main thread
+	cm.threads[0].brushChecks = Hunk_Alloc( ( cm.numBrushes + BOX_BRUSHES ) * sizeof( int ), h_high );
+	cm.threads[0].patchChecks = Hunk_Alloc( cm.numSurfaces * sizeof( int ), h_high );
+	cm.threads[0].brushRays = Hunk_Alloc( ( cm.numBrushes + BOX_BRUSHES ) * sizeof( unsigned ), h_high );
+	cm.threads[0].patchRays = Hunk_Alloc( cm.numSurfaces * sizeof( unsigned ), h_high );
+	cm.numThreads = 1;
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf.v);
@@ -666,10 +1045,86 @@ CM_ClearMap
 ==================
 */
 void CM_ClearMap( void ) {
+	CM_FreeThreads();
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 }
 
+/*
+==================
+CM_ReserveThreads
+
+Allocates marks for thread slots 1 to count-1 of the current map
+==================
+*/
+void CM_ReserveThreads( int count ) {
+	cmThread_t	*thread;
+
+	if ( count > CM_MAX_THREADS ) {
+		Com_Error( ERR_DROP, "CM_ReserveThreads: %i > CM_MAX_THREADS", count );
+	}
+	if ( !cm.numThreads ) {
+		return;		// no map loaded
+	}
+
+	for ( ; cm.numThreads < count ; cm.numThreads++ ) {
+		thread = &cm.threads[cm.numThreads];
+		thread->checkcount = 0;
+		thread->brushChecks = Z_Malloc( ( cm.numBrushes + BOX_BRUSHES ) * sizeof( int ) );
+		thread->patchChecks = Z_Malloc( cm.numSurfaces * sizeof( int ) );
+		thread->brushRays = Z_Malloc( ( cm.numBrushes + BOX_BRUSHES ) * sizeof( unsigned ) );
+		thread->patchRays = Z_Malloc( cm.numSurfaces * sizeof( unsigned ) );
+	}
+}
+
+/*
+==================
+CM_SetThreadSlot
+
+Called once from each thread that runs queries
+==================
+*/
+void CM_SetThreadSlot( int slot ) {
+	if ( slot < 0 || slot >= CM_MAX_THREADS ) {
+		Com_Error( ERR_FATAL, "CM_SetThreadSlot: bad slot %i", slot );
+	}
+	cm_threadSlot = slot;
+}
+
+/*
+==================
+CM_BeginQuery
+
+Starts a new checkcount for the calling thread
+==================
+*/
+cmThread_t *CM_BeginQuery( void ) {
+	cmThread_t	*thread;
+
+	thread = &cm.threads[cm_threadSlot];
+	thread->checkcount++;
+
+	return thread;
+}
+
+/*
+==================
+CM_FreeThreads
+==================
+*/
+void CM_FreeThreads( void ) {
+	int		i;
+
+	// slot 0 is on the hunk
+	for ( i = 1 ; i < cm.numThreads ; i++ ) {
+		Z_Free( cm.threads[i].brushChecks );
+		Z_Free( cm.threads[i].patchChecks );
+		Z_Free( cm.threads[i].brushRays );
+		Z_Free( cm.threads[i].patchRays );
+	}
+	cm.numThreads = 0;
+}
+
 /*
 ==================
 CM_ClipHandleToModel
@@ -683,7 +1138,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &cm.threads[cm_threadSlot].boxModel;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -746,47 +1201,58 @@ can just be stored out and get a proper clipping hull structure.
 */
 void CM_InitBoxHull (void)
 {
-	int			i;
+	int			i, t;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	cmThread_t	*thread;
 
-	box_planes = &cm.planes[cm.numPlanes];
-
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
-
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+	for ( t = 0 ; t < CM_MAX_THREADS ; t++ ) {
+		thread = &cm.threads[t];
 
-	for (i=0 ; i<6 ; i++)
-	{
-		side = i&1;
-
-		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
-		s->surfaceFlags = 0;
+		thread->boxPlanes = &cm.planes[cm.numPlanes + t*12];
+		thread->boxSides = cm.numBrushSides + t*6;
 
-		// planes
-		p = &box_planes[i*2];
-		p->type = i>>1;
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = 1;
+		thread->boxBrush = &cm.brushes[cm.numBrushes + t];
+		thread->boxBrush->numsides = 6;
+		thread->boxBrush->sides = cm.brushsides + thread->boxSides;
+		thread->boxBrush->contents = CONTENTS_BODY;
 
-		p = &box_planes[i*2+1];
-		p->type = 3 + (i>>1);
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = -1;
+		thread->boxModel.leaf.numLeafBrushes = 1;
+		thread->boxModel.leaf.firstLeafBrush = cm.numLeafBrushes + t;
+		cm.leafbrushes[cm.numLeafBrushes + t] = cm.numBrushes + t;
+		CM_SetLeafBrushBounds( cm.numLeafBrushes + t, cm.numBrushes + t );
 
-		SetPlaneSignbits( p );
-	}	
+		for (i=0 ; i<6 ; i++)
+		{
+			side = i&1;
+
+			// brush sides
+			s = &cm.brushsides[thread->boxSides+i];
+			s->plane = 	thread->boxPlanes + (i*2+side);
+			s->surfaceFlags = 0;
+
+			// planes
+			p = &thread->boxPlanes[i*2];
+			p->type = i>>1;
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = 1;
+
+			p = &thread->boxPlanes[i*2+1];
+			p->type = 3 + (i>>1);
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = -1;
+
+			SetPlaneSignbits( p );
+
+			// the distances are set by CM_TempBoxModel
+			cm.sideNormals[0][thread->boxSides+i] = s->plane->normal[0];
+			cm.sideNormals[1][thread->boxSides+i] = s->plane->normal[1];
+			cm.sideNormals[2][thread->boxSides+i] = s->plane->normal[2];
+		}
+	}
 }
 
 /*
@@ -796,32 +1262,44 @@ CM_TempBoxModel
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 Capsules are handled differently though.
+The box belongs to the calling thread's slot.
 ===================
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	int			i;
+	cmThread_t	*thread;
+	cplane_t	*planes;
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	thread = &cm.threads[cm_threadSlot];
+
+	VectorCopy( mins, thread->boxModel.mins );
+	VectorCopy( maxs, thread->boxModel.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	planes = thread->boxPlanes;
+	planes[0].dist = maxs[0];
+	planes[1].dist = -maxs[0];
+	planes[2].dist = mins[0];
+	planes[3].dist = -mins[0];
+	planes[4].dist = maxs[1];
+	planes[5].dist = -maxs[1];
+	planes[6].dist = mins[1];
+	planes[7].dist = -mins[1];
+	planes[8].dist = maxs[2];
+	planes[9].dist = -maxs[2];
+	planes[10].dist = mins[2];
+	planes[11].dist = -mins[2];
+
+	for ( i = 0 ; i < 6 ; i++ ) {
+		cm.sideDists[thread->boxSides+i] = thread->boxBrush->sides[i].plane->dist;
+	}
+
+	VectorCopy( mins, thread->boxBrush->bounds[0] );
+	VectorCopy( maxs, thread->boxBrush->bounds[1] );
+	CM_SetLeafBrushBounds( thread->boxModel.leaf.firstLeafBrush, thread->boxBrush - cm.brushes );
 
 	return BOX_MODEL_HANDLE;
 }
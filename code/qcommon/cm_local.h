@@ -45,6 +45,16 @@ typedef struct {
 	int			numLeafSurfaces;
 } cLeaf_t;
 
+// bounds and contents of the brush of a leafbrushes entry, stored in
+// leafbrushes order so the brushes of a leaf can be rejected without
+// touching their cbrush_t
+typedef struct {
+	vec3_t		mins;		// brush bounds spread by SURFACE_CLIP_EPSILON
+	int			contents;
+	vec3_t		maxs;
+	int			brushNum;
+} cLeafBrush_t;
+
 typedef struct cmodel_s {
 	vec3_t		mins, maxs;
 	cLeaf_t		leaf;			// submodels don't reference the main tree
@@ -62,12 +72,10 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -79,6 +87,25 @@ typedef struct {
 	int			floodvalid;
 } cArea_t;
 
+// per thread query state, a query stamps each brush and patch it tests
+// with its own checkcount so it is only tested once even if it is in
+// several leafs, without queries on other threads seeing the stamps
+typedef struct {
+	int			checkcount;		// incremented on each query
+	int			*brushChecks;	// [numBrushes + BOX_BRUSHES]
+	int			*patchChecks;	// [numSurfaces]
+	unsigned	*brushRays;		// [numBrushes + BOX_BRUSHES] batch rays that tested it
+	unsigned	*patchRays;		// [numSurfaces]
+
+	// every slot has its own box for CM_TempBoxModel
+	cmodel_t	boxModel;
+	cplane_t	*boxPlanes;
+	cbrush_t	*boxBrush;
+	int			boxSides;		// index of the first box side
+} cmThread_t;
+
+#define	CM_MAX_BATCH_RAYS	32	// one bit per ray in brushRays / patchRays
+
 typedef struct {
 	char		name[MAX_QPATH];
 
@@ -87,6 +114,8 @@ typedef struct {
 
 	int			numBrushSides;
 	cbrushside_t *brushsides;
+	float		*sideNormals[3];	// brush side planes split by component so
+	float		*sideDists;			// four sides can be tested at once
 
 	int			numPlanes;
 	cplane_t	*planes;
@@ -97,8 +126,9 @@ typedef struct {
 	int			numLeafs;
 	cLeaf_t		*leafs;
 
-	int			numLeafBrushes;
+	int			numLeafBrushes;	// world leafs, then the submodels
 	int			*leafbrushes;
+	cLeafBrush_t	*leafBrushBounds;	// [numLeafBrushes + BOX_BRUSHES]
 
 	int			numLeafSurfaces;
 	int			*leafsurfaces;
@@ -125,7 +155,9 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+
+	int			numThreads;				// slots with check arrays for this map
+	cmThread_t	threads[CM_MAX_THREADS];	// slot 0 is the main thread
 } clipMap_t;
 
 
@@ -133,12 +165,18 @@ typedef struct {
 // and to avoid various numeric issues
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
+// the side plane arrays have this many extra entries so four sides can be
+// loaded starting at any side of a brush
+#define	SIDE_PLANES_PAD		3
+
 extern	clipMap_t	cm;
+extern	Q_THREADLOCAL int	cm_threadSlot;
 extern	int			c_pointcontents;
 extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_planeHash;
 
 // cm_test.c
 
@@ -164,6 +202,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmThread_t	*thread;	// checkcount and marks of the calling thread
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -174,6 +213,7 @@ typedef struct leafList_s {
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
+	cmThread_t	*thread;	// for storeLeafs callbacks that test brushes
 } leafList_t;
 
 
@@ -184,6 +224,8 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum );
 
 void CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
+cmThread_t	*CM_BeginQuery( void );
+void		CM_FreeThreads( void );
 cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
 qboolean CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
@@ -484,18 +484,49 @@ void CM_SnapVector(vec3_t normal) {
 
 /*
 ==================
-CM_FindPlane2
+CM_PlaneHashKey
+
+Planes that CM_PlaneEqual could match, in either direction, are at most
+one cell apart in both the absolute normal x and the absolute distance
 ==================
 */
-int CM_FindPlane2(float plane[4], int *flipped) {
-	int i;
+#define	PLANE_HASH_SIZE		1024
+#define	PLANE_HASH_NORMAL	( 2 * NORMAL_EPSILON )	// cell sizes, twice the epsilon to stay
+#define	PLANE_HASH_DIST		( 2 * DIST_EPSILON )	// clear of rounding at cell borders
 
-	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if (CM_PlaneEqual(&planes[i], plane, flipped)) return i;
-	}
+static	int				planeHashTable[PLANE_HASH_SIZE];	// first plane + 1, 0 for empty
+static	int				planeHashChain[MAX_PATCH_PLANES];
+
+static int CM_PlaneHashKey( int normalCell, int distCell ) {
+	return ( ( normalCell * 73856093 ) ^ ( distCell * 19349663 ) ) & ( PLANE_HASH_SIZE - 1 );
+}
+
+static int CM_PlaneNormalCell( const float *plane ) {
+	return (int)floor( fabs( plane[0] ) / PLANE_HASH_NORMAL );
+}
+
+static int CM_PlaneDistCell( const float *plane ) {
+	return (int)floor( fabs( plane[3] ) / PLANE_HASH_DIST );
+}
+
+/*
+==================
+CM_ClearPlanes
+==================
+*/
+static void CM_ClearPlanes( void ) {
+	numPlanes = 0;
+	Com_Memset( planeHashTable, 0, sizeof( planeHashTable ) );
+}
+
+/*
+==================
+CM_AddPlane
+==================
+*/
+static int CM_AddPlane( float plane[4] ) {
+	int		key;
 
-	// add a new plane
 	if ( numPlanes == MAX_PATCH_PLANES ) {
 		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
 	}
@@ -503,11 +534,68 @@ int CM_FindPlane2(float plane[4], int *flipped) {
 	Vector4Copy( plane, planes[numPlanes].plane );
 	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
 
+	key = CM_PlaneHashKey( CM_PlaneNormalCell( plane ), CM_PlaneDistCell( plane ) );
+	planeHashChain[numPlanes] = planeHashTable[key];
+	planeHashTable[key] = numPlanes + 1;
+
 	numPlanes++;
 
+	return numPlanes-1;
+}
+
+/*
+==================
+CM_FindPlane2
+
+Returns the lowest numbered plane that CM_PlaneEqual accepts, the same
+one a linear search would find, cm_planeHash 0 searches linearly so
+cmbench -patchplanes can compare the two
+==================
+*/
+int CM_FindPlane2(float plane[4], int *flipped) {
+	int		normalCell, distCell;
+	int		i, j, k;
+	int		best, bestFlipped, f;
+
+#ifndef BSPC
+	if ( !cm_planeHash->integer ) {
+		for ( i = 0 ; i < numPlanes ; i++ ) {
+			if ( CM_PlaneEqual( &planes[i], plane, flipped ) ) {
+				return i;
+			}
+		}
+
+		*flipped = qfalse;
+
+		return CM_AddPlane( plane );
+	}
+#endif
+
+	normalCell = CM_PlaneNormalCell( plane );
+	distCell = CM_PlaneDistCell( plane );
+
+	// see if the points are close enough to an existing plane
+	best = numPlanes;
+	bestFlipped = qfalse;
+	for ( i = -1 ; i <= 1 ; i++ ) {
+		for ( j = -1 ; j <= 1 ; j++ ) {
+			for ( k = planeHashTable[CM_PlaneHashKey( normalCell + i, distCell + j )] - 1 ; k >= 0 ; k = planeHashChain[k] - 1 ) {
+				if ( k < best && CM_PlaneEqual( &planes[k], plane, &f ) ) {
+					best = k;
+					bestFlipped = f;
+				}
+			}
+		}
+	}
+	if ( best < numPlanes ) {
+		*flipped = bestFlipped;
+		return best;
+	}
+
+	// add a new plane
 	*flipped = qfalse;
 
-	return numPlanes-1;
+	return CM_AddPlane( plane );
 }
 
 /*
@@ -550,16 +638,7 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 	}
 
 	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
-	}
-
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
-
-	numPlanes++;
-
-	return numPlanes-1;
+	return CM_AddPlane( plane );
 }
 
 /*
@@ -1013,7 +1092,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 	int				borders[4];
 	int				noAdjust[4];
 
-	numPlanes = 0;
+	CM_ClearPlanes();
 	numFacets = 0;
 
 	// find the planes for each triangle of the grid
@@ -1325,10 +1404,11 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
+			// only the main thread updates the debug surface
+			if ( !cm_threadSlot && !cv ) {
 				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 			}
-			if (cv->integer) {
+			if ( !cm_threadSlot && cv->integer ) {
 				debugPatchCollide = pc;
 				debugFacet = facet;
 			}
@@ -1512,10 +1592,11 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if (!cv) {
+				// only the main thread updates the debug surface
+				if ( !cm_threadSlot && !cv ) {
 					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 				}
-				if (cv && cv->integer) {
+				if ( !cm_threadSlot && cv && cv->integer ) {
 					debugPatchCollide = pc;
 					debugFacet = facet;
 				}
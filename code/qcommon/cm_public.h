@@ -25,6 +25,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 void		CM_LoadMap( const char *name, qboolean clientload, int *checksum);
 void		CM_ClearMap( void );
+
+// traces, box queries and position tests may run on several threads at
+// once if each thread uses its own slot, slot 0 is the main thread.
+// CM_ReserveThreads must be called on the main thread after each map load
+// before other slots are used.  Each slot has its own CM_TempBoxModel.
+#define		CM_MAX_THREADS	16
+void		CM_ReserveThreads( int count );
+void		CM_SetThreadSlot( int slot );
 clipHandle_t CM_InlineModel( int index );		// 0 = world, 1 + are bmodels
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule );
 
@@ -45,6 +53,10 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule );
+// rays that share mins, maxs, model, brushmask and capsule, the results are
+// the same as a CM_BoxTrace for each ray but the world tree is walked once
+void		CM_TraceBatch( trace_t *results, const vec3_t *starts, const vec3_t *ends, int numTraces,
+						  vec3_t mins, vec3_t maxs, clipHandle_t model, int brushmask, int capsule );
 
 byte		*CM_ClusterPVS (int cluster);
 
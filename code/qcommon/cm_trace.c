@@ -21,6 +21,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#if idx64
+#include <xmmintrin.h>
+// test four brush sides at a time, every x86_64 cpu has SSE
+#define CM_SSE_PLANES
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -145,6 +151,116 @@ float SquareRootFloat(float number) {
 }
 
 
+#ifdef CM_SSE_PLANES
+/*
+===============================================================================
+
+SSE PLANE TESTS
+
+===============================================================================
+*/
+
+// trace values broadcast to all four lanes
+typedef struct {
+	__m128		start[3];
+	__m128		end[3];
+	__m128		size[2][3];
+} sideTestWork_t;
+
+/*
+================
+CM_SetupSideTest
+================
+*/
+static void CM_SetupSideTest( const traceWork_t *tw, sideTestWork_t *sw ) {
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		sw->start[i] = _mm_set1_ps( tw->start[i] );
+		sw->end[i] = _mm_set1_ps( tw->end[i] );
+		sw->size[0][i] = _mm_set1_ps( tw->size[0][i] );
+		sw->size[1][i] = _mm_set1_ps( tw->size[1][i] );
+	}
+}
+
+/*
+================
+CM_SideDistances
+
+Distances of the start and end points from the planes of four consecutive
+brush sides, with each plane moved out by the corner of the box that
+touches it first, like the scalar tests do with tw->offsets[signbits].
+The sums are grouped the way the scalar code is compiled so both give
+the same results.
+================
+*/
+static ID_INLINE void CM_SideDistances( const sideTestWork_t *sw, int side, __m128 *d1, __m128 *d2 ) {
+	__m128	normal[3];
+	__m128	offset[3];
+	__m128	negative;
+	__m128	dist;
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		normal[i] = _mm_loadu_ps( cm.sideNormals[i] + side );
+
+		// a set signbit picks the maxs corner for that axis
+		negative = _mm_cmplt_ps( normal[i], _mm_setzero_ps() );
+		offset[i] = _mm_or_ps( _mm_and_ps( negative, sw->size[1][i] ), _mm_andnot_ps( negative, sw->size[0][i] ) );
+	}
+
+	// negated plane distance adjusted for mins/maxs
+	dist = _mm_add_ps( _mm_add_ps( _mm_mul_ps( offset[0], normal[0] ), _mm_mul_ps( offset[1], normal[1] ) ),
+		_mm_sub_ps( _mm_mul_ps( offset[2], normal[2] ), _mm_loadu_ps( cm.sideDists + side ) ) );
+
+	*d1 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( sw->start[2], normal[2] ), dist ),
+		_mm_add_ps( _mm_mul_ps( sw->start[0], normal[0] ), _mm_mul_ps( sw->start[1], normal[1] ) ) );
+	*d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( sw->end[2], normal[2] ), dist ),
+		_mm_add_ps( _mm_mul_ps( sw->end[0], normal[0] ), _mm_mul_ps( sw->end[1], normal[1] ) ) );
+}
+
+/*
+================
+CM_StartDistances
+
+Distances of the start point from four brush side planes for position
+tests, grouped like the scalar CM_TestBoxInBrush
+================
+*/
+static ID_INLINE __m128 CM_StartDistances( const sideTestWork_t *sw, int side ) {
+	__m128	normal[3];
+	__m128	corner[3];
+	__m128	negative;
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		normal[i] = _mm_loadu_ps( cm.sideNormals[i] + side );
+
+		// a set signbit picks the maxs corner for that axis
+		negative = _mm_cmplt_ps( normal[i], _mm_setzero_ps() );
+		corner[i] = _mm_add_ps( sw->start[i],
+			_mm_or_ps( _mm_and_ps( negative, sw->size[1][i] ), _mm_andnot_ps( negative, sw->size[0][i] ) ) );
+	}
+
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( corner[0], normal[0] ), _mm_mul_ps( corner[1], normal[1] ) ),
+		_mm_sub_ps( _mm_mul_ps( corner[2], normal[2] ), _mm_loadu_ps( cm.sideDists + side ) ) );
+}
+
+/*
+================
+CM_SideMask
+
+Movemask bits of the sides from first up to numsides
+================
+*/
+static ID_INLINE int CM_SideMask( int first, int numsides ) {
+	if ( numsides - first >= 4 ) {
+		return 15;
+	}
+	return ( 1 << ( numsides - first ) ) - 1;
+}
+#endif
+
 /*
 ===============================================================================
 
@@ -208,6 +324,25 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 			}
 		}
 	} else {
+#ifdef CM_SSE_PLANES
+		sideTestWork_t	sw;
+		__m128			v1;
+		int				first;
+
+		CM_SetupSideTest( tw, &sw );
+		first = brush->sides - cm.brushsides;
+
+		// the first six planes are the axial planes, so we only
+		// need to test the remainder
+		for ( i = 6 ; i < brush->numsides ; i += 4 ) {
+			v1 = CM_StartDistances( &sw, first + i );
+
+			// if completely in front of face, no intersection
+			if ( _mm_movemask_ps( _mm_cmpgt_ps( v1, _mm_setzero_ps() ) ) & CM_SideMask( i, brush->numsides ) ) {
+				return;
+			}
+		}
+#else
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
 		for ( i = 6 ; i < brush->numsides ; i++ ) {
@@ -224,6 +359,7 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 				return;
 			}
 		}
+#endif
 	}
 
 	// inside this brush
@@ -241,7 +377,7 @@ CM_TestInLeaf
 */
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
 
@@ -249,10 +385,10 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if ( tw->thread->brushChecks[brushnum] == tw->thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		tw->thread->brushChecks[brushnum] = tw->thread->checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -271,14 +407,15 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->thread->patchChecks[surfnum] == tw->thread->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->patchChecks[surfnum] = tw->thread->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -428,13 +565,10 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
+	ll.thread = tw->thread;
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
-
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
 		CM_TestInLeaf( tw, &cm.leafs[leafs[i]] );
@@ -462,7 +596,9 @@ CM_TraceThroughPatch
 void CM_TraceThroughPatch( traceWork_t *tw, cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	if ( !cm_threadSlot ) {
+		c_patch_traces++;	// statistics only count the main thread
+	}
 
 	oldFrac = tw->trace.fraction;
 
@@ -500,7 +636,9 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
-	c_brush_traces++;
+	if ( !cm_threadSlot ) {
+		c_brush_traces++;	// statistics only count the main thread
+	}
 
 	getout = qfalse;
 	startout = qfalse;
@@ -575,6 +713,79 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 			}
 		}
 	} else {
+#ifdef CM_SSE_PLANES
+		sideTestWork_t	sw;
+		__m128			v1, v2;
+		float			d1s[4], d2s[4];
+		int				first, k, valid, out1, out2, cross;
+
+		CM_SetupSideTest( tw, &sw );
+		first = brush->sides - cm.brushsides;
+
+		//
+		// compare the trace against all planes of the brush, four at a time
+		// find the latest time the trace crosses a plane towards the interior
+		// and the earliest time the trace crosses a plane towards the exterior
+		//
+		for ( i = 0 ; i < brush->numsides ; i += 4 ) {
+			CM_SideDistances( &sw, first + i, &v1, &v2 );
+			valid = CM_SideMask( i, brush->numsides );
+
+			// if completely in front of any face, no intersection with the entire brush
+			if ( _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( v1, _mm_setzero_ps() ),
+				_mm_or_ps( _mm_cmpge_ps( v2, _mm_set1_ps( SURFACE_CLIP_EPSILON ) ), _mm_cmpge_ps( v2, v1 ) ) ) ) & valid ) {
+				return;
+			}
+
+			out1 = _mm_movemask_ps( _mm_cmpgt_ps( v1, _mm_setzero_ps() ) ) & valid;
+			out2 = _mm_movemask_ps( _mm_cmpgt_ps( v2, _mm_setzero_ps() ) ) & valid;
+			if ( out2 ) {
+				getout = qtrue;	// endpoint is not in solid
+			}
+			if ( out1 ) {
+				startout = qtrue;
+			}
+
+			// if it doesn't cross the plane, the plane isn't relevant
+			cross = out1 | out2;
+			if ( !cross ) {
+				continue;
+			}
+
+			_mm_storeu_ps( d1s, v1 );
+			_mm_storeu_ps( d2s, v2 );
+			for ( k = 0 ; k < 4 ; k++ ) {
+				if ( !( cross & ( 1 << k ) ) ) {
+					continue;
+				}
+				side = brush->sides + i + k;
+				plane = side->plane;
+				d1 = d1s[k];
+				d2 = d2s[k];
+
+				// crosses face
+				if (d1 > d2) {	// enter
+					f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f < 0 ) {
+						f = 0;
+					}
+					if (f > enterFrac) {
+						enterFrac = f;
+						clipplane = plane;
+						leadside = side;
+					}
+				} else {	// leave
+					f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f > 1 ) {
+						f = 1;
+					}
+					if (f < leaveFrac) {
+						leaveFrac = f;
+					}
+				}
+			}
+		}
+#else
 		//
 		// compare the trace against all planes of the brush
 		// find the latest time the trace crosses a plane towards the interior
@@ -628,6 +839,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				}
 			}
 		}
+#endif
 	}
 
 	//
@@ -661,37 +873,91 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 	}
 }
 
+// trace bounds for rejecting the packed leaf brushes
+#ifdef CM_SSE_PLANES
+typedef struct {
+	__m128		mins;
+	__m128		maxs;
+} boundsTest_t;
+#else
+typedef struct {
+	vec3_t		mins;
+	vec3_t		maxs;
+} boundsTest_t;
+#endif
+
+/*
+================
+CM_SetupBoundsTest
+================
+*/
+static ID_INLINE void CM_SetupBoundsTest( boundsTest_t *bt, const vec3_t mins, const vec3_t maxs ) {
+#ifdef CM_SSE_PLANES
+	bt->mins = _mm_setr_ps( mins[0], mins[1], mins[2], 0 );
+	bt->maxs = _mm_setr_ps( maxs[0], maxs[1], maxs[2], 0 );
+#else
+	VectorCopy( mins, bt->mins );
+	VectorCopy( maxs, bt->maxs );
+#endif
+}
+
+/*
+================
+CM_LeafBrushOutside
+
+The CM_BoundsIntersect test against the spread bounds of a leaf brush,
+the fourth lanes hold contents and brushNum and are ignored
+================
+*/
+static ID_INLINE qboolean CM_LeafBrushOutside( const boundsTest_t *bt, const cLeafBrush_t *lb ) {
+#ifdef CM_SSE_PLANES
+	__m128	outside;
+
+	outside = _mm_or_ps( _mm_cmplt_ps( bt->maxs, _mm_loadu_ps( lb->mins ) ),
+		_mm_cmplt_ps( _mm_loadu_ps( lb->maxs ), bt->mins ) );
+	return ( _mm_movemask_ps( outside ) & 7 ) != 0;
+#else
+	return bt->maxs[0] < lb->mins[0] || bt->maxs[1] < lb->mins[1] || bt->maxs[2] < lb->mins[2]
+		|| lb->maxs[0] < bt->mins[0] || lb->maxs[1] < bt->mins[1] || lb->maxs[2] < bt->mins[2];
+#endif
+}
+
 /*
 ================
 CM_TraceThroughLeaf
+
+The brushes are rejected on the packed leaf brush bounds first, the
+check marks and the brushes themselves are only touched by those that
+remain. A rejected brush isn't marked, it is rejected again in any
+other leaf.
 ================
 */
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
-	cbrush_t	*b;
+	int			brushnum, surfnum;
+	const cLeafBrush_t	*lb;
+	boundsTest_t	bt;
 	cPatch_t	*patch;
 
-	// trace line against all brushes in the leaf
-	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
-		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
+	CM_SetupBoundsTest( &bt, tw->bounds[0], tw->bounds[1] );
 
-		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
-			continue;	// already checked this brush in another leaf
+	// trace line against all brushes in the leaf
+	lb = &cm.leafBrushBounds[leaf->firstLeafBrush];
+	for ( k = 0 ; k < leaf->numLeafBrushes ; k++, lb++ ) {
+		if ( !(lb->contents & tw->contents) ) {
+			continue;
 		}
-		b->checkcount = cm.checkcount;
-
-		if ( !(b->contents & tw->contents) ) {
+		if ( CM_LeafBrushOutside( &bt, lb ) ) {
 			continue;
 		}
 
-		if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
-					b->bounds[0], b->bounds[1] ) ) {
-			continue;
+		brushnum = lb->brushNum;
+		if ( tw->thread->brushChecks[brushnum] == tw->thread->checkcount ) {
+			continue;	// already checked this brush in another leaf
 		}
+		tw->thread->brushChecks[brushnum] = tw->thread->checkcount;
 
-		CM_TraceThroughBrush( tw, b );
+		CM_TraceThroughBrush( tw, &cm.brushes[brushnum] );
 		if ( !tw->trace.fraction ) {
 			return;
 		}
@@ -704,14 +970,15 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( tw->thread->patchChecks[surfnum] == tw->thread->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			tw->thread->patchChecks[surfnum] = tw->thread->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1142,32 +1409,20 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 
 /*
 ==================
-CM_Trace
+CM_SetupTrace
+
+Fills in the trace work for a box or capsule moving from start to end
 ==================
 */
-void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
-						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+static void CM_SetupTrace( traceWork_t *tw, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+						  const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
 	int			i;
-	traceWork_t	tw;
 	vec3_t		offset;
-	cmodel_t	*cmod;
-
-	cmod = CM_ClipHandleToModel( model );
-
-	cm.checkcount++;		// for multi-check avoidance
-
-	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
-	Com_Memset( &tw, 0, sizeof(tw) );
-	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
-	VectorCopy(origin, tw.modelOrigin);
-
-	if (!cm.numNodes) {
-		*results = tw.trace;
-
-		return;	// map not loaded, shouldn't happen
-	}
+	Com_Memset( tw, 0, sizeof(*tw) );
+	tw->trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	VectorCopy(origin, tw->modelOrigin);
 
 	// allow NULL to be passed in for 0,0,0
 	if ( !mins ) {
@@ -1178,90 +1433,163 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 	}
 
 	// set basic parms
-	tw.contents = brushmask;
+	tw->contents = brushmask;
 
 	// adjust so that mins and maxs are always symetric, which
 	// avoids some complications with plane expanding of rotated
 	// bmodels
 	for ( i = 0 ; i < 3 ; i++ ) {
 		offset[i] = ( mins[i] + maxs[i] ) * 0.5;
-		tw.size[0][i] = mins[i] - offset[i];
-		tw.size[1][i] = maxs[i] - offset[i];
-		tw.start[i] = start[i] + offset[i];
-		tw.end[i] = end[i] + offset[i];
+		tw->size[0][i] = mins[i] - offset[i];
+		tw->size[1][i] = maxs[i] - offset[i];
+		tw->start[i] = start[i] + offset[i];
+		tw->end[i] = end[i] + offset[i];
 	}
 
 	// if a sphere is already specified
 	if ( sphere ) {
-		tw.sphere = *sphere;
+		tw->sphere = *sphere;
 	}
 	else {
-		tw.sphere.use = capsule;
-		tw.sphere.radius = ( tw.size[1][0] > tw.size[1][2] ) ? tw.size[1][2]: tw.size[1][0];
-		tw.sphere.halfheight = tw.size[1][2];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[1][2] - tw.sphere.radius );
+		tw->sphere.use = capsule;
+		tw->sphere.radius = ( tw->size[1][0] > tw->size[1][2] ) ? tw->size[1][2]: tw->size[1][0];
+		tw->sphere.halfheight = tw->size[1][2];
+		VectorSet( tw->sphere.offset, 0, 0, tw->size[1][2] - tw->sphere.radius );
 	}
 
-	tw.maxOffset = tw.size[1][0] + tw.size[1][1] + tw.size[1][2];
+	tw->maxOffset = tw->size[1][0] + tw->size[1][1] + tw->size[1][2];
 
-	// tw.offsets[signbits] = vector to appropriate corner from origin
-	tw.offsets[0][0] = tw.size[0][0];
-	tw.offsets[0][1] = tw.size[0][1];
-	tw.offsets[0][2] = tw.size[0][2];
+	// tw->offsets[signbits] = vector to appropriate corner from origin
+	tw->offsets[0][0] = tw->size[0][0];
+	tw->offsets[0][1] = tw->size[0][1];
+	tw->offsets[0][2] = tw->size[0][2];
 
-	tw.offsets[1][0] = tw.size[1][0];
-	tw.offsets[1][1] = tw.size[0][1];
-	tw.offsets[1][2] = tw.size[0][2];
+	tw->offsets[1][0] = tw->size[1][0];
+	tw->offsets[1][1] = tw->size[0][1];
+	tw->offsets[1][2] = tw->size[0][2];
 
-	tw.offsets[2][0] = tw.size[0][0];
-	tw.offsets[2][1] = tw.size[1][1];
-	tw.offsets[2][2] = tw.size[0][2];
+	tw->offsets[2][0] = tw->size[0][0];
+	tw->offsets[2][1] = tw->size[1][1];
+	tw->offsets[2][2] = tw->size[0][2];
 
-	tw.offsets[3][0] = tw.size[1][0];
-	tw.offsets[3][1] = tw.size[1][1];
-	tw.offsets[3][2] = tw.size[0][2];
+	tw->offsets[3][0] = tw->size[1][0];
+	tw->offsets[3][1] = tw->size[1][1];
+	tw->offsets[3][2] = tw->size[0][2];
 
-	tw.offsets[4][0] = tw.size[0][0];
-	tw.offsets[4][1] = tw.size[0][1];
-	tw.offsets[4][2] = tw.size[1][2];
+	tw->offsets[4][0] = tw->size[0][0];
+	tw->offsets[4][1] = tw->size[0][1];
+	tw->offsets[4][2] = tw->size[1][2];
 
-	tw.offsets[5][0] = tw.size[1][0];
-	tw.offsets[5][1] = tw.size[0][1];
-	tw.offsets[5][2] = tw.size[1][2];
+	tw->offsets[5][0] = tw->size[1][0];
+	tw->offsets[5][1] = tw->size[0][1];
+	tw->offsets[5][2] = tw->size[1][2];
 
-	tw.offsets[6][0] = tw.size[0][0];
-	tw.offsets[6][1] = tw.size[1][1];
-	tw.offsets[6][2] = tw.size[1][2];
+	tw->offsets[6][0] = tw->size[0][0];
+	tw->offsets[6][1] = tw->size[1][1];
+	tw->offsets[6][2] = tw->size[1][2];
 
-	tw.offsets[7][0] = tw.size[1][0];
-	tw.offsets[7][1] = tw.size[1][1];
-	tw.offsets[7][2] = tw.size[1][2];
+	tw->offsets[7][0] = tw->size[1][0];
+	tw->offsets[7][1] = tw->size[1][1];
+	tw->offsets[7][2] = tw->size[1][2];
 
 	//
 	// calculate bounds
 	//
-	if ( tw.sphere.use ) {
+	if ( tw->sphere.use ) {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.end[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->end[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			} else {
-				tw.bounds[0][i] = tw.end[i] - fabs(tw.sphere.offset[i]) - tw.sphere.radius;
-				tw.bounds[1][i] = tw.start[i] + fabs(tw.sphere.offset[i]) + tw.sphere.radius;
+				tw->bounds[0][i] = tw->end[i] - fabs(tw->sphere.offset[i]) - tw->sphere.radius;
+				tw->bounds[1][i] = tw->start[i] + fabs(tw->sphere.offset[i]) + tw->sphere.radius;
 			}
 		}
 	}
 	else {
 		for ( i = 0 ; i < 3 ; i++ ) {
-			if ( tw.start[i] < tw.end[i] ) {
-				tw.bounds[0][i] = tw.start[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.end[i] + tw.size[1][i];
+			if ( tw->start[i] < tw->end[i] ) {
+				tw->bounds[0][i] = tw->start[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->end[i] + tw->size[1][i];
 			} else {
-				tw.bounds[0][i] = tw.end[i] + tw.size[0][i];
-				tw.bounds[1][i] = tw.start[i] + tw.size[1][i];
+				tw->bounds[0][i] = tw->end[i] + tw->size[0][i];
+				tw->bounds[1][i] = tw->start[i] + tw->size[1][i];
 			}
 		}
 	}
+}
+
+/*
+==================
+CM_SetupSweep
+
+Sets the plane offsets for a trace that is not a position test
+==================
+*/
+static void CM_SetupSweep( traceWork_t *tw ) {
+	// check for point special case
+	if ( tw->size[0][0] == 0 && tw->size[0][1] == 0 && tw->size[0][2] == 0 ) {
+		tw->isPoint = qtrue;
+		VectorClear( tw->extents );
+	} else {
+		tw->isPoint = qfalse;
+		tw->extents[0] = tw->size[1][0];
+		tw->extents[1] = tw->size[1][1];
+		tw->extents[2] = tw->size[1][2];
+	}
+}
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace( traceWork_t *tw, trace_t *results, const vec3_t start, const vec3_t end ) {
+	int			i;
+
+	// generate endpos from the original, unmodified start/end
+	if ( tw->trace.fraction == 1 ) {
+		VectorCopy (end, tw->trace.endpos);
+	} else {
+		for ( i=0 ; i<3 ; i++ ) {
+			tw->trace.endpos[i] = start[i] + tw->trace.fraction * (end[i] - start[i]);
+		}
+	}
+
+        // If allsolid is set (was entirely inside something solid), the plane is not valid.
+        // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
+        // Otherwise, the normal on the plane should have unit length
+        assert(tw->trace.allsolid ||
+               tw->trace.fraction == 1.0 ||
+               VectorLengthSquared(tw->trace.plane.normal) > 0.9999);
+	*results = tw->trace;
+}
+
+/*
+==================
+CM_Trace
+==================
+*/
+void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mins, vec3_t maxs,
+						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, sphere_t *sphere ) {
+	traceWork_t	tw;
+	cmodel_t	*cmod;
+
+	cmod = CM_ClipHandleToModel( model );
+
+	if ( !cm_threadSlot ) {
+		c_traces++;				// for statistics, may be zeroed
+	}
+
+	if (!cm.numNodes) {
+		Com_Memset( results, 0, sizeof( *results ) );
+		results->fraction = 1;
+
+		return;	// map not loaded, shouldn't happen
+	}
+
+	CM_SetupTrace( &tw, start, end, mins, maxs, origin, brushmask, capsule, sphere );
+	tw.thread = CM_BeginQuery();	// for multi-check avoidance
 
 	//
 	// check for position test special case
@@ -1295,18 +1623,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 			CM_PositionTest( &tw );
 		}
 	} else {
-		//
-		// check for point special case
-		//
-		if ( tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0 ) {
-			tw.isPoint = qtrue;
-			VectorClear( tw.extents );
-		} else {
-			tw.isPoint = qfalse;
-			tw.extents[0] = tw.size[1][0];
-			tw.extents[1] = tw.size[1][1];
-			tw.extents[2] = tw.size[1][2];
-		}
+		CM_SetupSweep( &tw );
 
 		//
 		// general sweeping through world
@@ -1340,22 +1657,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 		}
 	}
 
-	// generate endpos from the original, unmodified start/end
-	if ( tw.trace.fraction == 1 ) {
-		VectorCopy (end, tw.trace.endpos);
-	} else {
-		for ( i=0 ; i<3 ; i++ ) {
-			tw.trace.endpos[i] = start[i] + tw.trace.fraction * (end[i] - start[i]);
-		}
-	}
-
-        // If allsolid is set (was entirely inside something solid), the plane is not valid.
-        // If fraction == 1.0, we never hit anything, and thus the plane is not valid.
-        // Otherwise, the normal on the plane should have unit length
-        assert(tw.trace.allsolid ||
-               tw.trace.fraction == 1.0 ||
-               VectorLengthSquared(tw.trace.plane.normal) > 0.9999);
-	*results = tw.trace;
+	CM_FinishTrace( &tw, results, start, end );
 }
 
 /*
@@ -1369,6 +1671,481 @@ void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
+/*
+===============================================================================
+
+BATCHED TRACES
+
+Rays that share their bounds, contents and capsule flag walk the tree
+together, so nodes, leafs and brush marks are visited once for the bundle
+instead of once per ray. Each ray keeps its own trace work and splits at
+the nodes exactly like CM_TraceThroughTree, so the results are the same
+as tracing the rays one at a time.
+
+===============================================================================
+*/
+
+typedef struct {
+	int			ray;		// tw index and bit in brushRays / patchRays
+	float		p1f, p2f;
+	vec3_t		p1, p2;
+} traceSegment_t;
+
+// where a live segment goes at a node
+typedef struct {
+	int			seg;		// index in the node's segments
+	int			where;		// SEG_*
+	float		frac[2];	// cuts for the near and the far child
+} traceSplit_t;
+
+// the splits and child segments of the nodes on the current path of the
+// walk, every node takes as many as it has live segments
+#define	CM_BATCH_STACK	1024
+
+typedef struct {
+	traceSegment_t	segs[CM_BATCH_STACK];
+	traceSplit_t	splits[CM_BATCH_STACK];
+} traceBatchStack_t;
+
+static traceBatchStack_t	cm_batchStacks[CM_MAX_THREADS];
+
+typedef struct {
+	traceWork_t		tw[CM_MAX_BATCH_RAYS];
+	traceSegment_t	segs[CM_MAX_BATCH_RAYS];	// the whole rays the walk starts with
+	boundsTest_t	rayBounds[CM_MAX_BATCH_RAYS];
+	boundsTest_t	bounds;		// enclosing box of all the rays
+	int				contents;
+	cmThread_t		*thread;
+	traceBatchStack_t	*stack;	// work area of the calling thread
+	int				stackTop;	// first free entry of the stack
+} traceBatch_t;
+
+/*
+================
+CM_TraceBatchThroughLeaf
+================
+*/
+static void CM_TraceBatchThroughLeaf( traceBatch_t *tb, const traceSegment_t *segs, const traceSplit_t *live, int numLive, cLeaf_t *leaf ) {
+	cmThread_t	*thread;
+	traceWork_t	*tw;
+	int			rays[CM_MAX_BATCH_RAYS];
+	int			i, k;
+	int			brushnum, surfnum;
+	unsigned	active, test;
+	const cLeafBrush_t	*lb;
+	cbrush_t	*b;
+	cPatch_t	*patch;
+
+	thread = tb->thread;
+	active = 0;
+	for ( i = 0 ; i < numLive ; i++ ) {
+		rays[i] = segs[live[i].seg].ray;
+		active |= 1u << rays[i];
+	}
+
+	// trace the rays against all brushes in the leaf
+	lb = &cm.leafBrushBounds[leaf->firstLeafBrush];
+	for ( k = 0 ; k < leaf->numLeafBrushes ; k++, lb++ ) {
+		if ( !(lb->contents & tb->contents) ) {
+			continue;
+		}
+		// none of the rays can touch it
+		if ( CM_LeafBrushOutside( &tb->bounds, lb ) ) {
+			continue;
+		}
+
+		brushnum = lb->brushNum;
+		if ( thread->brushChecks[brushnum] != thread->checkcount ) {
+			thread->brushChecks[brushnum] = thread->checkcount;
+			thread->brushRays[brushnum] = 0;
+		}
+		test = active & ~thread->brushRays[brushnum];
+		if ( !test ) {
+			continue;	// every ray already checked this brush in another leaf
+		}
+		thread->brushRays[brushnum] |= test;
+
+		b = &cm.brushes[brushnum];
+		for ( i = 0 ; i < numLive ; i++ ) {
+			if ( !( test & ( 1u << rays[i] ) ) ) {
+				continue;
+			}
+			if ( CM_LeafBrushOutside( &tb->rayBounds[rays[i]], lb ) ) {
+				continue;
+			}
+			tw = &tb->tw[rays[i]];
+
+			CM_TraceThroughBrush( tw, b );
+			if ( !tw->trace.fraction ) {
+				active &= ~( 1u << rays[i] );
+			}
+		}
+		if ( !active ) {
+			return;
+		}
+	}
+
+	// trace the rays against all patches in the leaf
+#ifdef BSPC
+	if (1) {
+#else
+	if ( !cm_noCurves->integer ) {
+#endif
+		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
+			if ( !patch ) {
+				continue;
+			}
+			if ( thread->patchChecks[surfnum] != thread->checkcount ) {
+				thread->patchChecks[surfnum] = thread->checkcount;
+				thread->patchRays[surfnum] = 0;
+			}
+			test = active & ~thread->patchRays[surfnum];
+			if ( !test ) {
+				continue;	// every ray already checked this patch in another leaf
+			}
+			thread->patchRays[surfnum] |= test;
+
+			if ( !(patch->contents & tb->contents) ) {
+				continue;
+			}
+
+			for ( i = 0 ; i < numLive ; i++ ) {
+				if ( !( test & ( 1u << rays[i] ) ) ) {
+					continue;
+				}
+				tw = &tb->tw[rays[i]];
+				CM_TraceThroughPatch( tw, patch );
+				if ( !tw->trace.fraction ) {
+					active &= ~( 1u << rays[i] );
+				}
+			}
+			if ( !active ) {
+				return;
+			}
+		}
+	}
+}
+
+/*
+==================
+CM_SplitSegment
+
+Cuts a segment at frac the same way CM_TraceThroughTree does,
+keeping the part before the cut or the part after it
+==================
+*/
+static void CM_SplitSegment( traceSegment_t *out, const traceSegment_t *in, float frac, qboolean after ) {
+	float	midf;
+	vec3_t	mid;
+
+	midf = in->p1f + (in->p2f - in->p1f)*frac;
+
+	mid[0] = in->p1[0] + frac*(in->p2[0] - in->p1[0]);
+	mid[1] = in->p1[1] + frac*(in->p2[1] - in->p1[1]);
+	mid[2] = in->p1[2] + frac*(in->p2[2] - in->p1[2]);
+
+	out->ray = in->ray;
+	if ( after ) {
+		out->p1f = midf;
+		out->p2f = in->p2f;
+		VectorCopy( mid, out->p1 );
+		VectorCopy( in->p2, out->p2 );
+	} else {
+		out->p1f = in->p1f;
+		out->p2f = midf;
+		VectorCopy( in->p1, out->p1 );
+		VectorCopy( mid, out->p2 );
+	}
+}
+
+// where a segment goes at a node
+#define	SEG_FRONT		0	// only children[0]
+#define	SEG_BACK		1	// only children[1]
+#define	SEG_CROSS_FRONT	2	// children[0], then children[1]
+#define	SEG_CROSS_BACK	3	// children[1], then children[0]
+
+/*
+==================
+CM_TraceBatchThroughTree
+
+Every ray has at most one segment in the list. To keep the order in
+which each ray visits the leafs, the front child is walked with the
+segments that start on the front, then the back child with everything
+that reaches it, then the front child again with the segments that
+crossed over from the back.
+==================
+*/
+static void CM_TraceBatchThroughTree( traceBatch_t *tb, int num, const traceSegment_t *segs, int numSegs ) {
+	cNode_t			*node;
+	cplane_t		*plane;
+	const traceSegment_t	*seg;
+	const traceWork_t		*tw;
+	traceSplit_t	*live, *split;
+	traceSegment_t	*child;
+	float			t1, t2, offset;
+	float			frac, frac2;
+	float			idist;
+	int				i, base, numLive, numChild;
+	int				numFront, numBack, numCrossBack;
+
+	base = tb->stackTop;
+	if ( base + numSegs > CM_BATCH_STACK ) {
+		if ( numSegs == 1 ) {
+			Com_Error( ERR_DROP, "CM_TraceBatch: tree too deep" );
+		}
+		// the rays only share the brush marks through their own bits,
+		// so they can as well go down the rest of the tree one by one
+		for ( i = 0 ; i < numSegs ; i++ ) {
+			CM_TraceBatchThroughTree( tb, num, &segs[i], 1 );
+		}
+		return;
+	}
+	live = &tb->stack->splits[base];
+	child = &tb->stack->segs[base];
+
+	// drop the rays that already hit something nearer
+	numLive = 0;
+	for ( i = 0 ; i < numSegs ; i++ ) {
+		if ( tb->tw[segs[i].ray].trace.fraction > segs[i].p1f ) {
+			live[numLive++].seg = i;
+		}
+	}
+	if ( !numLive ) {
+		return;
+	}
+
+	// no leaf is reached while the whole bundle stays on one
+	// side of the nodes, so the segments are passed down as is
+	while ( 1 ) {
+		// if < 0, we are in a leaf node
+		if (num < 0) {
+			CM_TraceBatchThroughLeaf( tb, segs, live, numLive, &cm.leafs[-1-num] );
+			return;
+		}
+
+		node = cm.nodes + num;
+		plane = node->plane;
+
+		numCrossBack = numFront = numBack = 0;
+		for ( i = 0 ; i < numLive ; i++ ) {
+			split = &live[i];
+			seg = &segs[split->seg];
+			tw = &tb->tw[seg->ray];
+
+			// adjust the plane distance appropriately for mins/maxs
+			if ( plane->type < 3 ) {
+				t1 = seg->p1[plane->type] - plane->dist;
+				t2 = seg->p2[plane->type] - plane->dist;
+				offset = tw->extents[plane->type];
+			} else {
+				t1 = DotProduct (plane->normal, seg->p1) - plane->dist;
+				t2 = DotProduct (plane->normal, seg->p2) - plane->dist;
+				if ( tw->isPoint ) {
+					offset = 0;
+				} else {
+					// this is silly
+					offset = 2048;
+				}
+			}
+
+			// see which sides we need to consider
+			if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+				split->where = SEG_FRONT;
+				numFront++;
+				continue;
+			}
+			if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+				split->where = SEG_BACK;
+				numBack++;
+				continue;
+			}
+
+			// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+			if ( t1 < t2 ) {
+				idist = 1.0/(t1-t2);
+				split->where = SEG_CROSS_BACK;
+				numCrossBack++;
+				frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+				frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+			} else if (t1 > t2) {
+				idist = 1.0/(t1-t2);
+				split->where = SEG_CROSS_FRONT;
+				frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+				frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			} else {
+				split->where = SEG_CROSS_FRONT;
+				frac = 1;
+				frac2 = 0;
+			}
+
+			if ( frac < 0 ) {
+				frac = 0;
+			}
+			if ( frac > 1 ) {
+				frac = 1;
+			}
+			if ( frac2 < 0 ) {
+				frac2 = 0;
+			}
+			if ( frac2 > 1 ) {
+				frac2 = 1;
+			}
+			split->frac[0] = frac;
+			split->frac[1] = frac2;
+		}
+
+		if ( numFront == numLive ) {
+			num = node->children[0];
+		} else if ( numBack == numLive ) {
+			num = node->children[1];
+		} else {
+			break;
+		}
+	}
+
+	// the children take the entries after this node's
+	tb->stackTop = base + numLive;
+
+	// front child
+	numChild = 0;
+	for ( i = 0 ; i < numLive ; i++ ) {
+		split = &live[i];
+		if ( split->where == SEG_FRONT ) {
+			child[numChild++] = segs[split->seg];
+		} else if ( split->where == SEG_CROSS_FRONT ) {
+			CM_SplitSegment( &child[numChild++], &segs[split->seg], split->frac[0], qfalse );
+		}
+	}
+	if ( numChild ) {
+		CM_TraceBatchThroughTree( tb, node->children[0], child, numChild );
+	}
+
+	// back child
+	numChild = 0;
+	for ( i = 0 ; i < numLive ; i++ ) {
+		split = &live[i];
+		if ( split->where == SEG_BACK ) {
+			child[numChild++] = segs[split->seg];
+		} else if ( split->where == SEG_CROSS_FRONT ) {
+			CM_SplitSegment( &child[numChild++], &segs[split->seg], split->frac[1], qtrue );
+		} else if ( split->where == SEG_CROSS_BACK ) {
+			CM_SplitSegment( &child[numChild++], &segs[split->seg], split->frac[0], qfalse );
+		}
+	}
+	if ( numChild ) {
+		CM_TraceBatchThroughTree( tb, node->children[1], child, numChild );
+	}
+
+	// front child again for the rays that started on the back
+	if ( numCrossBack ) {
+		numChild = 0;
+		for ( i = 0 ; i < numLive ; i++ ) {
+			split = &live[i];
+			if ( split->where == SEG_CROSS_BACK ) {
+				CM_SplitSegment( &child[numChild++], &segs[split->seg], split->frac[1], qtrue );
+			}
+		}
+		CM_TraceBatchThroughTree( tb, node->children[0], child, numChild );
+	}
+
+	tb->stackTop = base;
+}
+
+/*
+==================
+CM_TraceBatchThroughWorld
+
+Sweeps up to CM_MAX_BATCH_RAYS rays through the world tree together
+==================
+*/
+static void CM_TraceBatchThroughWorld( trace_t *results, const vec3_t *starts, const vec3_t *ends,
+						  const int *indexes, int numRays, vec3_t mins, vec3_t maxs, int brushmask, int capsule ) {
+	traceBatch_t	tb;
+	traceSegment_t	*seg;
+	traceWork_t		*tw;
+	vec3_t			bounds[2];
+	int				i, r;
+
+	tb.thread = CM_BeginQuery();	// one checkcount for the bundle, rays are told apart by brushRays
+	tb.contents = brushmask;
+	tb.stack = &cm_batchStacks[cm_threadSlot];
+	tb.stackTop = 0;
+
+	if ( !cm_threadSlot ) {
+		c_traces += numRays;	// for statistics, may be zeroed
+	}
+
+	ClearBounds( bounds[0], bounds[1] );
+	for ( r = 0 ; r < numRays ; r++ ) {
+		i = indexes[r];
+		tw = &tb.tw[r];
+		CM_SetupTrace( tw, starts[i], ends[i], mins, maxs, vec3_origin, brushmask, capsule, NULL );
+		CM_SetupSweep( tw );
+		tw->thread = tb.thread;
+		CM_SetupBoundsTest( &tb.rayBounds[r], tw->bounds[0], tw->bounds[1] );
+		AddPointToBounds( tw->bounds[0], bounds[0], bounds[1] );
+		AddPointToBounds( tw->bounds[1], bounds[0], bounds[1] );
+
+		seg = &tb.segs[r];
+		seg->ray = r;
+		seg->p1f = 0;
+		seg->p2f = 1;
+		VectorCopy( tw->start, seg->p1 );
+		VectorCopy( tw->end, seg->p2 );
+	}
+
+	CM_SetupBoundsTest( &tb.bounds, bounds[0], bounds[1] );
+
+	CM_TraceBatchThroughTree( &tb, 0, tb.segs, numRays );
+
+	for ( r = 0 ; r < numRays ; r++ ) {
+		i = indexes[r];
+		CM_FinishTrace( &tb.tw[r], &results[i], starts[i], ends[i] );
+	}
+}
+
+/*
+==================
+CM_TraceBatch
+
+Traces numTraces rays that share mins, maxs, model, brushmask and capsule.
+Each result is the same as a CM_BoxTrace of that ray on its own.
+==================
+*/
+void CM_TraceBatch( trace_t *results, const vec3_t *starts, const vec3_t *ends, int numTraces,
+						  vec3_t mins, vec3_t maxs, clipHandle_t model, int brushmask, int capsule ) {
+	int		indexes[CM_MAX_BATCH_RAYS];
+	int		i, numRays;
+
+	// inline models are a single leaf, nothing to share
+	if ( model || !cm.numNodes ) {
+		for ( i = 0 ; i < numTraces ; i++ ) {
+			CM_Trace( &results[i], starts[i], ends[i], mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+		}
+		return;
+	}
+
+	numRays = 0;
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		// position tests don't walk the tree
+		if ( starts[i][0] == ends[i][0] && starts[i][1] == ends[i][1] && starts[i][2] == ends[i][2] ) {
+			CM_Trace( &results[i], starts[i], ends[i], mins, maxs, 0, vec3_origin, brushmask, capsule, NULL );
+			continue;
+		}
+
+		indexes[numRays++] = i;
+		if ( numRays == CM_MAX_BATCH_RAYS ) {
+			CM_TraceBatchThroughWorld( results, starts, ends, indexes, numRays, mins, maxs, brushmask, capsule );
+			numRays = 0;
+		}
+	}
+	if ( numRays ) {
+		CM_TraceBatchThroughWorld( results, starts, ends, indexes, numRays, mins, maxs, brushmask, capsule );
+	}
+}
+
 /*
 ==================
 CM_TransformedBoxTrace
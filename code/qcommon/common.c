@@ -255,6 +255,77 @@ void QDECL Com_DPrintf( const char *fmt, ...) {
 	Com_Printf ("%s", msg);
 }
 
+/*
+=============================================================================
+
+WORKER THREADS
+
+A Com_Error can't unwind a worker thread to the main thread's abortframe,
+so while Com_RunThreads runs, the error only stops the work of the thread
+that raised it and is raised again on the calling thread afterwards.
+
+=============================================================================
+*/
+
+typedef struct {
+	int		code;			// 0 if the thread finished its work
+	char	message[MAXPRINTMSG];
+} threadError_t;
+
+static void				(*com_threadFunc)( int thread );
+static threadError_t	com_threadErrors[MAX_SYS_THREADS];
+
+static Q_THREADLOCAL jmp_buf	*com_threadAbort;	// set while a thread runs com_threadFunc
+static Q_THREADLOCAL int		com_threadNum;
+
+/*
+=============
+Com_ThreadWork
+=============
+*/
+static void Com_ThreadWork( int thread ) {
+	jmp_buf		abort;
+
+	com_threadErrors[thread].code = 0;
+	if ( setjmp( abort ) ) {
+		com_threadAbort = NULL;
+		return;
+	}
+
+	com_threadNum = thread;
+	com_threadAbort = &abort;
+	com_threadFunc( thread );
+	com_threadAbort = NULL;
+}
+
+/*
+=============
+Com_RunThreads
+
+Sys_RunThreads for code that can Com_Error
+=============
+*/
+void Com_RunThreads( int count, void (*func)( int thread ) ) {
+	int		i;
+
+	if ( com_threadFunc ) {
+		Com_Error( ERR_FATAL, "Com_RunThreads: already running" );
+	}
+	if ( count > MAX_SYS_THREADS ) {
+		count = MAX_SYS_THREADS;
+	}
+
+	com_threadFunc = func;
+	Sys_RunThreads( count, Com_ThreadWork );
+	com_threadFunc = NULL;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( com_threadErrors[i].code ) {
+			Com_Error( com_threadErrors[i].code, "%s", com_threadErrors[i].message );
+		}
+	}
+}
+
 /*
 =============
 Com_Error
@@ -270,6 +341,16 @@ void QDECL Com_Error( int code, const char *fmt, ... ) {
 	int			currentTime;
 	qboolean	restartClient;
 
+	if ( com_threadAbort ) {
+		threadError_t	*error = &com_threadErrors[com_threadNum];
+
+		va_start( argptr, fmt );
+		Q_vsnprintf( error->message, sizeof( error->message ), fmt, argptr );
+		va_end( argptr );
+		error->code = code;
+		longjmp( *com_threadAbort, 1 );
+	}
+
 	if(com_errorEntered)
 		Sys_Error("recursive error after: %s", com_errorMessage);
 
@@ -763,12 +844,24 @@ The rover can be left pointing at a non-empty block
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
+
+Blocks of up to ZONE_SLAB_MAX bytes don't go through the rover, they are
+taken from slabs: TAG_SLAB zone blocks split into ZONE_SLAB_SLOTS equal slots
+with a free list per size class, so small allocations and frees are constant
+time and don't fragment the zone.  Every slot still has a memblock_t header
+with its own tag, so Z_Free, Z_FreeTags and the heap logs treat slots like
+any other block.
 ==============================================================================
 */
 
 #define	ZONEID	0x1d4a11
+#define	SLABID	0x1d4a12		// id of a slot inside a TAG_SLAB block
 #define MINFRAGMENT	64
 
+#define	ZONE_SLAB_MAX		512	// largest slot, including header and trash tester
+#define	ZONE_SLAB_CLASSES	11
+#define	ZONE_SLAB_SLOTS		32	// slots per slab
+
 typedef struct zonedebug_s {
 	char *label;
 	char *file;
@@ -786,13 +879,39 @@ typedef struct memblock_s {
 #endif
 } memblock_t;
 
+typedef struct zoneslab_s zoneslab_t;
+
 typedef struct {
 	int		size;			// total bytes malloced, including header
 	int		used;			// total bytes used
 	memblock_t	blocklist;	// start / end cap for linked list
 	memblock_t	*rover;
+	zoneslab_t	*slabs[ZONE_SLAB_CLASSES];		// slabs with free slots
+	zoneslab_t	*fullSlabs[ZONE_SLAB_CLASSES];
 } memzone_t;
 
+// stored at the start of a TAG_SLAB block, followed by the slots
+// a slot's prev pointer is the TAG_SLAB block it lives in
+struct zoneslab_s {
+	memzone_t	*zone;
+	zoneslab_t	*next, *prev;
+	memblock_t	*freeSlots;		// linked through next
+	int			sizeClass;
+	int			used;			// slots handed out
+};
+
+#define	SLAB_HEADER_SIZE	PAD(sizeof(zoneslab_t), sizeof(intptr_t))
+
+static const int zoneSlabSizes[ZONE_SLAB_CLASSES] = {
+	48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512
+};
+
+// size class for each 16 byte step of block size
+static const byte zoneSlabClass[ZONE_SLAB_MAX / 16] = {
+	0, 0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 7, 7, 7, 7,
+	8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 10, 10, 10, 10
+};
+
 // main zone for all "dynamic" memory allocation
 static memzone_t	*mainzone;
 // we also have a small zone for small allocations that would only
@@ -801,6 +920,31 @@ static memzone_t	*smallzone;
 
 static void Z_CheckHeap( void );
 
+// allocation tracing, see Com_AllocStats_f
+typedef enum {
+	ALLOC_ZONE,
+	ALLOC_HUNK,
+	ALLOC_HUNKTEMP
+} allocKind_t;
+
+static void Com_TraceAlloc( allocKind_t kind, void *ptr, int size, int tag,
+	const void *caller, const char *file, int line );
+static void Com_TraceFree( void *ptr );
+static void Com_TraceHunkClear( void );
+static void Com_AllocStats_f( void );
+
+static cvar_t	*com_allocTrace;
+
+// call site for builds without ZONE_DEBUG / HUNK_DEBUG labels
+#if defined( __GNUC__ )
+#define Com_ReturnAddress()	__builtin_return_address( 0 )
+#elif defined( _MSC_VER )
+#include <intrin.h>
+#define Com_ReturnAddress()	_ReturnAddress()
+#else
+#define Com_ReturnAddress()	NULL
+#endif
+
 /*
 ========================
 Z_ClearZone
@@ -824,6 +968,9 @@ static void Z_ClearZone( memzone_t *zone, int size ) {
 	block->tag = 0;			// free block
 	block->id = ZONEID;
 	block->size = size - sizeof(memzone_t);
+
+	Com_Memset( zone->slabs, 0, sizeof( zone->slabs ) );
+	Com_Memset( zone->fullSlabs, 0, sizeof( zone->fullSlabs ) );
 }
 
 /*
@@ -844,13 +991,240 @@ int Z_AvailableMemory( void ) {
 	return Z_AvailableZoneMemory( mainzone );
 }
 
+/*
+========================
+Z_AllocBlock
+
+Finds the first free block of at least size bytes (header included)
+starting at the rover, or returns NULL if there is none
+========================
+*/
+static memblock_t *Z_AllocBlock( memzone_t *zone, int size, int tag ) {
+	int			extra;
+	memblock_t	*start, *rover, *new, *base;
+
+	base = rover = zone->rover;
+	start = base->prev;
+	
+	do {
+		if (rover == start)	{
+			// scaned all the way around the list
+			return NULL;
+		}
+		if (rover->tag) {
+			base = rover = rover->next;
+		} else {
+			rover = rover->next;
+		}
+	} while (base->tag || base->size < size);
+	
+	//
+	// found a block big enough
+	//
+	extra = base->size - size;
+	if (extra > MINFRAGMENT) {
+		// there will be a free fragment after the allocated block
+		new = (memblock_t *) ((byte *)base + size );
+		new->size = extra;
+		new->tag = 0;			// free block
+		new->prev = base;
+		new->id = ZONEID;
+		new->next = base->next;
+		new->next->prev = new;
+		base->next = new;
+		base->size = size;
+	}
+	
+	base->tag = tag;			// no longer a free block
+	
+	zone->rover = base->next;	// next allocation will start looking here
+	zone->used += base->size;	//
+	
+	base->id = ZONEID;
+
+	// marker for memory trash testing
+	*(int *)((byte *)base + base->size - 4) = ZONEID;
+
+	return base;
+}
+
+/*
+========================
+Z_FreeBlock
+========================
+*/
+static void Z_FreeBlock( memzone_t *zone, memblock_t *block ) {
+	memblock_t	*other;
+
+	zone->used -= block->size;
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
+
+	block->tag = 0;		// mark as free
+	
+	other = block->prev;
+	if (!other->tag) {
+		// merge with previous free block
+		other->size += block->size;
+		other->next = block->next;
+		other->next->prev = other;
+		if (block == zone->rover) {
+			zone->rover = other;
+		}
+		block = other;
+	}
+
+	zone->rover = block;
+
+	other = block->next;
+	if ( !other->tag ) {
+		// merge the next free block onto the end
+		block->size += other->size;
+		block->next = other->next;
+		block->next->prev = block;
+	}
+}
+
+/*
+========================
+Z_SlabSlot
+========================
+*/
+static memblock_t *Z_SlabSlot( zoneslab_t *slab, int slot ) {
+	return (memblock_t *)( (byte *)slab + SLAB_HEADER_SIZE + slot * zoneSlabSizes[slab->sizeClass] );
+}
+
+/*
+========================
+Z_SlabLink / Z_SlabUnlink
+========================
+*/
+static void Z_SlabLink( zoneslab_t **list, zoneslab_t *slab ) {
+	slab->prev = NULL;
+	slab->next = *list;
+	if ( slab->next ) {
+		slab->next->prev = slab;
+	}
+	*list = slab;
+}
+
+static void Z_SlabUnlink( zoneslab_t **list, zoneslab_t *slab ) {
+	if ( slab->prev ) {
+		slab->prev->next = slab->next;
+	} else {
+		*list = slab->next;
+	}
+	if ( slab->next ) {
+		slab->next->prev = slab->prev;
+	}
+	slab->next = slab->prev = NULL;
+}
+
+/*
+========================
+Z_SlabAlloc
+
+Hands out a slot of the size class that fits size bytes (header included),
+carving a new slab out of the zone if every slab of that class is full
+========================
+*/
+static memblock_t *Z_SlabAlloc( memzone_t *zone, int size, int tag ) {
+	int			sizeClass, slotSize, i;
+	memblock_t	*block, *slot;
+	zoneslab_t	*slab;
+
+	sizeClass = zoneSlabClass[(size - 1) >> 4];
+	slab = zone->slabs[sizeClass];
+
+	if ( !slab ) {
+		slotSize = zoneSlabSizes[sizeClass];
+		block = Z_AllocBlock( zone, PAD( sizeof(memblock_t) + SLAB_HEADER_SIZE +
+			ZONE_SLAB_SLOTS * slotSize + 4, sizeof(intptr_t) ), TAG_SLAB );
+		if ( !block ) {
+			return NULL;
+		}
+
+		slab = (zoneslab_t *)( block + 1 );
+		slab->zone = zone;
+		slab->sizeClass = sizeClass;
+		slab->used = 0;
+		slab->freeSlots = NULL;
+		for ( i = ZONE_SLAB_SLOTS - 1 ; i >= 0 ; i-- ) {
+			slot = Z_SlabSlot( slab, i );
+			slot->size = slotSize;
+			slot->tag = 0;
+			slot->id = SLABID;
+			slot->prev = block;
+			slot->next = slab->freeSlots;
+			slab->freeSlots = slot;
+		}
+		Z_SlabLink( &zone->slabs[sizeClass], slab );
+	}
+
+	slot = slab->freeSlots;
+	slab->freeSlots = slot->next;
+	slot->next = NULL;
+	slot->tag = tag;
+	slab->used++;
+
+	if ( !slab->freeSlots ) {
+		Z_SlabUnlink( &zone->slabs[sizeClass], slab );
+		Z_SlabLink( &zone->fullSlabs[sizeClass], slab );
+	}
+
+	// marker for memory trash testing
+	*(int *)((byte *)slot + slot->size - 4) = ZONEID;
+
+	return slot;
+}
+
+/*
+========================
+Z_SlabFree
+
+Returns qtrue if the slab became empty and was given back to the zone
+========================
+*/
+static qboolean Z_SlabFree( memblock_t *slot ) {
+	memblock_t	*block;
+	zoneslab_t	*slab;
+	memzone_t	*zone;
+
+	block = slot->prev;
+	slab = (zoneslab_t *)( block + 1 );
+	zone = slab->zone;
+
+	// set the slot to something that should cause problems
+	// if it is referenced...
+	Com_Memset( slot + 1, 0xaa, slot->size - sizeof( *slot ) );
+	slot->tag = 0;
+
+	if ( !slab->freeSlots ) {
+		Z_SlabUnlink( &zone->fullSlabs[slab->sizeClass], slab );
+		Z_SlabLink( &zone->slabs[slab->sizeClass], slab );
+	}
+	slot->next = slab->freeSlots;
+	slab->freeSlots = slot;
+
+	// keep one slab per class around so alternating alloc / free
+	// of a single slot doesn't go back to the zone every time
+	if ( --slab->used == 0 && ( slab->prev || slab->next ) ) {
+		Z_SlabUnlink( &zone->slabs[slab->sizeClass], slab );
+		Z_FreeBlock( zone, block );
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
 /*
 ========================
 Z_Free
 ========================
 */
 void Z_Free( void *ptr ) {
-	memblock_t	*block, *other;
+	memblock_t	*block;
 	memzone_t *zone;
 	
 	if (!ptr) {
@@ -858,7 +1232,7 @@ void Z_Free( void *ptr ) {
 	}
 
 	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
-	if (block->id != ZONEID) {
+	if (block->id != ZONEID && block->id != SLABID) {
 		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
 	}
 	if (block->tag == 0) {
@@ -874,6 +1248,13 @@ void Z_Free( void *ptr ) {
 		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
 	}
 
+	Com_TraceFree( ptr );
+
+	if (block->id == SLABID) {
+		Z_SlabFree( block );
+		return;
+	}
+
 	if (block->tag == TAG_SMALL) {
 		zone = smallzone;
 	}
@@ -881,33 +1262,31 @@ void Z_Free( void *ptr ) {
 		zone = mainzone;
 	}
 
-	zone->used -= block->size;
-	// set the block to something that should cause problems
-	// if it is referenced...
-	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
-
-	block->tag = 0;		// mark as free
-	
-	other = block->prev;
-	if (!other->tag) {
-		// merge with previous free block
-		other->size += block->size;
-		other->next = block->next;
-		other->next->prev = other;
-		if (block == zone->rover) {
-			zone->rover = other;
-		}
-		block = other;
-	}
+	Z_FreeBlock( zone, block );
+}
 
-	zone->rover = block;
+/*
+================
+Z_SlabFreeTags
+================
+*/
+static void Z_SlabFreeTags( zoneslab_t *slab, int tag ) {
+	zoneslab_t	*next;
+	memblock_t	*slot;
+	int			i;
 
-	other = block->next;
-	if ( !other->tag ) {
-		// merge the next free block onto the end
-		block->size += other->size;
-		block->next = other->next;
-		block->next->prev = block;
+	for ( ; slab ; slab = next ) {
+		next = slab->next;
+		for ( i = 0 ; i < ZONE_SLAB_SLOTS ; i++ ) {
+			slot = Z_SlabSlot( slab, i );
+			if ( slot->tag != tag ) {
+				continue;
+			}
+			Com_TraceFree( slot + 1 );
+			if ( Z_SlabFree( slot ) ) {
+				break;		// the whole slab is gone
+			}
+		}
 	}
 }
 
@@ -919,6 +1298,7 @@ Z_FreeTags
 */
 void Z_FreeTags( int tag ) {
 	memzone_t	*zone;
+	int			i;
 
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
@@ -926,6 +1306,15 @@ void Z_FreeTags( int tag ) {
 	else {
 		zone = mainzone;
 	}
+
+	// slots first, freeing them can give emptied slabs back to the zone
+	// full slabs that get a free slot move to the front of the other
+	// list, so walking that one first visits every slab once
+	for ( i = 0 ; i < ZONE_SLAB_CLASSES ; i++ ) {
+		Z_SlabFreeTags( zone->slabs[i], tag );
+		Z_SlabFreeTags( zone->fullSlabs[i], tag );
+	}
+
 	// use the rover as our pointer, because
 	// Z_Free automatically adjusts it
 	zone->rover = zone->blocklist.next;
@@ -948,10 +1337,9 @@ Z_TagMalloc
 void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
 	int		allocSize;
 #else
-void *Z_TagMalloc( int size, int tag ) {
+static void *Z_TagMallocCaller( int size, int tag, const void *caller, const char *file, int line ) {
 #endif
-	int		extra;
-	memblock_t	*start, *rover, *new, *base;
+	memblock_t	*base;
 	memzone_t *zone;
 
 	if (!tag) {
@@ -968,75 +1356,68 @@ void *Z_TagMalloc( int size, int tag ) {
 #ifdef ZONE_DEBUG
 	allocSize = size;
 #endif
-	//
-	// scan through the block list looking for the first free block
-	// of sufficient size
-	//
 	size += sizeof(memblock_t);	// account for size of block header
 	size += 4;					// space for memory trash tester
 	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
-	
-	base = rover = zone->rover;
-	start = base->prev;
-	
-	do {
-		if (rover == start)	{
-			// scaned all the way around the list
+
+	if ( size <= ZONE_SLAB_MAX ) {
+		base = Z_SlabAlloc( zone, size, tag );
+	} else {
+		//
+		// scan through the block list looking for the first free block
+		// of sufficient size
+		//
+		base = Z_AllocBlock( zone, size, tag );
+	}
+
+	if ( !base ) {
 #ifdef ZONE_DEBUG
-			Z_LogHeap();
+		Z_LogHeap();
 
-			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
-								size, zone == smallzone ? "small" : "main", file, line, label);
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
+							size, zone == smallzone ? "small" : "main", file, line, label);
 #else
-			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-								size, zone == smallzone ? "small" : "main");
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+							size, zone == smallzone ? "small" : "main");
 #endif
-			return NULL;
-		}
-		if (rover->tag) {
-			base = rover = rover->next;
-		} else {
-			rover = rover->next;
-		}
-	} while (base->tag || base->size < size);
-	
-	//
-	// found a block big enough
-	//
-	extra = base->size - size;
-	if (extra > MINFRAGMENT) {
-		// there will be a free fragment after the allocated block
-		new = (memblock_t *) ((byte *)base + size );
-		new->size = extra;
-		new->tag = 0;			// free block
-		new->prev = base;
-		new->id = ZONEID;
-		new->next = base->next;
-		new->next->prev = new;
-		base->next = new;
-		base->size = size;
+		return NULL;
 	}
-	
-	base->tag = tag;			// no longer a free block
-	
-	zone->rover = base->next;	// next allocation will start looking here
-	zone->used += base->size;	//
-	
-	base->id = ZONEID;
 
 #ifdef ZONE_DEBUG
 	base->d.label = label;
 	base->d.file = file;
 	base->d.line = line;
 	base->d.allocSize = allocSize;
-#endif
 
-	// marker for memory trash testing
-	*(int *)((byte *)base + base->size - 4) = ZONEID;
+	Com_TraceAlloc( ALLOC_ZONE, base + 1, base->size, tag, NULL, file, line );
+#else
+	Com_TraceAlloc( ALLOC_ZONE, base + 1, base->size, tag, caller, file, line );
+#endif
 
 	return (void *) ((byte *)base + sizeof(memblock_t));
 }
 
+#ifndef ZONE_DEBUG
+void *Z_TagMalloc( int size, int tag ) {
+	return Z_TagMallocCaller( size, tag, Com_ReturnAddress(), NULL, 0 );
+}
+#endif
+
+/*
+================
+Z_TagMallocSite
+
+For allocators that pass on the call site of their own caller
+================
+*/
+void *Z_TagMallocSite( int size, int tag, char *file, int line ) {
+#ifdef ZONE_DEBUG
+	return Z_TagMallocDebug( size, tag, "site", file, line );
+#else
+	return Z_TagMallocCaller( size, tag, NULL, file, line );
+#endif
+}
+
 /*
 ========================
 Z_Malloc
@@ -1054,7 +1435,7 @@ void *Z_Malloc( int size ) {
 #ifdef ZONE_DEBUG
 	buf = Z_TagMallocDebug( size, TAG_GENERAL, label, file, line );
 #else
-	buf = Z_TagMalloc( size, TAG_GENERAL );
+	buf = Z_TagMallocCaller( size, TAG_GENERAL, Com_ReturnAddress(), NULL, 0 );
 #endif
 	Com_Memset( buf, 0, size );
 
@@ -1067,7 +1448,7 @@ void *S_MallocDebug( int size, char *label, char *file, int line ) {
 }
 #else
 void *S_Malloc( int size ) {
-	return Z_TagMalloc( size, TAG_SMALL );
+	return Z_TagMallocCaller( size, TAG_SMALL, Com_ReturnAddress(), NULL, 0 );
 }
 #endif
 
@@ -1088,10 +1469,40 @@ static void Z_CheckHeap( void ) {
 		if ( block->next->prev != block) {
 			Com_Error( ERR_FATAL, "Z_CheckHeap: next block doesn't have proper back link" );
 		}
-		if ( !block->tag && !block->next->tag ) {
-			Com_Error( ERR_FATAL, "Z_CheckHeap: two consecutive free blocks" );
+		if ( !block->tag && !block->next->tag ) {
+			Com_Error( ERR_FATAL, "Z_CheckHeap: two consecutive free blocks" );
+		}
+	}
+}
+
+/*
+========================
+Z_LogBlock
+========================
+*/
+static void Z_LogBlock( memblock_t *block, int *size, int *allocSize, int *numBlocks ) {
+#ifdef ZONE_DEBUG
+	char dump[32], *ptr;
+	char		buf[4096];
+	int  i, j;
+
+	ptr = ((char *) block) + sizeof(memblock_t);
+	j = 0;
+	for (i = 0; i < 20 && i < block->d.allocSize; i++) {
+		if (ptr[i] >= 32 && ptr[i] < 127) {
+			dump[j++] = ptr[i];
+		}
+		else {
+			dump[j++] = '_';
 		}
 	}
+	dump[j] = '\0';
+	Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s) [%s]\r\n", block->d.allocSize, block->d.file, block->d.line, block->d.label, dump);
+	FS_Write(buf, strlen(buf), logfile);
+	*allocSize += block->d.allocSize;
+#endif
+	*size += block->size;
+	(*numBlocks)++;
 }
 
 /*
@@ -1100,42 +1511,30 @@ Z_LogZoneHeap
 ========================
 */
 void Z_LogZoneHeap( memzone_t *zone, char *name ) {
-#ifdef ZONE_DEBUG
-	char dump[32], *ptr;
-	int  i, j;
-#endif
-	memblock_t	*block;
+	memblock_t	*block, *slot;
+	zoneslab_t	*slab;
 	char		buf[4096];
 	int size, allocSize, numBlocks;
+	int			i;
 
 	if (!logfile || !FS_Initialized())
 		return;
 	size = numBlocks = 0;
-#ifdef ZONE_DEBUG
 	allocSize = 0;
-#endif
 	Com_sprintf(buf, sizeof(buf), "\r\n================\r\n%s log\r\n================\r\n", name);
 	FS_Write(buf, strlen(buf), logfile);
 	for (block = zone->blocklist.next ; block->next != &zone->blocklist; block = block->next) {
-		if (block->tag) {
-#ifdef ZONE_DEBUG
-			ptr = ((char *) block) + sizeof(memblock_t);
-			j = 0;
-			for (i = 0; i < 20 && i < block->d.allocSize; i++) {
-				if (ptr[i] >= 32 && ptr[i] < 127) {
-					dump[j++] = ptr[i];
-				}
-				else {
-					dump[j++] = '_';
+		if (block->tag == TAG_SLAB) {
+			slab = (zoneslab_t *)( block + 1 );
+			for (i = 0; i < ZONE_SLAB_SLOTS; i++) {
+				slot = Z_SlabSlot( slab, i );
+				if (slot->tag) {
+					Z_LogBlock( slot, &size, &allocSize, &numBlocks );
 				}
 			}
-			dump[j] = '\0';
-			Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s) [%s]\r\n", block->d.allocSize, block->d.file, block->d.line, block->d.label, dump);
-			FS_Write(buf, strlen(buf), logfile);
-			allocSize += block->d.allocSize;
-#endif
-			size += block->size;
-			numBlocks++;
+		}
+		else if (block->tag) {
+			Z_LogBlock( block, &size, &allocSize, &numBlocks );
 		}
 	}
 #ifdef ZONE_DEBUG
@@ -1236,6 +1635,13 @@ Goals:
   permanent allocations to the other side.  Permanent allocations should be
   kept on the side that has the current greatest wasted highwater mark.
 
+  Where the system allows it the block is only reserved address space, at least
+  HUNK_RESERVE_MEGS of it whatever com_hunkMegs says, and pages are committed in
+  HUNK_COMMIT_SIZE steps as the two ends grow.  Clearing the hunk or clearing to
+  the mark gives the pages in between back, and so does clearing the temp memory
+  once more than HUNK_TEMP_SLACK of it is left committed, so the reserve only
+  costs memory when a map actually needs it.
+
 ==============================================================================
 */
 
@@ -1272,6 +1678,20 @@ static	hunkUsed_t	*hunk_permanent, *hunk_temp;
 static	byte	*s_hunkData = NULL;
 static	int		s_hunkTotal;
 
+#define	HUNK_COMMIT_SIZE	( 1024 * 1024 )
+#define	HUNK_TEMP_SLACK		( 4 * HUNK_COMMIT_SIZE )	// kept committed for the next file load
+
+// address space to reserve for the hunk, the offsets into it are ints
+#if idx64 || defined(__LP64__) || defined(_WIN64)
+#define	HUNK_RESERVE_MEGS	1024
+#else
+#define	HUNK_RESERVE_MEGS	256
+#endif
+
+static	qboolean	s_hunkReserved;		// s_hunkData is committed on demand
+static	int		s_hunkLowCommitted;		// bytes backed at the start
+static	int		s_hunkHighCommitted;	// bytes backed at the end
+
 static	int		s_zoneTotal;
 static	int		s_smallZoneTotal;
 
@@ -1282,22 +1702,44 @@ Com_Meminfo_f
 =================
 */
 void Com_Meminfo_f( void ) {
-	memblock_t	*block;
+	memblock_t	*block, *slot;
+	zoneslab_t	*slab;
 	int			zoneBytes, zoneBlocks;
 	int			smallZoneBytes;
 	int			botlibBytes, rendererBytes;
+	int			slabBytes, slabFreeBytes;
 	int			unused;
+	int			i;
 
 	zoneBytes = 0;
 	botlibBytes = 0;
 	rendererBytes = 0;
 	zoneBlocks = 0;
+	slabBytes = 0;
+	slabFreeBytes = 0;
 	for (block = mainzone->blocklist.next ; ; block = block->next) {
 		if ( Cmd_Argc() != 1 ) {
 			Com_Printf ("block:%p    size:%7i    tag:%3i\n",
 				(void *)block, block->size, block->tag);
 		}
-		if ( block->tag ) {
+		if ( block->tag == TAG_SLAB ) {
+			slab = (zoneslab_t *)( block + 1 );
+			slabBytes += block->size;
+			for ( i = 0 ; i < ZONE_SLAB_SLOTS ; i++ ) {
+				slot = Z_SlabSlot( slab, i );
+				if ( !slot->tag ) {
+					slabFreeBytes += slot->size;
+					continue;
+				}
+				zoneBytes += slot->size;
+				zoneBlocks++;
+				if ( slot->tag == TAG_BOTLIB ) {
+					botlibBytes += slot->size;
+				} else if ( slot->tag == TAG_RENDERER ) {
+					rendererBytes += slot->size;
+				}
+			}
+		} else if ( block->tag ) {
 			zoneBytes += block->size;
 			zoneBlocks++;
 			if ( block->tag == TAG_BOTLIB ) {
@@ -1323,7 +1765,18 @@ void Com_Meminfo_f( void ) {
 
 	smallZoneBytes = 0;
 	for (block = smallzone->blocklist.next ; ; block = block->next) {
-		if ( block->tag ) {
+		if ( block->tag == TAG_SLAB ) {
+			slab = (zoneslab_t *)( block + 1 );
+			slabBytes += block->size;
+			for ( i = 0 ; i < ZONE_SLAB_SLOTS ; i++ ) {
+				slot = Z_SlabSlot( slab, i );
+				if ( slot->tag ) {
+					smallZoneBytes += slot->size;
+				} else {
+					slabFreeBytes += slot->size;
+				}
+			}
+		} else if ( block->tag ) {
 			smallZoneBytes += block->size;
 		}
 
@@ -1333,6 +1786,9 @@ void Com_Meminfo_f( void ) {
 	}
 
 	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
+	if ( s_hunkReserved ) {
+		Com_Printf( "%8i bytes committed hunk\n", s_hunkLowCommitted + s_hunkHighCommitted );
+	}
 	Com_Printf( "%8i bytes total zone\n", s_zoneTotal );
 	Com_Printf( "\n" );
 	Com_Printf( "%8i low mark\n", hunk_low.mark );
@@ -1364,6 +1820,7 @@ void Com_Meminfo_f( void ) {
 	Com_Printf( "        %8i bytes in dynamic renderer\n", rendererBytes );
 	Com_Printf( "        %8i bytes in dynamic other\n", zoneBytes - ( botlibBytes + rendererBytes ) );
 	Com_Printf( "        %8i bytes in small Zone memory\n", smallZoneBytes );
+	Com_Printf( "%8i bytes in zone slabs, %i in free slots\n", slabBytes, slabFreeBytes );
 }
 
 /*
@@ -1553,7 +2010,8 @@ void Com_InitHunkMemory( void ) {
 
 	// allocate the stack based hunk allocator
 	cv = Cvar_Get( "com_hunkMegs", DEF_COMHUNKMEGS_S, CVAR_LATCH | CVAR_ARCHIVE );
-	Cvar_SetDescription(cv, "The size of the hunk memory segment");
+	Cvar_SetDescription(cv, "The minimum size of the hunk memory segment, where pages are committed on demand "
+		XSTRING(HUNK_RESERVE_MEGS) " megs are reserved if that is more");
 
 	// if we are not dedicated min allocation is 56, otherwise min is 1
 	if (com_dedicated && com_dedicated->integer) {
@@ -1572,15 +2030,36 @@ void Com_InitHunkMemory( void ) {
 		s_hunkTotal = cv->integer * 1024 * 1024;
 	}
 
-	s_hunkData = calloc( s_hunkTotal + 31, 1 );
+	// the reserved range is page aligned and gets committed as it is used,
+	// so a generous ceiling costs nothing until a map needs it
+	if ( s_hunkTotal < HUNK_RESERVE_MEGS * 1024 * 1024 ) {
+		s_hunkData = Sys_ReserveMemory( HUNK_RESERVE_MEGS * 1024 * 1024 );
+		if ( s_hunkData ) {
+			s_hunkTotal = HUNK_RESERVE_MEGS * 1024 * 1024;
+		}
+	}
 	if ( !s_hunkData ) {
-		Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
+		s_hunkData = Sys_ReserveMemory( s_hunkTotal );
+	}
+	if ( s_hunkData ) {
+		s_hunkReserved = qtrue;
+		s_hunkLowCommitted = 0;
+		s_hunkHighCommitted = 0;
+	} else {
+		s_hunkData = calloc( s_hunkTotal + 31, 1 );
+		if ( !s_hunkData ) {
+			Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
+		}
+		// cacheline align
+		s_hunkData = (byte *) ( ( (intptr_t)s_hunkData + 31 ) & ~31 );
 	}
-	// cacheline align
-	s_hunkData = (byte *) ( ( (intptr_t)s_hunkData + 31 ) & ~31 );
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+
+	com_allocTrace = Cvar_Get( "com_allocTrace", "0", CVAR_TEMP );
+	Cvar_SetDescription( com_allocTrace, "Record zone and hunk allocations for allocstats" );
+	Cmd_AddCommand( "allocstats", Com_AllocStats_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -1604,6 +2083,82 @@ int	Hunk_MemoryRemaining( void ) {
 	return s_hunkTotal - ( low + high );
 }
 
+/*
+====================
+Hunk_Commit
+
+Makes sure the first low and the last high bytes of a reserved hunk
+are backed by memory
+====================
+*/
+static qboolean Hunk_Commit( int low, int high ) {
+	int		newLow, newHigh;
+
+	if ( !s_hunkReserved ) {
+		return qtrue;
+	}
+
+	newLow = PAD( low, HUNK_COMMIT_SIZE );
+	newHigh = PAD( high, HUNK_COMMIT_SIZE );
+
+	if ( newLow + newHigh > s_hunkTotal ) {
+		// the two ends share a step, commit everything in between
+		newLow = s_hunkTotal - s_hunkHighCommitted;
+		newHigh = s_hunkHighCommitted;
+	} else {
+		// the other end may already cover more than it needs
+		newLow = MIN( newLow, s_hunkTotal - s_hunkHighCommitted );
+		newHigh = MIN( newHigh, s_hunkTotal - MAX( newLow, s_hunkLowCommitted ) );
+	}
+
+	if ( newLow > s_hunkLowCommitted ) {
+		if ( !Sys_CommitMemory( s_hunkData + s_hunkLowCommitted, newLow - s_hunkLowCommitted ) ) {
+			return qfalse;
+		}
+		s_hunkLowCommitted = newLow;
+	}
+
+	if ( newHigh > s_hunkHighCommitted ) {
+		if ( !Sys_CommitMemory( s_hunkData + s_hunkTotal - newHigh, newHigh - s_hunkHighCommitted ) ) {
+			return qfalse;
+		}
+		s_hunkHighCommitted = newHigh;
+	}
+
+	return qtrue;
+}
+
+/*
+====================
+Hunk_Decommit
+
+Gives back the pages between the two ends that are no longer in use,
+except for slack bytes past each end
+====================
+*/
+static void Hunk_Decommit( int slack ) {
+	int		low, high;
+
+	if ( !s_hunkReserved ) {
+		return;
+	}
+
+	low = PAD( MAX( hunk_low.permanent, hunk_low.temp ), HUNK_COMMIT_SIZE ) + slack;
+	high = PAD( MAX( hunk_high.permanent, hunk_high.temp ), HUNK_COMMIT_SIZE ) + slack;
+	low = MIN( low, s_hunkLowCommitted );
+	high = MIN( high, s_hunkHighCommitted );
+
+	if ( low + high >= s_hunkTotal ||
+		( low == s_hunkLowCommitted && high == s_hunkHighCommitted ) ) {
+		return;
+	}
+
+	// everything outside the gap is committed, see Hunk_Commit
+	Sys_DecommitMemory( s_hunkData + low, s_hunkTotal - high - low );
+	s_hunkLowCommitted = low;
+	s_hunkHighCommitted = high;
+}
+
 /*
 ===================
 Hunk_SetMark
@@ -1626,6 +2181,9 @@ The client calls this before starting a vid_restart or snd_restart
 void Hunk_ClearToMark( void ) {
 	hunk_low.permanent = hunk_low.temp = hunk_low.mark;
 	hunk_high.permanent = hunk_high.temp = hunk_high.mark;
+
+	Com_TraceHunkClear();
+	Hunk_Decommit( 0 );
 }
 
 /*
@@ -1674,6 +2232,9 @@ void Hunk_Clear( void ) {
 	hunk_permanent = &hunk_low;
 	hunk_temp = &hunk_high;
 
+	Com_TraceHunkClear();
+	Hunk_Decommit( 0 );
+
 	Com_Printf( "Hunk_Clear: reset the hunk ok\n" );
 	VM_Clear();
 #ifdef HUNK_DEBUG
@@ -1736,7 +2297,9 @@ void *Hunk_Alloc( int size, ha_pref preference ) {
 	// round to cacheline
 	size = (size+31)&~31;
 
-	if ( hunk_low.temp + hunk_high.temp + size > s_hunkTotal ) {
+	if ( hunk_low.temp + hunk_high.temp + size > s_hunkTotal ||
+		!Hunk_Commit( hunk_low.temp + ( hunk_permanent == &hunk_low ? size : 0 ),
+			hunk_high.temp + ( hunk_permanent == &hunk_high ? size : 0 ) ) ) {
 #ifdef HUNK_DEBUG
 		Hunk_Log();
 		Hunk_SmallLog();
@@ -1772,6 +2335,10 @@ void *Hunk_Alloc( int size, ha_pref preference ) {
 		hunkblocks = block;
 		buf = ((byte *) buf) + sizeof(hunkblock_t);
 	}
+
+	Com_TraceAlloc( ALLOC_HUNK, buf, size, 0, NULL, file, line );
+#else
+	Com_TraceAlloc( ALLOC_HUNK, buf, size, 0, Com_ReturnAddress(), NULL, 0 );
 #endif
 	return buf;
 }
@@ -1802,7 +2369,9 @@ void *Hunk_AllocateTempMemory( int size ) {
 
 	size = PAD(size, sizeof(intptr_t)) + sizeof( hunkHeader_t );
 
-	if ( hunk_temp->temp + hunk_permanent->permanent + size > s_hunkTotal ) {
+	if ( hunk_temp->temp + hunk_permanent->permanent + size > s_hunkTotal ||
+		!Hunk_Commit( hunk_low.temp + ( hunk_temp == &hunk_low ? size : 0 ),
+			hunk_high.temp + ( hunk_temp == &hunk_high ? size : 0 ) ) ) {
 		Com_Error( ERR_DROP, "Hunk_AllocateTempMemory: failed on %i", size );
 	}
 
@@ -1824,6 +2393,8 @@ void *Hunk_AllocateTempMemory( int size ) {
 	hdr->magic = HUNK_MAGIC;
 	hdr->size = size;
 
+	Com_TraceAlloc( ALLOC_HUNKTEMP, buf, size, 0, Com_ReturnAddress(), NULL, 0 );
+
 	// don't bother clearing, because we are going to load a file over it
 	return buf;
 }
@@ -1855,6 +2426,8 @@ void Hunk_FreeTempMemory( void *buf ) {
 
 	hdr->magic = HUNK_FREE_MAGIC;
 
+	Com_TraceFree( buf );
+
 	// this only works if the files are freed in stack order,
 	// otherwise the memory will stay around until Hunk_ClearTempMemory
 	if ( hunk_temp == &hunk_low ) {
@@ -1885,7 +2458,415 @@ permanent allocs use this side.
 void Hunk_ClearTempMemory( void ) {
 	if ( s_hunkData != NULL ) {
 		hunk_temp->temp = hunk_temp->permanent;
+		Com_TraceHunkClear();
+		// this runs whenever the last loaded file is freed, so keep a
+		// little committed instead of faulting it back in for every file
+		Hunk_Decommit( HUNK_TEMP_SLACK );
+	}
+}
+
+/*
+===================================================================
+
+ALLOCATION TRACING
+
+With com_allocTrace 1 every zone and hunk allocation is recorded with
+its call site, size, tag and lifetime in a ring of the most recent
+ALLOC_TRACE_RECORDS allocations.  The call site is the file and line
+in builds with ZONE_DEBUG / HUNK_DEBUG, otherwise the return address,
+which can be resolved with "info symbol" in a debugger.  Botlib zone memory
+shows up with TAG_BOTLIB and the file and line in botlib that allocated it.
+===================================================================
+*/
+
+#define	ALLOC_TRACE_RECORDS	65536			// must be a power of two
+#define	ALLOC_TRACE_HASH	( ALLOC_TRACE_RECORDS * 2 )
+#define	ALLOC_TRACE_SITES	1024
+
+typedef struct {
+	void		*ptr;
+	const void	*caller;
+	const char	*file;
+	int			line;
+	int			size;
+	int			tag;
+	allocKind_t	kind;
+	int			seq;
+	int			allocTime;
+	int			freeTime;
+	qboolean	freed;
+} allocRecord_t;
+
+// maps a live pointer to the sequence number of its record
+typedef struct {
+	void		*ptr;
+	int			seq;
+} allocHash_t;
+
+typedef struct {
+	const void	*caller;
+	const char	*file;
+	int			line;
+	allocKind_t	kind;
+	int			tag;
+	int			count;
+	int			live;
+	int			bytes;
+	int			freedCount;
+	int64_t		lifetime;		// msec summed over the freed allocations
+} allocSite_t;
+
+static allocRecord_t	*allocRecords;
+static allocHash_t		*allocHash;
+static int				allocSequence;
+static int				allocTraceStart;
+static int				allocTraceFrees;
+
+/*
+=================
+Com_AllocHashSlot
+=================
+*/
+static int Com_AllocHashSlot( void *ptr ) {
+	return ( ( (size_t)ptr >> 4 ) * 2654435761u ) & ( ALLOC_TRACE_HASH - 1 );
+}
+
+/*
+=================
+Com_AllocHashRemove
+
+Linear probing, so the entries after the removed one are moved back
+=================
+*/
+static void Com_AllocHashRemove( int slot ) {
+	int		next, home;
+
+	allocHash[slot].ptr = NULL;
+	next = slot;
+	while ( 1 ) {
+		next = ( next + 1 ) & ( ALLOC_TRACE_HASH - 1 );
+		if ( !allocHash[next].ptr ) {
+			return;
+		}
+		home = Com_AllocHashSlot( allocHash[next].ptr );
+		// move it back if its home isn't cyclically in (slot, next]
+		if ( ( next > slot && ( home <= slot || home > next ) ) ||
+			( next < slot && ( home <= slot && home > next ) ) ) {
+			allocHash[slot] = allocHash[next];
+			allocHash[next].ptr = NULL;
+			slot = next;
+		}
+	}
+}
+
+/*
+=================
+Com_AllocRetire
+
+Marks the record of a live allocation as freed
+=================
+*/
+static void Com_AllocRetire( allocRecord_t *rec ) {
+	int		slot;
+
+	for ( slot = Com_AllocHashSlot( rec->ptr ) ; allocHash[slot].ptr ;
+		slot = ( slot + 1 ) & ( ALLOC_TRACE_HASH - 1 ) ) {
+		if ( allocHash[slot].ptr == rec->ptr ) {
+			Com_AllocHashRemove( slot );
+			break;
+		}
+	}
+
+	rec->freed = qtrue;
+	rec->freeTime = Sys_Milliseconds();
+	allocTraceFrees++;
+}
+
+/*
+=================
+Com_TraceAlloc
+=================
+*/
+static void Com_TraceAlloc( allocKind_t kind, void *ptr, int size, int tag,
+	const void *caller, const char *file, int line ) {
+	allocRecord_t	*rec;
+	int				slot;
+
+	if ( !com_allocTrace || !com_allocTrace->integer ) {
+		return;
+	}
+
+	if ( !allocRecords ) {
+		// not from the zone, so tracing doesn't show up in what it traces
+		allocRecords = calloc( ALLOC_TRACE_RECORDS, sizeof( *allocRecords ) );
+		allocHash = calloc( ALLOC_TRACE_HASH, sizeof( *allocHash ) );
+		if ( !allocRecords || !allocHash ) {
+			free( allocRecords );
+			free( allocHash );
+			allocRecords = NULL;
+			allocHash = NULL;
+			Com_Printf( "Couldn't allocate the allocation trace buffers\n" );
+			Cvar_Set( "com_allocTrace", "0" );
+			return;
+		}
+		allocTraceStart = Sys_Milliseconds();
+	}
+
+	rec = &allocRecords[allocSequence & ( ALLOC_TRACE_RECORDS - 1 )];
+	if ( rec->ptr && !rec->freed ) {
+		// falling out of the ring, nothing will look it up any more
+		for ( slot = Com_AllocHashSlot( rec->ptr ) ; allocHash[slot].ptr ;
+			slot = ( slot + 1 ) & ( ALLOC_TRACE_HASH - 1 ) ) {
+			if ( allocHash[slot].ptr == rec->ptr ) {
+				Com_AllocHashRemove( slot );
+				break;
+			}
+		}
+	}
+
+	rec->ptr = ptr;
+	rec->caller = caller;
+	rec->file = file;
+	rec->line = line;
+	rec->size = size;
+	rec->tag = tag;
+	rec->kind = kind;
+	rec->seq = allocSequence;
+	rec->allocTime = Sys_Milliseconds();
+	rec->freeTime = 0;
+	rec->freed = qfalse;
+
+	for ( slot = Com_AllocHashSlot( ptr ) ; allocHash[slot].ptr ;
+		slot = ( slot + 1 ) & ( ALLOC_TRACE_HASH - 1 ) ) {
+		if ( allocHash[slot].ptr == ptr ) {
+			break;		// stale entry of a record that fell out of the ring
+		}
+	}
+	allocHash[slot].ptr = ptr;
+	allocHash[slot].seq = allocSequence;
+
+	allocSequence++;
+}
+
+/*
+=================
+Com_TraceFree
+=================
+*/
+static void Com_TraceFree( void *ptr ) {
+	allocRecord_t	*rec;
+	int				slot;
+
+	if ( !allocHash ) {
+		return;
+	}
+
+	for ( slot = Com_AllocHashSlot( ptr ) ; allocHash[slot].ptr ;
+		slot = ( slot + 1 ) & ( ALLOC_TRACE_HASH - 1 ) ) {
+		if ( allocHash[slot].ptr == ptr ) {
+			rec = &allocRecords[allocHash[slot].seq & ( ALLOC_TRACE_RECORDS - 1 )];
+			if ( rec->seq == allocHash[slot].seq && rec->ptr == ptr && !rec->freed ) {
+				Com_AllocRetire( rec );
+			} else {
+				Com_AllocHashRemove( slot );
+			}
+			return;
+		}
+	}
+}
+
+/*
+=================
+Com_TraceHunkClear
+
+Retires the hunk records that are outside the used ends of the hunk
+=================
+*/
+static void Com_TraceHunkClear( void ) {
+	allocRecord_t	*rec;
+	int				i, ofs;
+
+	if ( !allocRecords ) {
+		return;
+	}
+
+	for ( i = 0, rec = allocRecords ; i < ALLOC_TRACE_RECORDS ; i++, rec++ ) {
+		if ( !rec->ptr || rec->freed || rec->kind == ALLOC_ZONE ) {
+			continue;
+		}
+		ofs = (byte *)rec->ptr - s_hunkData;
+		if ( ofs < MAX( hunk_low.permanent, hunk_low.temp ) ||
+			ofs >= s_hunkTotal - MAX( hunk_high.permanent, hunk_high.temp ) ) {
+			continue;
+		}
+		Com_AllocRetire( rec );
+	}
+}
+
+/*
+=================
+Com_AllocSiteCompare
+=================
+*/
+static int Com_AllocSiteCompare( const void *a, const void *b ) {
+	return ( (const allocSite_t *)b )->count - ( (const allocSite_t *)a )->count;
+}
+
+typedef struct {
+	int			counts[32], bytes[32];
+	int			freeBytes, freeBlocks, largest;
+} zoneFragments_t;
+
+/*
+=================
+Com_AddFragment
+=================
+*/
+static void Com_AddFragment( zoneFragments_t *frag, int size ) {
+	int		i;
+
+	for ( i = 0 ; ( size >> i ) > 1 && i < 31 ; i++ ) {
+	}
+	frag->counts[i]++;
+	frag->bytes[i] += size;
+	frag->freeBytes += size;
+	frag->freeBlocks++;
+	if ( size > frag->largest ) {
+		frag->largest = size;
+	}
+}
+
+/*
+=================
+Com_ZoneFragmentation
+
+Histogram of the free blocks in a zone by power of two size.  The free
+slots of the slabs count as blocks of their slot size, the TAG_SLAB
+blocks holding them are in use as far as the block list goes.
+=================
+*/
+static void Com_ZoneFragmentation( memzone_t *zone, const char *name ) {
+	zoneFragments_t	frag;
+	memblock_t		*block;
+	zoneslab_t		*slab;
+	int				i;
+
+	Com_Memset( &frag, 0, sizeof( frag ) );
+
+	for ( block = zone->blocklist.next ; block != &zone->blocklist ; block = block->next ) {
+		if ( !block->tag ) {
+			Com_AddFragment( &frag, block->size );
+		}
+	}
+	for ( i = 0 ; i < ZONE_SLAB_CLASSES ; i++ ) {
+		for ( slab = zone->slabs[i] ; slab ; slab = slab->next ) {
+			for ( block = slab->freeSlots ; block ; block = block->next ) {
+				Com_AddFragment( &frag, zoneSlabSizes[i] );
+			}
+		}
+	}
+
+	Com_Printf( "%s zone: %i bytes free in %i blocks, largest %i, %i%% fragmented\n",
+		name, frag.freeBytes, frag.freeBlocks, frag.largest,
+		frag.freeBytes ? (int)( ( frag.freeBytes - frag.largest ) * 100.0f / frag.freeBytes ) : 0 );
+	for ( i = 0 ; i < 32 ; i++ ) {
+		if ( frag.counts[i] ) {
+			Com_Printf( "  < %9u: %6i blocks %10i bytes\n", 2u << i, frag.counts[i], frag.bytes[i] );
+		}
+	}
+}
+
+/*
+=================
+Com_AllocStats_f
+
+Hot spot table of the traced allocations and the zone fragmentation
+=================
+*/
+static void Com_AllocStats_f( void ) {
+	static const char	*kindNames[] = { "zone", "hunk", "temp" };
+	allocRecord_t	*rec;
+	allocSite_t		*sites, *site;
+	int				numSites, numRecords, i, j, top, now;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "clear" ) ) {
+		if ( allocRecords ) {
+			Com_Memset( allocRecords, 0, ALLOC_TRACE_RECORDS * sizeof( *allocRecords ) );
+			Com_Memset( allocHash, 0, ALLOC_TRACE_HASH * sizeof( *allocHash ) );
+			allocSequence = 0;
+			allocTraceFrees = 0;
+			allocTraceStart = Sys_Milliseconds();
+		}
+		return;
+	}
+
+	Com_ZoneFragmentation( mainzone, "main" );
+	Com_ZoneFragmentation( smallzone, "small" );
+
+	if ( !allocRecords ) {
+		Com_Printf( "No allocations traced, set com_allocTrace 1 first\n" );
+		return;
+	}
+
+	sites = calloc( ALLOC_TRACE_SITES, sizeof( *sites ) );
+	if ( !sites ) {
+		return;
+	}
+
+	now = Sys_Milliseconds();
+	numSites = 0;
+	numRecords = MIN( allocSequence, ALLOC_TRACE_RECORDS );
+	for ( i = 0, rec = allocRecords ; i < numRecords ; i++, rec++ ) {
+		for ( j = 0, site = sites ; j < numSites ; j++, site++ ) {
+			if ( site->caller == rec->caller && site->line == rec->line &&
+				site->file == rec->file && site->kind == rec->kind && site->tag == rec->tag ) {
+				break;
+			}
+		}
+		if ( j == numSites ) {
+			if ( numSites == ALLOC_TRACE_SITES ) {
+				continue;
+			}
+			site->caller = rec->caller;
+			site->file = rec->file;
+			site->line = rec->line;
+			site->kind = rec->kind;
+			site->tag = rec->tag;
+			numSites++;
+		}
+		site->count++;
+		site->bytes += rec->size;
+		if ( rec->freed ) {
+			site->freedCount++;
+			site->lifetime += rec->freeTime - rec->allocTime;
+		} else {
+			site->live++;
+		}
+	}
+
+	qsort( sites, numSites, sizeof( *sites ), Com_AllocSiteCompare );
+
+	Com_Printf( "\n%i allocations, %i frees in %i seconds, last %i kept\n",
+		allocSequence, allocTraceFrees, ( now - allocTraceStart ) / 1000, numRecords );
+	Com_Printf( " count    bytes  live  avg life kind tag site\n" );
+
+	top = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20;
+	for ( i = 0, site = sites ; i < numSites && i < top ; i++, site++ ) {
+		Com_Printf( "%6i %8i %5i ", site->count, site->bytes, site->live );
+		if ( site->freedCount ) {
+			Com_Printf( "%8ims ", (int)( site->lifetime / site->freedCount ) );
+		} else {
+			Com_Printf( "       -  " );
+		}
+		Com_Printf( "%s %3i ", kindNames[site->kind], site->tag );
+		if ( site->file ) {
+			Com_Printf( "%s:%i\n", site->file, site->line );
+		} else {
+			Com_Printf( "%p\n", site->caller );
+		}
 	}
+
+	free( sites );
 }
 
 /*
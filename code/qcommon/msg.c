@@ -22,6 +22,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
+#if idx64
+#include <emmintrin.h>
+// compare entity states four words at a time, every x86_64 cpu has SSE2
+#define MSG_SSE_DELTA
+#endif
+
 static huffman_t		msgHuff;
 
 static qboolean			msgInit = qfalse;
@@ -101,6 +107,107 @@ bit functions
 =============================================================================
 */
 
+/*
+The bitstream is stored LSB first, and every byte above 7 bits is sent as its
+static Huffman code.  Since the tree is never adapted after MSG_initHuffman,
+the codes are flattened into tables so whole codes can be packed into a 64 bit
+accumulator and emitted a byte at a time instead of walking the tree per bit.
+Anything the tables can't handle (long codes, the end of the buffer) goes
+through the generic huffman.c routines, so the wire format and the overflow
+behaviour are exactly those of the bit-at-a-time code.
+*/
+
+#define HUFF_CODE_MAXBITS	24		// longer codes are sent through Huff_offsetTransmit
+#define HUFF_LOOKUP_BITS	11		// longer codes are decoded through Huff_offsetReceive
+#define HUFF_PEEK_BITS		24		// bits that must be left in the buffer for a table lookup
+
+static unsigned int		msgHuffCode[HMAX];		// code bits in transmit order, first bit lowest
+static byte				msgHuffCodeLen[HMAX];	// 0 if the symbol has to use the tree
+static unsigned short	msgHuffDecode[1 << HUFF_LOOKUP_BITS];	// symbol | length << 9, 0 if not in table
+
+/*
+================
+MSG_BuildHuffCodes
+
+Walks the tree and fills the encode or decode table for every leaf.
+================
+*/
+static void MSG_BuildHuffCodes( node_t *node, unsigned int code, int len, qboolean decode ) {
+	int		i;
+
+	if ( !node ) {
+		return;
+	}
+	if ( node->symbol == INTERNAL_NODE ) {
+		if ( len >= HUFF_CODE_MAXBITS ) {
+			return;
+		}
+		MSG_BuildHuffCodes( node->left, code, len + 1, decode );
+		MSG_BuildHuffCodes( node->right, code | ( 1u << len ), len + 1, decode );
+		return;
+	}
+	if ( decode ) {
+		if ( len == 0 || len > HUFF_LOOKUP_BITS ) {
+			return;
+		}
+		for ( i = 0 ; i < 1 << ( HUFF_LOOKUP_BITS - len ) ; i++ ) {
+			msgHuffDecode[code | ( i << len )] = node->symbol | ( len << 9 );
+		}
+	} else if ( node->symbol < HMAX && len > 0 ) {
+		msgHuffCode[node->symbol] = code;
+		msgHuffCodeLen[node->symbol] = len;
+	}
+}
+
+/*
+================
+MSG_PutBits
+
+Appends count (at most 57) bits to the stream.  Like Huff_putBit, a partially
+filled byte is or'ed into and every newly started byte is overwritten.
+================
+*/
+static void MSG_PutBits( byte *data, int *bit, uint64_t value, int count ) {
+	int		pos = *bit;
+	byte	*p = data + ( pos >> 3 );
+	int		shift = pos & 7;
+	int		end = shift + count;
+
+	value <<= shift;
+	if ( shift ) {
+		*p++ |= (byte)value;
+		value >>= 8;
+		end -= 8;
+	}
+	for ( ; end > 0 ; end -= 8 ) {
+		*p++ = (byte)value;
+		value >>= 8;
+	}
+	*bit = pos + count;
+}
+
+/*
+================
+MSG_GetBits
+
+Reads count (at most 25) bits, the caller has already checked the buffer size.
+================
+*/
+static unsigned int MSG_GetBits( const byte *data, int *bit, int count ) {
+	int				pos = *bit;
+	const byte		*p = data + ( pos >> 3 );
+	int				shift = pos & 7;
+	int				bytes = ( shift + count + 7 ) >> 3;
+	unsigned int	value = 0;
+	int				i;
+
+	for ( i = 0 ; i < bytes ; i++ ) {
+		value |= (unsigned int)p[i] << ( i << 3 );
+	}
+	*bit = pos + count;
+	return ( value >> shift ) & ( 0xffffffffu >> ( 32 - count ) );
+}
+
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	int	i;
@@ -143,31 +250,55 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			Com_Error( ERR_DROP, "can't write %d bits", bits );
 		}
 	} else {
-		value &= (0xffffffff >> (32 - bits));
+		unsigned int	uvalue;
+		const int		maxbits = msg->maxsize << 3;
+		uint64_t		acc;
+		int				accBits, ch, len;
+
+		uvalue = (unsigned int)value & (0xffffffff >> (32 - bits));
 		if ( bits&7 ) {
 			int nbits;
 			nbits = bits&7;
-			if ( msg->bit + nbits > msg->maxsize << 3 ) {
+			if ( msg->bit + nbits > maxbits ) {
 				msg->overflowed = qtrue;
 				return;
 			}
-			for( i = 0; i < nbits; i++ ) {
-				Huff_putBit( (value & 1), msg->data, &msg->bit );
-				value = (value >> 1);
-			}
+			MSG_PutBits( msg->data, &msg->bit, uvalue & ( ( 1 << nbits ) - 1 ), nbits );
+			uvalue >>= nbits;
 			bits = bits - nbits;
 		}
-		if ( bits ) {
-			for( i = 0; i < bits; i += 8 ) {
-				Huff_offsetTransmit( &msgHuff.compressor, (value & 0xff), msg->data, &msg->bit, msg->maxsize << 3 );
-				value = (value >> 8);
-
-				if ( msg->bit > msg->maxsize << 3 ) {
-					msg->overflowed = qtrue;
-					return;
+		acc = 0;
+		accBits = 0;
+		for( i = 0; i < bits; i += 8 ) {
+			ch = uvalue & 0xff;
+			uvalue >>= 8;
+			len = msgHuffCodeLen[ch];
+			if ( len && msg->bit + accBits + len <= maxbits ) {
+				acc |= (uint64_t)msgHuffCode[ch] << accBits;
+				accBits += len;
+				if ( accBits > 32 ) {
+					MSG_PutBits( msg->data, &msg->bit, acc, accBits );
+					acc = 0;
+					accBits = 0;
 				}
+				continue;
+			}
+
+			// long code or close to the end of the buffer
+			if ( accBits ) {
+				MSG_PutBits( msg->data, &msg->bit, acc, accBits );
+				acc = 0;
+				accBits = 0;
+			}
+			Huff_offsetTransmit( &msgHuff.compressor, ch, msg->data, &msg->bit, maxbits );
+			if ( msg->bit > maxbits ) {
+				msg->overflowed = qtrue;
+				return;
 			}
 		}
+		if ( accBits ) {
+			MSG_PutBits( msg->data, &msg->bit, acc, accBits );
+		}
 		msg->cursize = (msg->bit >> 3) + 1;
 	}
 }
@@ -177,7 +308,6 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			get;
 	qboolean	sgn;
 	int			i, nbits;
-//	FILE*	fp;
 
 	if ( msg->readcount > msg->cursize ) {
 		return 0;
@@ -222,31 +352,39 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		else
 			Com_Error(ERR_DROP, "can't read %d bits", bits);
 	} else {
+		const int	maxbits = msg->cursize << 3;
+		int			entry;
+
 		nbits = 0;
 		if (bits&7) {
 			nbits = bits&7;
-			if (msg->bit + nbits > msg->cursize << 3) {
+			if (msg->bit + nbits > maxbits) {
 				msg->readcount = msg->cursize + 1;
 				return 0;
 			}
-			for(i=0;i<nbits;i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
-			}
+			value = MSG_GetBits( msg->data, &msg->bit, nbits );
 			bits = bits - nbits;
 		}
-		if (bits) {
-//			fp = fopen("c:\\netchan.bin", "a");
-			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit, msg->cursize<<3);
-//				fwrite(&get, 1, 1, fp);
-				value = (unsigned int)value | ((unsigned int)get<<(i+nbits));
-
-				if (msg->bit > msg->cursize<<3) {
-					msg->readcount = msg->cursize + 1;
-					return 0;
-				}
+		for(i=0;i<bits;i+=8) {
+			entry = 0;
+			if ( msg->bit + HUFF_PEEK_BITS <= maxbits ) {
+				const byte *p = msg->data + ( msg->bit >> 3 );
+				unsigned int peek = ( p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) ) >> ( msg->bit & 7 );
+
+				entry = msgHuffDecode[peek & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 )];
+			}
+			if ( entry ) {
+				get = entry & 511;
+				msg->bit += entry >> 9;
+			} else {
+				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit, maxbits);
+			}
+			value = (unsigned int)value | ((unsigned int)get<<(i+nbits));
+
+			if (msg->bit > maxbits) {
+				msg->readcount = msg->cursize + 1;
+				return 0;
 			}
-//			fclose(fp);
 		}
 		msg->readcount = (msg->bit>>3)+1;
 	}
@@ -802,6 +940,105 @@ netField_t	entityStateFields[] =
 #define	FLOAT_INT_BITS	13
 #define	FLOAT_INT_BIAS	(1<<(FLOAT_INT_BITS-1))
 
+/*
+==================
+MSG_LowestBit
+==================
+*/
+static ID_INLINE int MSG_LowestBit( uint64_t mask ) {
+#ifdef __GNUC__
+	return __builtin_ctzll( mask );
+#else
+	int		bit;
+
+	for ( bit = 0 ; !( mask & 1 ) ; bit++ ) {
+		mask >>= 1;
+	}
+	return bit;
+#endif
+}
+
+#ifdef MSG_SSE_DELTA
+// entityStateFields index of every word of an entityState_t, the "number"
+// word is never compared
+static byte		msgEntityWordField[sizeof( entityState_t ) / 4];
+static qboolean	msgEntityWordsInit;
+
+/*
+==================
+MSG_InitEntityWords
+==================
+*/
+static void MSG_InitEntityWords( void ) {
+	int		i;
+
+	for ( i = 0 ; i < ARRAY_LEN( entityStateFields ) ; i++ ) {
+		msgEntityWordField[entityStateFields[i].offset / 4] = i;
+	}
+	msgEntityWordsInit = qtrue;
+}
+#endif
+
+/*
+==================
+MSG_EntityDeltaMask
+
+Returns a bit for every entityStateFields entry that differs between
+the two states, bit 0 for the first field.  The highest bit set is the
+last field a delta has to include.
+==================
+*/
+uint64_t MSG_EntityDeltaMask( const entityState_t *from, const entityState_t *to ) {
+	uint64_t	mask;
+	int			i;
+
+	// all fields should be 32 bits to avoid any compiler packing issues
+	// the "number" field is not part of the field list
+	// if this assert fails, someone added a field to the entityState_t
+	// struct without updating the message fields
+	assert( ARRAY_LEN( entityStateFields ) + 1 == sizeof( *from )/4 );
+
+#ifdef MSG_SSE_DELTA
+	{
+		uint64_t	words;
+		__m128i		a, b;
+
+		if ( !msgEntityWordsInit ) {
+			MSG_InitEntityWords();
+		}
+
+		// find the changed words in struct order
+		words = 0;
+		for ( i = 0 ; i < sizeof( *from ) / 16 ; i++ ) {
+			a = _mm_loadu_si128( (const __m128i *)from + i );
+			b = _mm_loadu_si128( (const __m128i *)to + i );
+			words |= (uint64_t)_mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( a, b ) ) ) << ( i * 4 );
+		}
+		words = ~words & ( ( (uint64_t)2 << ( sizeof( *from ) / 4 - 1 ) ) - 2 );
+
+		// then put them in field order
+		mask = 0;
+		while ( words ) {
+			mask |= (uint64_t)1 << msgEntityWordField[MSG_LowestBit( words )];
+			words &= words - 1;
+		}
+	}
+#else
+	{
+		const netField_t	*field;
+
+		mask = 0;
+		for ( i = 0, field = entityStateFields ; i < ARRAY_LEN( entityStateFields ) ; i++, field++ ) {
+			if ( *(int *)( (byte *)from + field->offset ) != *(int *)( (byte *)to + field->offset ) ) {
+				mask |= (uint64_t)1 << i;
+			}
+		}
+	}
+#endif
+
+	return mask;
+}
+
 /*
 ==================
 MSG_WriteDeltaEntity
@@ -815,21 +1052,6 @@ identical, under the assumption that the in-order delta code will catch it.
 */
 void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entityState_s *to, 
 						   qboolean force ) {
-	int			i, lc;
-	int			numFields;
-	netField_t	*field;
-	int			trunc;
-	float		fullFloat;
-	int			*fromF, *toF;
-
-	numFields = ARRAY_LEN( entityStateFields );
-
-	// all fields should be 32 bits to avoid any compiler packing issues
-	// the "number" field is not part of the field list
-	// if this assert fails, someone added a field to the entityState_t
-	// struct without updating the message fields
-	assert( numFields + 1 == sizeof( *from )/4 );
-
 	// a NULL to is a delta remove message
 	if ( to == NULL ) {
 		if ( from == NULL ) {
@@ -840,21 +1062,31 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 		return;
 	}
 
+	MSG_WriteDeltaEntityMask( msg, from, to, force, MSG_EntityDeltaMask( from, to ) );
+}
+
+/*
+==================
+MSG_WriteDeltaEntityMask
+
+MSG_WriteDeltaEntity for a change mask the caller already has from
+MSG_EntityDeltaMask, only the changed fields are looked at.
+==================
+*/
+void MSG_WriteDeltaEntityMask( msg_t *msg, const entityState_t *from, const entityState_t *to, 
+							   qboolean force, uint64_t mask ) {
+	int			i, lc;
+	int			skip;
+	netField_t	*field;
+	int			trunc;
+	float		fullFloat;
+	int			*toF;
+
 	if ( to->number < 0 || to->number >= MAX_GENTITIES ) {
 		Com_Error (ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
-	lc = 0;
-	// build the change vector as bytes so it is endien independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
-
-	if ( lc == 0 ) {
+	if ( mask == 0 ) {
 		// nothing at all changed
 		if ( !force ) {
 			return;		// nothing at all
@@ -866,22 +1098,26 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 		return;
 	}
 
+	for ( lc = 0 ; ( mask >> lc ) != 0 ; lc++ ) {
+	}
+
 	MSG_WriteBits( msg, to->number, GENTITYNUM_BITS );
 	MSG_WriteBits( msg, 0, 1 );			// not removed
 	MSG_WriteBits( msg, 1, 1 );			// we have a delta
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields;
-
-	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
+	oldsize += ARRAY_LEN( entityStateFields );
 
-		if ( *fromF == *toF ) {
-			MSG_WriteBits( msg, 0, 1 );	// no change
-			continue;
+	for ( i = 0 ; mask ; i++, mask &= mask - 1 ) {
+		// one no change bit for every field up to the next changed one,
+		// never more than seven in a write so they stay raw bits
+		for ( skip = MSG_LowestBit( mask ) - i ; skip > 0 ; skip -= 7 ) {
+			MSG_WriteBits( msg, 0, skip > 7 ? 7 : skip );
 		}
+		i = MSG_LowestBit( mask );
+		field = &entityStateFields[i];
+		toF = (int *)( (byte *)to + field->offset );
 
 		MSG_WriteBits( msg, 1, 1 );	// changed
 
@@ -1677,6 +1913,8 @@ void MSG_initHuffman( void ) {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+	MSG_BuildHuffCodes( msgHuff.compressor.tree, 0, 0, qfalse );
+	MSG_BuildHuffCodes( msgHuff.decompressor.tree, 0, 0, qtrue );
 }
 
 /*
@@ -131,6 +131,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define Q_EXPORT
 #endif
 
+#if (defined _MSC_VER)
+#define Q_THREADLOCAL __declspec(thread)
+#elif (defined __GNUC__)
+#define Q_THREADLOCAL __thread
+#else
+#define Q_THREADLOCAL
+#endif
+
 /**********************************************************************
   VM Considerations
 
@@ -100,6 +100,9 @@ void MSG_ReadDeltaUsercmdKey( msg_t *msg, int key, usercmd_t *from, usercmd_t *t
 
 void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entityState_s *to
 						   , qboolean force );
+uint64_t MSG_EntityDeltaMask( const entityState_t *from, const entityState_t *to );
+void MSG_WriteDeltaEntityMask( msg_t *msg, const entityState_t *from, const entityState_t *to,
+							   qboolean force, uint64_t mask );
 void MSG_ReadDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to, 
 						 int number );
 
@@ -334,7 +337,8 @@ typedef struct vm_s vm_t;
 typedef enum {
 	VMI_NATIVE,
 	VMI_BYTECODE,
-	VMI_COMPILED
+	VMI_COMPILED,
+	VMI_OPTIMIZED		// second tier compiler, falls back to VMI_COMPILED
 } vmInterpret_t;
 
 typedef enum {
@@ -367,10 +371,13 @@ void	VM_Forced_Unload_Done(void);
 vm_t	*VM_Restart(vm_t *vm, qboolean unpure);
 
 intptr_t		QDECL VM_Call( vm_t *vm, int callNum, ... );
+qboolean	VM_IsNative( vm_t *vm );
+intptr_t	VM_CallNative( vm_t *vm, int callNum, int arg );
 
 void	VM_Debug( int level );
 
 void	*VM_ArgPtr( intptr_t intValue );
+void	*VM_ArgBlock( intptr_t intValue, int size );
 void	*VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue );
 
 #define	VMA(x) VM_ArgPtr(args[x])
@@ -826,6 +833,9 @@ void 		QDECL Com_Printf( const char *fmt, ... ) __attribute__ ((format (printf,
 void 		QDECL Com_DPrintf( const char *fmt, ... ) __attribute__ ((format (printf, 1, 2)));
 void 		QDECL Com_Error( int code, const char *fmt, ... ) __attribute__ ((noreturn, format(printf, 2, 3)));
 void 		Com_Quit_f( void ) __attribute__ ((noreturn));
+void		Com_RunThreads( int count, void (*func)( int thread ) );
+// Sys_RunThreads where a Com_Error on any of the threads stops that
+// thread's work and is raised on the calling thread once all are done
 void		Com_GameRestart(int checksumFeed, qboolean disconnect);
 
 int			Com_Milliseconds( void );	// will be journaled properly
@@ -905,7 +915,8 @@ typedef enum {
 	TAG_BOTLIB,
 	TAG_RENDERER,
 	TAG_SMALL,
-	TAG_STATIC
+	TAG_STATIC,
+	TAG_SLAB		// zone block carved into small fixed-size slots, see Z_SlabAlloc
 } memtag_t;
 
 /*
@@ -943,6 +954,7 @@ void *Z_TagMalloc( int size, int tag );	// NOT 0 filled memory
 void *Z_Malloc( int size );			// returns 0 filled memory
 void *S_Malloc( int size );			// NOT 0 filled memory only for small allocations
 #endif
+void *Z_TagMallocSite( int size, int tag, char *file, int line );	// Z_TagMalloc for the code at file:line
 void Z_Free( void *ptr );
 void Z_FreeTags( int tag );
 int Z_AvailableMemory( void );
@@ -1082,6 +1094,7 @@ void	Sys_Init (void);
 // general development dll loading for virtual machine testing
 void	* QDECL Sys_LoadGameDll( const char *name, intptr_t (QDECL **entryPoint)(int, ...),
 				  intptr_t (QDECL *systemcalls)(intptr_t, ...) );
+void	*Sys_LoadGameDllFunction( void *dllHandle, const char *name );
 void	Sys_UnloadDll( void *dllHandle );
 
 qboolean Sys_DllExtension( const char *name );
@@ -1097,6 +1110,14 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+// monotonic, for timing short stretches of code
+int64_t	Sys_Nanoseconds( void );
+
+// runs func( 0 ) on the calling thread and func( 1 ) .. func( count - 1 )
+// on a pool of worker threads, returns when all of them have returned.
+// func may not Com_Error, use Com_RunThreads for that
+#define	MAX_SYS_THREADS	16
+void	Sys_RunThreads( int count, void (*func)( int thread ) );
 
 qboolean Sys_RandomBytes( byte *string, int len );
 
@@ -1140,6 +1161,12 @@ void	Sys_Sleep(int msec);
 
 qboolean Sys_LowPhysicalMemory( void );
 
+// address space reserved with Sys_ReserveMemory must be committed before use
+void	*Sys_ReserveMemory( size_t size );
+qboolean Sys_CommitMemory( void *ptr, size_t size );
+void	Sys_DecommitMemory( void *ptr, size_t size );
+void	Sys_ReleaseMemory( void *ptr, size_t size );
+
 void Sys_SetEnv(const char *name, const char *value);
 
 typedef enum
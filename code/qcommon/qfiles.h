@@ -488,4 +488,42 @@ typedef struct {
 } dsurface_t;
 
 
+/*
+==============================================================================
+
+  .tlog trace log file format
+
+  written by the server "tracelog" command, replayed by cmbench
+
+==============================================================================
+*/
+
+#define TLOG_IDENT			(('G'<<24)+('O'<<16)+('L'<<8)+'T')
+		// little-endian "TLOG"
+#define TLOG_VERSION		1
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			checksum;		// of the bsp, as sv_mapChecksum
+	char		mapname[MAX_QPATH];
+} tlogHeader_t;
+
+typedef enum {
+	TLOG_TRACE,					// SV_Trace
+	TLOG_POINTCONTENTS			// SV_PointContents, only start and passEntityNum are set
+} tlogType_t;
+
+typedef struct {
+	int			type;
+	float		start[3];
+	float		end[3];
+	float		mins[3];
+	float		maxs[3];
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+} tlogRecord_t;
+
+
 #endif
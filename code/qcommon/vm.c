@@ -43,12 +43,20 @@ int		vm_debugLevel;
 // used by Com_Error to get rid of running vm's before longjmp
 static int forced_unload;
 
+#ifdef VM_GUARD_DATA
+static cvar_t *vm_guardPages;
+#endif
+
 #define	MAX_VM		3
 vm_t	vmTable[MAX_VM];
 
 
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+#ifdef VM_SAMPLING
+void VM_VmSample_f( void );
+static void VM_DropSamples( vm_t *vm );
+#endif
 
 
 
@@ -73,9 +81,19 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	Cvar_SetDescription( Cvar_Get( "vm_cache", "0", CVAR_ARCHIVE ),
+		"Keep compiled x86_64 vm code in vmcache/ and reuse it when the same qvm is loaded again" );
+
+#ifdef VM_GUARD_DATA
+	vm_guardPages = Cvar_Get( "vm_guardPages", "1", CVAR_ARCHIVE );
+	Cvar_SetDescription( vm_guardPages, "Place compiled vm data between guard pages instead of masking every access" );
+#endif
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+#ifdef VM_SAMPLING
+	Cmd_AddCommand ("vmsample", VM_VmSample_f );
+#endif
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -281,6 +299,8 @@ void VM_LoadSymbols( vm_t *vm ) {
 		prev = &sym->next;
 		sym->next = NULL;
 
+		sym->symInstruction = value;
+
 		// convert value from an instruction number to a code offset
 		if ( value >= 0 && value < numInstructions ) {
 			value = vm->instructionPointers[value];
@@ -356,6 +376,32 @@ intptr_t QDECL VM_DllSyscall( intptr_t arg, ... ) {
 }
 
 
+#ifdef VM_GUARD_DATA
+/*
+=================
+VM_AllocGuardedData
+
+Reserve the whole range compiled code can reach with a 32 bit offset and
+a 32 bit displacement from dataBase, only the data itself is committed
+=================
+*/
+static byte *VM_AllocGuardedData( int size )
+{
+	byte *base = Sys_ReserveMemory( VM_GUARD_SIZE );
+
+	if ( !base )
+		return NULL;
+
+	if ( !Sys_CommitMemory( base + VM_GUARD_LOW, size ) )
+	{
+		Sys_ReleaseMemory( base, VM_GUARD_SIZE );
+		return NULL;
+	}
+
+	return base + VM_GUARD_LOW;
+}
+#endif
+
 /*
 =================
 VM_LoadQVM
@@ -453,8 +499,18 @@ vmHeader_t *VM_LoadQVM( vm_t *vm, qboolean alloc, qboolean unpure)
 		// allocate zero filled space for initialized and uninitialized data
 		// leave some space beyond data mask so we can secure all mask operations
 		vm->dataAlloc = dataLength + 4;
-		vm->dataBase = Hunk_Alloc(vm->dataAlloc, h_high);
 		vm->dataMask = dataLength - 1;
+
+#ifdef VM_GUARD_DATA
+		if(vm->guarded && !(vm->dataBase = VM_AllocGuardedData(vm->dataAlloc)))
+		{
+			Com_Printf(S_COLOR_YELLOW "Warning: couldn't reserve guarded data for %s\n", filename);
+			vm->guarded = qfalse;
+		}
+
+		if(!vm->guarded)
+#endif
+		vm->dataBase = Hunk_Alloc(vm->dataAlloc, h_high);
 	}
 	else
 	{
@@ -565,6 +621,36 @@ vm_t *VM_Restart(vm_t *vm, qboolean unpure)
 	return vm;
 }
 
+/*
+================
+VM_SandboxError
+================
+*/
+static void VM_SandboxError( const char *message ) {
+	Com_Error( ERR_DROP, "%s: %s", currentVM ? currentVM->name : "vm", message );
+}
+
+/*
+================
+VM_SandboxDll
+
+Dlls translated from a qvm by qvm2c keep the data segment of the qvm and
+pass vm addresses instead of pointers, so the syscall arguments are masked
+and offset like for bytecode
+================
+*/
+static void VM_SandboxDll( vm_t *vm ) {
+	void	(*dllSandbox)( void (*error)( const char *message ), byte **dataBase, int *dataMask );
+
+	dllSandbox = Sys_LoadGameDllFunction( vm->dllHandle, "dllSandbox" );
+	if ( !dllSandbox ) {
+		return;
+	}
+
+	dllSandbox( VM_SandboxError, &vm->dataBase, &vm->dataMask );
+	Com_Printf( "%s is a translated qvm with %i bytes of data\n", vm->name, vm->dataMask + 1 );
+}
+
 /*
 ================
 VM_Create
@@ -623,6 +709,7 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 			if(vm->dllHandle)
 			{
 				vm->systemCall = systemCalls;
+				VM_SandboxDll( vm );
 				return vm;
 			}
 			
@@ -631,6 +718,10 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 		else if(retval == VMI_COMPILED)
 		{
 			vm->searchPath = startSearch;
+#ifdef VM_GUARD_DATA
+			// the compiler decides about masking, but the data has to be placed first
+			vm->guarded = ( interpret != VMI_BYTECODE && vm_guardPages->integer );
+#endif
 			if((header = VM_LoadQVM(vm, qtrue, qfalse)))
 				break;
 
@@ -662,6 +753,7 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	if(interpret != VMI_BYTECODE)
 	{
 		vm->compiled = qtrue;
+		vm->optimize = ( interpret == VMI_OPTIMIZED );
 		VM_Compile( vm, header );
 	}
 #endif
@@ -706,6 +798,10 @@ void VM_Free( vm_t *vm ) {
 		}
 	}
 
+#ifdef VM_SAMPLING
+	VM_DropSamples( vm );
+#endif
+
 	if(vm->destroy)
 		vm->destroy(vm);
 
@@ -713,6 +809,11 @@ void VM_Free( vm_t *vm ) {
 		Sys_UnloadDll( vm->dllHandle );
 		Com_Memset( vm, 0, sizeof( *vm ) );
 	}
+#ifdef VM_GUARD_DATA
+	if ( vm->guarded && vm->dataBase ) {
+		Sys_ReleaseMemory( vm->dataBase - VM_GUARD_LOW, VM_GUARD_SIZE );
+	}
+#endif
 #if 0	// now automatically freed by hunk
 	if ( vm->codeBase ) {
 		Z_Free( vm->codeBase );
@@ -739,6 +840,11 @@ void VM_Clear(void) {
 
 void VM_Forced_Unload_Start(void) {
 	forced_unload = 1;
+#ifdef VM_SAMPLING
+	// the error longjmps past every VM_CallCompiled frame, which can't
+	// put back the stack top of the calls around them
+	vm_sampleStackTop = NULL;
+#endif
 }
 
 void VM_Forced_Unload_Done(void) {
@@ -753,7 +859,8 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	if ( currentVM==NULL )
 	  return NULL;
 
-	if ( currentVM->entryPoint ) {
+	// translated qvms have a dataMask, real dlls pass pointers
+	if ( currentVM->entryPoint && !currentVM->dataMask ) {
 		return (void *)(currentVM->dataBase + intValue);
 	}
 	else {
@@ -761,6 +868,32 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	}
 }
 
+/*
+============
+VM_ArgBlock
+
+Like VM_ArgPtr for an array of size bytes, which has to lie
+completely inside the data segment of the vm
+============
+*/
+void *VM_ArgBlock( intptr_t intValue, int size ) {
+	if ( !intValue || !currentVM ) {
+		return NULL;
+	}
+
+	if ( currentVM->entryPoint && !currentVM->dataMask ) {
+		return (void *)(currentVM->dataBase + intValue);
+	}
+
+	intValue &= currentVM->dataMask;
+	if ( size < 0 || intValue + size > currentVM->dataMask + 1 ) {
+		Com_Error( ERR_DROP, "VM_ArgBlock: %s block of %i bytes at %i exceeds data segment",
+			currentVM->name, size, (int)intValue );
+	}
+
+	return (void *)(currentVM->dataBase + intValue);
+}
+
 void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	if ( !intValue ) {
 		return NULL;
@@ -771,7 +904,7 @@ void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	  return NULL;
 
 	//
-	if ( vm->entryPoint ) {
+	if ( vm->entryPoint && !vm->dataMask ) {
 		return (void *)(vm->dataBase + intValue);
 	}
 	else {
@@ -872,6 +1005,36 @@ intptr_t QDECL VM_Call( vm_t *vm, int callnum, ... )
 	return r;
 }
 
+/*
+==============
+VM_IsNative
+
+True for a real dll, not for a qvm translated by qvm2c: those keep their
+program stack in one global and are built by lcc, where Q_THREADLOCAL is
+empty, so they can't be entered from several threads
+==============
+*/
+qboolean VM_IsNative( vm_t *vm ) {
+	return vm && vm->dllHandle != NULL && !vm->dataMask;
+}
+
+/*
+==============
+VM_CallNative
+
+Calls into a native module without touching currentVM or the call level,
+so other threads can use it while the owning thread is inside a VM_Call
+of the same vm.  The module's system calls still go to currentVM.
+==============
+*/
+intptr_t VM_CallNative( vm_t *vm, int callnum, int arg ) {
+	if ( !VM_IsNative( vm ) ) {
+		Com_Error( ERR_FATAL, "VM_CallNative on %s, which is not native", vm ? vm->name : "NULL" );
+	}
+
+	return vm->entryPoint( callnum, arg, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+}
+
 //=================================================================
 
 static int QDECL VM_ProfileSort( const void *a, const void *b ) {
@@ -936,6 +1099,465 @@ void VM_VmProfile_f( void ) {
 	Z_Free( sorted );
 }
 
+#ifdef VM_SAMPLING
+/*
+=================================================================================
+
+SAMPLING PROFILER
+
+A timer signal records where compiled code is running. The stack is walked by
+looking for return addresses into the code between the sampled stack pointer
+and the frame of the innermost VM_CallCompiled, so a sample holds the whole
+chain of qvm procedures. Samples taken in engine code called by the vm are
+attributed to a [syscall] frame.
+
+=================================================================================
+*/
+
+#define	MAX_VM_SAMPLES		16384
+#define	MAX_SAMPLE_DEPTH	16
+#define	MAX_SAMPLE_STACK	0x40000		// bytes of native stack to scan
+#define	SAMPLE_SYSCALL		-1
+
+typedef struct {
+	int		vm;						// index into vmTable
+	int		depth;
+	int		frames[MAX_SAMPLE_DEPTH];	// instruction numbers, innermost first
+} vmSample_t;
+
+void			*vm_sampleStackTop;
+
+static vmSample_t	*vm_samples;
+static volatile int	vm_numSamples;
+static volatile int	vm_droppedSamples;
+static qboolean		vm_sampling;
+
+/*
+===============
+VM_PointerToInstruction
+
+Binary search for the instruction containing compiled code at ptr,
+-1 for the stubs in front of the first instruction
+===============
+*/
+static int VM_PointerToInstruction( vm_t *vm, byte *ptr ) {
+	int		low, high, mid;
+
+	if ( ptr < (byte *)vm->instructionPointers[0] ) {
+		return -1;
+	}
+
+	low = 0;
+	high = vm->instructionCount - 1;
+	while ( low < high ) {
+		mid = ( low + high + 1 ) / 2;
+		if ( (byte *)vm->instructionPointers[mid] <= ptr ) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	return low;
+}
+
+static qboolean VM_IsCompiledCode( vm_t *vm, byte *ptr ) {
+	return vm->compiled && vm->codeBase && ptr >= vm->codeBase && ptr < vm->codeBase + vm->codeLength;
+}
+
+/*
+===============
+VM_RecordSample
+
+Runs inside the signal handler, must not call into anything
+===============
+*/
+void VM_RecordSample( void *pc, void **sp ) {
+	vmSample_t	*sample;
+	vm_t		*vm;
+	void		**p, **top;
+	int			i;
+
+	vm = currentVM;
+	if ( !vm_samples || !vm || !vm->callLevel || !vm->compiled ) {
+		return;
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( VM_IsCompiledCode( &vmTable[i], pc ) ) {
+			vm = &vmTable[i];
+			break;
+		}
+	}
+
+	if ( vm_numSamples >= MAX_VM_SAMPLES ) {
+		vm_droppedSamples++;
+		return;
+	}
+
+	sample = &vm_samples[vm_numSamples];
+	sample->vm = vm - vmTable;
+	sample->depth = 1;
+	sample->frames[0] = VM_IsCompiledCode( vm, pc ) ? VM_PointerToInstruction( vm, pc ) : SAMPLE_SYSCALL;
+
+	top = vm_sampleStackTop;
+	if ( top && sp < top && (byte *)top - (byte *)sp <= MAX_SAMPLE_STACK ) {
+		for ( p = sp ; p < top && sample->depth < MAX_SAMPLE_DEPTH ; p++ ) {
+			// return addresses point behind the call, the ones into
+			// the stubs in front of the code are not procedures
+			if ( VM_IsCompiledCode( vm, *p ) && (byte *)*p > (byte *)vm->instructionPointers[0] ) {
+				sample->frames[sample->depth++] = VM_PointerToInstruction( vm, (byte *)*p - 1 );
+			}
+		}
+	}
+
+	vm_numSamples++;
+}
+
+/*
+===============
+VM_DropSamples
+
+The instruction numbers are meaningless once the vm is gone
+===============
+*/
+static void VM_DropSamples( vm_t *vm ) {
+	int		i;
+
+	if ( !vm_samples ) {
+		return;
+	}
+
+	for ( i = 0 ; i < vm_numSamples ; i++ ) {
+		if ( vm_samples[i].vm == vm - vmTable ) {
+			vm_samples[i].vm = -1;
+		}
+	}
+}
+
+/*
+===============
+VM_SortedSymbols
+
+Symbols ordered by instruction number for VM_FrameSymbol
+===============
+*/
+static QDECL int VM_SymbolInstructionSort( const void *a, const void *b ) {
+	return (*(vmSymbol_t **)a)->symInstruction - (*(vmSymbol_t **)b)->symInstruction;
+}
+
+static vmSymbol_t **VM_SortedSymbols( vm_t *vm ) {
+	vmSymbol_t	**sorted, *sym;
+	int			i;
+
+	if ( !vm->numSymbols ) {
+		return NULL;
+	}
+
+	sorted = Z_Malloc( vm->numSymbols * sizeof( *sorted ) );
+	for ( i = 0, sym = vm->symbols ; i < vm->numSymbols && sym ; i++, sym = sym->next ) {
+		sorted[i] = sym;
+	}
+
+	qsort( sorted, vm->numSymbols, sizeof( *sorted ), VM_SymbolInstructionSort );
+	return sorted;
+}
+
+/*
+===============
+VM_FrameSymbol
+
+Index of the procedure containing instruction, -1 if there is none
+===============
+*/
+static int VM_FrameSymbol( vm_t *vm, vmSymbol_t **sorted, int instruction ) {
+	int		low, high, mid;
+
+	if ( !sorted || instruction < sorted[0]->symInstruction ) {
+		return -1;
+	}
+
+	low = 0;
+	high = vm->numSymbols - 1;
+	while ( low < high ) {
+		mid = ( low + high + 1 ) / 2;
+		if ( sorted[mid]->symInstruction <= instruction ) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	return low;
+}
+
+static const char *VM_FrameName( vm_t *vm, vmSymbol_t **sorted, int instruction ) {
+	int		index;
+
+	if ( instruction == SAMPLE_SYSCALL ) {
+		return "[syscall]";
+	}
+
+	index = VM_FrameSymbol( vm, sorted, instruction );
+	if ( index < 0 ) {
+		return va( "%s:%i", vm->name, instruction );
+	}
+
+	return sorted[index]->symName;
+}
+
+/*
+===============
+VM_SampleFlat
+
+Self and total samples per procedure
+===============
+*/
+typedef struct {
+	const char	*name;
+	int			self;
+	int			total;
+} vmFlatEntry_t;
+
+static QDECL int VM_FlatSort( const void *a, const void *b ) {
+	const vmFlatEntry_t *fa = a, *fb = b;
+
+	if ( fa->self != fb->self ) {
+		return fb->self - fa->self;
+	}
+	return fb->total - fa->total;
+}
+
+static void VM_SampleFlat( vm_t *vm ) {
+	vmSymbol_t		**sorted;
+	vmFlatEntry_t	*entries;
+	vmSample_t		*sample;
+	int				numEntries, total;
+	int				i, j, k, index;
+	int				seen[MAX_SAMPLE_DEPTH];
+
+	sorted = VM_SortedSymbols( vm );
+
+	// one entry per symbol plus [syscall] and unknown code
+	numEntries = vm->numSymbols + 2;
+	entries = Z_Malloc( numEntries * sizeof( *entries ) );
+	for ( i = 0 ; i < vm->numSymbols ; i++ ) {
+		entries[i].name = sorted[i]->symName;
+	}
+	entries[vm->numSymbols].name = "[syscall]";
+	entries[vm->numSymbols + 1].name = sorted ? "[unknown]" : "[no symbols]";
+
+	total = 0;
+	for ( i = 0 ; i < vm_numSamples ; i++ ) {
+		sample = &vm_samples[i];
+		if ( sample->vm != vm - vmTable ) {
+			continue;
+		}
+		total++;
+
+		for ( j = 0 ; j < sample->depth ; j++ ) {
+			if ( sample->frames[j] == SAMPLE_SYSCALL ) {
+				index = vm->numSymbols;
+			} else {
+				index = VM_FrameSymbol( vm, sorted, sample->frames[j] );
+				if ( index < 0 ) {
+					index = vm->numSymbols + 1;
+				}
+			}
+
+			if ( !j ) {
+				entries[index].self++;
+			}
+
+			// recursive procedures count once per sample
+			for ( k = 0 ; k < j ; k++ ) {
+				if ( seen[k] == index ) {
+					break;
+				}
+			}
+			seen[j] = index;
+			if ( k == j ) {
+				entries[index].total++;
+			}
+		}
+	}
+
+	qsort( entries, numEntries, sizeof( *entries ), VM_FlatSort );
+
+	Com_Printf( "%s: %i samples\n", vm->name, total );
+	Com_Printf( " self%%  total%%    self   total  procedure\n" );
+	for ( i = 0 ; i < numEntries && total ; i++ ) {
+		if ( !entries[i].total ) {
+			continue;
+		}
+		Com_Printf( "%5.1f%% %5.1f%% %7i %7i  %s\n", 100.0f * entries[i].self / total,
+			100.0f * entries[i].total / total, entries[i].self, entries[i].total, entries[i].name );
+	}
+
+	Z_Free( entries );
+	if ( sorted ) {
+		Z_Free( sorted );
+	}
+}
+
+/*
+===============
+VM_SampleCollapsed
+
+One line per distinct stack, outermost procedure first, as used by
+flame graph tools
+===============
+*/
+static QDECL int VM_StackSort( const void *a, const void *b ) {
+	return strcmp( *(const char **)a, *(const char **)b );
+}
+
+static void VM_SampleCollapsed( const char *filename ) {
+	vmSample_t		*sample;
+	vmSymbol_t		**sorted[MAX_VM];
+	char			**stacks;
+	fileHandle_t	f = 0;
+	char			line[MAX_STRING_CHARS];
+	int				numStacks, numLines, count;
+	int				i, j;
+
+	if ( filename ) {
+		f = FS_FOpenFileWrite( filename );
+		if ( !f ) {
+			Com_Printf( "Couldn't write %s\n", filename );
+			return;
+		}
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		sorted[i] = vmTable[i].name[0] ? VM_SortedSymbols( &vmTable[i] ) : NULL;
+	}
+
+	// samples at different instructions of the same procedures merge
+	// into a single line, so build the names first
+	stacks = Z_Malloc( vm_numSamples * sizeof( *stacks ) + 1 );
+	for ( i = numStacks = 0 ; i < vm_numSamples ; i++ ) {
+		vm_t	*vm;
+
+		sample = &vm_samples[i];
+		if ( sample->vm < 0 ) {
+			continue;
+		}
+
+		vm = &vmTable[sample->vm];
+		Q_strncpyz( line, vm->name, sizeof( line ) );
+		for ( j = sample->depth - 1 ; j >= 0 ; j-- ) {
+			Q_strcat( line, sizeof( line ), ";" );
+			Q_strcat( line, sizeof( line ), VM_FrameName( vm, sorted[sample->vm], sample->frames[j] ) );
+		}
+		stacks[numStacks++] = CopyString( line );
+	}
+
+	qsort( stacks, numStacks, sizeof( *stacks ), VM_StackSort );
+
+	for ( i = numLines = 0 ; i < numStacks ; i += count, numLines++ ) {
+		for ( count = 1 ; i + count < numStacks ; count++ ) {
+			if ( strcmp( stacks[i], stacks[i + count] ) ) {
+				break;
+			}
+		}
+
+		Com_sprintf( line, sizeof( line ), "%s %i\n", stacks[i], count );
+		if ( f ) {
+			FS_Write( line, strlen( line ), f );
+		} else {
+			Com_Printf( "%s", line );
+		}
+	}
+
+	if ( f ) {
+		FS_FCloseFile( f );
+		Com_Printf( "Wrote %i stacks to %s\n", numLines, filename );
+	}
+
+	for ( i = 0 ; i < numStacks ; i++ ) {
+		Z_Free( stacks[i] );
+	}
+	Z_Free( stacks );
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( sorted[i] ) {
+			Z_Free( sorted[i] );
+		}
+	}
+}
+
+/*
+==============
+VM_VmSample_f
+
+==============
+*/
+void VM_VmSample_f( void ) {
+	const char	*cmd = Cmd_Argv( 1 );
+	vm_t		*vm;
+	int			hz;
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		hz = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 1000;
+		if ( hz <= 0 ) {
+			hz = 1000;
+		}
+
+		if ( !vm_samples ) {
+			vm_samples = Z_Malloc( MAX_VM_SAMPLES * sizeof( *vm_samples ) );
+		}
+
+		if ( !vm_sampling && !VM_StartSampling( hz ) ) {
+			Com_Printf( "Couldn't start sampling\n" );
+			return;
+		}
+
+		vm_sampling = qtrue;
+		Com_Printf( "Sampling compiled vm code at %i Hz\n", hz );
+	} else if ( !Q_stricmp( cmd, "stop" ) ) {
+		if ( vm_sampling ) {
+			VM_StopSampling();
+			vm_sampling = qfalse;
+		}
+		Com_Printf( "%i samples, %i dropped\n", vm_numSamples, vm_droppedSamples );
+	} else if ( !Q_stricmp( cmd, "clear" ) ) {
+		vm_numSamples = 0;
+		vm_droppedSamples = 0;
+	} else if ( !Q_stricmp( cmd, "flat" ) ) {
+		if ( !vm_samples ) {
+			return;
+		}
+
+		if ( Cmd_Argc() > 2 ) {
+			for ( vm = vmTable ; vm < vmTable + MAX_VM ; vm++ ) {
+				if ( !Q_stricmp( vm->name, Cmd_Argv( 2 ) ) ) {
+					break;
+				}
+			}
+			if ( vm == vmTable + MAX_VM ) {
+				Com_Printf( "No vm named %s\n", Cmd_Argv( 2 ) );
+				return;
+			}
+			VM_SampleFlat( vm );
+		} else {
+			for ( vm = vmTable ; vm < vmTable + MAX_VM ; vm++ ) {
+				if ( vm->name[0] && vm->compiled ) {
+					VM_SampleFlat( vm );
+				}
+			}
+		}
+	} else if ( !Q_stricmp( cmd, "collapsed" ) ) {
+		if ( !vm_samples ) {
+			return;
+		}
+
+		VM_SampleCollapsed( Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : NULL );
+	} else {
+		Com_Printf( "usage: vmsample <start [hz] | stop | clear | flat [vm] | collapsed [file]>\n" );
+	}
+}
+#endif
+
 /*
 ==============
 VM_VmInfo_f
@@ -953,11 +1575,18 @@ void VM_VmInfo_f( void ) {
 			break;
 		}
 		Com_Printf( "%s : ", vm->name );
+		if ( vm->dllHandle && vm->dataMask ) {
+			Com_Printf( "native (translated qvm)\n" );
+			Com_Printf( "    data length : %7i\n", vm->dataMask + 1 );
+			continue;
+		}
 		if ( vm->dllHandle ) {
 			Com_Printf( "native\n" );
 			continue;
 		}
-		if ( vm->compiled ) {
+		if ( vm->compiled && vm->optimize ) {
+			Com_Printf( "compiled on load (optimized)\n" );
+		} else if ( vm->compiled ) {
 			Com_Printf( "compiled on load\n" );
 		} else {
 			Com_Printf( "interpreted\n" );
@@ -610,6 +610,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 #define OFF_IMMEDIATES 1
 
 	vm->compiled = qfalse;
+	vm->optimize = qfalse;	// no second tier compiler
 
 	vm->codeBase = NULL;
 	vm->codeLength = 0;
@@ -108,7 +108,14 @@ static char	*opnames[256] = {
 	"OP_MULF",
 
 	"OP_CVIF",
-	"OP_CVFI"
+	"OP_CVFI",
+
+	"OP_LOCAL_LOAD4",
+	"OP_CONST_ADD",
+	"OP_CONST_LOAD4",
+	"OP_CONST_JUMP",
+	"OP_ADD_LOAD4",
+	"OP_LOAD4_STORE4"
 };
 #endif
 
@@ -141,6 +148,31 @@ static ID_INLINE unsigned int __lwbrx(register void *addr,
     }
 #endif
 
+// dispatch through a table of label addresses where the compiler allows it,
+// VM_PrepareInterpreter then stores handler addresses instead of opcodes
+#if defined(__GNUC__) && !defined(DEBUG_VM)
+  #define VM_THREADED
+#endif
+
+// super-instructions for the most common pairs. Only the opcode of the first
+// instruction is replaced, the second one stays in place for jumps into it.
+typedef enum {
+	OP_LOCAL_LOAD4 = OP_CVFI + 1,
+	OP_CONST_ADD,
+	OP_CONST_LOAD4,
+	OP_CONST_JUMP,
+	OP_ADD_LOAD4,
+	OP_LOAD4_STORE4,
+
+	OP_NUM_INTERPRETED
+} superOpcode_t;
+
+#ifdef VM_THREADED
+static const void * const *vm_dispatch;
+#endif
+
+static int VM_Interpret( vm_t *vm, int *args, const void * const **dispatch );
+
 char *VM_Indent( vm_t *vm ) {
 	static char	*string = "                                        ";
 	if ( vm->callLevel > 20 ) {
@@ -162,6 +194,147 @@ void VM_StackTrace( vm_t *vm, int programCounter, int programStack ) {
 }
 
 
+/*
+====================
+VM_DivI, VM_ModI, VM_DivU, VM_ModU, VM_FloatToInt
+
+Defined for every operand, qvm2c emits the same helpers so translated
+qvms compute what the interpreter does.  INT_MIN / -1 wraps like the
+other integer ops, and a float that doesn't fit truncates to INT_MIN
+like cvttss2si in vm_x86
+====================
+*/
+static ID_INLINE int VM_DivI( int a, int b ) {
+	if ( !b ) {
+		Com_Error( ERR_DROP, "VM integer division by zero" );
+	}
+	return b == -1 ? (int)( 0u - (unsigned)a ) : a / b;
+}
+
+static ID_INLINE int VM_ModI( int a, int b ) {
+	if ( !b ) {
+		Com_Error( ERR_DROP, "VM integer division by zero" );
+	}
+	return b == -1 ? 0 : a % b;
+}
+
+static ID_INLINE int VM_DivU( int a, int b ) {
+	if ( !b ) {
+		Com_Error( ERR_DROP, "VM integer division by zero" );
+	}
+	return (int)( (unsigned)a / (unsigned)b );
+}
+
+static ID_INLINE int VM_ModU( int a, int b ) {
+	if ( !b ) {
+		Com_Error( ERR_DROP, "VM integer division by zero" );
+	}
+	return (int)( (unsigned)a % (unsigned)b );
+}
+
+static ID_INLINE int VM_FloatToInt( float f ) {
+	if ( f >= -2147483648.0f && f < 2147483648.0f ) {
+		return (int)f;
+	}
+	return (int)0x80000000;		// also NaN
+}
+
+/*
+====================
+VM_OperandSlots
+====================
+*/
+static int VM_OperandSlots( int op ) {
+	switch ( op ) {
+	case OP_ENTER:
+	case OP_CONST:
+	case OP_LOCAL:
+	case OP_LEAVE:
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+	case OP_EQF:
+	case OP_NEF:
+	case OP_LTF:
+	case OP_LEF:
+	case OP_GTF:
+	case OP_GEF:
+	case OP_BLOCK_COPY:
+	case OP_ARG:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+#ifdef VM_THREADED
+/*
+====================
+VM_InitDispatch
+
+The handler addresses are labels inside VM_Interpret, so only it can
+fill in the table
+====================
+*/
+static void VM_InitDispatch( void ) {
+	VM_Interpret( NULL, NULL, &vm_dispatch );
+}
+#endif
+
+/*
+====================
+VM_ThreadCode
+
+Replace the first instruction of common pairs with a super-instruction
+and, with VM_THREADED, every opcode with the address of its handler
+====================
+*/
+static void VM_ThreadCode( vm_t *vm, intptr_t *codeBase, int instructionCount ) {
+	int		instruction, int_pc, next;
+	int		op, op2;
+
+#ifdef VM_THREADED
+	if ( !vm_dispatch ) {
+		VM_InitDispatch();
+	}
+#endif
+
+	int_pc = 0;
+	for ( instruction = 0 ; instruction < instructionCount ; instruction++ ) {
+		op = codeBase[int_pc];
+		next = int_pc + 1 + VM_OperandSlots( op );
+		op2 = ( instruction + 1 < instructionCount ) ? codeBase[next] : OP_UNDEF;
+
+		if ( op == OP_LOCAL && op2 == OP_LOAD4 ) {
+			op = OP_LOCAL_LOAD4;
+		} else if ( op == OP_CONST && op2 == OP_ADD ) {
+			op = OP_CONST_ADD;
+		} else if ( op == OP_CONST && op2 == OP_LOAD4 ) {
+			op = OP_CONST_LOAD4;
+		} else if ( op == OP_CONST && op2 == OP_JUMP ) {
+			op = OP_CONST_JUMP;
+		} else if ( op == OP_ADD && op2 == OP_LOAD4 ) {
+			op = OP_ADD_LOAD4;
+		} else if ( op == OP_LOAD4 && op2 == OP_STORE4 ) {
+			op = OP_LOAD4_STORE4;
+		}
+
+#ifdef VM_THREADED
+		codeBase[int_pc] = (intptr_t) vm_dispatch[op];
+#else
+		codeBase[int_pc] = op;
+#endif
+		int_pc = next;
+	}
+}
+
 /*
 ====================
 VM_PrepareInterpreter
@@ -173,9 +346,9 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 	int		int_pc;
 	byte	*code;
 	int		instruction;
-	int		*codeBase;
+	intptr_t	*codeBase;
 
-	vm->codeBase = Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
+	vm->codeBase = Hunk_Alloc( vm->codeLength*sizeof(intptr_t), h_high );	// we're now pointer aligned
 //	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
 
 	// we don't need to translate the instructions, but we still need
@@ -183,7 +356,7 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 	int_pc = byte_pc = 0;
 	instruction = 0;
 	code = (byte *)header + header->codeOffset;
-	codeBase = (int *)vm->codeBase;
+	codeBase = (intptr_t *)vm->codeBase;
 
 	// Copy and expand instructions to words while building instruction table
 	while ( instruction < header->instructionCount ) {
@@ -191,6 +364,9 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 		instruction++;
 
 		op = (int)code[ byte_pc ];
+		if ( op > OP_CVFI ) {
+			op = OP_UNDEF;		// never executed as a super-instruction
+		}
 		codeBase[int_pc] = op;
 		if(byte_pc > header->codeLength)
 			Com_Error(ERR_DROP, "VM_PrepareInterpreter: pc > header->codeLength");
@@ -287,6 +463,8 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 		}
 
 	}
+
+	VM_ThreadCode( vm, codeBase, header->instructionCount );
 }
 
 /*
@@ -315,7 +493,30 @@ locals from sp
 
 #define	DEBUGSTR va("%s%i", VM_Indent(vm), opStackOfs)
 
-int	VM_CallInterpreted( vm_t *vm, int *args ) {
+#ifdef VM_THREADED
+  #define OPCASE( op )	op_##op
+  #define DISPATCH() \
+	do { \
+		r0 = opStack[opStackOfs]; \
+		r1 = opStack[(uint8_t) (opStackOfs - 1)]; \
+		goto *(void *) codeImage[programCounter++]; \
+	} while ( 0 )
+  #define DISPATCH2()	goto *(void *) codeImage[programCounter++]
+#else
+  #define OPCASE( op )	case op
+  #define DISPATCH()	goto nextInstruction
+  #define DISPATCH2()	goto nextInstruction2
+#endif
+
+/*
+====================
+VM_Interpret
+
+Runs vmMain, or with VM_THREADED and a dispatch pointer only returns the
+handler table for VM_InitDispatch
+====================
+*/
+static int VM_Interpret( vm_t *vm, int *args, const void * const **dispatch ) {
 	byte		stack[OPSTACK_SIZE + 15];
 	int		*opStack;
 	uint8_t 	opStackOfs;
@@ -323,13 +524,89 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	int		programStack;
 	int		stackOnEntry;
 	byte	*image;
-	int		*codeImage;
+	intptr_t	*codeImage;
 	int		v1;
 	int		dataMask;
 	int		arg;
+	int		r0, r1;
 #ifdef DEBUG_VM
 	vmSymbol_t	*profileSymbol;
 #endif
+#ifdef VM_THREADED
+	static const void * const dispatchTable[OP_NUM_INTERPRETED] = {
+		[OP_UNDEF] = &&op_OP_UNDEF,
+		[OP_IGNORE] = &&op_OP_IGNORE,
+		[OP_BREAK] = &&op_OP_BREAK,
+		[OP_ENTER] = &&op_OP_ENTER,
+		[OP_LEAVE] = &&op_OP_LEAVE,
+		[OP_CALL] = &&op_OP_CALL,
+		[OP_PUSH] = &&op_OP_PUSH,
+		[OP_POP] = &&op_OP_POP,
+		[OP_CONST] = &&op_OP_CONST,
+		[OP_LOCAL] = &&op_OP_LOCAL,
+		[OP_JUMP] = &&op_OP_JUMP,
+		[OP_EQ] = &&op_OP_EQ,
+		[OP_NE] = &&op_OP_NE,
+		[OP_LTI] = &&op_OP_LTI,
+		[OP_LEI] = &&op_OP_LEI,
+		[OP_GTI] = &&op_OP_GTI,
+		[OP_GEI] = &&op_OP_GEI,
+		[OP_LTU] = &&op_OP_LTU,
+		[OP_LEU] = &&op_OP_LEU,
+		[OP_GTU] = &&op_OP_GTU,
+		[OP_GEU] = &&op_OP_GEU,
+		[OP_EQF] = &&op_OP_EQF,
+		[OP_NEF] = &&op_OP_NEF,
+		[OP_LTF] = &&op_OP_LTF,
+		[OP_LEF] = &&op_OP_LEF,
+		[OP_GTF] = &&op_OP_GTF,
+		[OP_GEF] = &&op_OP_GEF,
+		[OP_LOAD1] = &&op_OP_LOAD1,
+		[OP_LOAD2] = &&op_OP_LOAD2,
+		[OP_LOAD4] = &&op_OP_LOAD4,
+		[OP_STORE1] = &&op_OP_STORE1,
+		[OP_STORE2] = &&op_OP_STORE2,
+		[OP_STORE4] = &&op_OP_STORE4,
+		[OP_ARG] = &&op_OP_ARG,
+		[OP_BLOCK_COPY] = &&op_OP_BLOCK_COPY,
+		[OP_SEX8] = &&op_OP_SEX8,
+		[OP_SEX16] = &&op_OP_SEX16,
+		[OP_NEGI] = &&op_OP_NEGI,
+		[OP_ADD] = &&op_OP_ADD,
+		[OP_SUB] = &&op_OP_SUB,
+		[OP_DIVI] = &&op_OP_DIVI,
+		[OP_DIVU] = &&op_OP_DIVU,
+		[OP_MODI] = &&op_OP_MODI,
+		[OP_MODU] = &&op_OP_MODU,
+		[OP_MULI] = &&op_OP_MULI,
+		[OP_MULU] = &&op_OP_MULU,
+		[OP_BAND] = &&op_OP_BAND,
+		[OP_BOR] = &&op_OP_BOR,
+		[OP_BXOR] = &&op_OP_BXOR,
+		[OP_BCOM] = &&op_OP_BCOM,
+		[OP_LSH] = &&op_OP_LSH,
+		[OP_RSHI] = &&op_OP_RSHI,
+		[OP_RSHU] = &&op_OP_RSHU,
+		[OP_NEGF] = &&op_OP_NEGF,
+		[OP_ADDF] = &&op_OP_ADDF,
+		[OP_SUBF] = &&op_OP_SUBF,
+		[OP_DIVF] = &&op_OP_DIVF,
+		[OP_MULF] = &&op_OP_MULF,
+		[OP_CVIF] = &&op_OP_CVIF,
+		[OP_CVFI] = &&op_OP_CVFI,
+		[OP_LOCAL_LOAD4] = &&op_OP_LOCAL_LOAD4,
+		[OP_CONST_ADD] = &&op_OP_CONST_ADD,
+		[OP_CONST_LOAD4] = &&op_OP_CONST_LOAD4,
+		[OP_CONST_JUMP] = &&op_OP_CONST_JUMP,
+		[OP_ADD_LOAD4] = &&op_OP_ADD_LOAD4,
+		[OP_LOAD4_STORE4] = &&op_OP_LOAD4_STORE4,
+	};
+
+	if ( dispatch ) {
+		*dispatch = dispatchTable;
+		return 0;
+	}
+#endif
 
 	// interpret the code
 	vm->currentlyInterpreting = qtrue;
@@ -345,7 +622,7 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	// set up the stack frame 
 
 	image = vm->dataBase;
-	codeImage = (int *)vm->codeBase;
+	codeImage = (intptr_t *)vm->codeBase;
 	dataMask = vm->dataMask;
 	
 	programCounter = 0;
@@ -371,10 +648,13 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	// main interpreter loop, will exit when a LEAVE instruction
 	// grabs the -1 program counter
 
-#define r2 codeImage[programCounter]
+#define r2 ((int) codeImage[programCounter])
 
+#ifdef VM_THREADED
+	DISPATCH();
+#else
 	while ( 1 ) {
-		int		opcode,	r0, r1;
+		int		opcode;
 //		unsigned int	r2;
 
 nextInstruction:
@@ -405,30 +685,36 @@ nextInstruction2:
 		opcode = codeImage[ programCounter++ ];
 
 		switch ( opcode ) {
+#endif
 #ifdef DEBUG_VM
 		default:
 			Com_Error( ERR_DROP, "Bad VM instruction" );  // this should be scanned on load!
 			return 0;
 #endif
-		case OP_BREAK:
+#ifdef VM_THREADED
+		OPCASE( OP_UNDEF ):
+		OPCASE( OP_IGNORE ):
+			DISPATCH();
+#endif
+		OPCASE( OP_BREAK ):
 			vm->breakCount++;
-			goto nextInstruction2;
-		case OP_CONST:
+			DISPATCH2();
+		OPCASE( OP_CONST ):
 			opStackOfs++;
 			r1 = r0;
 			r0 = opStack[opStackOfs] = r2;
 			
 			programCounter += 1;
-			goto nextInstruction2;
-		case OP_LOCAL:
+			DISPATCH2();
+		OPCASE( OP_LOCAL ):
 			opStackOfs++;
 			r1 = r0;
 			r0 = opStack[opStackOfs] = r2+programStack;
 
 			programCounter += 1;
-			goto nextInstruction2;
+			DISPATCH2();
 
-		case OP_LOAD4:
+		OPCASE( OP_LOAD4 ):
 #ifdef DEBUG_VM
 			if(opStack[opStackOfs] & 3)
 			{
@@ -437,41 +723,41 @@ nextInstruction2:
 			}
 #endif
 			r0 = opStack[opStackOfs] = *(int *) &image[ r0 & dataMask ];
-			goto nextInstruction2;
-		case OP_LOAD2:
+			DISPATCH2();
+		OPCASE( OP_LOAD2 ):
 			r0 = opStack[opStackOfs] = *(unsigned short *)&image[ r0 & dataMask ];
-			goto nextInstruction2;
-		case OP_LOAD1:
+			DISPATCH2();
+		OPCASE( OP_LOAD1 ):
 			r0 = opStack[opStackOfs] = image[ r0 & dataMask ];
-			goto nextInstruction2;
+			DISPATCH2();
 
-		case OP_STORE4:
+		OPCASE( OP_STORE4 ):
 			*(int *)&image[ r1 & dataMask ] = r0;
 			opStackOfs -= 2;
-			goto nextInstruction;
-		case OP_STORE2:
+			DISPATCH();
+		OPCASE( OP_STORE2 ):
 			*(short *)&image[ r1 & dataMask ] = r0;
 			opStackOfs -= 2;
-			goto nextInstruction;
-		case OP_STORE1:
+			DISPATCH();
+		OPCASE( OP_STORE1 ):
 			image[ r1 & dataMask ] = r0;
 			opStackOfs -= 2;
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_ARG:
+		OPCASE( OP_ARG ):
 			// single byte offset from programStack
 			*(int *)&image[ (codeImage[programCounter] + programStack) & dataMask ] = r0;
 			opStackOfs--;
 			programCounter += 1;
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_BLOCK_COPY:
+		OPCASE( OP_BLOCK_COPY ):
 			VM_BlockCopy(r1, r0, r2);
 			programCounter += 1;
 			opStackOfs -= 2;
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_CALL:
+		OPCASE( OP_CALL ):
 			// save current program counter
 			*(int *)&image[ programStack ] = programCounter;
 			
@@ -537,17 +823,17 @@ nextInstruction2:
 			} else {
 				programCounter = vm->instructionPointers[ programCounter ];
 			}
-			goto nextInstruction;
+			DISPATCH();
 
 		// push and pop are only needed for discarded or bad function return values
-		case OP_PUSH:
+		OPCASE( OP_PUSH ):
 			opStackOfs++;
-			goto nextInstruction;
-		case OP_POP:
+			DISPATCH();
+		OPCASE( OP_POP ):
 			opStackOfs--;
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_ENTER:
+		OPCASE( OP_ENTER ):
 #ifdef DEBUG_VM
 			profileSymbol = VM_ValueToFunctionSymbol( vm, programCounter );
 #endif
@@ -570,8 +856,8 @@ nextInstruction2:
 //				vm->callLevel++;
 			}
 #endif
-			goto nextInstruction;
-		case OP_LEAVE:
+			DISPATCH();
+		OPCASE( OP_LEAVE ):
 			// remove our stack frame
 			v1 = r2;
 
@@ -593,7 +879,7 @@ nextInstruction2:
 				Com_Error( ERR_DROP, "VM program counter out of range in OP_LEAVE" );
 				return 0;
 			}
-			goto nextInstruction;
+			DISPATCH();
 
 		/*
 		===================================================================
@@ -601,7 +887,7 @@ nextInstruction2:
 		===================================================================
 		*/
 
-		case OP_JUMP:
+		OPCASE( OP_JUMP ):
 			if ( (unsigned)r0 >= vm->instructionCount )
 			{
 				Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
@@ -611,282 +897,354 @@ nextInstruction2:
 			programCounter = vm->instructionPointers[ r0 ];
 
 			opStackOfs--;
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_EQ:
+		OPCASE( OP_EQ ):
 			opStackOfs -= 2;
 			if ( r1 == r0 ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_NE:
+		OPCASE( OP_NE ):
 			opStackOfs -= 2;
 			if ( r1 != r0 ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_LTI:
+		OPCASE( OP_LTI ):
 			opStackOfs -= 2;
 			if ( r1 < r0 ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_LEI:
+		OPCASE( OP_LEI ):
 			opStackOfs -= 2;
 			if ( r1 <= r0 ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_GTI:
+		OPCASE( OP_GTI ):
 			opStackOfs -= 2;
 			if ( r1 > r0 ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_GEI:
+		OPCASE( OP_GEI ):
 			opStackOfs -= 2;
 			if ( r1 >= r0 ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_LTU:
+		OPCASE( OP_LTU ):
 			opStackOfs -= 2;
 			if ( ((unsigned)r1) < ((unsigned)r0) ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_LEU:
+		OPCASE( OP_LEU ):
 			opStackOfs -= 2;
 			if ( ((unsigned)r1) <= ((unsigned)r0) ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_GTU:
+		OPCASE( OP_GTU ):
 			opStackOfs -= 2;
 			if ( ((unsigned)r1) > ((unsigned)r0) ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_GEU:
+		OPCASE( OP_GEU ):
 			opStackOfs -= 2;
 			if ( ((unsigned)r1) >= ((unsigned)r0) ) {
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_EQF:
+		OPCASE( OP_EQF ):
 			opStackOfs -= 2;
 			
 			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] == ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
 			{
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_NEF:
+		OPCASE( OP_NEF ):
 			opStackOfs -= 2;
 
 			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] != ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
 			{
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_LTF:
+		OPCASE( OP_LTF ):
 			opStackOfs -= 2;
 
 			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] < ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
 			{
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_LEF:
+		OPCASE( OP_LEF ):
 			opStackOfs -= 2;
 
 			if(((float *) opStack)[(uint8_t) ((uint8_t) (opStackOfs + 1))] <= ((float *) opStack)[(uint8_t) ((uint8_t) (opStackOfs + 2))])
 			{
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_GTF:
+		OPCASE( OP_GTF ):
 			opStackOfs -= 2;
 
 			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] > ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
 			{
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
-		case OP_GEF:
+		OPCASE( OP_GEF ):
 			opStackOfs -= 2;
 
 			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] >= ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
 			{
 				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
+				DISPATCH();
 			} else {
 				programCounter += 1;
-				goto nextInstruction;
+				DISPATCH();
 			}
 
 
 		//===================================================================
 
-		case OP_NEGI:
+		OPCASE( OP_NEGI ):
 			opStack[opStackOfs] = -r0;
-			goto nextInstruction;
-		case OP_ADD:
+			DISPATCH();
+		OPCASE( OP_ADD ):
 			opStackOfs--;
 			opStack[opStackOfs] = r1 + r0;
-			goto nextInstruction;
-		case OP_SUB:
+			DISPATCH();
+		OPCASE( OP_SUB ):
 			opStackOfs--;
 			opStack[opStackOfs] = r1 - r0;
-			goto nextInstruction;
-		case OP_DIVI:
+			DISPATCH();
+		OPCASE( OP_DIVI ):
 			opStackOfs--;
-			opStack[opStackOfs] = r1 / r0;
-			goto nextInstruction;
-		case OP_DIVU:
+			opStack[opStackOfs] = VM_DivI( r1, r0 );
+			DISPATCH();
+		OPCASE( OP_DIVU ):
 			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) / ((unsigned) r0);
-			goto nextInstruction;
-		case OP_MODI:
+			opStack[opStackOfs] = VM_DivU( r1, r0 );
+			DISPATCH();
+		OPCASE( OP_MODI ):
 			opStackOfs--;
-			opStack[opStackOfs] = r1 % r0;
-			goto nextInstruction;
-		case OP_MODU:
+			opStack[opStackOfs] = VM_ModI( r1, r0 );
+			DISPATCH();
+		OPCASE( OP_MODU ):
 			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) % ((unsigned) r0);
-			goto nextInstruction;
-		case OP_MULI:
+			opStack[opStackOfs] = VM_ModU( r1, r0 );
+			DISPATCH();
+		OPCASE( OP_MULI ):
 			opStackOfs--;
 			opStack[opStackOfs] = r1 * r0;
-			goto nextInstruction;
-		case OP_MULU:
+			DISPATCH();
+		OPCASE( OP_MULU ):
 			opStackOfs--;
 			opStack[opStackOfs] = ((unsigned) r1) * ((unsigned) r0);
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_BAND:
+		OPCASE( OP_BAND ):
 			opStackOfs--;
 			opStack[opStackOfs] = ((unsigned) r1) & ((unsigned) r0);
-			goto nextInstruction;
-		case OP_BOR:
+			DISPATCH();
+		OPCASE( OP_BOR ):
 			opStackOfs--;
 			opStack[opStackOfs] = ((unsigned) r1) | ((unsigned) r0);
-			goto nextInstruction;
-		case OP_BXOR:
+			DISPATCH();
+		OPCASE( OP_BXOR ):
 			opStackOfs--;
 			opStack[opStackOfs] = ((unsigned) r1) ^ ((unsigned) r0);
-			goto nextInstruction;
-		case OP_BCOM:
+			DISPATCH();
+		OPCASE( OP_BCOM ):
 			opStack[opStackOfs] = ~((unsigned) r0);
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_LSH:
+		OPCASE( OP_LSH ):
 			opStackOfs--;
 			opStack[opStackOfs] = r1 << r0;
-			goto nextInstruction;
-		case OP_RSHI:
+			DISPATCH();
+		OPCASE( OP_RSHI ):
 			opStackOfs--;
 			opStack[opStackOfs] = r1 >> r0;
-			goto nextInstruction;
-		case OP_RSHU:
+			DISPATCH();
+		OPCASE( OP_RSHU ):
 			opStackOfs--;
 			opStack[opStackOfs] = ((unsigned) r1) >> r0;
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_NEGF:
+		OPCASE( OP_NEGF ):
 			((float *) opStack)[opStackOfs] =  -((float *) opStack)[opStackOfs];
-			goto nextInstruction;
-		case OP_ADDF:
+			DISPATCH();
+		OPCASE( OP_ADDF ):
 			opStackOfs--;
 			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] + ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-		case OP_SUBF:
+			DISPATCH();
+		OPCASE( OP_SUBF ):
 			opStackOfs--;
 			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] - ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-		case OP_DIVF:
+			DISPATCH();
+		OPCASE( OP_DIVF ):
 			opStackOfs--;
 			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] / ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-		case OP_MULF:
+			DISPATCH();
+		OPCASE( OP_MULF ):
 			opStackOfs--;
 			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] * ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
+			DISPATCH();
 
-		case OP_CVIF:
+		OPCASE( OP_CVIF ):
 			((float *) opStack)[opStackOfs] = (float) opStack[opStackOfs];
-			goto nextInstruction;
-		case OP_CVFI:
-			opStack[opStackOfs] = Q_ftol(((float *) opStack)[opStackOfs]);
-			goto nextInstruction;
-		case OP_SEX8:
+			DISPATCH();
+		OPCASE( OP_CVFI ):
+			opStack[opStackOfs] = VM_FloatToInt( ((float *) opStack)[opStackOfs] );
+			DISPATCH();
+		OPCASE( OP_SEX8 ):
 			opStack[opStackOfs] = (signed char) opStack[opStackOfs];
-			goto nextInstruction;
-		case OP_SEX16:
+			DISPATCH();
+		OPCASE( OP_SEX16 ):
 			opStack[opStackOfs] = (short) opStack[opStackOfs];
-			goto nextInstruction;
+			DISPATCH();
+
+		/*
+		===================================================================
+		SUPER-INSTRUCTIONS
+		===================================================================
+		*/
+
+		OPCASE( OP_LOCAL_LOAD4 ):
+#ifdef DEBUG_VM
+			if( ( r2 + programStack ) & 3 )
+			{
+				Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
+				return 0;
+			}
+#endif
+			opStackOfs++;
+			r1 = r0;
+			r0 = opStack[opStackOfs] = *(int *) &image[ ( r2 + programStack ) & dataMask ];
+			programCounter += 2;		// operand, OP_LOAD4
+			DISPATCH2();
+		OPCASE( OP_CONST_ADD ):
+			r0 = opStack[opStackOfs] = r0 + r2;
+			programCounter += 2;		// operand, OP_ADD
+			DISPATCH2();
+		OPCASE( OP_CONST_LOAD4 ):
+#ifdef DEBUG_VM
+			if( r2 & 3 )
+			{
+				Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
+				return 0;
+			}
+#endif
+			opStackOfs++;
+			r1 = r0;
+			r0 = opStack[opStackOfs] = *(int *) &image[ r2 & dataMask ];
+			programCounter += 2;		// operand, OP_LOAD4
+			DISPATCH2();
+		OPCASE( OP_CONST_JUMP ):
+			if ( (unsigned)r2 >= vm->instructionCount )
+			{
+				Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
+				return 0;
+			}
+
+			programCounter = vm->instructionPointers[ r2 ];
+			DISPATCH2();
+		OPCASE( OP_ADD_LOAD4 ):
+#ifdef DEBUG_VM
+			if( ( r1 + r0 ) & 3 )
+			{
+				Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
+				return 0;
+			}
+#endif
+			opStackOfs--;
+			opStack[opStackOfs] = *(int *) &image[ ( r1 + r0 ) & dataMask ];
+			programCounter += 1;		// OP_LOAD4
+			DISPATCH();
+		OPCASE( OP_LOAD4_STORE4 ):
+#ifdef DEBUG_VM
+			if( r0 & 3 )
+			{
+				Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
+				return 0;
+			}
+#endif
+			*(int *) &image[ r1 & dataMask ] = *(int *) &image[ r0 & dataMask ];
+			opStackOfs -= 2;
+			programCounter += 1;		// OP_STORE4
+			DISPATCH();
+#ifndef VM_THREADED
 		}
 	}
+#endif
 
 done:
 	vm->currentlyInterpreting = qfalse;
@@ -899,3 +1257,7 @@ done:
 	// return the result
 	return opStack[opStackOfs];
 }
+
+int	VM_CallInterpreted( vm_t *vm, int *args ) {
+	return VM_Interpret( vm, args, NULL );
+}
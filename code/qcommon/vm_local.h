@@ -40,6 +40,20 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	PROGRAM_STACK_SIZE	0x10000
 #define	PROGRAM_STACK_MASK	(PROGRAM_STACK_SIZE-1)
 
+// on 64-bit Linux the data segment of compiled vms is placed inside a
+// reserved range surrounded by inaccessible pages, so the compiler can
+// skip masking addresses and let stray accesses fault instead
+#if idx64 && defined(__linux__) && !defined(NO_VM_COMPILED)
+  #define VM_GUARD_DATA
+  #define VM_GUARD_LOW		0x80000000ULL	// reserved below dataBase
+  #define VM_GUARD_SIZE		0x200000000ULL	// whole reserved range
+#endif
+
+// the x86 compiler can sample compiled code with SIGPROF on Linux
+#if ( idx64 || id386 ) && defined(__linux__) && !defined(NO_VM_COMPILED)
+  #define VM_SAMPLING
+#endif
+
 typedef enum {
 	OP_UNDEF, 
 
@@ -134,6 +148,7 @@ typedef int	vmptr_t;
 typedef struct vmSymbol_s {
 	struct vmSymbol_s	*next;
 	int		symValue;
+	int		symInstruction;		// instruction number from the map file
 	int		profileCount;
 	char	symName[1];		// variable sized
 } vmSymbol_t;
@@ -161,6 +176,7 @@ struct vm_s {
 	qboolean	currentlyInterpreting;
 
 	qboolean	compiled;
+	qboolean	optimize;			// use the second tier compiler if there is one
 	byte		*codeBase;
 	int			entryOfs;
 	int			codeLength;
@@ -171,6 +187,7 @@ struct vm_s {
 	byte		*dataBase;
 	int			dataMask;
 	int			dataAlloc;			// actually allocated
+	qboolean	guarded;			// dataBase lies VM_GUARD_LOW into a reserved range
 
 	int			stackBottom;		// if programStack < stackBottom, error
 
@@ -201,3 +218,11 @@ const char *VM_ValueToSymbol( vm_t *vm, int value );
 void VM_LogSyscalls( int *args );
 
 void VM_BlockCopy(unsigned int dest, unsigned int src, size_t n);
+
+#ifdef VM_SAMPLING
+extern	void	*vm_sampleStackTop;		// native stack of the innermost VM_CallCompiled
+
+qboolean VM_StartSampling( int hz );
+void	VM_StopSampling( void );
+void	VM_RecordSample( void *pc, void **sp );	// called from the signal handler
+#endif
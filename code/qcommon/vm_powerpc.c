@@ -1983,6 +1983,7 @@ VM_Compile( vm_t *vm, vmHeader_t *header )
 	source_instruction_t *i_first /* dummy */, *i_last = NULL, *i_now;
 
 	vm->compiled = qfalse;
+	vm->optimize = qfalse;	// no second tier compiler
 
 	gettimeofday(&tvstart, NULL);
 
@@ -1552,6 +1552,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	unsigned char *code;
 	int i_count, pc, i;
 
+	vm->optimize = qfalse;	// no second tier compiler
 	memset(&fi, 0, sizeof(fi));
 
 	fi.first = Z_Malloc(sizeof(struct src_insn));
@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 // vm_x86.c -- load time compiler and execution environment for x86
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE	// for REG_RIP and REG_RSP
+#endif
+
 #include "vm_local.h"
 
 #ifdef _WIN32
@@ -40,10 +44,36 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
   #ifndef MAP_ANONYMOUS
     #define MAP_ANONYMOUS MAP_ANON
   #endif
+
+  #if defined(VM_GUARD_DATA) || defined(VM_SAMPLING)
+    #include <signal.h>
+    #include <ucontext.h>
+  #endif
+  #ifdef VM_SAMPLING
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+  #endif
 #endif
 
 static void VM_Destroy_Compiled(vm_t* self);
 
+// the second tier compiler relies on the System V register conventions
+#if idx64 && !defined(_MSC_VER)
+  #define VM_X86_OPT
+#endif
+
+// x86_64 code only refers to host memory through EmitPtr, which can be
+// relocated, so it may be kept on disk
+#if idx64
+  #define VM_X86_CACHE
+#endif
+
+// calls of the math and memory traps skip DoSyscall on x86_64
+#if idx64
+  #define VM_X86_INTRINSICS
+#endif
+
 /*
 
   eax		scratch
@@ -58,7 +88,25 @@ x86_64:
 
 */
 
-#define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused);} while(0)
+#ifdef VM_X86_CACHE
+typedef struct
+{
+	int		ofs;		// of the 8 byte pointer in the code
+	int		target;		// index into VM_RelocTargets
+} vmReloc_t;
+
+static	vmReloc_t	*relocs = NULL;
+static	int		numRelocs, maxRelocs, stubRelocs;
+static	qboolean	relocFailed;
+
+static void VM_AddReloc(void *ptr);
+
+#define VMFREE_RELOCS() do {if(relocs) {Z_Free(relocs); relocs = NULL;}} while(0)
+#else
+#define VMFREE_RELOCS() do {} while(0)
+#endif
+
+#define VMFREE_BUFFERS() do {Z_Free(buf); Z_Free(jused); VMFREE_RELOCS();} while(0)
 static	byte	*buf = NULL;
 static	byte	*jused = NULL;
 static	int		jusedSize = 0;
@@ -70,6 +118,7 @@ static	int		pc = 0;
 
 static	int	instruction, pass;
 static	int	lastConst = 0;
+static	int	accessMask;		// mask for computed addresses, 0 if the data is guarded
 static	int	oc0, oc1, pop0, pop1;
 static	int jlabel;
 
@@ -148,7 +197,10 @@ static void Emit4(int v)
 static void EmitPtr(void *ptr)
 {
 	intptr_t v = (intptr_t) ptr;
-	
+
+#ifdef VM_X86_CACHE
+	VM_AddReloc(ptr);
+#endif
 	Emit4(v);
 #if idx64
 	Emit1((v >> 32) & 0xFF);
@@ -204,9 +256,11 @@ static void EmitRexString(byte rex, const char *string)
 
 #define MASK_REG(modrm, mask) \
 	do { \
-		EmitString("81"); \
-		EmitString((modrm)); \
-		Emit4((mask)); \
+		if((mask)) { \
+			EmitString("81"); \
+			EmitString((modrm)); \
+			Emit4((mask)); \
+		} \
 	} while(0)
 
 // add bl, bytes
@@ -392,6 +446,176 @@ static void __attribute__((__noreturn__)) ErrJump(void)
 	Com_Error(ERR_DROP, "program tried to execute code outside VM");
 }
 
+#ifdef VM_GUARD_DATA
+/*
+=================
+ErrAccess
+Error handler for loads and stores outside of a guarded data segment
+=================
+*/
+
+static void __attribute__((__noreturn__, __used__)) ErrAccess(void)
+{
+	Com_Error(ERR_DROP, "program tried to access memory outside VM");
+}
+
+static struct sigaction vm_oldSegv;
+static qboolean vm_guardHandler;
+
+/*
+=================
+VM_GuardHandler
+
+Faults of compiled code inside the reserved range of the running vm
+resume in ErrAccess, everything else goes to the previous handler
+=================
+*/
+
+static void VM_GuardHandler(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	greg_t *regs = uc->uc_mcontext.gregs;
+	byte *rip = (byte *) regs[REG_RIP];
+	byte *addr = info->si_addr;
+	vm_t *vm = currentVM;
+
+	if(vm && vm->compiled && vm->guarded &&
+	   rip >= vm->codeBase && rip < vm->codeBase + vm->codeLength &&
+	   addr >= vm->dataBase - VM_GUARD_LOW && addr < vm->dataBase - VM_GUARD_LOW + VM_GUARD_SIZE)
+	{
+		// skip the red zone and fake a call with an aligned stack
+		regs[REG_RSP] = ((regs[REG_RSP] - 128) & ~15) - 8;
+		regs[REG_RIP] = (greg_t) ErrAccess;
+		return;
+	}
+
+	if(vm_oldSegv.sa_flags & SA_SIGINFO)
+		vm_oldSegv.sa_sigaction(sig, info, context);
+	else if(vm_oldSegv.sa_handler != SIG_DFL && vm_oldSegv.sa_handler != SIG_IGN)
+		vm_oldSegv.sa_handler(sig);
+	else
+	{
+		// let the faulting instruction run again with the default action
+		sigaction(SIGSEGV, &vm_oldSegv, NULL);
+	}
+}
+
+/*
+=================
+VM_InstallGuardHandler
+=================
+*/
+
+static void VM_InstallGuardHandler(void)
+{
+	struct sigaction sa;
+
+	if(vm_guardHandler)
+		return;
+
+	Com_Memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = VM_GuardHandler;
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+
+	if(sigaction(SIGSEGV, &sa, &vm_oldSegv) == 0)
+		vm_guardHandler = qtrue;
+}
+#endif
+
+#ifdef VM_SAMPLING
+#if idx64
+  #define REG_PC	REG_RIP
+  #define REG_SP	REG_RSP
+#else
+  #define REG_PC	REG_EIP
+  #define REG_SP	REG_ESP
+#endif
+
+// older glibc headers lack the name for the SIGEV_THREAD_ID target
+#ifndef sigev_notify_thread_id
+  #define sigev_notify_thread_id	_sigev_un._tid
+#endif
+
+static struct sigaction vm_oldProf;
+static timer_t vm_sampleTimer;
+
+/*
+=================
+VM_SampleHandler
+=================
+*/
+
+static void VM_SampleHandler(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	greg_t *regs = uc->uc_mcontext.gregs;
+
+	VM_RecordSample((void *) regs[REG_PC], (void **) regs[REG_SP]);
+}
+
+/*
+=================
+VM_StartSampling
+
+The timer counts the cpu time of the calling thread and signals only that
+thread, so the worker threads of the server never take samples and
+vm_sampleStackTop always belongs to the thread that was interrupted
+=================
+*/
+
+qboolean VM_StartSampling(int hz)
+{
+	struct sigaction sa;
+	struct sigevent sev;
+	struct itimerspec timer;
+
+	Com_Memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = VM_SampleHandler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+
+	if(sigaction(SIGPROF, &sa, &vm_oldProf) != 0)
+		return qfalse;
+
+	Com_Memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+
+	if(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &vm_sampleTimer) != 0)
+	{
+		sigaction(SIGPROF, &vm_oldProf, NULL);
+		return qfalse;
+	}
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_nsec = hz < 1000000000 ? 1000000000 / hz : 1;
+	timer.it_value = timer.it_interval;
+
+	if(timer_settime(vm_sampleTimer, 0, &timer, NULL) != 0)
+	{
+		timer_delete(vm_sampleTimer);
+		sigaction(SIGPROF, &vm_oldProf, NULL);
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+VM_StopSampling
+=================
+*/
+
+void VM_StopSampling(void)
+{
+	timer_delete(vm_sampleTimer);
+	sigaction(SIGPROF, &vm_oldProf, NULL);
+}
+#endif
+
 /*
 =================
 DoSyscall
@@ -615,6 +839,232 @@ int EmitCallProcedure(vm_t *vm, int sysCallOfs)
 	return retval;
 }
 
+#ifdef VM_X86_INTRINSICS
+/*
+=================
+Intrinsics
+
+Calls of some math and memory traps with a constant trap number are
+compiled to inline code or to a direct call of a helper.  The results
+have to match what the system call handlers of the modules return, so
+the helpers compute them exactly the same way.
+=================
+*/
+
+typedef enum
+{
+	VM_INTRINSIC_MEMSET,
+	VM_INTRINSIC_MEMCPY,
+	VM_INTRINSIC_SIN,
+	VM_INTRINSIC_COS,
+	VM_INTRINSIC_ATAN2,
+	VM_INTRINSIC_FLOOR,
+	VM_NUM_INTRINSIC_HELPERS,
+
+	VM_INTRINSIC_SQRT = VM_NUM_INTRINSIC_HELPERS,	// inline sqrtss
+	VM_INTRINSIC_NONE
+} vmIntrinsic_t;
+
+static int intrinsicOfs[VM_NUM_INTRINSIC_HELPERS];
+
+/*
+=================
+VM_IntrinsicBlock
+
+Address of size bytes at vm address, these have to fit into the data segment
+=================
+*/
+static byte *VM_IntrinsicBlock(int address, int size)
+{
+	vm_t *vm = currentVM;
+
+	address &= vm->dataMask;
+	if(size < 0 || (unsigned) size > (unsigned) vm->dataMask + 1 - address)
+		Com_Error(ERR_DROP, "program tried to access memory outside VM");
+
+	return vm->dataBase + address;
+}
+
+// data points at the programStack of the caller, the arguments start at data[1]
+
+static int VM_IntrinsicMemset(int *data)
+{
+	Com_Memset(VM_IntrinsicBlock(data[1], data[3]), data[2], data[3]);
+	return 0;
+}
+
+static int VM_IntrinsicMemcpy(int *data)
+{
+	byte *dest = VM_IntrinsicBlock(data[1], data[3]);
+
+	Com_Memcpy(dest, VM_IntrinsicBlock(data[2], data[3]), data[3]);
+	return 0;
+}
+
+static int VM_IntrinsicSin(int *data)
+{
+	floatint_t fi;
+
+	fi.i = data[1];
+	fi.f = sin(fi.f);
+	return fi.i;
+}
+
+static int VM_IntrinsicCos(int *data)
+{
+	floatint_t fi;
+
+	fi.i = data[1];
+	fi.f = cos(fi.f);
+	return fi.i;
+}
+
+static int VM_IntrinsicAtan2(int *data)
+{
+	floatint_t y, x;
+
+	y.i = data[1];
+	x.i = data[2];
+	y.f = atan2(y.f, x.f);
+	return y.i;
+}
+
+static int VM_IntrinsicFloor(int *data)
+{
+	floatint_t fi;
+
+	fi.i = data[1];
+	fi.f = floor(fi.f);
+	return fi.i;
+}
+
+static int (*const vm_intrinsicHelpers[VM_NUM_INTRINSIC_HELPERS])(int *data) =
+{
+	VM_IntrinsicMemset,
+	VM_IntrinsicMemcpy,
+	VM_IntrinsicSin,
+	VM_IntrinsicCos,
+	VM_IntrinsicAtan2,
+	VM_IntrinsicFloor
+};
+
+/*
+=================
+VM_IntrinsicForTrap
+
+The traps from memset to sqrt have the same numbers in all modules, cgame
+and ui have no matrix and vector traps in front of floor
+=================
+*/
+static vmIntrinsic_t VM_IntrinsicForTrap(vm_t *vm, int trap)
+{
+	switch(trap)
+	{
+	case TRAP_MEMSET:
+		return VM_INTRINSIC_MEMSET;
+	case TRAP_MEMCPY:
+		return VM_INTRINSIC_MEMCPY;
+	case TRAP_SIN:
+		return VM_INTRINSIC_SIN;
+	case TRAP_COS:
+		return VM_INTRINSIC_COS;
+	case TRAP_ATAN2:
+		return VM_INTRINSIC_ATAN2;
+	case TRAP_SQRT:
+		return VM_INTRINSIC_SQRT;
+	default:
+		break;
+	}
+
+	if(trap == (!strcmp(vm->name, "qagame") ? TRAP_FLOOR : TRAP_SQRT + 1))
+		return VM_INTRINSIC_FLOOR;
+
+	return VM_INTRINSIC_NONE;
+}
+
+/*
+=================
+EmitIntrinsicStubs
+
+One entry per helper which loads its address and continues in the
+common part.  That saves the registers of the compiled code, passes the
+programStack as data and writes the result to the opStack like DoSyscall
+=================
+*/
+static void EmitIntrinsicStubs(vm_t *vm)
+{
+	int callOfs, i;
+
+	callOfs = compiledOfs;
+
+	EmitString("56");			// push rsi
+	EmitString("57");			// push rdi
+	EmitRexString(0x41, "50");		// push r8
+	EmitRexString(0x41, "51");		// push r9
+
+	// align the stack pointer to a 16-byte-boundary
+	EmitString("55");			// push rbp
+	EmitRexString(0x48, "89 E5");		// mov rbp, rsp
+	EmitRexString(0x48, "83 E4 F0");	// and rsp, 0xFFFFFFF0
+
+	EmitRexString(0x49, "8D 7C 31 04");	// lea rdi, [r9 + rsi + 4]
+	EmitString("FF D0");			// call rax
+
+	EmitRexString(0x48, "89 EC");		// mov rsp, rbp
+	EmitString("5D");			// pop rbp
+
+	EmitRexString(0x41, "59");		// pop r9
+	EmitRexString(0x41, "58");		// pop r8
+	EmitString("5F");			// pop rdi
+	EmitString("5E");			// pop rsi
+
+	EmitString("89 44 9F 04");		// mov dword ptr [rdi + rbx * 4 + 4], eax
+	EmitString("C3");			// ret
+
+	for(i = 0; i < VM_NUM_INTRINSIC_HELPERS; i++)
+	{
+		intrinsicOfs[i] = compiledOfs;
+
+		EmitRexString(0x48, "B8");	// mov rax, helper
+		EmitPtr(vm_intrinsicHelpers[i]);
+		EmitString("E9");		// jmp callOfs
+		Emit4(callOfs - compiledOfs - 4);
+	}
+}
+
+/*
+=================
+EmitIntrinsic
+
+Call of the constant trap number with the committed opStack,
+returns qfalse if there is no intrinsic for it
+=================
+*/
+static qboolean EmitIntrinsic(vm_t *vm, int trap)
+{
+	vmIntrinsic_t intrinsic = VM_IntrinsicForTrap(vm, trap);
+
+	if(intrinsic == VM_INTRINSIC_NONE)
+		return qfalse;
+
+	if(intrinsic == VM_INTRINSIC_SQRT)
+	{
+		// double rounding doesn't change a square root, so this
+		// is the same as the float of sqrt() in double precision
+		EmitString("F3 41 0F 10 44 31 08");	// movss xmm0, dword ptr [r9 + rsi + 8]
+		EmitString("F3 0F 51 C0");		// sqrtss xmm0, xmm0
+		EmitString("F3 0F 11 44 9F 04");	// movss dword ptr [rdi + rbx * 4 + 4], xmm0
+	}
+	else
+		EmitCallRel(vm, intrinsicOfs[intrinsic]);
+
+	// have opStack reg point at return value
+	STACK_PUSH(1);				// add bl, 1
+
+	return qtrue;
+}
+#endif
+
 /*
 =================
 EmitJumpIns
@@ -664,6 +1114,11 @@ Call to constant instruction number or syscall
 
 void EmitCallConst(vm_t *vm, int cdest, int callProcOfsSyscall)
 {
+#ifdef VM_X86_INTRINSICS
+	if(cdest < 0 && EmitIntrinsic(vm, ~cdest))
+		return;
+#endif
+
 	if(cdest < 0)
 	{
 		EmitString("B8");	// mov eax, cdest
@@ -790,7 +1245,7 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 		return qtrue;
 
 	case OP_STORE4:
-		EmitMovEAXStack(vm, vm->dataMask);
+		EmitMovEAXStack(vm, accessMask);
 #if idx64
 		EmitRexString(0x41, "C7 04 01");		// mov dword ptr [r9 + eax], 0x12345678
 		Emit4(Constant4());
@@ -805,7 +1260,7 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 		return qtrue;
 
 	case OP_STORE2:
-		EmitMovEAXStack(vm, vm->dataMask);
+		EmitMovEAXStack(vm, accessMask);
 #if idx64
 		Emit1(0x66);					// mov word ptr [r9 + eax], 0x1234
 		EmitRexString(0x41, "C7 04 01");
@@ -822,7 +1277,7 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 		return qtrue;
 
 	case OP_STORE1:
-		EmitMovEAXStack(vm, vm->dataMask);
+		EmitMovEAXStack(vm, accessMask);
 #if idx64
 		EmitRexString(0x41, "C6 04 01");		// mov byte [r9 + eax], 0x12
 		Emit1(Constant4());
@@ -1062,35 +1517,1534 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 	return qfalse;
 }
 
+#ifdef VM_X86_OPT
+/*
+=================================================================
+
+SECOND TIER COMPILER
+
+Selected with vm_game/vm_cgame/vm_ui 3.  The bytecode is decoded up front,
+every jump target and procedure entry starts a new block, and within a block
+the top of the opStack is kept in a small virtual stack of constants, local
+addresses and registers instead of memory.  Entries are only written back to
+the opStack at block boundaries, calls and when registers run out, so most
+instructions become one or two register operations and address arithmetic
+ends up folded into the masked load or store.
+
+The generated code keeps the calling conventions of the first tier: esi is
+the program stack, edi/ebx the opStack, r8 the instruction pointers and r9
+the data base.  r10-r15 hold cached opStack entries.
+
+=================================================================
+*/
+
+#define OPT_CACHE_MAX		8		// opStack entries kept out of memory
+#define OPT_STACK_RANGE		8		// commit ebx when the virtual top drifts further
+
+typedef enum {
+	R_EAX, R_ECX, R_EDX, R_EBX, R_ESP, R_EBP, R_ESI, R_EDI,
+	R_R8, R_R9, R_R10, R_R11, R_R12, R_R13, R_R14, R_R15
+} x86reg_t;
+
+#define OPF_W		0x0100		// 64 bit operand
+#define OPF_BYTE	0x0200		// byte register operand, force a REX prefix
+#define OPF_66		0x0400		// operand size prefix
+#define OPF_F3		0x0800		// scalar single prefix
+
+typedef enum {
+	VAL_MEM,		// still on the opStack, value is its position
+	VAL_CONST,
+	VAL_LOCAL,		// programStack + value
+	VAL_REG
+} optValType_t;
+
+typedef struct {
+	optValType_t	type;
+	int				value;
+} optVal_t;
+
+typedef struct {
+	int			op;
+	int			value;
+	qboolean	label;
+} optIns_t;
+
+static const int	optRegs[] = { R_R10, R_R11, R_R12, R_R13, R_R14, R_R15 };
+
+static optIns_t		*optCode;
+static optVal_t		optStack[OPT_CACHE_MAX];
+static int			optDepth;		// cached entries at the top of optStack
+static int			optTop;			// opStack position of the top entry relative to the committed ebx
+static int			optEbx;			// opStack position ebx points at right now
+static int			optRegsUsed;
+static int			optMaxLength;
+
+static void Opt_EmitRex( int flags, int reg, int index, int base )
+{
+	int rex = 0x40;
+
+	if ( flags & OPF_W )
+		rex |= 8;
+	if ( reg & 8 )
+		rex |= 4;
+	if ( index & 8 )
+		rex |= 2;
+	if ( base & 8 )
+		rex |= 1;
+
+	if ( rex != 0x40 || ( flags & OPF_BYTE ) )
+		Emit1( rex );
+}
+
+static void Opt_EmitOpcode( int flags, int op, int reg, int index, int base )
+{
+	if ( flags & OPF_66 )
+		Emit1( 0x66 );
+	if ( flags & OPF_F3 )
+		Emit1( 0xF3 );
+
+	Opt_EmitRex( flags, reg, index, base );
+
+	if ( op > 0xFFFF )
+		Emit1( op >> 16 );
+	if ( op > 0xFF )
+		Emit1( ( op >> 8 ) & 0xFF );
+	Emit1( op & 0xFF );
+}
+
 /*
 =================
-VM_Compile
+Opt_EmitRR
+op reg, rm with a register operand
 =================
 */
-void VM_Compile(vm_t *vm, vmHeader_t *header)
+static void Opt_EmitRR( int flags, int op, int reg, int rm )
 {
-	int		op;
-	int		maxLength;
-	int		v;
-	int		i;
-        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	Opt_EmitOpcode( flags, op, reg, 0, rm );
+	Emit1( 0xC0 | ( ( reg & 7 ) << 3 ) | ( rm & 7 ) );
+}
 
-	jusedSize = header->instructionCount + 2;
+/*
+=================
+Opt_EmitRM
+op reg, [base + index * scale + disp], index -1 for none
+=================
+*/
+static void Opt_EmitRM( int flags, int op, int reg, int base, int index, int scale, int disp )
+{
+	int mod;
 
-	// allocate a very large temp buffer, we will shrink it later
-	maxLength = header->codeLength * 8 + 64;
-	buf = Z_Malloc(maxLength);
-	jused = Z_Malloc(jusedSize);
-	code = Z_Malloc(header->codeLength+32);
-	
-	Com_Memset(jused, 0, jusedSize);
-	Com_Memset(buf, 0, maxLength);
+	Opt_EmitOpcode( flags, op, reg, index < 0 ? 0 : index, base );
 
-	// copy code in larger buffer and put some zeros at the end
-	// so we can safely look ahead for a few instructions in it
-	// without a chance to get false-positive because of some garbage bytes
-	Com_Memset(code, 0, header->codeLength+32);
-	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+	if ( disp == 0 && ( base & 7 ) != R_EBP )
+		mod = 0x00;
+	else if ( iss8( disp ) )
+		mod = 0x40;
+	else
+		mod = 0x80;
+
+	if ( index < 0 && ( base & 7 ) != R_ESP )
+		Emit1( mod | ( ( reg & 7 ) << 3 ) | ( base & 7 ) );
+	else
+	{
+		if ( index < 0 )
+			index = R_ESP;		// no index
+
+		Emit1( mod | ( ( reg & 7 ) << 3 ) | 4 );
+		Emit1( ( ( scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0 ) << 6 ) | ( ( index & 7 ) << 3 ) | ( base & 7 ) );
+	}
+
+	if ( mod == 0x40 )
+		Emit1( disp );
+	else if ( mod == 0x80 )
+		Emit4( disp );
+}
+
+// the opStack entry ebx points at, see Opt_Slot
+#define OPT_SLOT			R_EDI, R_EBX, 4, 0
+
+/*
+=================
+Opt_EmitImm
+group 1 arithmetic (add, or, and, sub, xor, cmp) with an immediate
+=================
+*/
+static void Opt_EmitImm( int ext, int reg, int v )
+{
+	if ( iss8( v ) )
+	{
+		Opt_EmitRR( 0, 0x83, ext, reg );
+		Emit1( v );
+	}
+	else
+	{
+		Opt_EmitRR( 0, 0x81, ext, reg );
+		Emit4( v );
+	}
+}
+
+static void Opt_EmitMovImm( int reg, int v )
+{
+	if ( v == 0 )
+		Opt_EmitRR( 0, 0x33, reg, reg );	// xor reg, reg
+	else
+	{
+		Opt_EmitRex( 0, 0, 0, reg );
+		Emit1( 0xB8 + ( reg & 7 ) );		// mov reg, 0x12345678
+		Emit4( v );
+	}
+}
+
+/*
+=================
+Opt_EmitJump
+Jump to an instruction number, the offsets are only known in the last pass
+=================
+*/
+static void Opt_EmitJump( vm_t *vm, const char *jmpop, int dest )
+{
+	EmitString( jmpop );
+
+	if ( pass == 1 )
+		Emit4( vm->instructionPointers[dest] - compiledOfs - 4 );
+	else
+		compiledOfs += 4;
+}
+
+static void Opt_CheckTarget( vm_t *vm, int dest )
+{
+	if ( dest < 0 || dest >= vm->instructionCount )
+	{
+		Z_Free( optCode );
+		VMFREE_BUFFERS();
+		Com_Error( ERR_DROP, "VM_CompileX86: jump target out of range at instruction %d", instruction );
+	}
+}
+
+/*
+=================
+Opt_Slot
+Point ebx at an opStack position.  Entries are always addressed through
+bl, so the index wraps at 256 entries like in the first tier instead of
+reaching past the opStack with a displacement.  add changes the flags,
+so this must not go between a compare and its branch.
+=================
+*/
+static void Opt_Slot( int pos )
+{
+	if ( pos == optEbx )
+		return;
+
+	EmitString( "80 C3" );		// add bl, pos - optEbx
+	Emit1( pos - optEbx );
+	optEbx = pos;
+}
+
+/*
+=================
+Opt_StoreVal
+Write a cached entry back to its opStack slot
+=================
+*/
+static void Opt_StoreVal( optVal_t *val, int pos )
+{
+	switch ( val->type )
+	{
+	case VAL_CONST:
+		Opt_Slot( pos );
+		Opt_EmitRM( 0, 0xC7, 0, OPT_SLOT );			// mov dword ptr [edi + ebx * 4], 0x12345678
+		Emit4( val->value );
+		break;
+	case VAL_LOCAL:
+		Opt_EmitRM( 0, 0x8D, R_EAX, R_ESI, -1, 1, val->value );	// lea eax, [esi + 0x12345678]
+		Opt_Slot( pos );
+		Opt_EmitRM( 0, 0x89, R_EAX, OPT_SLOT );		// mov dword ptr [edi + ebx * 4], eax
+		break;
+	case VAL_REG:
+		Opt_Slot( pos );
+		Opt_EmitRM( 0, 0x89, val->value, OPT_SLOT );		// mov dword ptr [edi + ebx * 4], reg
+		optRegsUsed &= ~( 1 << val->value );
+		break;
+	default:
+		break;
+	}
+	val->type = VAL_MEM;
+}
+
+/*
+=================
+Opt_Spill
+Write back the cached entries up to and including the lowest one held in a
+register, so everything below the cache stays in memory
+=================
+*/
+static void Opt_Spill( void )
+{
+	int i, n;
+
+	for ( n = 0 ; n < optDepth ; n++ )
+	{
+		if ( optStack[n].type == VAL_REG )
+			break;
+	}
+	if ( n == optDepth )
+		return;
+
+	n++;
+	for ( i = 0 ; i < n ; i++ )
+		Opt_StoreVal( &optStack[i], optTop - optDepth + 1 + i );
+
+	optDepth -= n;
+	memmove( optStack, optStack + n, optDepth * sizeof( optStack[0] ) );
+}
+
+static int Opt_AllocReg( void )
+{
+	int i;
+
+	for ( i = 0 ; i < ARRAY_LEN( optRegs ) ; i++ )
+	{
+		if ( !( optRegsUsed & ( 1 << optRegs[i] ) ) )
+		{
+			optRegsUsed |= 1 << optRegs[i];
+			return optRegs[i];
+		}
+	}
+
+	Opt_Spill();
+
+	for ( i = 0 ; i < ARRAY_LEN( optRegs ) ; i++ )
+	{
+		if ( !( optRegsUsed & ( 1 << optRegs[i] ) ) )
+		{
+			optRegsUsed |= 1 << optRegs[i];
+			return optRegs[i];
+		}
+	}
+
+	Z_Free( optCode );
+	VMFREE_BUFFERS();
+	Com_Error( ERR_DROP, "VM_CompileX86: out of registers at instruction %d", instruction );
+	return -1;
+}
+
+static void Opt_FreeReg( int reg )
+{
+	optRegsUsed &= ~( 1 << reg );
+}
+
+/*
+=================
+Opt_Flush
+Write back all cached entries and commit the opStack offset in ebx.
+This is the canonical state at every block boundary and call.
+=================
+*/
+static void Opt_Flush( void )
+{
+	int i;
+
+	for ( i = 0 ; i < optDepth ; i++ )
+		Opt_StoreVal( &optStack[i], optTop - optDepth + 1 + i );
+	optDepth = 0;
+
+	Opt_Slot( optTop );
+	optTop = 0;
+	optEbx = 0;
+}
+
+static void Opt_Push( optValType_t type, int value )
+{
+	if ( optDepth == OPT_CACHE_MAX )
+	{
+		Opt_StoreVal( &optStack[0], optTop - optDepth + 1 );
+		optDepth--;
+		memmove( optStack, optStack + 1, optDepth * sizeof( optStack[0] ) );
+	}
+
+	optStack[optDepth].type = type;
+	optStack[optDepth].value = value;
+	optDepth++;
+	optTop++;
+}
+
+/*
+=================
+Opt_Pop
+Entries that are still in memory are returned as VAL_MEM with their position,
+they have to be loaded before ebx changes
+=================
+*/
+static optVal_t Opt_Pop( void )
+{
+	optVal_t val;
+
+	if ( optDepth )
+		val = optStack[--optDepth];
+	else
+	{
+		val.type = VAL_MEM;
+		val.value = optTop;
+	}
+	optTop--;
+
+	return val;
+}
+
+/*
+=================
+Opt_Load
+Get a value into a register owned by the caller
+=================
+*/
+static int Opt_Load( optVal_t val )
+{
+	int reg;
+
+	if ( val.type == VAL_REG )
+		return val.value;
+
+	reg = Opt_AllocReg();
+
+	switch ( val.type )
+	{
+	case VAL_CONST:
+		Opt_EmitMovImm( reg, val.value );
+		break;
+	case VAL_LOCAL:
+		Opt_EmitRM( 0, 0x8D, reg, R_ESI, -1, 1, val.value );	// lea reg, [esi + 0x12345678]
+		break;
+	default:
+		Opt_Slot( val.value );
+		Opt_EmitRM( 0, 0x8B, reg, OPT_SLOT );		// mov reg, dword ptr [edi + ebx * 4]
+		break;
+	}
+
+	return reg;
+}
+
+static void Opt_Release( optVal_t val )
+{
+	if ( val.type == VAL_REG )
+		Opt_FreeReg( val.value );
+}
+
+/*
+=================
+Opt_Address
+Turn a vm address into a masked register offset from r9, or -1 with the
+offset in *disp for constant addresses. With a guarded data segment local
+addresses become esi plus a displacement.
+=================
+*/
+static int Opt_Address( vm_t *vm, optVal_t val, int *disp )
+{
+	int reg;
+
+	if ( val.type == VAL_CONST )
+	{
+		*disp = val.value & vm->dataMask;
+		return -1;
+	}
+
+	if ( val.type == VAL_LOCAL && !accessMask )
+	{
+		*disp = val.value;
+		return R_ESI;
+	}
+
+	reg = Opt_Load( val );
+	if ( accessMask )
+		Opt_EmitImm( 4, reg, accessMask );			// and reg, vm->dataMask
+	*disp = 0;
+
+	return reg;
+}
+
+static void Opt_EmitDataAccess( int flags, int op, int reg, int addr, int disp )
+{
+	if ( addr < 0 )
+		Opt_EmitRM( flags, op, reg, R_R9, -1, 1, disp );	// op reg, [r9 + disp]
+	else
+		Opt_EmitRM( flags, op, reg, R_R9, addr, 1, disp );	// op reg, [r9 + addr + disp]
+}
+
+static void Opt_Load1( vm_t *vm, int op )
+{
+	int addr, disp, reg;
+	optVal_t val = Opt_Pop();
+
+	addr = Opt_Address( vm, val, &disp );
+	reg = ( addr < 0 || addr == R_ESI ) ? Opt_AllocReg() : addr;
+
+	Opt_EmitDataAccess( 0, op, reg, addr, disp );		// mov/movzx reg, [r9 + addr]
+	Opt_Push( VAL_REG, reg );
+}
+
+static void Opt_Store( vm_t *vm, int size )
+{
+	int addr, disp, reg = -1;
+	optVal_t val = Opt_Pop();
+	optVal_t ptr = Opt_Pop();
+
+	if ( val.type != VAL_CONST )
+		reg = Opt_Load( val );
+
+	addr = Opt_Address( vm, ptr, &disp );
+
+	if ( reg < 0 )
+	{
+		switch ( size )
+		{
+		case 1:
+			Opt_EmitDataAccess( 0, 0xC6, 0, addr, disp );		// mov byte ptr [r9 + addr], 0x12
+			Emit1( val.value );
+			break;
+		case 2:
+			Opt_EmitDataAccess( OPF_66, 0xC7, 0, addr, disp );	// mov word ptr [r9 + addr], 0x1234
+			Emit2( val.value );
+			break;
+		default:
+			Opt_EmitDataAccess( 0, 0xC7, 0, addr, disp );		// mov dword ptr [r9 + addr], 0x12345678
+			Emit4( val.value );
+			break;
+		}
+	}
+	else
+	{
+		switch ( size )
+		{
+		case 1:
+			Opt_EmitDataAccess( OPF_BYTE, 0x88, reg, addr, disp );	// mov byte ptr [r9 + addr], reg
+			break;
+		case 2:
+			Opt_EmitDataAccess( OPF_66, 0x89, reg, addr, disp );	// mov word ptr [r9 + addr], reg
+			break;
+		default:
+			Opt_EmitDataAccess( 0, 0x89, reg, addr, disp );		// mov dword ptr [r9 + addr], reg
+			break;
+		}
+		Opt_FreeReg( reg );
+	}
+
+	if ( addr >= 0 && addr != R_ESI )
+		Opt_FreeReg( addr );
+}
+
+/*
+=================
+Opt_FoldConst
+Evaluate integer operations on two constants at compile time
+=================
+*/
+static qboolean Opt_FoldConst( int op, unsigned int a, unsigned int b, int *result )
+{
+	switch ( op )
+	{
+	case OP_ADD:	*result = a + b; break;
+	case OP_SUB:	*result = a - b; break;
+	case OP_MULI:
+	case OP_MULU:	*result = a * b; break;
+	case OP_BAND:	*result = a & b; break;
+	case OP_BOR:	*result = a | b; break;
+	case OP_BXOR:	*result = a ^ b; break;
+	case OP_LSH:	*result = a << ( b & 31 ); break;
+	case OP_RSHI:	*result = (int)a >> ( b & 31 ); break;
+	case OP_RSHU:	*result = a >> ( b & 31 ); break;
+	default:
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+=================
+Opt_Binary
+Two operand integer arithmetic, reg form opcode and group 1 extension
+=================
+*/
+static void Opt_Binary( int op, int opcode, int ext )
+{
+	int ra, rb, v;
+	optVal_t b = Opt_Pop();
+	optVal_t a = Opt_Pop();
+
+	if ( a.type == VAL_CONST && b.type == VAL_CONST && Opt_FoldConst( op, a.value, b.value, &v ) )
+	{
+		Opt_Push( VAL_CONST, v );
+		return;
+	}
+
+	// local address arithmetic stays symbolic
+	if ( op == OP_ADD && a.type == VAL_LOCAL && b.type == VAL_CONST )
+	{
+		Opt_Push( VAL_LOCAL, a.value + b.value );
+		return;
+	}
+	if ( op == OP_ADD && a.type == VAL_CONST && b.type == VAL_LOCAL )
+	{
+		Opt_Push( VAL_LOCAL, a.value + b.value );
+		return;
+	}
+	if ( op == OP_SUB && a.type == VAL_LOCAL && b.type == VAL_CONST )
+	{
+		Opt_Push( VAL_LOCAL, a.value - b.value );
+		return;
+	}
+
+	ra = Opt_Load( a );
+
+	if ( b.type == VAL_CONST && ext >= 0 )
+		Opt_EmitImm( ext, ra, b.value );		// op ra, 0x12345678
+	else if ( b.type == VAL_MEM )
+	{
+		Opt_Slot( b.value );
+		Opt_EmitRM( 0, opcode, ra, OPT_SLOT );		// op ra, dword ptr [edi + ebx * 4]
+	}
+	else
+	{
+		rb = Opt_Load( b );
+		Opt_EmitRR( 0, opcode, ra, rb );		// op ra, rb
+		Opt_FreeReg( rb );
+	}
+
+	Opt_Push( VAL_REG, ra );
+}
+
+static void Opt_Multiply( void )
+{
+	int ra, rb, v;
+	optVal_t b = Opt_Pop();
+	optVal_t a = Opt_Pop();
+
+	if ( a.type == VAL_CONST && b.type == VAL_CONST && Opt_FoldConst( OP_MULI, a.value, b.value, &v ) )
+	{
+		Opt_Push( VAL_CONST, v );
+		return;
+	}
+
+	ra = Opt_Load( a );
+
+	if ( b.type == VAL_CONST )
+	{
+		if ( iss8( b.value ) )
+		{
+			Opt_EmitRR( 0, 0x6B, ra, ra );		// imul ra, ra, 0x12
+			Emit1( b.value );
+		}
+		else
+		{
+			Opt_EmitRR( 0, 0x69, ra, ra );		// imul ra, ra, 0x12345678
+			Emit4( b.value );
+		}
+	}
+	else if ( b.type == VAL_MEM )
+	{
+		Opt_Slot( b.value );
+		Opt_EmitRM( 0, 0x0FAF, ra, OPT_SLOT );		// imul ra, dword ptr [edi + ebx * 4]
+	}
+	else
+	{
+		rb = Opt_Load( b );
+		Opt_EmitRR( 0, 0x0FAF, ra, rb );		// imul ra, rb
+		Opt_FreeReg( rb );
+	}
+
+	Opt_Push( VAL_REG, ra );
+}
+
+static void Opt_Divide( int op )
+{
+	int ra, rb;
+	optVal_t b = Opt_Pop();
+	optVal_t a = Opt_Pop();
+
+	ra = Opt_Load( a );
+	rb = Opt_Load( b );
+
+	Opt_EmitRR( 0, 0x8B, R_EAX, ra );			// mov eax, ra
+	if ( op == OP_DIVI || op == OP_MODI )
+	{
+		EmitString( "99" );				// cdq
+		Opt_EmitRR( 0, 0xF7, 7, rb );			// idiv rb
+	}
+	else
+	{
+		EmitString( "33 D2" );				// xor edx, edx
+		Opt_EmitRR( 0, 0xF7, 6, rb );			// div rb
+	}
+
+	if ( op == OP_DIVI || op == OP_DIVU )
+		Opt_EmitRR( 0, 0x8B, ra, R_EAX );		// mov ra, eax
+	else
+		Opt_EmitRR( 0, 0x8B, ra, R_EDX );		// mov ra, edx
+
+	Opt_FreeReg( rb );
+	Opt_Push( VAL_REG, ra );
+}
+
+static void Opt_Shift( int op, int ext )
+{
+	int ra, rb, v;
+	optVal_t b = Opt_Pop();
+	optVal_t a = Opt_Pop();
+
+	if ( a.type == VAL_CONST && b.type == VAL_CONST && Opt_FoldConst( op, a.value, b.value, &v ) )
+	{
+		Opt_Push( VAL_CONST, v );
+		return;
+	}
+
+	ra = Opt_Load( a );
+
+	if ( b.type == VAL_CONST )
+	{
+		Opt_EmitRR( 0, 0xC1, ext, ra );			// shl/sar/shr ra, 0x12
+		Emit1( b.value & 31 );
+	}
+	else
+	{
+		rb = Opt_Load( b );
+		Opt_EmitRR( 0, 0x8B, R_ECX, rb );		// mov ecx, rb
+		Opt_EmitRR( 0, 0xD3, ext, ra );			// shl/sar/shr ra, cl
+		Opt_FreeReg( rb );
+	}
+
+	Opt_Push( VAL_REG, ra );
+}
+
+static void Opt_Unary( int op )
+{
+	int ra;
+	optVal_t a = Opt_Pop();
+
+	if ( a.type == VAL_CONST && op != OP_NEGF )
+	{
+		switch ( op )
+		{
+		case OP_NEGI:	Opt_Push( VAL_CONST, -(unsigned int)a.value ); return;
+		case OP_BCOM:	Opt_Push( VAL_CONST, ~a.value ); return;
+		case OP_SEX8:	Opt_Push( VAL_CONST, (signed char)a.value ); return;
+		case OP_SEX16:	Opt_Push( VAL_CONST, (short)a.value ); return;
+		default:	break;
+		}
+	}
+
+	ra = Opt_Load( a );
+
+	switch ( op )
+	{
+	case OP_NEGI:
+		Opt_EmitRR( 0, 0xF7, 3, ra );			// neg ra
+		break;
+	case OP_BCOM:
+		Opt_EmitRR( 0, 0xF7, 2, ra );			// not ra
+		break;
+	case OP_SEX8:
+		Opt_EmitRR( OPF_BYTE, 0x0FBE, ra, ra );		// movsx ra, ra8
+		break;
+	case OP_SEX16:
+		Opt_EmitRR( 0, 0x0FBF, ra, ra );		// movsx ra, ra16
+		break;
+	case OP_NEGF:
+		Opt_EmitRR( 0, 0x81, 6, ra );			// xor ra, 0x80000000
+		Emit4( 0x80000000 );
+		break;
+	case OP_CVIF:
+		Opt_EmitRR( OPF_F3, 0x0F2A, 0, ra );		// cvtsi2ss xmm0, ra
+		Opt_EmitRR( OPF_66, 0x0F7E, 0, ra );		// movd ra, xmm0
+		break;
+	case OP_CVFI:
+		Opt_EmitRR( OPF_66, 0x0F6E, 0, ra );		// movd xmm0, ra
+		Opt_EmitRR( OPF_F3, 0x0F2C, ra, 0 );		// cvttss2si ra, xmm0
+		break;
+	}
+
+	Opt_Push( VAL_REG, ra );
+}
+
+static void Opt_Float( int opcode )
+{
+	int ra, rb;
+	optVal_t b = Opt_Pop();
+	optVal_t a = Opt_Pop();
+
+	ra = Opt_Load( a );
+	Opt_EmitRR( OPF_66, 0x0F6E, 0, ra );			// movd xmm0, ra
+
+	if ( b.type == VAL_MEM )
+	{
+		Opt_Slot( b.value );
+		Opt_EmitRM( OPF_F3, opcode, 0, OPT_SLOT );		// op xmm0, dword ptr [edi + ebx * 4]
+	}
+	else
+	{
+		rb = Opt_Load( b );
+		Opt_EmitRR( OPF_66, 0x0F6E, 1, rb );		// movd xmm1, rb
+		Opt_EmitRR( OPF_F3, opcode, 0, 1 );		// op xmm0, xmm1
+		Opt_FreeReg( rb );
+	}
+
+	Opt_EmitRR( OPF_66, 0x0F7E, 0, ra );			// movd ra, xmm0
+	Opt_Push( VAL_REG, ra );
+}
+
+/*
+=================
+Opt_Branch
+Compare and branch, both operands are loaded before the opStack is committed
+=================
+*/
+static void Opt_Branch( vm_t *vm, int op, int dest )
+{
+	static const char *jcc[] = {
+		"0F 84", "0F 85",				// OP_EQ, OP_NE
+		"0F 8C", "0F 8E", "0F 8F", "0F 8D",		// OP_LTI, OP_LEI, OP_GTI, OP_GEI
+		"0F 82", "0F 86", "0F 87", "0F 83",		// OP_LTU, OP_LEU, OP_GTU, OP_GEU
+		// the x87 code jumps on unordered for EQF, LTF and LEF, so do the same
+		"0F 84", "0F 85",				// OP_EQF, OP_NEF
+		"0F 82", "0F 86", "0F 87", "0F 83"		// OP_LTF, OP_LEF, OP_GTF, OP_GEF
+	};
+	int ra, rb = -1;
+	optVal_t b = Opt_Pop();
+	optVal_t a = Opt_Pop();
+
+	ra = Opt_Load( a );
+
+	if ( op >= OP_EQF )
+	{
+		rb = Opt_Load( b );
+		Opt_EmitRR( OPF_66, 0x0F6E, 0, ra );		// movd xmm0, ra
+		Opt_EmitRR( OPF_66, 0x0F6E, 1, rb );		// movd xmm1, rb
+		Opt_Flush();
+		Opt_EmitRR( 0, 0x0F2E, 0, 1 );			// ucomiss xmm0, xmm1
+	}
+	else
+	{
+		if ( b.type != VAL_CONST )
+			rb = Opt_Load( b );
+		Opt_Flush();
+		if ( rb < 0 )
+			Opt_EmitImm( 7, ra, b.value );		// cmp ra, 0x12345678
+		else
+			Opt_EmitRR( 0, 0x3B, ra, rb );		// cmp ra, rb
+	}
+
+	Opt_FreeReg( ra );
+	if ( rb >= 0 )
+		Opt_FreeReg( rb );
+
+	Opt_EmitJump( vm, jcc[op - OP_EQ], dest );
+}
+
+/*
+=================
+Opt_Decode
+Decode the bytecode into optCode and mark the instructions that start a block
+=================
+*/
+static void Opt_Decode( vm_t *vm, vmHeader_t *header )
+{
+	int i, op, dest;
+
+	pc = 0;
+	for ( instruction = 0 ; instruction < header->instructionCount ; instruction++ )
+	{
+		if ( pc >= header->codeLength )
+		{
+			Z_Free( optCode );
+			VMFREE_BUFFERS();
+			Com_Error( ERR_DROP, "VM_CompileX86: pc > header->codeLength" );
+		}
+
+		op = code[pc++];
+		optCode[instruction].op = op;
+
+		switch ( op )
+		{
+		case OP_ENTER:
+			optCode[instruction].label = qtrue;
+			// fall through
+		case OP_LEAVE:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_EQ: case OP_NE:
+		case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+		case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+		case OP_EQF: case OP_NEF:
+		case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+		case OP_BLOCK_COPY:
+			optCode[instruction].value = Constant4();
+			break;
+		case OP_ARG:
+			optCode[instruction].value = Constant1();
+			break;
+		case OP_IGNORE:
+			Z_Free( optCode );
+			VMFREE_BUFFERS();
+			Com_Error( ERR_DROP, "VM_CompileX86: bad opcode %i at offset %i", op, pc );
+			break;
+		default:
+			if ( op > OP_CVFI )
+			{
+				Z_Free( optCode );
+				VMFREE_BUFFERS();
+				Com_Error( ERR_DROP, "VM_CompileX86: bad opcode %i at offset %i", op, pc );
+			}
+			break;
+		}
+	}
+
+	optCode[0].label = qtrue;
+
+	for ( i = 0 ; i < header->instructionCount ; i++ )
+	{
+		op = optCode[i].op;
+		instruction = i;
+
+		if ( op >= OP_EQ && op <= OP_GEF )
+			dest = optCode[i].value;
+		else if ( op == OP_CONST && i + 1 < header->instructionCount &&
+			( optCode[i + 1].op == OP_JUMP || optCode[i + 1].op == OP_CALL ) && optCode[i].value >= 0 )
+			dest = optCode[i].value;
+		else
+			continue;
+
+		Opt_CheckTarget( vm, dest );
+		optCode[dest].label = qtrue;
+	}
+
+	for ( i = 0 ; i < vm->numJumpTableTargets ; i++ )
+	{
+		dest = *(int *)( vm->jumpTableTargets + i * sizeof( int ) );
+		Opt_CheckTarget( vm, dest );
+		optCode[dest].label = qtrue;
+	}
+}
+
+/*
+=================
+VM_CompileOpt
+=================
+*/
+static void VM_CompileOpt( vm_t *vm, vmHeader_t *header, int callProcOfsSyscall, int callProcOfs, int callDoSyscallOfs )
+{
+	optIns_t	*ins;
+	optVal_t	val, ptr;
+	int			reg, addr, disp;
+
+	optCode = Z_Malloc( header->instructionCount * sizeof( *optCode ) );
+	Com_Memset( optCode, 0, header->instructionCount * sizeof( *optCode ) );
+
+	Opt_Decode( vm, header );
+
+	for ( pass = 0 ; pass < 2 ; pass++ )
+	{
+		compiledOfs = vm->entryOfs;
+#ifdef VM_X86_CACHE
+		numRelocs = stubRelocs;
+#endif
+		optDepth = 0;
+		optTop = 0;
+		optEbx = 0;
+		optRegsUsed = 0;
+
+		for ( instruction = 0 ; instruction < header->instructionCount ; instruction++ )
+		{
+			ins = &optCode[instruction];
+
+			if ( ins->label )
+				Opt_Flush();
+
+			if ( compiledOfs > optMaxLength - 512 )
+			{
+				Z_Free( optCode );
+				VMFREE_BUFFERS();
+				Com_Error( ERR_DROP, "VM_CompileX86: maxLength exceeded" );
+			}
+
+			vm->instructionPointers[instruction] = compiledOfs;
+
+			switch ( ins->op )
+			{
+			case OP_UNDEF:
+				break;
+			case OP_BREAK:
+				EmitString( "CC" );				// int 3
+				break;
+			case OP_ENTER:
+				EmitString( "81 EE" );				// sub esi, 0x12345678
+				Emit4( ins->value );
+				break;
+			case OP_LEAVE:
+				Opt_Flush();
+				EmitString( "81 C6" );				// add esi, 0x12345678
+				Emit4( ins->value );
+				EmitString( "C3" );				// ret
+				break;
+			case OP_CONST:
+				Opt_Push( VAL_CONST, ins->value );
+				break;
+			case OP_LOCAL:
+				Opt_Push( VAL_LOCAL, ins->value );
+				break;
+			case OP_PUSH:
+				Opt_Push( VAL_CONST, 0 );
+				break;
+			case OP_POP:
+				Opt_Release( Opt_Pop() );
+				break;
+
+			case OP_CALL:
+				val = Opt_Pop();
+				if ( val.type == VAL_CONST )
+				{
+					Opt_Flush();
+					if ( val.value < 0 )
+					{
+						if ( !EmitIntrinsic( vm, ~val.value ) )
+						{
+							EmitString( "B8" );		// mov eax, 0x12345678
+							Emit4( val.value );
+							EmitCallRel( vm, callProcOfsSyscall );
+						}
+					}
+					else
+					{
+						Opt_CheckTarget( vm, val.value );
+						Opt_EmitJump( vm, "E8", val.value );	// call 0x12345678
+					}
+				}
+				else
+				{
+					// the call procedure takes the target from the opStack
+					if ( val.type == VAL_MEM )
+						optTop++;
+					else
+						Opt_Push( val.type, val.value );
+					Opt_Flush();
+					EmitCallRel( vm, callProcOfs );
+				}
+				// the return value is on top of the committed opStack
+				break;
+
+			case OP_JUMP:
+				val = Opt_Pop();
+				if ( val.type == VAL_CONST )
+				{
+					Opt_CheckTarget( vm, val.value );
+					Opt_Flush();
+					Opt_EmitJump( vm, "E9", val.value );		// jmp 0x12345678
+				}
+				else
+				{
+					reg = Opt_Load( val );
+					Opt_Flush();
+					Opt_EmitRR( 0, 0x8B, R_EAX, reg );		// mov eax, reg
+					Opt_FreeReg( reg );
+					EmitString( "3D" );				// cmp eax, vm->instructionCount
+					Emit4( vm->instructionCount );
+					EmitString( "73 04" );				// jae +4
+					EmitRexString( 0x49, "FF 24 C0" );		// jmp qword ptr [r8 + eax * 8]
+					EmitCallErrJump( vm, callDoSyscallOfs );
+				}
+				break;
+
+			case OP_EQ: case OP_NE:
+			case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+			case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+			case OP_EQF: case OP_NEF:
+			case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+				Opt_Branch( vm, ins->op, ins->value );
+				break;
+
+			case OP_LOAD1:
+				Opt_Load1( vm, 0x0FB6 );				// movzx reg, byte ptr
+				break;
+			case OP_LOAD2:
+				Opt_Load1( vm, 0x0FB7 );				// movzx reg, word ptr
+				break;
+			case OP_LOAD4:
+				Opt_Load1( vm, 0x8B );					// mov reg, dword ptr
+				break;
+			case OP_STORE1:
+				Opt_Store( vm, 1 );
+				break;
+			case OP_STORE2:
+				Opt_Store( vm, 2 );
+				break;
+			case OP_STORE4:
+				Opt_Store( vm, 4 );
+				break;
+
+			case OP_ARG:
+				val = Opt_Pop();
+				reg = -1;
+				if ( val.type != VAL_CONST )
+					reg = Opt_Load( val );
+				ptr.type = VAL_LOCAL;
+				ptr.value = ins->value;
+				addr = Opt_Address( vm, ptr, &disp );
+				if ( reg < 0 )
+				{
+					Opt_EmitDataAccess( 0, 0xC7, 0, addr, disp );	// mov dword ptr [r9 + addr], 0x12345678
+					Emit4( val.value );
+				}
+				else
+				{
+					Opt_EmitDataAccess( 0, 0x89, reg, addr, disp );	// mov dword ptr [r9 + addr], reg
+					Opt_FreeReg( reg );
+				}
+				if ( addr != R_ESI )
+					Opt_FreeReg( addr );
+				break;
+
+			case OP_BLOCK_COPY:
+				Opt_Flush();
+				EmitString( "B8" );				// mov eax, 0x12345678
+				Emit4( VM_BLOCK_COPY );
+				EmitString( "B9" );				// mov ecx, 0x12345678
+				Emit4( ins->value );
+				EmitCallRel( vm, callDoSyscallOfs );
+				STACK_POP( 2 );					// sub bl, 2
+				break;
+
+			case OP_SEX8:
+			case OP_SEX16:
+			case OP_NEGI:
+			case OP_BCOM:
+			case OP_NEGF:
+			case OP_CVIF:
+			case OP_CVFI:
+				Opt_Unary( ins->op );
+				break;
+
+			case OP_ADD:
+				Opt_Binary( ins->op, 0x03, 0 );
+				break;
+			case OP_SUB:
+				Opt_Binary( ins->op, 0x2B, 5 );
+				break;
+			case OP_BAND:
+				Opt_Binary( ins->op, 0x23, 4 );
+				break;
+			case OP_BOR:
+				Opt_Binary( ins->op, 0x0B, 1 );
+				break;
+			case OP_BXOR:
+				Opt_Binary( ins->op, 0x33, 6 );
+				break;
+			case OP_MULI:
+			case OP_MULU:
+				Opt_Multiply();
+				break;
+			case OP_DIVI:
+			case OP_DIVU:
+			case OP_MODI:
+			case OP_MODU:
+				Opt_Divide( ins->op );
+				break;
+			case OP_LSH:
+				Opt_Shift( ins->op, 4 );
+				break;
+			case OP_RSHI:
+				Opt_Shift( ins->op, 7 );
+				break;
+			case OP_RSHU:
+				Opt_Shift( ins->op, 5 );
+				break;
+
+			case OP_ADDF:
+				Opt_Float( 0x0F58 );
+				break;
+			case OP_SUBF:
+				Opt_Float( 0x0F5C );
+				break;
+			case OP_MULF:
+				Opt_Float( 0x0F59 );
+				break;
+			case OP_DIVF:
+				Opt_Float( 0x0F5E );
+				break;
+			}
+
+			if ( optTop > OPT_STACK_RANGE || optTop < -OPT_STACK_RANGE )
+				Opt_Flush();
+		}
+
+		Opt_Flush();
+	}
+
+	Z_Free( optCode );
+	optCode = NULL;
+}
+#endif
+
+/*
+=================
+VM_InstallCode
+Copy code to an exact sized buffer with the appropriate permission bits
+=================
+*/
+static void VM_InstallCode(vm_t *vm, byte *src, int length)
+{
+	vm->codeLength = length;
+#ifdef VM_X86_MMAP
+	vm->codeBase = mmap(NULL, length, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(vm->codeBase == MAP_FAILED)
+		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
+#elif _WIN32
+	// allocate memory with EXECUTE permissions under windows.
+	vm->codeBase = VirtualAlloc(NULL, length, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+	if(!vm->codeBase)
+		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
+#else
+	vm->codeBase = malloc(length);
+	if(!vm->codeBase)
+	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
+#endif
+
+	Com_Memcpy( vm->codeBase, src, length );
+
+#ifdef VM_X86_MMAP
+	if(mprotect(vm->codeBase, length, PROT_READ|PROT_EXEC))
+		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
+#elif _WIN32
+	{
+		DWORD oldProtect = 0;
+		
+		// remove write permissions.
+		if(!VirtualProtect(vm->codeBase, length, PAGE_EXECUTE_READ, &oldProtect))
+			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
+	}
+#endif
+}
+
+#ifdef VM_X86_CACHE
+/*
+=================================================================================
+
+CODE CACHE
+
+Compiled code is written to vmcache/ in the home path and reused when the same
+qvm is compiled again with the same settings. The few host pointers in the code
+are stored as indexes into VM_RelocTargets and patched on load.
+
+=================================================================================
+*/
+
+#define	VM_CACHE_IDENT		(('T'<<24)+('I'<<16)+('J'<<8)+'Q')
+#define	VM_CACHE_VERSION	2		// bump when the generated code changes
+#define	MAX_RELOC_TARGETS	16
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	char		build[32];			// date and time this compiler was built
+	int			cpuFeatures;
+	unsigned	checksum;			// of the qvm code and jump table targets
+	int			instructionCount;
+	int			dataMask;
+	int			accessMask;
+	int			optimize;
+	int			entryOfs;
+	int			codeLength;
+	int			numRelocs;
+	// followed by int instructionPointers[instructionCount],
+	// vmReloc_t relocs[numRelocs] and the code
+} vmCacheHeader_t;
+
+/*
+=================
+VM_RelocTargets
+=================
+*/
+static int VM_RelocTargets(void **targets)
+{
+	int count, i;
+
+	targets[0] = (void *) DoSyscall;
+	targets[1] = &vm_syscallNum;
+	targets[2] = &vm_programStack;
+	targets[3] = &vm_opStackOfs;
+	targets[4] = &vm_opStackBase;
+	targets[5] = &vm_arg;
+	targets[6] = (void *) Q_VMftol;
+	count = 7;
+
+#ifdef VM_X86_INTRINSICS
+	for(i = 0; i < VM_NUM_INTRINSIC_HELPERS; i++)
+		targets[count++] = (void *) vm_intrinsicHelpers[i];
+#endif
+
+	return count;
+}
+
+static void VM_AddReloc(void *ptr)
+{
+	void *targets[MAX_RELOC_TARGETS];
+	int i, count;
+
+	if(!relocs)
+		return;
+
+	count = VM_RelocTargets(targets);
+	for(i = 0; i < count; i++)
+	{
+		if(targets[i] == ptr)
+			break;
+	}
+
+	if(i == count || numRelocs >= maxRelocs)
+	{
+		relocFailed = qtrue;
+		return;
+	}
+
+	relocs[numRelocs].ofs = compiledOfs;
+	relocs[numRelocs].target = i;
+	numRelocs++;
+}
+
+/*
+=================
+VM_CacheHeader
+Fill in everything the cached code depends on
+=================
+*/
+static void VM_CacheHeader(vm_t *vm, vmHeader_t *header, vmCacheHeader_t *ch, char *filename, int size)
+{
+	unsigned sums[4];
+
+	Com_Memset(ch, 0, sizeof(*ch));
+	ch->ident = VM_CACHE_IDENT;
+	ch->version = VM_CACHE_VERSION;
+	Q_strncpyz(ch->build, __DATE__ " " __TIME__, sizeof(ch->build));
+	ch->cpuFeatures = Sys_GetProcessorFeatures();
+
+	sums[0] = Com_BlockChecksum((byte *) header + header->codeOffset, header->codeLength);
+	sums[1] = vm->numJumpTableTargets ?
+		Com_BlockChecksum(vm->jumpTableTargets, vm->numJumpTableTargets * sizeof(int)) : 0;
+	sums[2] = header->codeLength;
+	sums[3] = vm->numJumpTableTargets;
+	ch->checksum = Com_BlockChecksum(sums, sizeof(sums));
+
+	ch->instructionCount = header->instructionCount;
+	ch->dataMask = vm->dataMask;
+	ch->accessMask = accessMask;
+	ch->optimize = vm->optimize;
+
+	Com_sprintf(filename, size, "vmcache/%s-%08x.jit", vm->name, ch->checksum);
+}
+
+/*
+=================
+VM_LoadCache
+=================
+*/
+static qboolean VM_LoadCache(vm_t *vm, vmHeader_t *header)
+{
+	vmCacheHeader_t	key, *ch;
+	char		filename[MAX_QPATH];
+	void		*targets[MAX_RELOC_TARGETS];
+	fileHandle_t	f;
+	byte		*data, *codeData;
+	int		*ofs;
+	vmReloc_t	*rel;
+	long		len;
+	int		i, numTargets;
+
+	VM_CacheHeader(vm, header, &key, filename, sizeof(filename));
+
+	len = FS_SV_FOpenFileRead(filename, &f);
+	if(!f)
+		return qfalse;
+
+	if(len < sizeof(*ch))
+	{
+		FS_FCloseFile(f);
+		return qfalse;
+	}
+
+	data = Z_Malloc(len);
+	if(FS_Read(data, len, f) != len)
+	{
+		FS_FCloseFile(f);
+		Z_Free(data);
+		return qfalse;
+	}
+	FS_FCloseFile(f);
+
+	ch = (vmCacheHeader_t *) data;
+	if(ch->ident != key.ident || ch->version != key.version || strcmp(ch->build, key.build)
+	   || ch->cpuFeatures != key.cpuFeatures || ch->checksum != key.checksum
+	   || ch->instructionCount != key.instructionCount || ch->dataMask != key.dataMask
+	   || ch->accessMask != key.accessMask || ch->optimize != key.optimize
+	   || ch->codeLength <= 0 || ch->numRelocs < 0 || ch->entryOfs < 0 || ch->entryOfs >= ch->codeLength
+	   || len != sizeof(*ch) + ch->instructionCount * sizeof(int) + ch->numRelocs * sizeof(vmReloc_t) + ch->codeLength)
+	{
+		Com_Printf("Ignoring stale vm cache %s\n", filename);
+		Z_Free(data);
+		return qfalse;
+	}
+
+	ofs = (int *) (ch + 1);
+	rel = (vmReloc_t *) (ofs + ch->instructionCount);
+	codeData = (byte *) (rel + ch->numRelocs);
+
+	for(i = 0; i < ch->instructionCount; i++)
+	{
+		if(ofs[i] < 0 || ofs[i] >= ch->codeLength)
+			break;
+	}
+
+	numTargets = VM_RelocTargets(targets);
+	if(i == ch->instructionCount)
+	{
+		for(i = 0; i < ch->numRelocs; i++)
+		{
+			if(rel[i].ofs < 0 || rel[i].ofs > ch->codeLength - (int) sizeof(void *)
+			   || rel[i].target < 0 || rel[i].target >= numTargets)
+				break;
+
+			Com_Memcpy(codeData + rel[i].ofs, &targets[rel[i].target], sizeof(void *));
+		}
+	}
+
+	if(i != ch->numRelocs)
+	{
+		Com_Printf(S_COLOR_YELLOW "Warning: corrupt vm cache %s\n", filename);
+		Z_Free(data);
+		return qfalse;
+	}
+
+	VM_InstallCode(vm, codeData, ch->codeLength);
+	vm->entryOfs = ch->entryOfs;
+
+	for(i = 0; i < ch->instructionCount; i++)
+		vm->instructionPointers[i] = (intptr_t) vm->codeBase + ofs[i];
+
+	Com_Printf("VM file %s loaded %i bytes of code from %s%s\n", vm->name, ch->codeLength, filename,
+		vm->optimize ? " (optimized)" : "");
+
+	Z_Free(data);
+	return qtrue;
+}
+
+/*
+=================
+VM_SaveCache
+Called with the final code in buf and unrelocated instruction pointers
+=================
+*/
+static void VM_SaveCache(vm_t *vm, vmHeader_t *header)
+{
+	vmCacheHeader_t	ch;
+	char		filename[MAX_QPATH];
+	fileHandle_t	f;
+	int		i, ofs;
+
+	if(relocFailed)
+	{
+		Com_DPrintf("VM file %s has code that can't be cached\n", vm->name);
+		return;
+	}
+
+	VM_CacheHeader(vm, header, &ch, filename, sizeof(filename));
+	ch.entryOfs = vm->entryOfs;
+	ch.codeLength = compiledOfs;
+	ch.numRelocs = numRelocs;
+
+	f = FS_SV_FOpenFileWrite(filename);
+	if(!f)
+		return;
+
+	FS_Write(&ch, sizeof(ch), f);
+	for(i = 0; i < header->instructionCount; i++)
+	{
+		ofs = vm->instructionPointers[i];
+		FS_Write(&ofs, sizeof(ofs), f);
+	}
+	FS_Write(relocs, numRelocs * sizeof(*relocs), f);
+	FS_Write(buf, compiledOfs, f);
+	FS_FCloseFile(f);
+}
+#endif
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile(vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		i;
+        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+
+	jusedSize = header->instructionCount + 2;
+
+#ifdef VM_GUARD_DATA
+	// stray accesses fault in the guard pages, so addresses don't need masking
+	if(vm->guarded)
+		VM_InstallGuardHandler();
+
+	accessMask = (vm->guarded && vm_guardHandler) ? 0 : vm->dataMask;
+#else
+	accessMask = vm->dataMask;
+#endif
+
+#ifdef VM_X86_OPT
+	if(vm->optimize && !vm->jumpTableTargets)
+	{
+		Com_Printf("VM file %s has no jump table targets, using the first tier compiler\n", vm->name);
+		vm->optimize = qfalse;
+	}
+#else
+	vm->optimize = qfalse;
+#endif
+
+#ifdef VM_X86_CACHE
+	if(Cvar_VariableIntegerValue("vm_cache") && VM_LoadCache(vm, header))
+	{
+		vm->destroy = VM_Destroy_Compiled;
+		return;
+	}
+#endif
+
+	// allocate a very large temp buffer, we will shrink it later
+	maxLength = header->codeLength * 8 + 64;
+#ifdef VM_X86_INTRINSICS
+	maxLength += 64 + VM_NUM_INTRINSIC_HELPERS * 16;
+#endif
+#ifdef VM_X86_OPT
+	// cached opStack entries get written back at every block end
+	if(vm->optimize)
+		maxLength += header->instructionCount * 8 + 512;
+	optMaxLength = maxLength;
+#endif
+	buf = Z_Malloc(maxLength);
+	jused = Z_Malloc(jusedSize);
+	code = Z_Malloc(header->codeLength+32);
+#ifdef VM_X86_CACHE
+	// every instruction emits at most one host pointer
+	maxRelocs = header->instructionCount + 16;
+	relocs = Z_Malloc(maxRelocs * sizeof(*relocs));
+	numRelocs = 0;
+	relocFailed = qfalse;
+#endif
+	
+	Com_Memset(jused, 0, jusedSize);
+	Com_Memset(buf, 0, maxLength);
+
+	// copy code in larger buffer and put some zeros at the end
+	// so we can safely look ahead for a few instructions in it
+	// without a chance to get false-positive because of some garbage bytes
+	Com_Memset(code, 0, header->codeLength+32);
+	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
 
 	// ensure that the optimisation pass knows about all the jump
 	// table targets
@@ -1105,8 +3059,19 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	callDoSyscallOfs = compiledOfs;
 	callProcOfs = EmitCallDoSyscall(vm);
 	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
+#ifdef VM_X86_INTRINSICS
+	EmitIntrinsicStubs(vm);
+#endif
 	vm->entryOfs = compiledOfs;
+#ifdef VM_X86_CACHE
+	stubRelocs = numRelocs;
+#endif
 
+#ifdef VM_X86_OPT
+	if(vm->optimize)
+		VM_CompileOpt(vm, header, callProcOfsSyscall, callProcOfs, callDoSyscallOfs);
+	else
+#endif
 	for(pass=0; pass < 3; pass++) {
 	oc0 = -23423;
 	oc1 = -234354;
@@ -1118,6 +3083,9 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	instruction = 0;
 	//code = (byte *)header + header->codeOffset;
 	compiledOfs = vm->entryOfs;
+#ifdef VM_X86_CACHE
+	numRelocs = stubRelocs;
+#endif
 
 	LastCommand = LAST_COMMAND_NONE;
 
@@ -1182,7 +3150,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 			EmitString("8B D6");				// mov edx, esi
 			EmitString("81 C2");				// add edx, 0x12345678
 			Emit4((Constant1() & 0xFF));
-			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
+			MASK_REG("E2", accessMask);			// and edx, 0x12345678
 #if idx64
 			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
 #else
@@ -1218,7 +3186,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 				pc++;				// OP_CONST
 				v = Constant4();
 
-				EmitMovEDXStack(vm, vm->dataMask);
+				EmitMovEDXStack(vm, accessMask);
 				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
 				{
 #if idx64
@@ -1252,7 +3220,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 					{
 						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
 						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
-						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+						MASK_REG("E2", accessMask);		// and edx, 0x12345678
 #if idx64
 						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
 #else
@@ -1280,7 +3248,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 				pc++;					// OP_CONST
 				v = Constant4();
 
-				EmitMovEDXStack(vm, vm->dataMask);
+				EmitMovEDXStack(vm, accessMask);
 				if(v == 1 && oc0 == oc1 && pop0 == OP_LOCAL && pop1 == OP_LOCAL)
 				{
 #if idx64
@@ -1314,7 +3282,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 					{
 						EmitCommand(LAST_COMMAND_SUB_BL_1);	// sub bl, 1
 						EmitString("8B 14 9F");			// mov edx, dword ptr [edi + ebx * 4]
-						MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+						MASK_REG("E2", accessMask);		// and edx, 0x12345678
 #if idx64
 						EmitRexString(0x41, "89 04 11");	// mov dword ptr [r9 + edx], eax
 #else
@@ -1334,7 +3302,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 			{
 				compiledOfs -= 3;
 				vm->instructionPointers[instruction - 1] = compiledOfs;
-				MASK_REG("E0", vm->dataMask);			// and eax, 0x12345678
+				MASK_REG("E0", accessMask);			// and eax, 0x12345678
 #if idx64
 				EmitRexString(0x41, "8B 04 01");		// mov eax, dword ptr [r9 + eax]
 #else
@@ -1345,7 +3313,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 				break;
 			}
 			
-			EmitMovEAXStack(vm, vm->dataMask);
+			EmitMovEAXStack(vm, accessMask);
 #if idx64
 			EmitRexString(0x41, "8B 04 01");		// mov eax, dword ptr [r9 + eax]
 #else
@@ -1355,7 +3323,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
 			break;
 		case OP_LOAD2:
-			EmitMovEAXStack(vm, vm->dataMask);
+			EmitMovEAXStack(vm, accessMask);
 #if idx64
 			EmitRexString(0x41, "0F B7 04 01");		// movzx eax, word ptr [r9 + eax]
 #else
@@ -1365,7 +3333,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 			EmitCommand(LAST_COMMAND_MOV_STACK_EAX);	// mov dword ptr [edi + ebx * 4], eax
 			break;
 		case OP_LOAD1:
-			EmitMovEAXStack(vm, vm->dataMask);
+			EmitMovEAXStack(vm, accessMask);
 #if idx64
 			EmitRexString(0x41, "0F B6 04 01");		// movzx eax, byte ptr [r9 + eax]
 #else
@@ -1377,7 +3345,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 		case OP_STORE4:
 			EmitMovEAXStack(vm, 0);	
 			EmitString("8B 54 9F FC");			// mov edx, dword ptr -4[edi + ebx * 4]
-			MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+			MASK_REG("E2", accessMask);		// and edx, 0x12345678
 #if idx64
 			EmitRexString(0x41, "89 04 11");		// mov dword ptr [r9 + edx], eax
 #else
@@ -1389,7 +3357,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 		case OP_STORE2:
 			EmitMovEAXStack(vm, 0);	
 			EmitString("8B 54 9F FC");			// mov edx, dword ptr -4[edi + ebx * 4]
-			MASK_REG("E2", vm->dataMask);		// and edx, 0x12345678
+			MASK_REG("E2", accessMask);		// and edx, 0x12345678
 #if idx64
 			Emit1(0x66);					// mov word ptr [r9 + edx], eax
 			EmitRexString(0x41, "89 04 11");
@@ -1402,7 +3370,7 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 		case OP_STORE1:
 			EmitMovEAXStack(vm, 0);	
 			EmitString("8B 54 9F FC");			// mov edx, dword ptr -4[edi + ebx * 4]
-			MASK_REG("E2", vm->dataMask);			// and edx, 0x12345678
+			MASK_REG("E2", accessMask);			// and edx, 0x12345678
 #if idx64
 			EmitRexString(0x41, "88 04 11");		// mov byte ptr [r9 + edx], eax
 #else
@@ -1645,42 +3613,19 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	}
 	}
 
-	// copy to an exact sized buffer with the appropriate permission bits
-	vm->codeLength = compiledOfs;
-#ifdef VM_X86_MMAP
-	vm->codeBase = mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-	if(vm->codeBase == MAP_FAILED)
-		Com_Error(ERR_FATAL, "VM_CompileX86: can't mmap memory");
-#elif _WIN32
-	// allocate memory with EXECUTE permissions under windows.
-	vm->codeBase = VirtualAlloc(NULL, compiledOfs, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-	if(!vm->codeBase)
-		Com_Error(ERR_FATAL, "VM_CompileX86: VirtualAlloc failed");
-#else
-	vm->codeBase = malloc(compiledOfs);
-	if(!vm->codeBase)
-	        Com_Error(ERR_FATAL, "VM_CompileX86: malloc failed");
+#ifdef VM_X86_CACHE
+	if(Cvar_VariableIntegerValue("vm_cache"))
+		VM_SaveCache(vm, header);
+	VMFREE_RELOCS();
 #endif
 
-	Com_Memcpy( vm->codeBase, buf, compiledOfs );
-
-#ifdef VM_X86_MMAP
-	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
-		Com_Error(ERR_FATAL, "VM_CompileX86: mprotect failed");
-#elif _WIN32
-	{
-		DWORD oldProtect = 0;
-		
-		// remove write permissions.
-		if(!VirtualProtect(vm->codeBase, compiledOfs, PAGE_EXECUTE_READ, &oldProtect))
-			Com_Error(ERR_FATAL, "VM_CompileX86: VirtualProtect failed");
-	}
-#endif
+	VM_InstallCode(vm, buf, compiledOfs);
 
 	Z_Free( code );
 	Z_Free( buf );
 	Z_Free( jused );
-	Com_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
+	Com_Printf( "VM file %s compiled to %i bytes of code%s\n", vm->name, compiledOfs,
+		vm->optimize ? " (optimized)" : "" );
 
 	vm->destroy = VM_Destroy_Compiled;
 
@@ -1722,6 +3667,9 @@ int VM_CallCompiled(vm_t *vm, int *args)
 	int	*opStack;
 	int		opStackOfs;
 	int		arg;
+#ifdef VM_SAMPLING
+	void	*oldStackTop = vm_sampleStackTop;
+#endif
 
 	currentVM = vm;
 
@@ -1748,6 +3696,11 @@ int VM_CallCompiled(vm_t *vm, int *args)
 	*opStack = 0xDEADBEEF;
 	opStackOfs = 0;
 
+#ifdef VM_SAMPLING
+	// return addresses of compiled code are pushed below here
+	vm_sampleStackTop = stack;
+#endif
+
 #ifdef _MSC_VER
   #if idx64
 	opStackOfs = qvmcall64(&programStack, opStack, vm->instructionPointers, vm->dataBase);
@@ -1796,6 +3749,10 @@ int VM_CallCompiled(vm_t *vm, int *args)
 	);
 #endif
 
+#ifdef VM_SAMPLING
+	vm_sampleStackTop = oldStackTop;
+#endif
+
 	if(opStackOfs != 1 || *opStack != 0xDEADBEEF)
 	{
 		Com_Error(ERR_DROP, "opStack corrupted in compiled code");
@@ -49,8 +49,7 @@ typedef struct voipServerPacket_s
 #endif
 
 typedef struct svEntity_s {
-	struct worldSector_s *worldSector;
-	struct svEntity_s *nextEntityInWorldSector;
+	struct worldNode_s *worldNode;		// leaf in the world tree, NULL if not linked
 	
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
@@ -58,6 +57,11 @@ typedef struct svEntity_s {
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
 	int			snapshotCounter;	// used to prevent double adding from portal views
+
+	entityState_t	snapshotState;		// last state copied into a snapshot
+	int			snapshotStateId;	// changes whenever snapshotState does, 0 = none yet
+	int			deltaFromId, deltaToId;	// the states deltaMask was computed for
+	uint64_t	deltaMask;			// MSG_EntityDeltaMask between them
 } svEntity_t;
 
 typedef enum {
@@ -93,6 +97,28 @@ typedef struct {
 
 	int				restartTime;
 	int				time;
+
+	// boundary crossings of the game module, see syscallstats
+	int				gameFrames;
+	int				gameSyscalls;
+	int				gameTraces;
+	int				gameTraceBatches;
+
+	// SV_Trace results taken from the trace cache, see sv_traceCache
+	int				traceCacheHits;
+	int				traceCacheMisses;
+
+	// SV_inPVS and SV_inPVSIgnorePortals, see sv_pvsCache
+	int				pvsQueries;
+	int				pvsAreaChecks;
+	int				pvsCacheHits;
+	int				pvsCacheMisses;
+	int				pvsTimedQueries;	// only timed with com_speeds
+	int64_t			pvsNanoseconds;
+
+	// clients moved by G_RUN_CLIENT_MOVES, see sv_moveThreads
+	int				clientMoves;
+	int				threadedMoves;
 } server_t;
 
 
@@ -238,6 +264,7 @@ typedef struct {
 	int			numSnapshotEntities;		// sv_maxclients->integer*PACKET_BACKUP*MAX_SNAPSHOT_ENTITIES
 	int			nextSnapshotEntities;		// next snapshotEntities to use
 	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
+	int			*snapshotStateIds;		// [numSnapshotEntities] svEntity_t->snapshotStateId of each
 	int			nextHeartbeatTime;
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 	netadr_t	redirectAddress;			// for rcon return messages
@@ -291,6 +318,9 @@ extern	cvar_t	*sv_gametype;
 extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_floodProtect;
 extern	cvar_t	*sv_lanForceRate;
+extern	cvar_t	*sv_traceCache;
+extern	cvar_t	*sv_pvsCache;
+extern	cvar_t	*sv_moveThreads;
 #ifndef STANDALONE
 extern	cvar_t	*sv_strictAuth;
 #endif
@@ -413,6 +443,12 @@ void		SV_InitGameProgs ( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
+void		SV_SyscallStats_f( void );
+void		SV_FlushPVSCache( void );
+
+// 0 on the main thread, the collision model slot on the threads that move
+// clients, which may only trace and test point contents
+extern	Q_THREADLOCAL int	sv_threadSlot;
 
 //
 // sv_bot.c
@@ -457,6 +493,24 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 void SV_SectorList_f( void );
 
+void SV_FlushTraceCache( void );
+// forgets all the remembered SV_Trace results, called before every game frame
+
+void SV_InvalidateTraceCache( const vec3_t mins, const vec3_t maxs );
+// forgets the remembered SV_Trace results that could have touched the box,
+// called with the old and new bounds of an entity that is linked or unlinked
+
+void SV_TraceLog_f( void );
+void SV_StopTraceLog( void );
+// tracelog console command, records traces for cmbench
+
+void SV_MoveLog_f( void );
+void SV_StopMoveLog( void );
+void SV_LogClientMoves( void );
+void SV_MoveCheck_f( void );
+// movelog and movecheck console commands, check that the threaded client
+// moves of G_RUN_CLIENT_MOVES think the same as one at a time
+
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
 // fills in a table of entity numbers with entities that have bounding boxes
@@ -483,6 +537,11 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
 
+void SV_TraceBatch( const traceRequest_t *requests, trace_t *results, int numTraces );
+// same results as an SV_Trace for each request, but the linked entities are
+// gathered only once for the bounds of the whole batch
+
+
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
@@ -170,6 +170,28 @@ static __attribute__ ((format (printf, 2, 3))) void QDECL BotImport_Print(int ty
 	}
 }
 
+/*
+==================
+BotImport_CopyTrace
+==================
+*/
+static void BotImport_CopyTrace(bsp_trace_t *bsptrace, const trace_t *trace) {
+	bsptrace->allsolid = trace->allsolid;
+	bsptrace->startsolid = trace->startsolid;
+	bsptrace->fraction = trace->fraction;
+	VectorCopy(trace->endpos, bsptrace->endpos);
+	bsptrace->plane.dist = trace->plane.dist;
+	VectorCopy(trace->plane.normal, bsptrace->plane.normal);
+	bsptrace->plane.signbits = trace->plane.signbits;
+	bsptrace->plane.type = trace->plane.type;
+	bsptrace->surface.value = 0;
+	bsptrace->surface.flags = trace->surfaceFlags;
+	bsptrace->ent = trace->entityNum;
+	bsptrace->exp_dist = 0;
+	bsptrace->sidenum = 0;
+	bsptrace->contents = 0;
+}
+
 /*
 ==================
 BotImport_Trace
@@ -180,20 +202,7 @@ static void BotImport_Trace(bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, ve
 
 	SV_Trace(&trace, start, mins, maxs, end, passent, contentmask, qfalse);
 	//copy the trace information
-	bsptrace->allsolid = trace.allsolid;
-	bsptrace->startsolid = trace.startsolid;
-	bsptrace->fraction = trace.fraction;
-	VectorCopy(trace.endpos, bsptrace->endpos);
-	bsptrace->plane.dist = trace.plane.dist;
-	VectorCopy(trace.plane.normal, bsptrace->plane.normal);
-	bsptrace->plane.signbits = trace.plane.signbits;
-	bsptrace->plane.type = trace.plane.type;
-	bsptrace->surface.value = 0;
-	bsptrace->surface.flags = trace.surfaceFlags;
-	bsptrace->ent = trace.entityNum;
-	bsptrace->exp_dist = 0;
-	bsptrace->sidenum = 0;
-	bsptrace->contents = 0;
+	BotImport_CopyTrace(bsptrace, &trace);
 }
 
 /*
@@ -206,20 +215,7 @@ static void BotImport_EntityTrace(bsp_trace_t *bsptrace, vec3_t start, vec3_t mi
 
 	SV_ClipToEntity(&trace, start, mins, maxs, end, entnum, contentmask, qfalse);
 	//copy the trace information
-	bsptrace->allsolid = trace.allsolid;
-	bsptrace->startsolid = trace.startsolid;
-	bsptrace->fraction = trace.fraction;
-	VectorCopy(trace.endpos, bsptrace->endpos);
-	bsptrace->plane.dist = trace.plane.dist;
-	VectorCopy(trace.plane.normal, bsptrace->plane.normal);
-	bsptrace->plane.signbits = trace.plane.signbits;
-	bsptrace->plane.type = trace.plane.type;
-	bsptrace->surface.value = 0;
-	bsptrace->surface.flags = trace.surfaceFlags;
-	bsptrace->ent = trace.entityNum;
-	bsptrace->exp_dist = 0;
-	bsptrace->sidenum = 0;
-	bsptrace->contents = 0;
+	BotImport_CopyTrace(bsptrace, &trace);
 }
 
 
@@ -283,10 +279,10 @@ static void BotImport_BSPModelMinsMaxsOrigin(int modelnum, vec3_t angles, vec3_t
 BotImport_GetMemory
 ==================
 */
-static void *BotImport_GetMemory(int size) {
+static void *BotImport_GetMemory(int size, char *file, int line) {
 	void *ptr;
 
-	ptr = Z_TagMalloc( size, TAG_BOTLIB );
+	ptr = Z_TagMallocSite( size, TAG_BOTLIB, file, line );
 	return ptr;
 }
 
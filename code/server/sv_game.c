@@ -136,60 +136,160 @@ void SV_SetBrushModel( sharedEntity_t *ent, const char *name ) {
 
 
 
+/*
+===============================================================================
+
+PVS QUERIES
+
+Game and bot code test the same origins against each other many times a
+frame (every event against every client, bots looking for targets), so
+with sv_pvsCache set the cluster and area of a point are kept in a small
+cache keyed on the exact point.  A point lands in the same leaf for as long
+as the map is loaded, so entries only go stale when a new map is loaded.
+syscallstats shows the counts, and the time spent with com_speeds set.
+===============================================================================
+*/
+
+typedef struct {
+	vec3_t		point;
+	int			cluster;
+	int			area;
+	int			generation;		// entry is only valid for this generation
+} pvsCacheEntry_t;
+
+#define	PVS_CACHE_SIZE	256		// must be a power of two
+
+static pvsCacheEntry_t	sv_pvsCacheEntries[PVS_CACHE_SIZE];
+static int		sv_pvsCacheGeneration = 1;
+
+/*
+==================
+SV_FlushPVSCache
+
+Called when a new map is loaded
+==================
+*/
+void SV_FlushPVSCache( void ) {
+	sv_pvsCacheGeneration++;
+}
+
+/*
+==================
+SV_PointClusterArea
+==================
+*/
+static void SV_PointClusterArea( const vec3_t p, int *cluster, int *area ) {
+	const unsigned int	*w;
+	unsigned int		hash;
+	pvsCacheEntry_t		*entry;
+	int					leafnum;
+
+	if ( !sv_pvsCache->integer ) {
+		leafnum = CM_PointLeafnum( p );
+		*cluster = CM_LeafCluster( leafnum );
+		*area = CM_LeafArea( leafnum );
+		return;
+	}
+
+	// FNV-1a over the words of the point
+	w = (const unsigned int *)p;
+	hash = ( ( ( 2166136261u ^ w[0] ) * 16777619u ^ w[1] ) * 16777619u ^ w[2] ) * 16777619u;
+	hash ^= hash >> 16;
+	entry = &sv_pvsCacheEntries[ hash & ( PVS_CACHE_SIZE - 1 ) ];
+
+	if ( entry->generation == sv_pvsCacheGeneration
+		&& entry->point[0] == p[0] && entry->point[1] == p[1] && entry->point[2] == p[2] ) {
+		sv.pvsCacheHits++;
+	} else {
+		sv.pvsCacheMisses++;
+		leafnum = CM_PointLeafnum( p );
+		VectorCopy( p, entry->point );
+		entry->cluster = CM_LeafCluster( leafnum );
+		entry->area = CM_LeafArea( leafnum );
+		entry->generation = sv_pvsCacheGeneration;
+	}
+
+	*cluster = entry->cluster;
+	*area = entry->area;
+}
+
 /*
 =================
-SV_inPVS
+SV_PointsVisible
 
-Also checks portalareas so that doors block sight
+The PVS test, and with portals set the area test that lets closed doors
+block sight.  Points in the same area are always connected, so the area
+test is only made for points in the PVS of each other in different areas.
 =================
 */
-qboolean SV_inPVS (const vec3_t p1, const vec3_t p2)
-{
-	int		leafnum;
-	int		cluster;
+static qboolean SV_PointsVisible( const vec3_t p1, const vec3_t p2, qboolean portals ) {
+	int		cluster1, cluster2;
 	int		area1, area2;
 	byte	*mask;
 
-	leafnum = CM_PointLeafnum (p1);
-	cluster = CM_LeafCluster (leafnum);
-	area1 = CM_LeafArea (leafnum);
-	mask = CM_ClusterPVS (cluster);
+	SV_PointClusterArea( p1, &cluster1, &area1 );
+	SV_PointClusterArea( p2, &cluster2, &area2 );
 
-	leafnum = CM_PointLeafnum (p2);
-	cluster = CM_LeafCluster (leafnum);
-	area2 = CM_LeafArea (leafnum);
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
+	mask = CM_ClusterPVS( cluster1 );
+	if ( mask && (!(mask[cluster2>>3] & (1<<(cluster2&7)) ) ) ) {
 		return qfalse;
-	if (!CM_AreasConnected (area1, area2))
-		return qfalse;		// a door blocks sight
+	}
+
+	if ( portals && ( area1 != area2 || area1 < 0 ) ) {
+		sv.pvsAreaChecks++;
+		if ( !CM_AreasConnected( area1, area2 ) ) {
+			return qfalse;		// a door blocks sight
+		}
+	}
+
 	return qtrue;
 }
 
+/*
+=================
+SV_TimedPointsVisible
+=================
+*/
+static qboolean SV_TimedPointsVisible( const vec3_t p1, const vec3_t p2, qboolean portals ) {
+	int64_t		start;
+	qboolean	visible;
+
+	sv.pvsQueries++;
+	if ( !com_speeds->integer ) {
+		return SV_PointsVisible( p1, p2, portals );
+	}
+
+	start = Sys_Nanoseconds();
+	visible = SV_PointsVisible( p1, p2, portals );
+	sv.pvsNanoseconds += Sys_Nanoseconds() - start;
+	sv.pvsTimedQueries++;
+
+	return visible;
+}
 
 /*
 =================
-SV_inPVSIgnorePortals
+SV_inPVS
 
-Does NOT check portalareas
+Also checks portalareas so that doors block sight
 =================
 */
-qboolean SV_inPVSIgnorePortals( const vec3_t p1, const vec3_t p2)
+qboolean SV_inPVS (const vec3_t p1, const vec3_t p2)
 {
-	int		leafnum;
-	int		cluster;
-	byte	*mask;
-
-	leafnum = CM_PointLeafnum (p1);
-	cluster = CM_LeafCluster (leafnum);
-	mask = CM_ClusterPVS (cluster);
+	return SV_TimedPointsVisible( p1, p2, qtrue );
+}
 
-	leafnum = CM_PointLeafnum (p2);
-	cluster = CM_LeafCluster (leafnum);
 
-	if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
-		return qfalse;
+/*
+=================
+SV_inPVSIgnorePortals
 
-	return qtrue;
+Does NOT check portalareas
+=================
+*/
+qboolean SV_inPVSIgnorePortals( const vec3_t p1, const vec3_t p2)
+{
+	return SV_TimedPointsVisible( p1, p2, qfalse );
 }
 
 
@@ -274,6 +374,638 @@ void SV_GetUsercmd( int clientNum, usercmd_t *cmd ) {
 	*cmd = svs.clients[clientNum].lastUsercmd;
 }
 
+/*
+===============================================================================
+
+CLIENT MOVES
+
+G_RUN_CLIENT_MOVES hands the engine the clients the game would think one
+after another, split in parts: the game prepares the move, Pmove runs, and
+the game links the client and runs its triggers, touches and events.
+A Pmove only reads the world and the linked entities, so when the bounds a
+client can reach during its move don't overlap another's, the moves run on
+sv_moveThreads threads at once, ahead of the thinks of the clients before
+them, while everything else stays on the main thread in the order the game
+gave.  When the game reports that a think can reach beyond its own move, a
+weapon fired, a teleport or a death, the ahead moves after it are cancelled
+and thought again in order, so the result is the same as thinking them one
+at a time.  Clients that could touch each other are thought one at a time,
+as before.  Only a native game module can be entered from several threads,
+a vm or translated qvm game gets qfalse and thinks its clients itself.
+===============================================================================
+*/
+
+// how much further than its velocity takes it a client can get in a move,
+// for acceleration, jumping and falling, and how much its bounds can grow
+#define	MOVE_SPEED_SLACK	1200
+#define	MOVE_BOUNDS_SLACK	48
+
+Q_THREADLOCAL int	sv_threadSlot;
+
+static int		sv_moveClients[MAX_CLIENTS];	// the moves run on the threads
+static int		sv_numMoveClients;
+static int		sv_numMoveThreads;
+
+/*
+==================
+SV_ClientMoveBounds
+
+Bounds that hold the client during the move to sv.time, returns how far
+they reach beyond the client's current bounds
+==================
+*/
+static float SV_ClientMoveBounds( int clientNum, vec3_t mins, vec3_t maxs ) {
+	sharedEntity_t	*ent;
+	playerState_t	*ps;
+	float			reach;
+	int				msec;
+	int				i;
+
+	ent = SV_GentityNum( clientNum );
+	ps = SV_GameClientNum( clientNum );
+
+	// pmove_fixed can round the command time up by a frame,
+	// Pmove never moves more than a second
+	msec = sv.time + 33 - ps->commandTime;
+	if ( msec < 0 ) {
+		msec = 0;
+	} else if ( msec > 1000 ) {
+		msec = 1000;
+	}
+
+	reach = ( VectorLength( ps->velocity ) + MOVE_SPEED_SLACK ) * msec * 0.001f + MOVE_BOUNDS_SLACK;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = ent->r.absmin[i] - reach;
+		maxs[i] = ent->r.absmax[i] + reach;
+	}
+
+	return reach;
+}
+
+/*
+==================
+SV_ClientMoveThread
+==================
+*/
+static void SV_ClientMoveThread( int thread ) {
+	int		i;
+
+	CM_SetThreadSlot( thread );
+	sv_threadSlot = thread;
+
+	for ( i = thread ; i < sv_numMoveClients ; i += sv_numMoveThreads ) {
+		VM_CallNative( gvm, GAME_CLIENT_MOVE, sv_moveClients[i] );
+	}
+}
+
+/*
+==================
+SV_CancelClientMoves
+
+Undoes the ahead moves from first to end, returns how many there were
+==================
+*/
+static int SV_CancelClientMoves( const int *clientNums, qboolean *ahead, int first, int end ) {
+	int		i, count;
+
+	count = 0;
+	for ( i = first ; i < end ; i++ ) {
+		if ( ahead[i] ) {
+			VM_Call( gvm, GAME_CLIENT_MOVE_CANCEL, clientNums[i] );
+			ahead[i] = qfalse;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+==================
+SV_RunClientMoves
+
+Returns qfalse if the game has to think the clients itself
+==================
+*/
+static qboolean SV_RunClientMoves( const int *clientNums, int numClients ) {
+	static vec3_t	mins[MAX_CLIENTS], maxs[MAX_CLIENTS];
+	int				touch[MAX_GENTITIES];
+	int				order[MAX_CLIENTS];		// index in clientNums, or -1
+	qboolean		alone[MAX_CLIENTS];		// can't touch another client's move
+	qboolean		ahead[MAX_CLIENTS];		// moved before the clients before it
+	vec3_t			areaMins, areaMaxs;
+	float			reach, maxReach;
+	int				i, j, k, num, threads, cancelled;
+
+	if ( !VM_IsNative( gvm ) || sv_moveThreads->integer < 2 ) {
+		return qfalse;
+	}
+
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		order[i] = -1;
+	}
+
+	maxReach = 0;
+	for ( i = 0 ; i < numClients ; i++ ) {
+		if ( clientNums[i] < 0 || clientNums[i] >= sv_maxclients->integer || order[clientNums[i]] >= 0 ) {
+			Com_Error( ERR_DROP, "SV_RunClientMoves: bad clientNum %i", clientNums[i] );
+		}
+		order[clientNums[i]] = i;
+
+		reach = SV_ClientMoveBounds( clientNums[i], mins[i], maxs[i] );
+		if ( reach > maxReach ) {
+			maxReach = reach;
+		}
+
+		// an unlinked client can't be found by the others
+		alone[i] = SV_GentityNum( clientNums[i] )->r.linked;
+	}
+
+	// every client whose move bounds overlap this one's is currently linked
+	// within maxReach of them, so the world tree finds them all
+	for ( i = 0 ; i < numClients ; i++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			areaMins[j] = mins[i][j] - maxReach;
+			areaMaxs[j] = maxs[i][j] + maxReach;
+		}
+
+		num = SV_AreaEntities( areaMins, areaMaxs, touch, MAX_GENTITIES );
+		for ( j = 0 ; j < num ; j++ ) {
+			if ( touch[j] >= sv_maxclients->integer ) {
+				continue;
+			}
+			k = order[touch[j]];
+			if ( k < 0 || k == i ) {
+				continue;
+			}
+			if ( mins[k][0] > maxs[i][0] || mins[k][1] > maxs[i][1] || mins[k][2] > maxs[i][2]
+				|| maxs[k][0] < mins[i][0] || maxs[k][1] < mins[i][1] || maxs[k][2] < mins[i][2] ) {
+				continue;
+			}
+			alone[i] = alone[k] = qfalse;
+		}
+	}
+
+	// begin the moves that can run at once ahead of the clients before them
+	sv_numMoveClients = 0;
+	for ( i = 0 ; i < numClients ; i++ ) {
+		ahead[i] = alone[i] && VM_Call( gvm, GAME_CLIENT_MOVE_BEGIN, clientNums[i], qtrue );
+		if ( ahead[i] ) {
+			sv_moveClients[sv_numMoveClients++] = clientNums[i];
+		}
+	}
+
+	threads = sv_moveThreads->integer;
+	if ( threads > CM_MAX_THREADS ) {
+		threads = CM_MAX_THREADS;
+	}
+	if ( threads > MAX_SYS_THREADS ) {
+		threads = MAX_SYS_THREADS;
+	}
+	if ( threads > sv_numMoveClients ) {
+		threads = sv_numMoveClients;
+	}
+
+	if ( threads > 0 ) {
+		CM_ReserveThreads( threads );
+		sv_numMoveThreads = threads;
+		Com_RunThreads( threads, SV_ClientMoveThread );
+
+		// a worker that couldn't be started ran its share on this thread
+		CM_SetThreadSlot( 0 );
+		sv_threadSlot = 0;
+	}
+
+	// finish them and think the others in the game's order, a think that
+	// can reach beyond its own move undoes the ahead moves after it, which
+	// are then thought again when their turn comes
+	cancelled = 0;
+	for ( i = 0 ; i < numClients ; i++ ) {
+		if ( !ahead[i] ) {
+			if ( !VM_Call( gvm, GAME_CLIENT_MOVE_LOCAL, clientNums[i], qfalse ) ) {
+				cancelled += SV_CancelClientMoves( clientNums, ahead, i + 1, numClients );
+			}
+			if ( !VM_Call( gvm, GAME_CLIENT_MOVE_BEGIN, clientNums[i], qfalse ) ) {
+				continue;
+			}
+			VM_Call( gvm, GAME_CLIENT_MOVE, clientNums[i] );
+		}
+		if ( !VM_Call( gvm, GAME_CLIENT_MOVE_LOCAL, clientNums[i], qtrue ) ) {
+			cancelled += SV_CancelClientMoves( clientNums, ahead, i + 1, numClients );
+		}
+		VM_Call( gvm, GAME_CLIENT_MOVE_END, clientNums[i] );
+	}
+
+	sv.clientMoves += numClients;
+	sv.threadedMoves += sv_numMoveClients - cancelled;
+
+	return qtrue;
+}
+
+/*
+===============================================================================
+
+MOVE LOG
+
+movelog records the usercmds of the active clients every game frame, and
+movecheck replays such a log on an empty server twice from the same random
+seed, once thinking the clients one at a time and once with the moves on
+sv_moveThreads threads, and compares the player states after every frame.
+The replayed clients are synchronous, so every one of them goes through
+G_RUN_CLIENT_MOVES.
+===============================================================================
+*/
+
+#define	MLOG_IDENT			(('G'<<24)+('O'<<16)+('L'<<8)+'M')
+		// little-endian "MLOG"
+#define	MLOG_VERSION		1
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			checksum;		// of the bsp, as sv_mapChecksum
+	char		mapname[MAX_QPATH];
+} mlogHeader_t;
+
+typedef struct {
+	int			time;			// sv.time of the frame
+	int			numCmds;		// mlogCmd_t that follow
+} mlogFrame_t;
+
+typedef struct {
+	int			clientNum;
+	int			serverTime;
+	int			angles[3];
+	int			buttons;
+	int			weapon;
+	int			forwardmove, rightmove, upmove;
+} mlogCmd_t;
+
+static fileHandle_t	sv_moveLog;
+static int			sv_moveLogFrames;
+static int			sv_gameSeed;		// GAME_INIT random seed if not 0
+
+/*
+==================
+SV_StopMoveLog
+==================
+*/
+void SV_StopMoveLog( void ) {
+	if ( !sv_moveLog ) {
+		return;
+	}
+
+	FS_FCloseFile( sv_moveLog );
+	sv_moveLog = 0;
+	Com_Printf( "move log stopped, %i frames\n", sv_moveLogFrames );
+}
+
+/*
+==================
+SV_MoveLog_f
+
+movelog <file> writes the usercmds of every game frame to a .mlog file
+that movecheck can replay, movelog without arguments stops logging
+==================
+*/
+void SV_MoveLog_f( void ) {
+	mlogHeader_t	header;
+	char			name[MAX_QPATH];
+
+	SV_StopMoveLog();
+
+	if ( Cmd_Argc() < 2 ) {
+		return;
+	}
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".mlog" );
+
+	sv_moveLog = FS_FOpenFileWrite( name );
+	if ( !sv_moveLog ) {
+		Com_Printf( "Couldn't open %s\n", name );
+		return;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = LittleLong( MLOG_IDENT );
+	header.version = LittleLong( MLOG_VERSION );
+	header.checksum = LittleLong( sv_mapChecksum->integer );
+	Q_strncpyz( header.mapname, sv_mapname->string, sizeof( header.mapname ) );
+	FS_Write( &header, sizeof( header ), sv_moveLog );
+
+	sv_moveLogFrames = 0;
+	Com_Printf( "logging usercmds to %s\n", name );
+}
+
+/*
+==================
+SV_LogClientMoves
+
+Called before every GAME_RUN_FRAME
+==================
+*/
+void SV_LogClientMoves( void ) {
+	mlogFrame_t	frame;
+	mlogCmd_t	cmds[MAX_CLIENTS];
+	usercmd_t	*cmd;
+	int			i, j;
+
+	if ( !sv_moveLog ) {
+		return;
+	}
+
+	frame.numCmds = 0;
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state != CS_ACTIVE ) {
+			continue;
+		}
+		cmd = &svs.clients[i].lastUsercmd;
+
+		cmds[frame.numCmds].clientNum = LittleLong( i );
+		cmds[frame.numCmds].serverTime = LittleLong( cmd->serverTime );
+		for ( j = 0 ; j < 3 ; j++ ) {
+			cmds[frame.numCmds].angles[j] = LittleLong( cmd->angles[j] );
+		}
+		cmds[frame.numCmds].buttons = LittleLong( cmd->buttons );
+		cmds[frame.numCmds].weapon = LittleLong( cmd->weapon );
+		cmds[frame.numCmds].forwardmove = LittleLong( cmd->forwardmove );
+		cmds[frame.numCmds].rightmove = LittleLong( cmd->rightmove );
+		cmds[frame.numCmds].upmove = LittleLong( cmd->upmove );
+		frame.numCmds++;
+	}
+
+	frame.time = LittleLong( sv.time );
+	frame.numCmds = LittleLong( frame.numCmds );
+	FS_Write( &frame, sizeof( frame ), sv_moveLog );
+	FS_Write( cmds, LittleLong( frame.numCmds ) * sizeof( cmds[0] ), sv_moveLog );
+	sv_moveLogFrames++;
+}
+
+/*
+==================
+SV_UnlinkAllEntities
+
+So a restarted game starts from an empty world
+==================
+*/
+static void SV_UnlinkAllEntities( void ) {
+	int		i;
+
+	for ( i = 0 ; i < sv.num_entities ; i++ ) {
+		SV_UnlinkEntity( SV_GentityNum( i ) );
+	}
+}
+
+/*
+==================
+SV_ReplayMoveLog
+
+Restarts the game with a fixed seed and thinks the logged usercmds from
+startTime, filling in a hash of the player states after every frame.
+Returns the number of frames, or -1 if the log is bad.
+==================
+*/
+static int SV_ReplayMoveLog( const byte *data, int length, int startTime, unsigned *hashes, int maxFrames ) {
+	const mlogFrame_t	*frame;
+	const mlogCmd_t		*rec;
+	qboolean			replaying[MAX_CLIENTS];
+	qboolean			present[MAX_CLIENTS];
+	client_t			*cl;
+	usercmd_t			cmd;
+	const byte			*p, *end;
+	const byte			*state;
+	char				*denied;
+	unsigned			hash;
+	int					firstTime, numCmds;
+	int					numFrames;
+	int					i, j, k, c;
+
+	SV_UnlinkAllEntities();
+	sv.time = startTime;
+	sv_gameSeed = 1;
+	SV_RestartGameProgs();
+	sv_gameSeed = 0;
+
+	Com_Memset( replaying, 0, sizeof( replaying ) );
+
+	p = data + sizeof( mlogHeader_t );
+	end = data + length;
+	firstTime = 0;
+	numFrames = 0;
+	while ( p + sizeof( *frame ) <= end && numFrames < maxFrames ) {
+		frame = (const mlogFrame_t *)p;
+		numCmds = LittleLong( frame->numCmds );
+		if ( numCmds < 0 || numCmds > MAX_CLIENTS
+			|| p + sizeof( *frame ) + numCmds * sizeof( *rec ) > end ) {
+			numFrames = -1;
+			break;
+		}
+		p += sizeof( *frame );
+		if ( !numFrames ) {
+			firstTime = LittleLong( frame->time );
+		}
+		sv.time = startTime + LittleLong( frame->time ) - firstTime;
+
+		// connect the clients that show up and think their usercmds
+		Com_Memset( present, 0, sizeof( present ) );
+		for ( i = 0 ; i < numCmds ; i++, p += sizeof( *rec ) ) {
+			rec = (const mlogCmd_t *)p;
+			c = LittleLong( rec->clientNum );
+			if ( c < 0 || c >= sv_maxclients->integer || present[c] ) {
+				continue;
+			}
+			present[c] = qtrue;
+			cl = &svs.clients[c];
+
+			Com_Memset( &cmd, 0, sizeof( cmd ) );
+			cmd.serverTime = LittleLong( rec->serverTime );
+			for ( j = 0 ; j < 3 ; j++ ) {
+				cmd.angles[j] = LittleLong( rec->angles[j] );
+			}
+			cmd.buttons = LittleLong( rec->buttons );
+			cmd.weapon = LittleLong( rec->weapon );
+			cmd.forwardmove = LittleLong( rec->forwardmove );
+			cmd.rightmove = LittleLong( rec->rightmove );
+			cmd.upmove = LittleLong( rec->upmove );
+
+			if ( !replaying[c] ) {
+				Com_Memset( cl, 0, sizeof( *cl ) );
+				Com_sprintf( cl->userinfo, sizeof( cl->userinfo ), "\\name\\movecheck%i\\ip\\localhost", c );
+				Q_strncpyz( cl->name, va( "movecheck%i", c ), sizeof( cl->name ) );
+				cl->state = CS_CONNECTED;
+				denied = VM_ExplicitArgPtr( gvm, VM_Call( gvm, GAME_CLIENT_CONNECT, c, qtrue, qfalse ) );
+				if ( denied ) {
+					Com_Printf( "movecheck: client %i denied: %s\n", c, denied );
+					cl->state = CS_FREE;
+					continue;
+				}
+				replaying[c] = qtrue;
+				SV_ClientEnterWorld( cl, &cmd );
+			}
+
+			cl->lastUsercmd = cmd;
+			VM_Call( gvm, GAME_CLIENT_THINK, c );
+		}
+
+		// clients that left
+		for ( c = 0 ; c < sv_maxclients->integer ; c++ ) {
+			if ( replaying[c] && !present[c] ) {
+				VM_Call( gvm, GAME_CLIENT_DISCONNECT, c );
+				svs.clients[c].state = CS_FREE;
+				replaying[c] = qfalse;
+			}
+		}
+
+		SV_FlushTraceCache();
+		VM_Call( gvm, GAME_RUN_FRAME, sv.time );
+
+		// nothing is sent, so acknowledge the reliable commands at once
+		hash = 2166136261u;
+		for ( c = 0 ; c < sv_maxclients->integer ; c++ ) {
+			if ( !replaying[c] ) {
+				continue;
+			}
+			svs.clients[c].reliableAcknowledge = svs.clients[c].reliableSequence;
+
+			state = (const byte *)SV_GameClientNum( c );
+			for ( k = 0 ; k < sizeof( playerState_t ) ; k++ ) {
+				hash = ( hash ^ state[k] ) * 16777619u;
+			}
+		}
+		hashes[numFrames++] = hash;
+	}
+
+	for ( c = 0 ; c < sv_maxclients->integer ; c++ ) {
+		if ( replaying[c] ) {
+			VM_Call( gvm, GAME_CLIENT_DISCONNECT, c );
+			svs.clients[c].state = CS_FREE;
+			svs.clients[c].gentity = NULL;
+		}
+	}
+
+	return numFrames;
+}
+
+/*
+==================
+SV_MoveCheck_f
+
+movecheck <file> [threads] replays a .mlog file thinking the clients one
+at a time and with the moves on threads, and reports the first frame
+whose player states differ
+==================
+*/
+void SV_MoveCheck_f( void ) {
+	mlogHeader_t	*header;
+	char			name[MAX_QPATH];
+	char			moveThreads[16], synchronous[16];
+	void			*data;
+	unsigned		*hashes[2];
+	int				length, startTime, maxFrames;
+	int				frames[2], threadedMoves[2], clientMoves[2];
+	int				threads, pass, i;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: movecheck <file> [threads]\n" );
+		return;
+	}
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( !VM_IsNative( gvm ) ) {
+		Com_Printf( "movecheck needs a native game module\n" );
+		return;
+	}
+
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED ) {
+			Com_Printf( "movecheck needs an empty server\n" );
+			return;
+		}
+	}
+
+	threads = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : sv_moveThreads->integer;
+	if ( threads < 2 ) {
+		threads = 2;
+	}
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".mlog" );
+
+	length = FS_ReadFile( name, &data );
+	if ( !data ) {
+		Com_Printf( "Couldn't read %s\n", name );
+		return;
+	}
+
+	header = (mlogHeader_t *)data;
+	if ( length < sizeof( *header ) || LittleLong( header->ident ) != MLOG_IDENT
+		|| LittleLong( header->version ) != MLOG_VERSION ) {
+		Com_Printf( "%s is not a version %i move log\n", name, MLOG_VERSION );
+		FS_FreeFile( data );
+		return;
+	}
+	if ( LittleLong( header->checksum ) != sv_mapChecksum->integer ) {
+		Com_Printf( "%s was recorded on %s, not on this map\n", name, header->mapname );
+		FS_FreeFile( data );
+		return;
+	}
+
+	maxFrames = length / sizeof( mlogFrame_t );
+	hashes[0] = Z_Malloc( maxFrames * sizeof( unsigned ) );
+	hashes[1] = Z_Malloc( maxFrames * sizeof( unsigned ) );
+
+	Q_strncpyz( moveThreads, sv_moveThreads->string, sizeof( moveThreads ) );
+	Q_strncpyz( synchronous, Cvar_VariableString( "g_synchronousClients" ), sizeof( synchronous ) );
+	Cvar_Set( "g_synchronousClients", "1" );
+
+	startTime = sv.time;
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		Cvar_Set( "sv_moveThreads", pass ? va( "%i", threads ) : "0" );
+		clientMoves[pass] = sv.clientMoves;
+		threadedMoves[pass] = sv.threadedMoves;
+		frames[pass] = SV_ReplayMoveLog( data, length, startTime, hashes[pass], maxFrames );
+		clientMoves[pass] = sv.clientMoves - clientMoves[pass];
+		threadedMoves[pass] = sv.threadedMoves - threadedMoves[pass];
+	}
+
+	Cvar_Set( "sv_moveThreads", moveThreads );
+	Cvar_Set( "g_synchronousClients", synchronous );
+
+	// leave a fresh game behind
+	SV_UnlinkAllEntities();
+	SV_RestartGameProgs();
+
+	if ( frames[0] < 0 || frames[1] < 0 ) {
+		Com_Printf( "%s is truncated or corrupt\n", name );
+	} else {
+		for ( i = 0 ; i < frames[0] ; i++ ) {
+			if ( hashes[0][i] != hashes[1][i] ) {
+				break;
+			}
+		}
+		if ( i < frames[0] ) {
+			Com_Printf( "movecheck: %s differs at frame %i of %i\n", name, i, frames[0] );
+		} else {
+			Com_Printf( "movecheck: %s matches over %i frames, %i of %i client moves on %i threads\n",
+				name, frames[0], threadedMoves[1], clientMoves[1], threads );
+		}
+	}
+
+	Z_Free( hashes[0] );
+	Z_Free( hashes[1] );
+	FS_FreeFile( data );
+}
+
 //==============================================
 
 static int	FloatAsInt( float f ) {
@@ -284,153 +1016,334 @@ static int	FloatAsInt( float f ) {
 
 /*
 ====================
-SV_GameSystemCalls
+Game system calls
 
-The module is making a system call
+The core engine services are dispatched through sv_gameSyscalls indexed by
+the trap number, the botlib and math traps go through the switch in
+SV_GameSystemCalls
 ====================
 */
-intptr_t SV_GameSystemCalls( intptr_t *args ) {
-	switch( args[0] ) {
-	case G_PRINT:
-		Com_Printf( "%s", (const char*)VMA(1) );
-		return 0;
-	case G_ERROR:
-		Com_Error( ERR_DROP, "%s", (const char*)VMA(1) );
-		return 0;
-	case G_MILLISECONDS:
-		return Sys_Milliseconds();
-	case G_CVAR_REGISTER:
-		Cvar_Register( VMA(1), VMA(2), VMA(3), args[4] ); 
-		return 0;
-	case G_CVAR_UPDATE:
-		Cvar_Update( VMA(1) );
-		return 0;
-	case G_CVAR_SET:
-		Cvar_SetSafe( (const char *)VMA(1), (const char *)VMA(2) );
-		return 0;
-	case G_CVAR_VARIABLE_INTEGER_VALUE:
-		return Cvar_VariableIntegerValue( (const char *)VMA(1) );
-	case G_CVAR_VARIABLE_STRING_BUFFER:
-		Cvar_VariableStringBuffer( VMA(1), VMA(2), args[3] );
-		return 0;
-	case G_ARGC:
-		return Cmd_Argc();
-	case G_ARGV:
-		Cmd_ArgvBuffer( args[1], VMA(2), args[3] );
-		return 0;
-	case G_SEND_CONSOLE_COMMAND:
-		Cbuf_ExecuteText( args[1], VMA(2) );
-		return 0;
+typedef intptr_t (*gameSyscall_t)( intptr_t *args );
 
-	case G_FS_FOPEN_FILE:
-		return FS_FOpenFileByMode( VMA(1), VMA(2), args[3] );
-	case G_FS_READ:
-		FS_Read( VMA(1), args[2], args[3] );
-		return 0;
-	case G_FS_WRITE:
-		FS_Write( VMA(1), args[2], args[3] );
-		return 0;
-	case G_FS_FCLOSE_FILE:
-		FS_FCloseFile( args[1] );
-		return 0;
-	case G_FS_GETFILELIST:
-		return FS_GetFileList( VMA(1), VMA(2), VMA(3), args[4] );
-	case G_FS_SEEK:
-		return FS_Seek( args[1], args[2], args[3] );
+static intptr_t SV_G_Print( intptr_t *args ) {
+	Com_Printf( "%s", (const char*)VMA(1) );
+	return 0;
+}
 
-	case G_LOCATE_GAME_DATA:
-		SV_LocateGameData( VMA(1), args[2], args[3], VMA(4), args[5] );
-		return 0;
-	case G_DROP_CLIENT:
-		SV_GameDropClient( args[1], VMA(2) );
-		return 0;
-	case G_SEND_SERVER_COMMAND:
-		SV_GameSendServerCommand( args[1], VMA(2) );
-		return 0;
-	case G_LINKENTITY:
-		SV_LinkEntity( VMA(1) );
-		return 0;
-	case G_UNLINKENTITY:
-		SV_UnlinkEntity( VMA(1) );
-		return 0;
-	case G_ENTITIES_IN_BOX:
-		return SV_AreaEntities( VMA(1), VMA(2), VMA(3), args[4] );
-	case G_ENTITY_CONTACT:
-		return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qfalse );
-	case G_ENTITY_CONTACTCAPSULE:
-		return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qtrue );
-	case G_TRACE:
-		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qfalse );
-		return 0;
-	case G_TRACECAPSULE:
-		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
-		return 0;
-	case G_POINT_CONTENTS:
-		return SV_PointContents( VMA(1), args[2] );
-	case G_SET_BRUSH_MODEL:
-		SV_SetBrushModel( VMA(1), VMA(2) );
-		return 0;
-	case G_IN_PVS:
-		return SV_inPVS( VMA(1), VMA(2) );
-	case G_IN_PVS_IGNORE_PORTALS:
-		return SV_inPVSIgnorePortals( VMA(1), VMA(2) );
+static intptr_t SV_G_Error( intptr_t *args ) {
+	Com_Error( ERR_DROP, "%s", (const char*)VMA(1) );
+	return 0;
+}
 
-	case G_SET_CONFIGSTRING:
-		SV_SetConfigstring( args[1], VMA(2) );
-		return 0;
-	case G_GET_CONFIGSTRING:
-		SV_GetConfigstring( args[1], VMA(2), args[3] );
-		return 0;
-	case G_SET_USERINFO:
-		SV_SetUserinfo( args[1], VMA(2) );
-		return 0;
-	case G_GET_USERINFO:
-		SV_GetUserinfo( args[1], VMA(2), args[3] );
-		return 0;
-	case G_GET_SERVERINFO:
-		SV_GetServerinfo( VMA(1), args[2] );
-		return 0;
-	case G_ADJUST_AREA_PORTAL_STATE:
-		SV_AdjustAreaPortalState( VMA(1), args[2] );
-		return 0;
-	case G_AREAS_CONNECTED:
-		return CM_AreasConnected( args[1], args[2] );
+static intptr_t SV_G_Milliseconds( intptr_t *args ) {
+	return Sys_Milliseconds();
+}
 
-	case G_BOT_ALLOCATE_CLIENT:
-		return SV_BotAllocateClient();
-	case G_BOT_FREE_CLIENT:
-		SV_BotFreeClient( args[1] );
-		return 0;
+static intptr_t SV_G_CvarRegister( intptr_t *args ) {
+	Cvar_Register( VMA(1), VMA(2), VMA(3), args[4] ); 
+	return 0;
+}
 
-	case G_GET_USERCMD:
-		SV_GetUsercmd( args[1], VMA(2) );
-		return 0;
-	case G_GET_ENTITY_TOKEN:
-		{
-			const char	*s;
-
-			s = COM_Parse( &sv.entityParsePoint );
-			Q_strncpyz( VMA(1), s, args[2] );
-			if ( !sv.entityParsePoint && !s[0] ) {
-				return qfalse;
-			} else {
-				return qtrue;
-			}
-		}
+static intptr_t SV_G_CvarUpdate( intptr_t *args ) {
+	Cvar_Update( VMA(1) );
+	return 0;
+}
 
-	case G_DEBUG_POLYGON_CREATE:
-		return BotImport_DebugPolygonCreate( args[1], args[2], VMA(3) );
-	case G_DEBUG_POLYGON_DELETE:
-		BotImport_DebugPolygonDelete( args[1] );
-		return 0;
-	case G_REAL_TIME:
-		return Com_RealTime( VMA(1) );
-	case G_SNAPVECTOR:
-		Q_SnapVector(VMA(1));
-		return 0;
+static intptr_t SV_G_CvarSet( intptr_t *args ) {
+	Cvar_SetSafe( (const char *)VMA(1), (const char *)VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_CvarVariableIntegerValue( intptr_t *args ) {
+	return Cvar_VariableIntegerValue( (const char *)VMA(1) );
+}
+
+static intptr_t SV_G_CvarVariableStringBuffer( intptr_t *args ) {
+	Cvar_VariableStringBuffer( VMA(1), VMA(2), args[3] );
+	return 0;
+}
+
+static intptr_t SV_G_Argc( intptr_t *args ) {
+	return Cmd_Argc();
+}
+
+static intptr_t SV_G_Argv( intptr_t *args ) {
+	Cmd_ArgvBuffer( args[1], VMA(2), args[3] );
+	return 0;
+}
+
+static intptr_t SV_G_SendConsoleCommand( intptr_t *args ) {
+	Cbuf_ExecuteText( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_FS_FOpenFile( intptr_t *args ) {
+	return FS_FOpenFileByMode( VMA(1), VMA(2), args[3] );
+}
+
+static intptr_t SV_G_FS_Read( intptr_t *args ) {
+	FS_Read( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+static intptr_t SV_G_FS_Write( intptr_t *args ) {
+	FS_Write( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+static intptr_t SV_G_FS_FCloseFile( intptr_t *args ) {
+	FS_FCloseFile( args[1] );
+	return 0;
+}
+
+static intptr_t SV_G_FS_GetFileList( intptr_t *args ) {
+	return FS_GetFileList( VMA(1), VMA(2), VMA(3), args[4] );
+}
+
+static intptr_t SV_G_FS_Seek( intptr_t *args ) {
+	return FS_Seek( args[1], args[2], args[3] );
+}
+
+static intptr_t SV_G_LocateGameData( intptr_t *args ) {
+	SV_LocateGameData( VMA(1), args[2], args[3], VMA(4), args[5] );
+	return 0;
+}
 
-		//====================================
+static intptr_t SV_G_DropClient( intptr_t *args ) {
+	SV_GameDropClient( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_SendServerCommand( intptr_t *args ) {
+	SV_GameSendServerCommand( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_LinkEntity( intptr_t *args ) {
+	SV_LinkEntity( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_G_UnlinkEntity( intptr_t *args ) {
+	SV_UnlinkEntity( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_G_EntitiesInBox( intptr_t *args ) {
+	return SV_AreaEntities( VMA(1), VMA(2), VMA(3), args[4] );
+}
+
+static intptr_t SV_G_EntityContact( intptr_t *args ) {
+	return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qfalse );
+}
+
+static intptr_t SV_G_EntityContactCapsule( intptr_t *args ) {
+	return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qtrue );
+}
+
+static intptr_t SV_G_Trace( intptr_t *args ) {
+	if ( !sv_threadSlot ) {
+		sv.gameTraces++;
+	}
+	SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qfalse );
+	return 0;
+}
+
+static intptr_t SV_G_TraceCapsule( intptr_t *args ) {
+	if ( !sv_threadSlot ) {
+		sv.gameTraces++;
+	}
+	SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
+	return 0;
+}
+
+static intptr_t SV_G_TraceBatch( intptr_t *args ) {
+	int		numTraces = args[3];
+
+	if ( numTraces < 0 || numTraces > MAX_TRACE_BATCH ) {
+		Com_Error( ERR_DROP, "SV_G_TraceBatch: bad numTraces %i", numTraces );
+	}
+
+	sv.gameTraces += numTraces;
+	sv.gameTraceBatches++;
+	SV_TraceBatch( VM_ArgBlock( args[1], numTraces * sizeof( traceRequest_t ) ),
+		VM_ArgBlock( args[2], numTraces * sizeof( trace_t ) ), numTraces );
+	return 0;
+}
+
+static intptr_t SV_G_RunClientMoves( intptr_t *args ) {
+	int		numClients = args[2];
+
+	if ( numClients < 0 || numClients > MAX_CLIENTS ) {
+		Com_Error( ERR_DROP, "SV_G_RunClientMoves: bad numClients %i", numClients );
+	}
+
+	return SV_RunClientMoves( VM_ArgBlock( args[1], numClients * sizeof( int ) ), numClients );
+}
+
+static intptr_t SV_G_PointContents( intptr_t *args ) {
+	return SV_PointContents( VMA(1), args[2] );
+}
+
+static intptr_t SV_G_SetBrushModel( intptr_t *args ) {
+	SV_SetBrushModel( VMA(1), VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_InPVS( intptr_t *args ) {
+	return SV_inPVS( VMA(1), VMA(2) );
+}
+
+static intptr_t SV_G_InPVSIgnorePortals( intptr_t *args ) {
+	return SV_inPVSIgnorePortals( VMA(1), VMA(2) );
+}
+
+static intptr_t SV_G_SetConfigstring( intptr_t *args ) {
+	SV_SetConfigstring( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_GetConfigstring( intptr_t *args ) {
+	SV_GetConfigstring( args[1], VMA(2), args[3] );
+	return 0;
+}
+
+static intptr_t SV_G_SetUserinfo( intptr_t *args ) {
+	SV_SetUserinfo( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_GetUserinfo( intptr_t *args ) {
+	SV_GetUserinfo( args[1], VMA(2), args[3] );
+	return 0;
+}
+
+static intptr_t SV_G_GetServerinfo( intptr_t *args ) {
+	SV_GetServerinfo( VMA(1), args[2] );
+	return 0;
+}
 
+static intptr_t SV_G_AdjustAreaPortalState( intptr_t *args ) {
+	SV_AdjustAreaPortalState( VMA(1), args[2] );
+	return 0;
+}
+
+static intptr_t SV_G_AreasConnected( intptr_t *args ) {
+	return CM_AreasConnected( args[1], args[2] );
+}
+
+static intptr_t SV_G_BotAllocateClient( intptr_t *args ) {
+	return SV_BotAllocateClient();
+}
+
+static intptr_t SV_G_BotFreeClient( intptr_t *args ) {
+	SV_BotFreeClient( args[1] );
+	return 0;
+}
+
+static intptr_t SV_G_GetUsercmd( intptr_t *args ) {
+	SV_GetUsercmd( args[1], VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_G_GetEntityToken( intptr_t *args ) {
+	const char	*s;
+
+	s = COM_Parse( &sv.entityParsePoint );
+	Q_strncpyz( VMA(1), s, args[2] );
+	if ( !sv.entityParsePoint && !s[0] ) {
+		return qfalse;
+	} else {
+		return qtrue;
+	}
+}
+
+static intptr_t SV_G_DebugPolygonCreate( intptr_t *args ) {
+	return BotImport_DebugPolygonCreate( args[1], args[2], VMA(3) );
+}
+
+static intptr_t SV_G_DebugPolygonDelete( intptr_t *args ) {
+	BotImport_DebugPolygonDelete( args[1] );
+	return 0;
+}
+
+static intptr_t SV_G_RealTime( intptr_t *args ) {
+	return Com_RealTime( VMA(1) );
+}
+
+static intptr_t SV_G_SnapVector( intptr_t *args ) {
+	Q_SnapVector(VMA(1));
+	return 0;
+}
+
+static const gameSyscall_t sv_gameSyscalls[] = {
+	[G_PRINT]							= SV_G_Print,
+	[G_ERROR]							= SV_G_Error,
+	[G_MILLISECONDS]					= SV_G_Milliseconds,
+	[G_CVAR_REGISTER]					= SV_G_CvarRegister,
+	[G_CVAR_UPDATE]						= SV_G_CvarUpdate,
+	[G_CVAR_SET]						= SV_G_CvarSet,
+	[G_CVAR_VARIABLE_INTEGER_VALUE]		= SV_G_CvarVariableIntegerValue,
+	[G_CVAR_VARIABLE_STRING_BUFFER]		= SV_G_CvarVariableStringBuffer,
+	[G_ARGC]							= SV_G_Argc,
+	[G_ARGV]							= SV_G_Argv,
+	[G_FS_FOPEN_FILE]					= SV_G_FS_FOpenFile,
+	[G_FS_READ]							= SV_G_FS_Read,
+	[G_FS_WRITE]						= SV_G_FS_Write,
+	[G_FS_FCLOSE_FILE]					= SV_G_FS_FCloseFile,
+	[G_SEND_CONSOLE_COMMAND]			= SV_G_SendConsoleCommand,
+	[G_LOCATE_GAME_DATA]				= SV_G_LocateGameData,
+	[G_DROP_CLIENT]						= SV_G_DropClient,
+	[G_SEND_SERVER_COMMAND]				= SV_G_SendServerCommand,
+	[G_SET_CONFIGSTRING]				= SV_G_SetConfigstring,
+	[G_GET_CONFIGSTRING]				= SV_G_GetConfigstring,
+	[G_GET_USERINFO]					= SV_G_GetUserinfo,
+	[G_SET_USERINFO]					= SV_G_SetUserinfo,
+	[G_GET_SERVERINFO]					= SV_G_GetServerinfo,
+	[G_SET_BRUSH_MODEL]					= SV_G_SetBrushModel,
+	[G_TRACE]							= SV_G_Trace,
+	[G_POINT_CONTENTS]					= SV_G_PointContents,
+	[G_IN_PVS]							= SV_G_InPVS,
+	[G_IN_PVS_IGNORE_PORTALS]			= SV_G_InPVSIgnorePortals,
+	[G_ADJUST_AREA_PORTAL_STATE]		= SV_G_AdjustAreaPortalState,
+	[G_AREAS_CONNECTED]					= SV_G_AreasConnected,
+	[G_LINKENTITY]						= SV_G_LinkEntity,
+	[G_UNLINKENTITY]					= SV_G_UnlinkEntity,
+	[G_ENTITIES_IN_BOX]					= SV_G_EntitiesInBox,
+	[G_ENTITY_CONTACT]					= SV_G_EntityContact,
+	[G_BOT_ALLOCATE_CLIENT]				= SV_G_BotAllocateClient,
+	[G_BOT_FREE_CLIENT]					= SV_G_BotFreeClient,
+	[G_GET_USERCMD]						= SV_G_GetUsercmd,
+	[G_GET_ENTITY_TOKEN]				= SV_G_GetEntityToken,
+	[G_FS_GETFILELIST]					= SV_G_FS_GetFileList,
+	[G_DEBUG_POLYGON_CREATE]			= SV_G_DebugPolygonCreate,
+	[G_DEBUG_POLYGON_DELETE]			= SV_G_DebugPolygonDelete,
+	[G_REAL_TIME]						= SV_G_RealTime,
+	[G_SNAPVECTOR]						= SV_G_SnapVector,
+	[G_TRACECAPSULE]					= SV_G_TraceCapsule,
+	[G_ENTITY_CONTACTCAPSULE]			= SV_G_EntityContactCapsule,
+	[G_FS_SEEK]							= SV_G_FS_Seek,
+	[G_TRACE_BATCH]						= SV_G_TraceBatch,
+	[G_RUN_CLIENT_MOVES]				= SV_G_RunClientMoves,
+};
+
+/*
+====================
+SV_GameSystemCalls
+
+The module is making a system call
+====================
+*/
+intptr_t SV_GameSystemCalls( intptr_t *args ) {
+	if ( !sv_threadSlot ) {
+		sv.gameSyscalls++;
+	}
+
+	if ( args[0] >= 0 && args[0] < ARRAY_LEN( sv_gameSyscalls ) && sv_gameSyscalls[args[0]] ) {
+		return sv_gameSyscalls[args[0]]( args );
+	}
+
+	switch( args[0] ) {
 	case BOTLIB_SETUP:
 		return SV_BotLibSetup();
 	case BOTLIB_SHUTDOWN:
@@ -849,6 +1762,49 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	return 0;
 }
 
+/*
+===============
+SV_SyscallStats_f
+
+Boundary crossings of the game module since the map was loaded
+===============
+*/
+void SV_SyscallStats_f( void ) {
+	int		frames;
+
+	if ( !gvm ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	frames = sv.gameFrames ? sv.gameFrames : 1;
+
+	Com_Printf( "%i game frames\n", sv.gameFrames );
+	Com_Printf( "%8.1f syscalls per frame\n", (float)sv.gameSyscalls / frames );
+	Com_Printf( "%8.1f traces per frame\n", (float)sv.gameTraces / frames );
+	Com_Printf( "%8.1f trace batches per frame\n", (float)sv.gameTraceBatches / frames );
+	if ( sv.traceCacheHits + sv.traceCacheMisses ) {
+		Com_Printf( "%8.1f%% of %i cached traces hit\n",
+			100.0f * sv.traceCacheHits / ( sv.traceCacheHits + sv.traceCacheMisses ),
+			sv.traceCacheHits + sv.traceCacheMisses );
+	}
+	Com_Printf( "%8.1f PVS queries per frame\n", (float)sv.pvsQueries / frames );
+	Com_Printf( "%8.1f PVS area checks per frame\n", (float)sv.pvsAreaChecks / frames );
+	if ( sv.pvsCacheHits + sv.pvsCacheMisses ) {
+		Com_Printf( "%8.1f%% of %i cached PVS point lookups hit\n",
+			100.0f * sv.pvsCacheHits / ( sv.pvsCacheHits + sv.pvsCacheMisses ),
+			sv.pvsCacheHits + sv.pvsCacheMisses );
+	}
+	if ( sv.pvsTimedQueries ) {
+		Com_Printf( "%8.0f ns per PVS query over %i timed with com_speeds\n",
+			(double)sv.pvsNanoseconds / sv.pvsTimedQueries, sv.pvsTimedQueries );
+	}
+	if ( sv.clientMoves ) {
+		Com_Printf( "%8.1f client moves per frame, %.1f%% on sv_moveThreads\n",
+			(float)sv.clientMoves / frames, 100.0f * sv.threadedMoves / sv.clientMoves );
+	}
+}
+
 /*
 ===============
 SV_ShutdownGameProgs
@@ -888,7 +1844,7 @@ static void SV_InitGameVM( qboolean restart ) {
 	
 	// use the current msec count for a random seed
 	// init for this gamestate
-	VM_Call (gvm, GAME_INIT, sv.time, Com_Milliseconds(), restart);
+	VM_Call (gvm, GAME_INIT, sv.time, sv_gameSeed ? sv_gameSeed : Com_Milliseconds(), restart);
 }
 
 
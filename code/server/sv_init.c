@@ -405,6 +405,10 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// shut down the existing game if it is running
 	SV_ShutdownGameProgs();
 
+	// a trace or move log only covers one map
+	SV_StopTraceLog();
+	SV_StopMoveLog();
+
 	Com_Printf ("------ Server Initialization ------\n");
 	Com_Printf ("Server: %s\n",server);
 
@@ -436,6 +440,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	// allocate the snapshot entities on the hunk
 	svs.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
+	svs.snapshotStateIds = Hunk_Alloc( sizeof(int)*svs.numSnapshotEntities, h_high );
 	svs.nextSnapshotEntities = 0;
 
 	// toggle the server bit so clients can detect that a
@@ -468,6 +473,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	FS_Restart( sv.checksumFeed );
 
 	CM_LoadMap( va("maps/%s.bsp", server), qfalse, &checksum );
+	SV_FlushPVSCache();
 
 	// set serverinfo visible name
 	Cvar_Set( "mapname", server );
@@ -497,6 +503,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// run a few frames to allow everything to settle
 	for (i = 0;i < 3; i++)
 	{
+		SV_FlushTraceCache();
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 		SV_BotFrame (sv.time);
 		sv.time += 100;
@@ -554,6 +561,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	}	
 
 	// run another frame to allow things to look at all the players
+	SV_FlushTraceCache();
 	VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	SV_BotFrame (sv.time);
 	sv.time += 100;
@@ -683,6 +691,9 @@ void SV_Init (void)
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
+	sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE );
+	sv_pvsCache = Cvar_Get ("sv_pvsCache", "1", CVAR_ARCHIVE );
+	sv_moveThreads = Cvar_Get ("sv_moveThreads", "0", CVAR_ARCHIVE );
 #ifndef STANDALONE
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "1", CVAR_ARCHIVE );
 #endif
@@ -755,6 +766,8 @@ void SV_Shutdown( char *finalmsg ) {
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
 	SV_ShutdownGameProgs();
+	SV_StopTraceLog();
+	SV_StopMoveLog();
 
 	// free current level
 	SV_ClearServer();
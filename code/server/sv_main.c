@@ -58,6 +58,9 @@ cvar_t	*sv_gametype;
 cvar_t	*sv_pure;
 cvar_t	*sv_floodProtect;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
+cvar_t	*sv_traceCache;			// remember SV_Trace results within a frame
+cvar_t	*sv_pvsCache;			// remember the cluster and area of PVS query points
+cvar_t	*sv_moveThreads;		// threads for the client moves of G_RUN_CLIENT_MOVES
 #ifndef STANDALONE
 cvar_t	*sv_strictAuth;
 #endif
@@ -1140,7 +1143,10 @@ void SV_Frame( int msec ) {
 		sv.time += frameMsec;
 
 		// let everything in the world think and move
+		SV_FlushTraceCache();
+		SV_LogClientMoves();
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
+		sv.gameFrames++;
 	}
 
 	if ( com_speeds->integer ) {
@@ -45,6 +45,41 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============
+SV_SnapshotDeltaMask
+
+The changed fields between two snapshotEntities of the same entity.
+Most clients delta from the same previous state, so the mask is kept
+with the entity and only computed again for a different pair of states.
+=============
+*/
+static uint64_t SV_SnapshotDeltaMask( int fromIndex, int toIndex ) {
+	entityState_t	*from, *to;
+	svEntity_t		*svEnt;
+	int				fromId, toId;
+
+	from = &svs.snapshotEntities[fromIndex];
+	to = &svs.snapshotEntities[toIndex];
+	fromId = svs.snapshotStateIds[fromIndex];
+	toId = svs.snapshotStateIds[toIndex];
+
+	if ( !fromId || !toId ) {
+		return MSG_EntityDeltaMask( from, to );
+	}
+	if ( fromId == toId ) {
+		return 0;
+	}
+
+	svEnt = &sv.svEntities[to->number];
+	if ( svEnt->deltaFromId != fromId || svEnt->deltaToId != toId ) {
+		svEnt->deltaMask = MSG_EntityDeltaMask( from, to );
+		svEnt->deltaFromId = fromId;
+		svEnt->deltaToId = toId;
+	}
+	return svEnt->deltaMask;
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -88,7 +123,9 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emitted if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			MSG_WriteDeltaEntityMask( msg, oldent, newent, qfalse,
+				SV_SnapshotDeltaMask( (from->first_entity+oldindex) % svs.numSnapshotEntities,
+					(to->first_entity+newindex) % svs.numSnapshotEntities ) );
 			oldindex++;
 			newindex++;
 			continue;
@@ -511,6 +548,16 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
 		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
 		*state = ent->s;
+
+		// every client seeing the same state gets the same id, so the
+		// changed fields are only found once per entity and frame
+		svEnt = SV_SvEntityForGentity( ent );
+		if ( !svEnt->snapshotStateId || memcmp( &svEnt->snapshotState, state, sizeof( *state ) ) ) {
+			svEnt->snapshotState = *state;
+			svEnt->snapshotStateId = svs.nextSnapshotEntities + 1;
+		}
+		svs.snapshotStateIds[svs.nextSnapshotEntities % svs.numSnapshotEntities] = svEnt->snapshotStateId;
+
 		svs.nextSnapshotEntities++;
 		// this should never hit, map should always be restarted first in SV_Frame
 		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
@@ -54,88 +54,311 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent ) {
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+linked entities are kept in a dynamic bounding volume tree.  Each entity is a leaf
+holding its bounds grown by a margin, so small moves don't have to touch the tree,
+and each interior node holds the bounds of its two children.  New leafs are put
+next to the node whose bounds grow the least, and the tree is kept balanced with
+AVL style rotations, so queries stay logarithmic however the entities are spread.
 
 ===============================================================================
 */
 
-typedef struct worldSector_s {
-	int		axis;		// -1 = leaf node
-	float	dist;
-	struct worldSector_s	*children[2];
-	svEntity_t	*entities;
-} worldSector_t;
+typedef struct worldNode_s {
+	vec3_t		mins, maxs;			// fattened entity bounds for leafs
+	struct worldNode_s	*parent;		// next free node when not in use
+	struct worldNode_s	*children[2];	// NULL for leafs
+	int			height;				// 0 for leafs
+	svEntity_t	*entity;			// only set for leafs
+} worldNode_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	64
+// each entity can have a leaf, and n leafs need n-1 interior nodes
+#define	WORLD_NODES		( MAX_GENTITIES * 2 )
 
-worldSector_t	sv_worldSectors[AREA_NODES];
-int			sv_numworldSectors;
+// how far an entity can move before its leaf has to be moved
+#define	WORLD_NODE_MARGIN	8
+
+// leafs are also grown by the last move if it was shorter than this
+#define	WORLD_NODE_LOOKAHEAD	128
+
+static worldNode_t	sv_worldNodes[WORLD_NODES];
+static worldNode_t	*sv_worldRoot;
+static worldNode_t	*sv_freeWorldNodes;
 
 
+/*
+===============
+SV_WorldNodeStats_r
+===============
+*/
+static int SV_WorldNodeStats_r( worldNode_t *node, int depth, int *numLeafs, int *depthSum ) {
+	if ( !node->children[0] ) {
+		( *numLeafs )++;
+		*depthSum += depth;
+		return 1;
+	}
+	return 1 + SV_WorldNodeStats_r( node->children[0], depth + 1, numLeafs, depthSum )
+		+ SV_WorldNodeStats_r( node->children[1], depth + 1, numLeafs, depthSum );
+}
+
 /*
 ===============
 SV_SectorList_f
 ===============
 */
 void SV_SectorList_f( void ) {
-	int				i, c;
-	worldSector_t	*sec;
-	svEntity_t		*ent;
+	int		numNodes, numLeafs, depthSum;
+
+	if ( !sv_worldRoot ) {
+		Com_Printf( "no entities linked\n" );
+		return;
+	}
 
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
-		sec = &sv_worldSectors[i];
+	numLeafs = depthSum = 0;
+	numNodes = SV_WorldNodeStats_r( sv_worldRoot, 0, &numLeafs, &depthSum );
 
-		c = 0;
-		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
-			c++;
-		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
+	Com_Printf( "%i entities linked in %i world nodes\n", numLeafs, numNodes );
+	Com_Printf( "tree height %i, average entity depth %.1f\n", sv_worldRoot->height,
+		(float)depthSum / numLeafs );
+}
+
+/*
+===============
+SV_AllocWorldNode
+===============
+*/
+static worldNode_t *SV_AllocWorldNode( void ) {
+	worldNode_t	*node;
+
+	node = sv_freeWorldNodes;
+	if ( !node ) {
+		Com_Error( ERR_DROP, "SV_AllocWorldNode: no free nodes" );
+	}
+	sv_freeWorldNodes = node->parent;
+
+	Com_Memset( node, 0, sizeof( *node ) );
+	return node;
+}
+
+/*
+===============
+SV_FreeWorldNode
+===============
+*/
+static void SV_FreeWorldNode( worldNode_t *node ) {
+	node->entity = NULL;
+	node->parent = sv_freeWorldNodes;
+	sv_freeWorldNodes = node;
+}
+
+/*
+===============
+SV_BoundsArea
+
+Surface area of a box, the cost of a node in the tree
+===============
+*/
+static float SV_BoundsArea( const vec3_t mins, const vec3_t maxs ) {
+	vec3_t	size;
+
+	VectorSubtract( maxs, mins, size );
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+/*
+===============
+SV_UnionArea
+===============
+*/
+static float SV_UnionArea( const worldNode_t *a, const worldNode_t *b ) {
+	vec3_t	mins, maxs;
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = a->mins[i] < b->mins[i] ? a->mins[i] : b->mins[i];
+		maxs[i] = a->maxs[i] > b->maxs[i] ? a->maxs[i] : b->maxs[i];
+	}
+	return SV_BoundsArea( mins, maxs );
+}
+
+/*
+===============
+SV_RefitWorldNode
+
+Recalculates the bounds and height of an interior node from its children
+===============
+*/
+static void SV_RefitWorldNode( worldNode_t *node ) {
+	worldNode_t	*a, *b;
+	int			i;
+
+	a = node->children[0];
+	b = node->children[1];
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = a->mins[i] < b->mins[i] ? a->mins[i] : b->mins[i];
+		node->maxs[i] = a->maxs[i] > b->maxs[i] ? a->maxs[i] : b->maxs[i];
 	}
+	node->height = 1 + ( a->height > b->height ? a->height : b->height );
 }
 
 /*
 ===============
-SV_CreateworldSector
+SV_ReplaceWorldChild
 
-Builds a uniformly subdivided tree for the given world size
+Puts node where child was under child's parent
 ===============
 */
-static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
-	worldSector_t	*anode;
-	vec3_t		size;
-	vec3_t		mins1, maxs1, mins2, maxs2;
+static void SV_ReplaceWorldChild( worldNode_t *child, worldNode_t *node ) {
+	worldNode_t	*parent;
+
+	parent = child->parent;
+	node->parent = parent;
+	if ( !parent ) {
+		sv_worldRoot = node;
+	} else if ( parent->children[0] == child ) {
+		parent->children[0] = node;
+	} else {
+		parent->children[1] = node;
+	}
+}
 
-	anode = &sv_worldSectors[sv_numworldSectors];
-	sv_numworldSectors++;
+/*
+===============
+SV_RotateWorldNode
 
-	if (depth == AREA_DEPTH) {
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
+Lifts the taller child of a node above it when the heights of its children
+differ by more than one and returns the node now at the top of the subtree.
+The lifted node keeps its taller child and gives the shorter one to the old
+parent in place of itself.
+===============
+*/
+static worldNode_t *SV_RotateWorldNode( worldNode_t *node ) {
+	worldNode_t	*up, *keep, *give;
+	int			side, balance;
+
+	if ( !node->children[0] || node->height < 2 ) {
+		return node;
 	}
-	
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1]) {
-		anode->axis = 0;
+
+	balance = node->children[1]->height - node->children[0]->height;
+	if ( balance >= -1 && balance <= 1 ) {
+		return node;
+	}
+
+	side = balance > 0 ? 1 : 0;
+	up = node->children[side];
+
+	if ( up->children[0]->height > up->children[1]->height ) {
+		keep = up->children[0];
+		give = up->children[1];
 	} else {
-		anode->axis = 1;
+		keep = up->children[1];
+		give = up->children[0];
+	}
+
+	SV_ReplaceWorldChild( node, up );
+
+	up->children[0] = node;
+	up->children[1] = keep;
+	node->parent = up;
+	keep->parent = up;
+
+	node->children[side] = give;
+	give->parent = node;
+
+	SV_RefitWorldNode( node );
+	SV_RefitWorldNode( up );
+
+	return up;
+}
+
+/*
+===============
+SV_RefitWorldAncestors
+
+Walks up from node fixing bounds and heights and rebalancing
+===============
+*/
+static void SV_RefitWorldAncestors( worldNode_t *node ) {
+	while ( node ) {
+		SV_RefitWorldNode( node );
+		node = SV_RotateWorldNode( node );
+		node = node->parent;
+	}
+}
+
+/*
+===============
+SV_InsertWorldLeaf
+===============
+*/
+static void SV_InsertWorldLeaf( worldNode_t *leaf ) {
+	worldNode_t	*sibling, *parent;
+	float		area, unionArea, cost, inherit, childCost[2];
+	int			i;
+
+	if ( !sv_worldRoot ) {
+		sv_worldRoot = leaf;
+		leaf->parent = NULL;
+		return;
+	}
+
+	// find the node that grows the tree the least when paired with the leaf
+	sibling = sv_worldRoot;
+	while ( sibling->children[0] ) {
+		area = SV_BoundsArea( sibling->mins, sibling->maxs );
+		unionArea = SV_UnionArea( sibling, leaf );
+
+		// cost of a new parent for the leaf and this node
+		cost = 2 * unionArea;
+
+		// cost every node further down pays for growing this one
+		inherit = 2 * ( unionArea - area );
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			childCost[i] = SV_UnionArea( sibling->children[i], leaf ) + inherit;
+			if ( sibling->children[i]->children[0] ) {
+				childCost[i] -= SV_BoundsArea( sibling->children[i]->mins, sibling->children[i]->maxs );
+			}
+		}
+
+		if ( cost < childCost[0] && cost < childCost[1] ) {
+			break;
+		}
+
+		sibling = sibling->children[ childCost[1] < childCost[0] ];
 	}
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy (mins, mins1);	
-	VectorCopy (mins, mins2);	
-	VectorCopy (maxs, maxs1);	
-	VectorCopy (maxs, maxs2);	
-	
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
-	
-	anode->children[0] = SV_CreateworldSector (depth+1, mins2, maxs2);
-	anode->children[1] = SV_CreateworldSector (depth+1, mins1, maxs1);
+	// pair them under a new parent
+	parent = SV_AllocWorldNode();
+	SV_ReplaceWorldChild( sibling, parent );
+	parent->children[0] = sibling;
+	parent->children[1] = leaf;
+	sibling->parent = parent;
+	leaf->parent = parent;
 
-	return anode;
+	SV_RefitWorldAncestors( parent );
+}
+
+/*
+===============
+SV_RemoveWorldLeaf
+===============
+*/
+static void SV_RemoveWorldLeaf( worldNode_t *leaf ) {
+	worldNode_t	*parent, *sibling;
+
+	parent = leaf->parent;
+	if ( !parent ) {
+		sv_worldRoot = NULL;
+		return;
+	}
+
+	// the sibling takes the place of the parent
+	sibling = parent->children[ parent->children[0] == leaf ];
+	SV_ReplaceWorldChild( parent, sibling );
+	SV_FreeWorldNode( parent );
+
+	SV_RefitWorldAncestors( sibling->parent );
 }
 
 /*
@@ -145,16 +368,15 @@ SV_ClearWorld
 ===============
 */
 void SV_ClearWorld( void ) {
-	clipHandle_t	h;
-	vec3_t			mins, maxs;
+	int		i;
 
-	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
-	sv_numworldSectors = 0;
+	Com_Memset( sv_worldNodes, 0, sizeof( sv_worldNodes ) );
+	sv_worldRoot = NULL;
 
-	// get world map bounds
-	h = CM_InlineModel( 0 );
-	CM_ModelBounds( h, mins, maxs );
-	SV_CreateworldSector( 0, mins, maxs );
+	sv_freeWorldNodes = NULL;
+	for ( i = WORLD_NODES - 1 ; i >= 0 ; i-- ) {
+		SV_FreeWorldNode( &sv_worldNodes[i] );
+	}
 }
 
 
@@ -166,32 +388,20 @@ SV_UnlinkEntity
 */
 void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	svEntity_t		*ent;
-	svEntity_t		*scan;
-	worldSector_t	*ws;
 
 	ent = SV_SvEntityForGentity( gEnt );
 
 	gEnt->r.linked = qfalse;
 
-	ws = ent->worldSector;
-	if ( !ws ) {
+	if ( !ent->worldNode ) {
 		return;		// not linked in anywhere
 	}
-	ent->worldSector = NULL;
 
-	if ( ws->entities == ent ) {
-		ws->entities = ent->nextEntityInWorldSector;
-		return;
-	}
+	SV_InvalidateTraceCache( gEnt->r.absmin, gEnt->r.absmax );
 
-	for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
-		if ( scan->nextEntityInWorldSector == ent ) {
-			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-			return;
-		}
-	}
-
-	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+	SV_RemoveWorldLeaf( ent->worldNode );
+	SV_FreeWorldNode( ent->worldNode );
+	ent->worldNode = NULL;
 }
 
 
@@ -203,7 +413,9 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
+	worldNode_t	*node;
+	vec3_t		oldAbsmin;
+	float		move;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -215,8 +427,13 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
-	if ( ent->worldSector ) {
-		SV_UnlinkEntity( gEnt );	// unlink from old position
+	// the leaf is only moved if the entity leaves its bounds
+	VectorCopy( gEnt->r.absmin, oldAbsmin );
+	gEnt->r.linked = qfalse;
+
+	// traces that saw the entity where it was are stale
+	if ( ent->worldNode ) {
+		SV_InvalidateTraceCache( gEnt->r.absmin, gEnt->r.absmax );
 	}
 
 	// encode the size into the entityState_t for client prediction
@@ -291,6 +508,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		SV_UnlinkEntity( gEnt );
 		return;
 	}
 
@@ -332,24 +550,45 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
+	// and so are the ones that would see it where it is now
+	SV_InvalidateTraceCache( gEnt->r.absmin, gEnt->r.absmax );
+
+	// still inside its leaf
+	node = ent->worldNode;
+	if ( node && node->mins[0] <= gEnt->r.absmin[0] && node->maxs[0] >= gEnt->r.absmax[0]
+		&& node->mins[1] <= gEnt->r.absmin[1] && node->maxs[1] >= gEnt->r.absmax[1]
+		&& node->mins[2] <= gEnt->r.absmin[2] && node->maxs[2] >= gEnt->r.absmax[2] ) {
+		gEnt->r.linked = qtrue;
+		return;
+	}
+
+	if ( node ) {
+		SV_RemoveWorldLeaf( node );
+	} else {
+		node = SV_AllocWorldNode();
+		node->entity = ent;
+		ent->worldNode = node;
+		VectorCopy( gEnt->r.absmin, oldAbsmin );
+	}
+
+	// grow the leaf by a margin and by one more move like the last one,
+	// so entities moving steadily don't have to be moved every frame
+	for ( i = 0 ; i < 3 ; i++ ) {
+		move = gEnt->r.absmin[i] - oldAbsmin[i];
+		if ( move > WORLD_NODE_LOOKAHEAD || move < -WORLD_NODE_LOOKAHEAD ) {
+			move = 0;	// teleported
+		}
+
+		node->mins[i] = gEnt->r.absmin[i] - WORLD_NODE_MARGIN;
+		node->maxs[i] = gEnt->r.absmax[i] + WORLD_NODE_MARGIN;
+		if ( move < 0 ) {
+			node->mins[i] += move;
+		} else {
+			node->maxs[i] += move;
+		}
+	}
+
+	SV_InsertWorldLeaf( node );
 
 	gEnt->r.linked = qtrue;
 }
@@ -378,44 +617,43 @@ SV_AreaEntities_r
 
 ====================
 */
-static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
-	svEntity_t	*check, *next;
+static void SV_AreaEntities_r( worldNode_t *node, areaParms_t *ap ) {
 	sharedEntity_t *gcheck;
 
-	for ( check = node->entities  ; check ; check = next ) {
-		next = check->nextEntityInWorldSector;
-
-		gcheck = SV_GEntityForSvEntity( check );
+	if ( node->mins[0] > ap->maxs[0]
+		|| node->mins[1] > ap->maxs[1]
+		|| node->mins[2] > ap->maxs[2]
+		|| node->maxs[0] < ap->mins[0]
+		|| node->maxs[1] < ap->mins[1]
+		|| node->maxs[2] < ap->mins[2] ) {
+		return;
+	}
 
-		if ( gcheck->r.absmin[0] > ap->maxs[0]
-		|| gcheck->r.absmin[1] > ap->maxs[1]
-		|| gcheck->r.absmin[2] > ap->maxs[2]
-		|| gcheck->r.absmax[0] < ap->mins[0]
-		|| gcheck->r.absmax[1] < ap->mins[1]
-		|| gcheck->r.absmax[2] < ap->mins[2]) {
-			continue;
-		}
+	if ( node->children[0] ) {
+		SV_AreaEntities_r( node->children[0], ap );
+		SV_AreaEntities_r( node->children[1], ap );
+		return;
+	}
 
-		if ( ap->count == ap->maxcount ) {
-			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
-			return;
-		}
+	// the leaf bounds are fattened, check the real ones
+	gcheck = SV_GEntityForSvEntity( node->entity );
 
-		ap->list[ap->count] = check - sv.svEntities;
-		ap->count++;
-	}
-	
-	if (node->axis == -1) {
-		return;		// terminal node
+	if ( gcheck->r.absmin[0] > ap->maxs[0]
+	|| gcheck->r.absmin[1] > ap->maxs[1]
+	|| gcheck->r.absmin[2] > ap->maxs[2]
+	|| gcheck->r.absmax[0] < ap->mins[0]
+	|| gcheck->r.absmax[1] < ap->mins[1]
+	|| gcheck->r.absmax[2] < ap->mins[2]) {
+		return;
 	}
 
-	// recurse down both sides
-	if ( ap->maxs[node->axis] > node->dist ) {
-		SV_AreaEntities_r ( node->children[0], ap );
-	}
-	if ( ap->mins[node->axis] < node->dist ) {
-		SV_AreaEntities_r ( node->children[1], ap );
+	if ( ap->count == ap->maxcount ) {
+		Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+		return;
 	}
+
+	ap->list[ap->count] = node->entity - sv.svEntities;
+	ap->count++;
 }
 
 /*
@@ -432,7 +670,9 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_worldRoot ) {
+		SV_AreaEntities_r( sv_worldRoot, &ap );
+	}
 
 	return ap.count;
 }
@@ -503,17 +743,14 @@ SV_ClipMoveToEntities
 
 ====================
 */
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
-	int			i, num;
-	int			touchlist[MAX_GENTITIES];
+static void SV_ClipMoveToEntities( moveclip_t *clip, const int *touchlist, int num ) {
+	int			i;
 	sharedEntity_t *touch;
 	int			passOwnerNum;
 	trace_t		trace;
 	clipHandle_t	clipHandle;
 	float		*origin, *angles;
 
-	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
-
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
 		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
 		if ( passOwnerNum == ENTITYNUM_NONE ) {
@@ -585,6 +822,270 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 }
 
 
+/*
+==================
+SV_SetupClip
+
+Sets up clip for the move from its trace against the world,
+returns qfalse if the world blocks it immediately
+==================
+*/
+static qboolean SV_SetupClip( moveclip_t *clip, const trace_t *worldTrace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	int			i;
+
+	Com_Memset ( clip, 0, sizeof ( moveclip_t ) );
+
+	clip->trace = *worldTrace;
+	clip->trace.entityNum = clip->trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+	if ( clip->trace.fraction == 0 ) {
+		return qfalse;		// blocked immediately by the world
+	}
+
+	clip->contentmask = contentmask;
+	clip->start = start;
+//	VectorCopy( clip->trace.endpos, clip->end );
+	VectorCopy( end, clip->end );
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->passEntityNum = passEntityNum;
+	clip->capsule = capsule;
+
+	// create the bounding box of the entire move
+	// we can limit it to the part of the move not
+	// already clipped off by the world, which can be
+	// a significant savings for line of sight and shot traces
+	for ( i=0 ; i<3 ; i++ ) {
+		if ( end[i] > start[i] ) {
+			clip->boxmins[i] = clip->start[i] + clip->mins[i] - 1;
+			clip->boxmaxs[i] = clip->end[i] + clip->maxs[i] + 1;
+		} else {
+			clip->boxmins[i] = clip->end[i] + clip->mins[i] - 1;
+			clip->boxmaxs[i] = clip->start[i] + clip->maxs[i] + 1;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+==================
+SV_ClipMoveToWorld
+
+Sets up clip for the move and traces it against the world,
+returns qfalse if the world blocks it immediately
+==================
+*/
+static qboolean SV_ClipMoveToWorld( moveclip_t *clip, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	trace_t		trace;
+
+	// clip to world
+	CM_BoxTrace( &trace, start, end, (float *)mins, (float *)maxs, 0, contentmask, capsule );
+	return SV_SetupClip( clip, &trace, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+}
+
+
+/*
+============================================================================
+
+TRACE CACHE
+
+With sv_traceCache set, SV_Trace results are remembered until an entity is
+linked or unlinked across the bounds of their move or the game runs another
+frame, so game and bot code
+repeating a trace in between (several bots checking the same target, ...)
+gets it for free.  Game code that changes the contents or owner of an entity
+without linking it again would see stale results, so it is off by default.
+syscallstats shows the hit rate.
+============================================================================
+*/
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+} traceKey_t;
+
+typedef struct {
+	traceKey_t	key;
+	unsigned int	generation;		// entry is only valid for this generation
+	vec3_t		boxmins, boxmaxs;	// bounds of the entire move
+	trace_t		trace;
+} traceCacheEntry_t;
+
+#define	TRACE_CACHE_SIZE	512		// must be a power of two
+
+static traceCacheEntry_t	sv_traceCacheEntries[TRACE_CACHE_SIZE];
+static unsigned int		sv_traceCacheGeneration = 1;
+
+// the entries valid in this generation, so an invalidation doesn't have
+// to look at the whole cache
+static int		sv_traceCacheValid[TRACE_CACHE_SIZE];
+static int		sv_numTraceCacheValid;
+
+
+/*
+==================
+SV_FlushTraceCache
+==================
+*/
+void SV_FlushTraceCache( void ) {
+	sv_numTraceCacheValid = 0;
+
+	// after a wrap entries from long ago could match the generation again
+	if ( ++sv_traceCacheGeneration == 0 ) {
+		Com_Memset( sv_traceCacheEntries, 0, sizeof( sv_traceCacheEntries ) );
+		sv_traceCacheGeneration = 1;
+	}
+}
+
+/*
+==================
+SV_InvalidateTraceCache
+
+Drops the entries whose move bounds touch the box
+==================
+*/
+void SV_InvalidateTraceCache( const vec3_t mins, const vec3_t maxs ) {
+	traceCacheEntry_t	*entry;
+	int					i;
+
+	for ( i = 0 ; i < sv_numTraceCacheValid ; i++ ) {
+		entry = &sv_traceCacheEntries[ sv_traceCacheValid[i] ];
+		if ( mins[0] > entry->boxmaxs[0]
+			|| mins[1] > entry->boxmaxs[1]
+			|| mins[2] > entry->boxmaxs[2]
+			|| maxs[0] < entry->boxmins[0]
+			|| maxs[1] < entry->boxmins[1]
+			|| maxs[2] < entry->boxmins[2] ) {
+			continue;
+		}
+
+		entry->generation = 0;
+		sv_traceCacheValid[i] = sv_traceCacheValid[--sv_numTraceCacheValid];
+		i--;
+	}
+}
+
+/*
+===============================================================================
+
+TRACE LOG
+
+===============================================================================
+*/
+
+static fileHandle_t	sv_traceLog;
+static int			sv_traceLogRecords;
+
+/*
+==================
+SV_StopTraceLog
+==================
+*/
+void SV_StopTraceLog( void ) {
+	if ( !sv_traceLog ) {
+		return;
+	}
+
+	FS_FCloseFile( sv_traceLog );
+	sv_traceLog = 0;
+	Com_Printf( "trace log stopped, %i records\n", sv_traceLogRecords );
+}
+
+/*
+==================
+SV_TraceLog_f
+
+tracelog <file> writes every SV_Trace and SV_PointContents call to a .tlog
+file that cmbench can replay, tracelog without arguments stops logging
+==================
+*/
+void SV_TraceLog_f( void ) {
+	tlogHeader_t	header;
+	char			name[MAX_QPATH];
+
+	SV_StopTraceLog();
+
+	if ( Cmd_Argc() < 2 ) {
+		return;
+	}
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	Q_strncpyz( name, Cmd_Argv( 1 ), sizeof( name ) );
+	COM_DefaultExtension( name, sizeof( name ), ".tlog" );
+
+	sv_traceLog = FS_FOpenFileWrite( name );
+	if ( !sv_traceLog ) {
+		Com_Printf( "Couldn't open %s\n", name );
+		return;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = LittleLong( TLOG_IDENT );
+	header.version = LittleLong( TLOG_VERSION );
+	header.checksum = LittleLong( sv_mapChecksum->integer );
+	Q_strncpyz( header.mapname, sv_mapname->string, sizeof( header.mapname ) );
+	FS_Write( &header, sizeof( header ), sv_traceLog );
+
+	sv_traceLogRecords = 0;
+	Com_Printf( "logging traces to %s\n", name );
+}
+
+/*
+==================
+SV_LogTrace
+==================
+*/
+static void SV_LogTrace( tlogType_t type, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end,
+	int passEntityNum, int contentmask, int capsule ) {
+	tlogRecord_t	record;
+	int				i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		record.start[i] = LittleFloat( start[i] );
+		record.end[i] = LittleFloat( end[i] );
+		record.mins[i] = LittleFloat( mins[i] );
+		record.maxs[i] = LittleFloat( maxs[i] );
+	}
+	record.type = LittleLong( type );
+	record.passEntityNum = LittleLong( passEntityNum );
+	record.contentmask = LittleLong( contentmask );
+	record.capsule = LittleLong( capsule );
+
+	FS_Write( &record, sizeof( record ), sv_traceLog );
+	sv_traceLogRecords++;
+}
+
+/*
+==================
+SV_TraceCacheEntry
+
+Returns the slot for a trace key
+==================
+*/
+static traceCacheEntry_t *SV_TraceCacheEntry( const traceKey_t *key ) {
+	const unsigned int	*p;
+	unsigned int		hash;
+	int					i;
+
+	// FNV-1a over the words of the key
+	p = (const unsigned int *)key;
+	hash = 2166136261u;
+	for ( i = 0 ; i < sizeof( *key ) / 4 ; i++ ) {
+		hash = ( hash ^ p[i] ) * 16777619u;
+	}
+	hash ^= hash >> 16;
+
+	return &sv_traceCacheEntries[ hash & ( TRACE_CACHE_SIZE - 1 ) ];
+}
+
+
 /*
 ==================
 SV_Trace
@@ -595,6 +1096,10 @@ passEntityNum and entities owned by passEntityNum are explicitly not checked.
 */
 void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
 	moveclip_t	clip;
+	int			touchlist[MAX_GENTITIES];
+	int			num;
+	traceKey_t	key;
+	traceCacheEntry_t	*entry;
 	int			i;
 
 	if ( !mins ) {
@@ -604,43 +1109,189 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 		maxs = vec3_origin;
 	}
 
-	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
-
-	// clip to world
-	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
-	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if ( clip.trace.fraction == 0 ) {
-		*results = clip.trace;
-		return;		// blocked immediately by the world
-	}
-
-	clip.contentmask = contentmask;
-	clip.start = start;
-//	VectorCopy( clip.trace.endpos, clip.end );
-	VectorCopy( end, clip.end );
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.passEntityNum = passEntityNum;
-	clip.capsule = capsule;
+	// the log and the cache belong to the main thread
+	if ( sv_traceLog && !sv_threadSlot ) {
+		SV_LogTrace( TLOG_TRACE, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	}
 
-	// create the bounding box of the entire move
-	// we can limit it to the part of the move not
-	// already clipped off by the world, which can be
-	// a significant savings for line of sight and shot traces
-	for ( i=0 ; i<3 ; i++ ) {
-		if ( end[i] > start[i] ) {
-			clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
-		} else {
-			clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
+	entry = NULL;
+	if ( sv_traceCache->integer && !sv_threadSlot ) {
+		VectorCopy( start, key.start );
+		VectorCopy( end, key.end );
+		VectorCopy( mins, key.mins );
+		VectorCopy( maxs, key.maxs );
+		key.passEntityNum = passEntityNum;
+		key.contentmask = contentmask;
+		key.capsule = capsule;
+
+		entry = SV_TraceCacheEntry( &key );
+		if ( entry->generation == sv_traceCacheGeneration
+			&& !memcmp( &entry->key, &key, sizeof( key ) ) ) {
+			sv.traceCacheHits++;
+			*results = entry->trace;
+			return;
 		}
+		sv.traceCacheMisses++;
 	}
 
-	// clip to other solid entities
-	SV_ClipMoveToEntities ( &clip );
+	if ( SV_ClipMoveToWorld( &clip, start, mins, maxs, end, passEntityNum, contentmask, capsule ) ) {
+		// clip to other solid entities
+		num = SV_AreaEntities( clip.boxmins, clip.boxmaxs, touchlist, MAX_GENTITIES );
+		SV_ClipMoveToEntities( &clip, touchlist, num );
+	}
 
 	*results = clip.trace;
+
+	if ( entry ) {
+		if ( entry->generation != sv_traceCacheGeneration ) {
+			sv_traceCacheValid[sv_numTraceCacheValid++] = entry - sv_traceCacheEntries;
+		}
+		entry->key = key;
+		entry->generation = sv_traceCacheGeneration;
+		entry->trace = clip.trace;
+
+		// the same bounds SV_SetupClip checks the entities in
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( end[i] > start[i] ) {
+				entry->boxmins[i] = start[i] + mins[i] - 1;
+				entry->boxmaxs[i] = end[i] + maxs[i] + 1;
+			} else {
+				entry->boxmins[i] = end[i] + mins[i] - 1;
+				entry->boxmaxs[i] = start[i] + maxs[i] + 1;
+			}
+		}
+	}
+}
+
+
+// scratch of SV_TraceBatch, one for every thread that can trace
+typedef struct {
+	vec3_t		starts[MAX_TRACE_BATCH], ends[MAX_TRACE_BATCH];
+	moveclip_t	clips[MAX_TRACE_BATCH];
+	trace_t		worldTraces[MAX_TRACE_BATCH];
+	qboolean	moving[MAX_TRACE_BATCH];
+	vec3_t		absmins[MAX_GENTITIES], absmaxs[MAX_GENTITIES];
+	int			touchlist[MAX_GENTITIES];
+	int			cliplist[MAX_GENTITIES];
+} traceBatchWork_t;
+
+static traceBatchWork_t	sv_traceBatchWork[CM_MAX_THREADS];
+
+/*
+==================
+SV_TraceBatchWorld
+
+Traces the requests against the world, runs of requests with the same
+box, contents and capsule flag go through CM_TraceBatch together
+==================
+*/
+static void SV_TraceBatchWorld( traceBatchWork_t *work, const traceRequest_t *requests, trace_t *results, int numTraces ) {
+	const traceRequest_t *req, *first;
+	int			i, j;
+
+	for ( i = 0 ; i < numTraces ; i = j ) {
+		first = &requests[i];
+		for ( j = i ; j < numTraces ; j++ ) {
+			req = &requests[j];
+			if ( !VectorCompare( req->mins, first->mins ) || !VectorCompare( req->maxs, first->maxs )
+				|| req->contentmask != first->contentmask || req->capsule != first->capsule ) {
+				break;
+			}
+			VectorCopy( req->start, work->starts[j - i] );
+			VectorCopy( req->end, work->ends[j - i] );
+		}
+
+		CM_TraceBatch( &results[i], (const vec3_t *)work->starts, (const vec3_t *)work->ends, j - i,
+			(float *)first->mins, (float *)first->maxs, 0, first->contentmask, first->capsule );
+	}
+}
+
+/*
+==================
+SV_TraceBatch
+
+Traces every request against the world first, runs of requests that
+share a box are walked through the tree together, then gathers the entities
+for the bounds of all moves that got past it once and hands each move the
+part of that list its own box reaches.  SV_AreaEntities returns the
+entities of a smaller box in the same order, so the results match single
+traces.
+==================
+*/
+void SV_TraceBatch( const traceRequest_t *requests, trace_t *results, int numTraces ) {
+	traceBatchWork_t	*work;
+	moveclip_t	*clips;
+	qboolean	*moving;
+	vec3_t		*absmins, *absmaxs;
+	int			*touchlist, *cliplist;
+	vec3_t		mins, maxs;
+	int			i, j, num, numClip, numMoving;
+	const traceRequest_t *req;
+	moveclip_t	*clip;
+	sharedEntity_t *touch;
+
+	if ( numTraces > MAX_TRACE_BATCH ) {
+		Com_Error( ERR_DROP, "SV_TraceBatch: %i traces", numTraces );
+	}
+
+	work = &sv_traceBatchWork[sv_threadSlot];
+	clips = work->clips;
+	moving = work->moving;
+	absmins = work->absmins;
+	absmaxs = work->absmaxs;
+	touchlist = work->touchlist;
+	cliplist = work->cliplist;
+
+	SV_TraceBatchWorld( work, requests, work->worldTraces, numTraces );
+
+	ClearBounds( mins, maxs );
+	numMoving = 0;
+
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		req = &requests[i];
+		if ( sv_traceLog && !sv_threadSlot ) {
+			SV_LogTrace( TLOG_TRACE, req->start, req->mins, req->maxs, req->end,
+				req->passEntityNum, req->contentmask, req->capsule );
+		}
+		moving[i] = SV_SetupClip( &clips[i], &work->worldTraces[i], req->start, req->mins, req->maxs, req->end,
+			req->passEntityNum, req->contentmask, req->capsule );
+		if ( moving[i] ) {
+			AddPointToBounds( clips[i].boxmins, mins, maxs );
+			AddPointToBounds( clips[i].boxmaxs, mins, maxs );
+			numMoving++;
+		}
+	}
+
+	num = numMoving ? SV_AreaEntities( mins, maxs, touchlist, MAX_GENTITIES ) : 0;
+
+	// keep the bounds together so the per move filtering
+	// doesn't have to touch the entities
+	for ( i = 0 ; i < num ; i++ ) {
+		touch = SV_GentityNum( touchlist[i] );
+		VectorCopy( touch->r.absmin, absmins[i] );
+		VectorCopy( touch->r.absmax, absmaxs[i] );
+	}
+
+	for ( i = 0 ; i < numTraces ; i++ ) {
+		clip = &clips[i];
+		if ( moving[i] ) {
+			// the same test SV_AreaEntities does
+			for ( j = numClip = 0 ; j < num ; j++ ) {
+				if ( absmins[j][0] > clip->boxmaxs[0]
+					|| absmins[j][1] > clip->boxmaxs[1]
+					|| absmins[j][2] > clip->boxmaxs[2]
+					|| absmaxs[j][0] < clip->boxmins[0]
+					|| absmaxs[j][1] < clip->boxmins[1]
+					|| absmaxs[j][2] < clip->boxmins[2] ) {
+					continue;
+				}
+				cliplist[numClip++] = touchlist[j];
+			}
+
+			SV_ClipMoveToEntities( clip, cliplist, numClip );
+		}
+		results[i] = clip->trace;
+	}
 }
 
 
@@ -658,6 +1309,10 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 	clipHandle_t	clipHandle;
 	float		*angles;
 
+	if ( sv_traceLog && !sv_threadSlot ) {
+		SV_LogTrace( TLOG_POINTCONTENTS, p, vec3_origin, vec3_origin, p, passEntityNum, 0, qfalse );
+	}
+
 	// get base contents from world
 	contents = CM_PointContents( p, 0 );
 
@@ -619,6 +619,18 @@ void *Sys_LoadGameDll(const char *name,
 	return libHandle;
 }
 
+/*
+=================
+Sys_LoadGameDllFunction
+
+Looks up an optional export of a dll loaded by Sys_LoadGameDll
+=================
+*/
+void *Sys_LoadGameDllFunction( void *dllHandle, const char *name )
+{
+	return Sys_LoadFunction( dllHandle, name );
+}
+
 /*
 =================
 Sys_ParseArgs
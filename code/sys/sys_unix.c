@@ -33,11 +33,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <pwd.h>
 #include <libgen.h>
 #include <fcntl.h>
 #include <fenv.h>
 #include <sys/wait.h>
+#include <pthread.h>
 
 qboolean stdinIsATTY;
 
@@ -152,6 +154,135 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Nanoseconds
+================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tp;
+
+	gettimeofday( &tp, NULL );
+	return (int64_t)tp.tv_sec * 1000000000 + (int64_t)tp.tv_usec * 1000;
+#endif
+}
+
+/*
+==============================================================================
+
+WORKER THREADS
+
+The workers are started the first time they are needed and then wait for
+the next Sys_RunThreads, so running a job costs a wakeup instead of a
+thread creation.
+
+==============================================================================
+*/
+
+static pthread_mutex_t	sys_workLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	sys_workStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	sys_workDone = PTHREAD_COND_INITIALIZER;
+
+static int		sys_numWorkers;				// func( 1 ) .. func( sys_numWorkers )
+static int		sys_workJob;				// bumped for every Sys_RunThreads
+static int		sys_workCount;				// threads taking part in the job
+static int		sys_workPending;			// workers that haven't finished it
+static void		(*sys_workFunc)( int thread );
+
+/*
+================
+Sys_WorkerMain
+================
+*/
+static void *Sys_WorkerMain( void *arg )
+{
+	int		thread = (int)(intptr_t)arg;
+	int		job = 0;
+
+	pthread_mutex_lock( &sys_workLock );
+	for ( ;; ) {
+		while ( sys_workJob == job ) {
+			pthread_cond_wait( &sys_workStart, &sys_workLock );
+		}
+		job = sys_workJob;
+
+		if ( thread < sys_workCount ) {
+			pthread_mutex_unlock( &sys_workLock );
+			sys_workFunc( thread );
+			pthread_mutex_lock( &sys_workLock );
+
+			if ( --sys_workPending == 0 ) {
+				pthread_cond_signal( &sys_workDone );
+			}
+		}
+	}
+	return NULL;
+}
+
+/*
+================
+Sys_RunThreads
+
+Runs func( 0 ) on the calling thread and func( 1 ) .. func( count - 1 )
+on the worker threads, and returns when all of them have returned.  If
+a worker can't be started, the calls that need it run on the calling
+thread afterwards.
+================
+*/
+void Sys_RunThreads( int count, void (*func)( int thread ) )
+{
+	pthread_t	handle;
+	int			i, workers;
+
+	if ( count > MAX_SYS_THREADS ) {
+		count = MAX_SYS_THREADS;
+	}
+
+	while ( sys_numWorkers < count - 1 ) {
+		if ( pthread_create( &handle, NULL, Sys_WorkerMain, (void *)(intptr_t)( sys_numWorkers + 1 ) ) ) {
+			break;
+		}
+		pthread_detach( handle );
+		sys_numWorkers++;
+	}
+
+	workers = count - 1;
+	if ( workers > sys_numWorkers ) {
+		workers = sys_numWorkers;
+	}
+
+	if ( workers > 0 ) {
+		pthread_mutex_lock( &sys_workLock );
+		sys_workFunc = func;
+		sys_workCount = workers + 1;
+		sys_workPending = workers;
+		sys_workJob++;
+		pthread_cond_broadcast( &sys_workStart );
+		pthread_mutex_unlock( &sys_workLock );
+	}
+
+	func( 0 );
+
+	for ( i = workers + 1 ; i < count ; i++ ) {
+		func( i );
+	}
+
+	if ( workers > 0 ) {
+		pthread_mutex_lock( &sys_workLock );
+		while ( sys_workPending ) {
+			pthread_cond_wait( &sys_workDone, &sys_workLock );
+		}
+		pthread_mutex_unlock( &sys_workLock );
+	}
+}
+
 /*
 ==================
 Sys_RandomBytes
@@ -206,6 +337,61 @@ qboolean Sys_LowPhysicalMemory( void )
 	return qfalse;
 }
 
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/*
+==================
+Sys_ReserveMemory
+
+Reserve address space without backing it with memory
+==================
+*/
+void *Sys_ReserveMemory( size_t size )
+{
+	void *ptr = mmap( NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0 );
+
+	if( ptr == MAP_FAILED )
+		return NULL;
+
+	return ptr;
+}
+
+/*
+==================
+Sys_CommitMemory
+==================
+*/
+qboolean Sys_CommitMemory( void *ptr, size_t size )
+{
+	return mprotect( ptr, size, PROT_READ | PROT_WRITE ) == 0 ? qtrue : qfalse;
+}
+
+/*
+==================
+Sys_DecommitMemory
+
+Give the pages back to the system, the range stays reserved
+==================
+*/
+void Sys_DecommitMemory( void *ptr, size_t size )
+{
+	mmap( ptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE | MAP_FIXED, -1, 0 );
+}
+
+/*
+==================
+Sys_ReleaseMemory
+
+Unmap a whole range returned by Sys_ReserveMemory
+==================
+*/
+void Sys_ReleaseMemory( void *ptr, size_t size )
+{
+	munmap( ptr, size );
+}
+
 /*
 ==================
 Sys_Basename
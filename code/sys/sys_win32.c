@@ -242,6 +242,127 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Nanoseconds
+================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+
+	// split to keep the multiplication from overflowing
+	return ( counter.QuadPart / frequency.QuadPart ) * 1000000000
+		+ ( counter.QuadPart % frequency.QuadPart ) * 1000000000 / frequency.QuadPart;
+}
+
+/*
+==============================================================================
+
+WORKER THREADS
+
+The workers are started the first time they are needed and then wait for
+the next Sys_RunThreads, so running a job costs a wakeup instead of a
+thread creation.
+
+==============================================================================
+*/
+
+static HANDLE	sys_workStart[MAX_SYS_THREADS];	// auto reset, one per worker
+static HANDLE	sys_workDone;					// set by the last worker to finish
+
+static int		sys_numWorkers;				// func( 1 ) .. func( sys_numWorkers )
+static volatile LONG	sys_workPending;	// workers that haven't finished the job
+static void		(*sys_workFunc)( int thread );
+
+/*
+================
+Sys_WorkerMain
+================
+*/
+static DWORD WINAPI Sys_WorkerMain( LPVOID arg )
+{
+	int		thread = (int)(intptr_t)arg;
+
+	for ( ;; ) {
+		WaitForSingleObject( sys_workStart[thread], INFINITE );
+		sys_workFunc( thread );
+		if ( InterlockedDecrement( &sys_workPending ) == 0 ) {
+			SetEvent( sys_workDone );
+		}
+	}
+	return 0;
+}
+
+/*
+================
+Sys_RunThreads
+
+Runs func( 0 ) on the calling thread and func( 1 ) .. func( count - 1 )
+on the worker threads, and returns when all of them have returned.  If
+a worker can't be started, the calls that need it run on the calling
+thread afterwards.
+================
+*/
+void Sys_RunThreads( int count, void (*func)( int thread ) )
+{
+	HANDLE		handle;
+	int			i, workers;
+
+	if ( count > MAX_SYS_THREADS ) {
+		count = MAX_SYS_THREADS;
+	}
+
+	if ( !sys_workDone ) {
+		sys_workDone = CreateEvent( NULL, FALSE, FALSE, NULL );
+	}
+
+	while ( sys_workDone && sys_numWorkers < count - 1 ) {
+		i = sys_numWorkers + 1;
+		sys_workStart[i] = CreateEvent( NULL, FALSE, FALSE, NULL );
+		if ( !sys_workStart[i] ) {
+			break;
+		}
+		handle = CreateThread( NULL, 0, Sys_WorkerMain, (LPVOID)(intptr_t)i, 0, NULL );
+		if ( !handle ) {
+			CloseHandle( sys_workStart[i] );
+			sys_workStart[i] = NULL;
+			break;
+		}
+		CloseHandle( handle );
+		sys_numWorkers++;
+	}
+
+	workers = count - 1;
+	if ( workers > sys_numWorkers ) {
+		workers = sys_numWorkers;
+	}
+
+	if ( workers > 0 ) {
+		sys_workFunc = func;
+		sys_workPending = workers;
+		for ( i = 1 ; i <= workers ; i++ ) {
+			SetEvent( sys_workStart[i] );
+		}
+	}
+
+	func( 0 );
+
+	for ( i = workers + 1 ; i < count ; i++ ) {
+		func( i );
+	}
+
+	if ( workers > 0 ) {
+		WaitForSingleObject( sys_workDone, INFINITE );
+	}
+}
+
 /*
 ================
 Sys_RandomBytes
@@ -300,6 +421,52 @@ qboolean Sys_LowPhysicalMemory( void )
 	return (stat.dwTotalPhys <= MEM_THRESHOLD) ? qtrue : qfalse;
 }
 
+/*
+==================
+Sys_ReserveMemory
+
+Reserve address space without backing it with memory
+==================
+*/
+void *Sys_ReserveMemory( size_t size )
+{
+	return VirtualAlloc( NULL, size, MEM_RESERVE, PAGE_NOACCESS );
+}
+
+/*
+==================
+Sys_CommitMemory
+==================
+*/
+qboolean Sys_CommitMemory( void *ptr, size_t size )
+{
+	return VirtualAlloc( ptr, size, MEM_COMMIT, PAGE_READWRITE ) != NULL ? qtrue : qfalse;
+}
+
+/*
+==================
+Sys_DecommitMemory
+
+Give the pages back to the system, the range stays reserved
+==================
+*/
+void Sys_DecommitMemory( void *ptr, size_t size )
+{
+	VirtualFree( ptr, size, MEM_DECOMMIT );
+}
+
+/*
+==================
+Sys_ReleaseMemory
+
+Free a whole range returned by Sys_ReserveMemory
+==================
+*/
+void Sys_ReleaseMemory( void *ptr, size_t size )
+{
+	VirtualFree( ptr, 0, MEM_RELEASE );
+}
+
 /*
 ==============
 Sys_Basename
@@ -0,0 +1,1128 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// qvm2c.c -- translate a finished qvm into sandboxed C
+//
+// The output is built into a shared object that the engine loads like a
+// native module. It keeps the memory model of the qvm: all loads and stores
+// go through the data segment of the qvm with the same dataMask as the
+// interpreter, pointers passed to syscalls stay vm addresses and the engine
+// masks them like for bytecode. Every procedure becomes a C function, the
+// opStack is resolved into locals at translation time.
+
+#include "../../qcommon/q_platform.h"
+#include "cmdlib.h"
+#include "mathlib.h"
+#include "../../qcommon/qfiles.h"
+
+// don't change, has to match vm_local.h and q3asm
+#define	PROGRAM_STACK_SIZE	0x10000
+#define	MAX_VMMAIN_ARGS		13
+#define	MAX_VMSYSCALL_ARGS	16
+
+typedef enum {
+	OP_UNDEF,
+
+	OP_IGNORE,
+
+	OP_BREAK,
+
+	OP_ENTER,
+	OP_LEAVE,
+	OP_CALL,
+	OP_PUSH,
+	OP_POP,
+
+	OP_CONST,
+	OP_LOCAL,
+
+	OP_JUMP,
+
+	//-------------------
+
+	OP_EQ,
+	OP_NE,
+
+	OP_LTI,
+	OP_LEI,
+	OP_GTI,
+	OP_GEI,
+
+	OP_LTU,
+	OP_LEU,
+	OP_GTU,
+	OP_GEU,
+
+	OP_EQF,
+	OP_NEF,
+
+	OP_LTF,
+	OP_LEF,
+	OP_GTF,
+	OP_GEF,
+
+	//-------------------
+
+	OP_LOAD1,
+	OP_LOAD2,
+	OP_LOAD4,
+	OP_STORE1,
+	OP_STORE2,
+	OP_STORE4,				// *(stack[top-1]) = stack[top]
+	OP_ARG,
+
+	OP_BLOCK_COPY,
+
+	//-------------------
+
+	OP_SEX8,
+	OP_SEX16,
+
+	OP_NEGI,
+	OP_ADD,
+	OP_SUB,
+	OP_DIVI,
+	OP_DIVU,
+	OP_MODI,
+	OP_MODU,
+	OP_MULI,
+	OP_MULU,
+
+	OP_BAND,
+	OP_BOR,
+	OP_BXOR,
+	OP_BCOM,
+
+	OP_LSH,
+	OP_RSHI,
+	OP_RSHU,
+
+	OP_NEGF,
+	OP_ADDF,
+	OP_SUBF,
+	OP_DIVF,
+	OP_MULF,
+
+	OP_CVIF,
+	OP_CVFI
+} opcode_t;
+
+typedef struct {
+	int		op;
+	int		value;
+	int		depth;			// opStack entries before the instruction, -1 if unreachable
+	int		proc;			// index of the procedure containing it
+	qboolean	target;		// needs a label
+	qboolean	constTarget;	// JUMP or CALL whose target is the preceding CONST
+} instruction_t;
+
+typedef struct {
+	int		start;			// instruction number of the OP_ENTER
+	int		end;
+	int		frame;
+	int		maxDepth;
+	qboolean	computedJump;
+	char	*name;
+} procedure_t;
+
+static vmHeader_t	header;
+static byte			*qvmData;
+static int			dataSize;		// data, lit and bss rounded up to a power of two
+
+static instruction_t	*code;
+static int			numInstructions;
+
+static procedure_t	*procs;
+static int			numProcs;
+
+// from the VM_MAGIC_VER2 jump table section, q3asm lists every address of a
+// local label there, which includes string literals
+static byte			*jumpTarget;
+static int			numJumpTargets;
+
+static FILE			*out;
+
+static struct {
+	char	*mapFile;
+	char	*outputFile;
+} options;
+
+
+static int ReadLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned)p[3] << 24 );
+}
+
+/*
+=============
+LoadQVM
+=============
+*/
+static void LoadQVM( const char *filename ) {
+	byte	*buffer;
+	byte	*p, *codeEnd;
+	int		length;
+	int		i;
+
+	length = LoadFile( filename, (void **)&buffer );
+	if ( length < (int)sizeof( vmHeader_t ) - (int)sizeof( int ) ) {
+		Error( "%s is too short", filename );
+	}
+
+	header.vmMagic = ReadLong( buffer );
+	header.instructionCount = ReadLong( buffer + 4 );
+	header.codeOffset = ReadLong( buffer + 8 );
+	header.codeLength = ReadLong( buffer + 12 );
+	header.dataOffset = ReadLong( buffer + 16 );
+	header.dataLength = ReadLong( buffer + 20 );
+	header.litLength = ReadLong( buffer + 24 );
+	header.bssLength = ReadLong( buffer + 28 );
+	header.jtrgLength = 0;
+
+	if ( header.vmMagic == VM_MAGIC_VER2 ) {
+		header.jtrgLength = ReadLong( buffer + 32 ) & ~3;
+	} else if ( header.vmMagic != VM_MAGIC ) {
+		Error( "%s is not a qvm", filename );
+	}
+
+	if ( header.instructionCount <= 0 || header.codeLength <= 0
+		|| header.dataLength < 0 || header.litLength < 0 || header.bssLength < 0
+		|| header.jtrgLength < 0 || ( header.dataLength & 3 )
+		|| header.codeOffset < 0 || header.codeOffset + header.codeLength > length
+		|| header.dataOffset < 0 || header.dataOffset + header.dataLength
+			+ header.litLength + header.jtrgLength > length ) {
+		Error( "%s has a bad header", filename );
+	}
+
+	// same rounding as VM_LoadQVM, so the dataMask matches the interpreter
+	for ( dataSize = 1 ; dataSize < header.dataLength + header.litLength + header.bssLength ; dataSize <<= 1 ) {
+	}
+	if ( dataSize < PROGRAM_STACK_SIZE * 2 ) {
+		Error( "%s has a data segment of only %i bytes", filename, dataSize );
+	}
+
+	qvmData = buffer + header.dataOffset;
+
+	// decode the instructions, the operand sizes are the ones of VM_PrepareInterpreter
+	numInstructions = header.instructionCount;
+	code = calloc( numInstructions, sizeof( *code ) );
+
+	numJumpTargets = header.jtrgLength / 4;
+	jumpTarget = calloc( numInstructions, 1 );
+	for ( i = 0 ; i < numJumpTargets ; i++ ) {
+		int		target = ReadLong( qvmData + header.dataLength + header.litLength + i * 4 );
+
+		if ( target >= 0 && target < numInstructions ) {
+			jumpTarget[target] = 1;
+		}
+	}
+
+	p = buffer + header.codeOffset;
+	codeEnd = p + header.codeLength;
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( p >= codeEnd ) {
+			Error( "instruction %i lies outside the code segment", i );
+		}
+
+		code[i].op = *p++;
+		code[i].depth = -1;
+
+		switch ( code[i].op ) {
+		case OP_ENTER:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_LEAVE:
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+		case OP_BLOCK_COPY:
+			if ( p + 4 > codeEnd ) {
+				Error( "operand of instruction %i lies outside the code segment", i );
+			}
+			code[i].value = ReadLong( p );
+			p += 4;
+			break;
+		case OP_ARG:
+			if ( p >= codeEnd ) {
+				Error( "operand of instruction %i lies outside the code segment", i );
+			}
+			code[i].value = *p++;
+			break;
+		default:
+			if ( code[i].op > OP_CVFI ) {
+				Error( "bad opcode %i at instruction %i", code[i].op, i );
+			}
+			break;
+		}
+	}
+}
+
+/*
+=============
+FindProcedures
+
+Every OP_ENTER starts a procedure that lasts until the next one
+=============
+*/
+static void FindProcedures( void ) {
+	int		i, n;
+
+	if ( code[0].op != OP_ENTER ) {
+		Error( "instruction 0 is not OP_ENTER" );
+	}
+
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( code[i].op == OP_ENTER ) {
+			numProcs++;
+		}
+	}
+
+	procs = calloc( numProcs, sizeof( *procs ) );
+
+	for ( i = 0, n = -1 ; i < numInstructions ; i++ ) {
+		if ( code[i].op == OP_ENTER ) {
+			if ( n >= 0 ) {
+				procs[n].end = i;
+			}
+			n++;
+			procs[n].start = i;
+			procs[n].frame = code[i].value;
+		}
+		code[i].proc = n;
+	}
+	procs[n].end = numInstructions;
+}
+
+/*
+=============
+ReadMapFile
+
+Procedure names from the map file written by q3asm -m, they only make the
+output and native profiles easier to read
+=============
+*/
+static void ReadMapFile( const char *filename ) {
+	FILE	*f;
+	char	name[1024];
+	int		seg, value;
+	int		i, n;
+
+	f = SafeOpenRead( filename );
+	while ( fscanf( f, "%i %x %1023s", &seg, &value, name ) == 3 ) {
+		if ( seg != 0 || value < 0 || value >= numInstructions ) {
+			continue;	// not in the code segment
+		}
+		if ( code[value].op != OP_ENTER || procs[code[value].proc].name ) {
+			continue;
+		}
+		for ( i = 0 ; name[i] ; i++ ) {
+			if ( !isalnum( (byte)name[i] ) && name[i] != '_' ) {
+				break;
+			}
+		}
+		if ( name[i] ) {
+			continue;
+		}
+		procs[code[value].proc].name = copystring( name );
+	}
+	fclose( f );
+
+	// static functions of different files may share a name
+	for ( n = 0 ; n < numProcs ; n++ ) {
+		if ( !procs[n].name ) {
+			continue;
+		}
+		for ( i = n + 1 ; i < numProcs ; i++ ) {
+			if ( procs[i].name && !strcmp( procs[i].name, procs[n].name ) ) {
+				free( procs[i].name );
+				procs[i].name = NULL;
+			}
+		}
+	}
+}
+
+static const char *ProcName( int n ) {
+	static char	buffer[2][1100];
+	static int	index;
+
+	index ^= 1;
+	if ( procs[n].name ) {
+		sprintf( buffer[index], "vm_%s", procs[n].name );
+	} else {
+		sprintf( buffer[index], "vm_%i", procs[n].start );
+	}
+	return buffer[index];
+}
+
+/*
+=============
+MarkTargets
+
+Targets of branches and of jumps whose address is a constant
+=============
+*/
+static void MarkTargets( void ) {
+	int		i, target;
+
+	for ( i = 0 ; i < numInstructions ; i++ ) {
+		if ( code[i].op >= OP_EQ && code[i].op <= OP_GEF ) {
+			target = code[i].value;
+			if ( target < 0 || target >= numInstructions || code[target].proc != code[i].proc ) {
+				Error( "branch at instruction %i leaves its procedure", i );
+			}
+			code[target].target = qtrue;
+		} else if ( code[i].op == OP_JUMP && i > 0 && code[i - 1].op == OP_CONST ) {
+			target = code[i - 1].value;
+			if ( target < 0 || target >= numInstructions || code[target].proc != code[i].proc ) {
+				Error( "jump at instruction %i leaves its procedure", i );
+			}
+			code[target].target = qtrue;
+		}
+	}
+
+	// a constant only decides the target if nothing else flows in between
+	for ( i = 1 ; i < numInstructions ; i++ ) {
+		if ( ( code[i].op == OP_JUMP || code[i].op == OP_CALL )
+			&& code[i - 1].op == OP_CONST && !code[i].target ) {
+			code[i].constTarget = qtrue;
+		}
+	}
+}
+
+/*
+=============
+SetDepth
+=============
+*/
+static void SetDepth( int i, int depth, int *work, int *numWork ) {
+	if ( i >= procs[code[i].proc].end ) {
+		return;
+	}
+	if ( code[i].depth == depth ) {
+		return;
+	}
+	if ( code[i].depth != -1 ) {
+		Error( "opStack depth %i and %i meet at instruction %i", code[i].depth, depth, i );
+	}
+	code[i].depth = depth;
+	work[( *numWork )++] = i;
+}
+
+/*
+=============
+AnalyzeProcedure
+
+Statically determines the opStack depth at every instruction, lcc never
+leaves values on the opStack across labels, so this only fails for qvms
+from other compilers
+=============
+*/
+static void AnalyzeProcedure( procedure_t *proc ) {
+	int		*work;
+	int		numWork;
+	int		i, d, pops, pushes;
+	instruction_t	*ins;
+	qboolean	seeded;
+	qboolean	computedTargets;
+
+	work = malloc( ( proc->end - proc->start ) * sizeof( int ) );
+	numWork = 0;
+	SetDepth( proc->start, 0, work, &numWork );
+
+	while ( 1 ) {
+		while ( numWork ) {
+			i = work[--numWork];
+			ins = &code[i];
+			d = ins->depth;
+
+			switch ( ins->op ) {
+			case OP_ENTER:
+				if ( i != proc->start || d != 0 ) {
+					Error( "unexpected OP_ENTER at instruction %i", i );
+				}
+				pops = 0; pushes = 0;
+				break;
+			case OP_LEAVE:
+				if ( d != 1 ) {
+					Error( "OP_LEAVE with opStack depth %i at instruction %i", d, i );
+				}
+				if ( ins->value != proc->frame ) {
+					Error( "OP_LEAVE %i does not match OP_ENTER %i at instruction %i", ins->value, proc->frame, i );
+				}
+				continue;
+			case OP_JUMP:
+				if ( d < 1 ) {
+					Error( "opStack underflow at instruction %i", i );
+				}
+				if ( ins->constTarget ) {
+					SetDepth( code[i - 1].value, d - 1, work, &numWork );
+				} else {
+					proc->computedJump = qtrue;
+					if ( d != 1 ) {
+						Error( "computed jump with opStack depth %i at instruction %i", d, i );
+					}
+				}
+				continue;
+			case OP_EQ: case OP_NE:
+			case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+			case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+			case OP_EQF: case OP_NEF:
+			case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+				if ( d < 2 ) {
+					Error( "opStack underflow at instruction %i", i );
+				}
+				SetDepth( ins->value, d - 2, work, &numWork );
+				pops = 2; pushes = 0;
+				break;
+			case OP_CONST: case OP_LOCAL: case OP_PUSH:
+				pops = 0; pushes = 1;
+				break;
+			case OP_POP: case OP_ARG:
+				pops = 1; pushes = 0;
+				break;
+			case OP_STORE1: case OP_STORE2: case OP_STORE4: case OP_BLOCK_COPY:
+				pops = 2; pushes = 0;
+				break;
+			case OP_CALL:
+			case OP_LOAD1: case OP_LOAD2: case OP_LOAD4:
+			case OP_SEX8: case OP_SEX16:
+			case OP_NEGI: case OP_BCOM: case OP_NEGF:
+			case OP_CVIF: case OP_CVFI:
+				pops = 1; pushes = 1;
+				break;
+			case OP_ADD: case OP_SUB:
+			case OP_DIVI: case OP_DIVU: case OP_MODI: case OP_MODU:
+			case OP_MULI: case OP_MULU:
+			case OP_BAND: case OP_BOR: case OP_BXOR:
+			case OP_LSH: case OP_RSHI: case OP_RSHU:
+			case OP_ADDF: case OP_SUBF: case OP_DIVF: case OP_MULF:
+				pops = 2; pushes = 1;
+				break;
+			default:
+				pops = 0; pushes = 0;
+				break;
+			}
+
+			if ( d < pops ) {
+				Error( "opStack underflow at instruction %i", i );
+			}
+			if ( d - pops + pushes > proc->maxDepth ) {
+				proc->maxDepth = d - pops + pushes;
+			}
+			SetDepth( i + 1, d - pops + pushes, work, &numWork );
+		}
+
+		if ( !proc->computedJump ) {
+			break;
+		}
+
+		// every possible target of a computed jump starts with an empty
+		// opStack, code that is still unreached can only be entered behind
+		// an instruction that doesn't fall through
+		seeded = qfalse;
+		for ( i = proc->start + 1 ; i < proc->end ; i++ ) {
+			if ( code[i].depth != -1 || ( code[i - 1].op != OP_JUMP && code[i - 1].op != OP_LEAVE ) ) {
+				continue;
+			}
+			if ( numJumpTargets && !jumpTarget[i] ) {
+				continue;
+			}
+			SetDepth( i, 0, work, &numWork );
+			seeded = qtrue;
+			break;
+		}
+		if ( !seeded ) {
+			break;
+		}
+	}
+
+	if ( proc->computedJump ) {
+		for ( i = proc->start ; i < proc->end ; i++ ) {
+			if ( code[i].depth == 0 && ( jumpTarget[i] || !numJumpTargets ) ) {
+				code[i].target = qtrue;
+			}
+		}
+	}
+
+	// a label in front of a constant jump would have cleared constTarget
+	for ( i = proc->start ; i < proc->end ; i++ ) {
+		if ( code[i].constTarget && code[i].target ) {
+			Error( "instruction %i is both a jump target and a constant jump", i );
+		}
+	}
+
+	// only keep the labels that reachable code jumps to
+	computedTargets = proc->computedJump;
+	proc->computedJump = qfalse;
+	for ( i = proc->start ; i < proc->end ; i++ ) {
+		if ( computedTargets && code[i].target && code[i].depth == 0 ) {
+			continue;
+		}
+		code[i].target = qfalse;
+	}
+	for ( i = proc->start ; i < proc->end ; i++ ) {
+		ins = &code[i];
+		if ( ins->depth == -1 ) {
+			continue;
+		}
+		if ( ins->op >= OP_EQ && ins->op <= OP_GEF ) {
+			code[ins->value].target = qtrue;
+		} else if ( ins->op == OP_JUMP && ins->constTarget ) {
+			code[code[i - 1].value].target = qtrue;
+		} else if ( ins->op == OP_JUMP ) {
+			proc->computedJump = qtrue;
+		}
+	}
+	if ( computedTargets && !proc->computedJump ) {
+		Error( "computed jump targets without a computed jump in %s", ProcName( proc - procs ) );
+	}
+
+	free( work );
+}
+
+static const char *Int( int value ) {
+	static char	buffer[4][32];
+	static int	index;
+
+	index = ( index + 1 ) & 3;
+	if ( value == (int)0x80000000 ) {
+		return "(-2147483647-1)";
+	}
+	sprintf( buffer[index], "%i", value );
+	return buffer[index];
+}
+
+/*
+=============
+EmitPrologue
+=============
+*/
+static void EmitPrologue( const char *source ) {
+	fprintf( out,
+		"// generated by qvm2c from %s, do not edit\n"
+		"\n"
+		"#include <stdint.h>\n"
+		"#include <string.h>\n"
+		"#include <stdlib.h>\n"
+		"\n"
+		"#if defined _WIN32\n"
+		"#define Q_EXPORT __declspec(dllexport)\n"
+		"#elif defined __GNUC__\n"
+		"#define Q_EXPORT __attribute__((visibility(\"default\")))\n"
+		"#else\n"
+		"#define Q_EXPORT\n"
+		"#endif\n"
+		"\n"
+		"#define DATA_SIZE    %i\n"
+		"#define DATA_MASK    ( DATA_SIZE - 1 )\n"
+		"#define STACK_BOTTOM ( DATA_SIZE - %i )\n"
+		"\n"
+		"typedef intptr_t ( *syscall_t )( intptr_t, ... );\n"
+		"\n"
+		"// stray loads at the mask may read up to three bytes beyond it\n"
+		"static unsigned char vmData[DATA_SIZE + 4];\n"
+		"static int vmProgramStack = DATA_SIZE;\n"
+		"static syscall_t vmSyscall;\n"
+		"static void ( *vmError )( const char *message );\n"
+		"\n"
+		"static void Fatal( const char *message ) {\n"
+		"\tif ( vmError ) {\n"
+		"\t\tvmError( message );\n"
+		"\t}\n"
+		"\tabort();\n"
+		"}\n"
+		"\n"
+		"static inline int LD1( int a ) { return vmData[a & DATA_MASK]; }\n"
+		"static inline int LD2( int a ) { unsigned short v; memcpy( &v, &vmData[a & DATA_MASK], 2 ); return v; }\n"
+		"static inline int LD4( int a ) { int v; memcpy( &v, &vmData[a & DATA_MASK], 4 ); return v; }\n"
+		"static inline void ST1( int a, int v ) { vmData[a & DATA_MASK] = (unsigned char)v; }\n"
+		"static inline void ST2( int a, int v ) { short s = (short)v; memcpy( &vmData[a & DATA_MASK], &s, 2 ); }\n"
+		"static inline void ST4( int a, int v ) { memcpy( &vmData[a & DATA_MASK], &v, 4 ); }\n"
+		"\n"
+		"static inline float F( int i ) { float f; memcpy( &f, &i, 4 ); return f; }\n"
+		"static inline int I( float f ) { int i; memcpy( &i, &f, 4 ); return i; }\n"
+		"\n"
+		"// wrapping integer arithmetic of the interpreter without undefined behaviour\n"
+		"#define ADD( a, b ) ( (int)( (unsigned)( a ) + (unsigned)( b ) ) )\n"
+		"#define SUB( a, b ) ( (int)( (unsigned)( a ) - (unsigned)( b ) ) )\n"
+		"#define MUL( a, b ) ( (int)( (unsigned)( a ) * (unsigned)( b ) ) )\n"
+		"#define LSH( a, b ) ( (int)( (unsigned)( a ) << ( ( b ) & 31 ) ) )\n"
+		"\n"
+		"// the guarded division and float conversion of vm_interpreted.c\n"
+		"static inline int DIVI( int a, int b ) {\n"
+		"\tif ( !b ) {\n"
+		"\t\tFatal( \"VM integer division by zero\" );\n"
+		"\t}\n"
+		"\treturn b == -1 ? SUB( 0, a ) : a / b;\n"
+		"}\n"
+		"static inline int MODI( int a, int b ) {\n"
+		"\tif ( !b ) {\n"
+		"\t\tFatal( \"VM integer division by zero\" );\n"
+		"\t}\n"
+		"\treturn b == -1 ? 0 : a %% b;\n"
+		"}\n"
+		"static inline int DIVU( int a, int b ) {\n"
+		"\tif ( !b ) {\n"
+		"\t\tFatal( \"VM integer division by zero\" );\n"
+		"\t}\n"
+		"\treturn (int)( (unsigned)a / (unsigned)b );\n"
+		"}\n"
+		"static inline int MODU( int a, int b ) {\n"
+		"\tif ( !b ) {\n"
+		"\t\tFatal( \"VM integer division by zero\" );\n"
+		"\t}\n"
+		"\treturn (int)( (unsigned)a %% (unsigned)b );\n"
+		"}\n"
+		"static inline int CVFI( float f ) {\n"
+		"\tif ( f >= -2147483648.0f && f < 2147483648.0f ) {\n"
+		"\t\treturn (int)f;\n"
+		"\t}\n"
+		"\treturn (int)0x80000000;\n"
+		"}\n"
+		"\n"
+		"static inline void BlockCopy( unsigned int dest, unsigned int src, unsigned int n ) {\n"
+		"\tif ( ( dest & DATA_MASK ) != dest || ( src & DATA_MASK ) != src\n"
+		"\t\t|| ( ( dest + n ) & DATA_MASK ) != dest + n || ( ( src + n ) & DATA_MASK ) != src + n ) {\n"
+		"\t\tFatal( \"OP_BLOCK_COPY out of range!\" );\n"
+		"\t}\n"
+		"\tmemmove( &vmData[dest], &vmData[src], n );\n"
+		"}\n"
+		"\n"
+		"// same frame as the interpreter, image[ps + 4] holds the syscall number\n"
+		"static inline int Syscall( int ps, int trap ) {\n"
+		"\tintptr_t args[%i];\n"
+		"\tint i;\n"
+		"\n"
+		"\tST4( ps + 4, trap );\n"
+		"\tfor ( i = 0 ; i < %i ; i++ ) {\n"
+		"\t\targs[i] = LD4( ps + 4 + i * 4 );\n"
+		"\t}\n"
+		"\n"
+		"\t// save the stack to allow recursive VM entry\n"
+		"\tvmProgramStack = ps - 4;\n"
+		"\treturn (int)vmSyscall( args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7],\n"
+		"\t\targs[8], args[9], args[10], args[11], args[12], args[13], args[14], args[15] );\n"
+		"}\n"
+		"\n"
+		"static inline int CallIndirect( int ps, int target );\n"
+		"\n",
+		source, dataSize, PROGRAM_STACK_SIZE, MAX_VMSYSCALL_ARGS, MAX_VMSYSCALL_ARGS );
+}
+
+/*
+=============
+EmitCall
+=============
+*/
+static void EmitCall( int i, const char *slot ) {
+	int		target;
+
+	if ( !code[i].constTarget ) {
+		fprintf( out, "\t%s = CallIndirect( ps, %s );\n", slot, slot );
+		return;
+	}
+
+	target = code[i - 1].value;
+	if ( target < 0 ) {
+		fprintf( out, "\t%s = Syscall( ps, %s );\n", slot, Int( -1 - target ) );
+	} else if ( target < numInstructions && code[target].op == OP_ENTER ) {
+		fprintf( out, "\t%s = %s( ps );\n", slot, ProcName( code[target].proc ) );
+	} else {
+		fprintf( out, "\tFatal( \"VM program counter out of range in OP_CALL\" );\n" );
+	}
+}
+
+/*
+=============
+EmitProcedure
+=============
+*/
+static void EmitProcedure( procedure_t *proc ) {
+	static const char	*intCompare[] = { "==", "!=", "<", "<=", ">", ">=" };
+	static const char	*floatCompare[] = { "==", "!=", "<", "<=", ">", ">=" };
+	instruction_t	*ins;
+	char	a[16], b[16], r[16];
+	int		i, n, d;
+
+	fprintf( out, "static int %s( int ps ) {\n", ProcName( proc - procs ) );
+	if ( proc->maxDepth ) {
+		fprintf( out, "\tint" );
+		for ( n = 0 ; n < proc->maxDepth ; n++ ) {
+			fprintf( out, "%s s%i", n ? "," : "", n );
+		}
+		fprintf( out, ";\n" );
+	}
+	fprintf( out, "\n" );
+
+	for ( i = proc->start ; i < proc->end ; i++ ) {
+		ins = &code[i];
+		d = ins->depth;
+		if ( d == -1 ) {
+			continue;	// unreachable
+		}
+
+		if ( ins->target ) {
+			fprintf( out, "L%i:\n", i );
+		}
+
+		// a is the second from the top, b the top, r the slot of a result
+		sprintf( a, "s%i", d - 2 );
+		sprintf( b, "s%i", d - 1 );
+		sprintf( r, "s%i", d );
+
+		switch ( ins->op ) {
+		case OP_UNDEF:
+		case OP_IGNORE:
+		case OP_BREAK:
+		case OP_POP:
+			break;
+
+		case OP_ENTER:
+			fprintf( out, "\tps -= %i;\n", ins->value );
+			fprintf( out, "\tif ( ps < STACK_BOTTOM ) {\n\t\tFatal( \"VM stack overflow\" );\n\t}\n" );
+			break;
+		case OP_LEAVE:
+			fprintf( out, "\treturn s0;\n" );
+			break;
+		case OP_CALL:
+			EmitCall( i, b );
+			break;
+		case OP_PUSH:
+			fprintf( out, "\t%s = 0;\n", r );
+			break;
+		case OP_CONST:
+			fprintf( out, "\t%s = %s;\n", r, Int( ins->value ) );
+			break;
+		case OP_LOCAL:
+			fprintf( out, "\t%s = ps + %s;\n", r, Int( ins->value ) );
+			break;
+
+		case OP_JUMP:
+			if ( ins->constTarget ) {
+				fprintf( out, "\tgoto L%i;\n", code[i - 1].value );
+				break;
+			}
+			fprintf( out, "\tswitch ( %s ) {\n", b );
+			for ( n = proc->start ; n < proc->end ; n++ ) {
+				if ( code[n].target && code[n].depth == 0 ) {
+					fprintf( out, "\tcase %i: goto L%i;\n", n, n );
+				}
+			}
+			fprintf( out, "\tdefault: Fatal( \"VM program counter out of range in OP_JUMP\" );\n\t}\n" );
+			break;
+
+		case OP_EQ: case OP_NE:
+		case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+			fprintf( out, "\tif ( %s %s %s ) goto L%i;\n", a, intCompare[ins->op - OP_EQ], b, ins->value );
+			break;
+		case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+			fprintf( out, "\tif ( (unsigned)%s %s (unsigned)%s ) goto L%i;\n", a, intCompare[ins->op - OP_LTU + 2], b, ins->value );
+			break;
+		case OP_EQF: case OP_NEF:
+		case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+			fprintf( out, "\tif ( F( %s ) %s F( %s ) ) goto L%i;\n", a, floatCompare[ins->op - OP_EQF], b, ins->value );
+			break;
+
+		case OP_LOAD1:
+			fprintf( out, "\t%s = LD1( %s );\n", b, b );
+			break;
+		case OP_LOAD2:
+			fprintf( out, "\t%s = LD2( %s );\n", b, b );
+			break;
+		case OP_LOAD4:
+			fprintf( out, "\t%s = LD4( %s );\n", b, b );
+			break;
+		case OP_STORE1:
+			fprintf( out, "\tST1( %s, %s );\n", a, b );
+			break;
+		case OP_STORE2:
+			fprintf( out, "\tST2( %s, %s );\n", a, b );
+			break;
+		case OP_STORE4:
+			fprintf( out, "\tST4( %s, %s );\n", a, b );
+			break;
+		case OP_ARG:
+			fprintf( out, "\tST4( ps + %i, %s );\n", ins->value, b );
+			break;
+		case OP_BLOCK_COPY:
+			fprintf( out, "\tBlockCopy( %s, %s, %u );\n", a, b, (unsigned)ins->value );
+			break;
+
+		case OP_SEX8:
+			fprintf( out, "\t%s = (signed char)%s;\n", b, b );
+			break;
+		case OP_SEX16:
+			fprintf( out, "\t%s = (short)%s;\n", b, b );
+			break;
+		case OP_NEGI:
+			fprintf( out, "\t%s = SUB( 0, %s );\n", b, b );
+			break;
+		case OP_ADD:
+			fprintf( out, "\t%s = ADD( %s, %s );\n", a, a, b );
+			break;
+		case OP_SUB:
+			fprintf( out, "\t%s = SUB( %s, %s );\n", a, a, b );
+			break;
+		case OP_DIVI:
+			fprintf( out, "\t%s = DIVI( %s, %s );\n", a, a, b );
+			break;
+		case OP_DIVU:
+			fprintf( out, "\t%s = DIVU( %s, %s );\n", a, a, b );
+			break;
+		case OP_MODI:
+			fprintf( out, "\t%s = MODI( %s, %s );\n", a, a, b );
+			break;
+		case OP_MODU:
+			fprintf( out, "\t%s = MODU( %s, %s );\n", a, a, b );
+			break;
+		case OP_MULI:
+		case OP_MULU:
+			fprintf( out, "\t%s = MUL( %s, %s );\n", a, a, b );
+			break;
+		case OP_BAND:
+			fprintf( out, "\t%s = %s & %s;\n", a, a, b );
+			break;
+		case OP_BOR:
+			fprintf( out, "\t%s = %s | %s;\n", a, a, b );
+			break;
+		case OP_BXOR:
+			fprintf( out, "\t%s = %s ^ %s;\n", a, a, b );
+			break;
+		case OP_BCOM:
+			fprintf( out, "\t%s = ~%s;\n", b, b );
+			break;
+		case OP_LSH:
+			fprintf( out, "\t%s = LSH( %s, %s );\n", a, a, b );
+			break;
+		case OP_RSHI:
+			fprintf( out, "\t%s = %s >> ( %s & 31 );\n", a, a, b );
+			break;
+		case OP_RSHU:
+			fprintf( out, "\t%s = (int)( (unsigned)%s >> ( %s & 31 ) );\n", a, a, b );
+			break;
+
+		case OP_NEGF:
+			fprintf( out, "\t%s = I( -F( %s ) );\n", b, b );
+			break;
+		case OP_ADDF:
+			fprintf( out, "\t%s = I( F( %s ) + F( %s ) );\n", a, a, b );
+			break;
+		case OP_SUBF:
+			fprintf( out, "\t%s = I( F( %s ) - F( %s ) );\n", a, a, b );
+			break;
+		case OP_DIVF:
+			fprintf( out, "\t%s = I( F( %s ) / F( %s ) );\n", a, a, b );
+			break;
+		case OP_MULF:
+			fprintf( out, "\t%s = I( F( %s ) * F( %s ) );\n", a, a, b );
+			break;
+		case OP_CVIF:
+			fprintf( out, "\t%s = I( (float)%s );\n", b, b );
+			break;
+		case OP_CVFI:
+			fprintf( out, "\t%s = CVFI( F( %s ) );\n", b, b );
+			break;
+		}
+	}
+
+	// reachable code never falls off the end, but the compiler can't know
+	fprintf( out, "\tFatal( \"VM program counter out of range\" );\n" );
+	fprintf( out, "\treturn 0;\n" );
+	fprintf( out, "}\n\n" );
+}
+
+/*
+=============
+EmitEpilogue
+=============
+*/
+static void EmitEpilogue( void ) {
+	int		i, n;
+
+	// calls through function pointers
+	fprintf( out,
+		"static inline int CallIndirect( int ps, int target ) {\n"
+		"\tif ( target < 0 ) {\n"
+		"\t\treturn Syscall( ps, -1 - target );\n"
+		"\t}\n"
+		"\tswitch ( target ) {\n" );
+	for ( n = 0 ; n < numProcs ; n++ ) {
+		fprintf( out, "\tcase %i: return %s( ps );\n", procs[n].start, ProcName( n ) );
+	}
+	fprintf( out,
+		"\t}\n"
+		"\tFatal( \"VM program counter out of range in OP_CALL\" );\n"
+		"\treturn 0;\n"
+		"}\n\n" );
+
+	// initialized data, the data section is in words so it doesn't depend on byte order
+	fprintf( out, "static const int vmDataInit[%i] = {", header.dataLength / 4 + 1 );
+	for ( i = 0 ; i < header.dataLength ; i += 4 ) {
+		fprintf( out, "%s%s,", ( i & 31 ) ? " " : "\n\t", Int( ReadLong( qvmData + i ) ) );
+	}
+	fprintf( out, "\n};\n\n" );
+
+	fprintf( out, "static const unsigned char vmLitInit[%i] = {", header.litLength + 1 );
+	for ( i = 0 ; i < header.litLength ; i++ ) {
+		fprintf( out, "%s%i,", ( i & 15 ) ? " " : "\n\t", qvmData[header.dataLength + i] );
+	}
+	fprintf( out, "\n};\n\n" );
+
+	fprintf( out,
+		"Q_EXPORT void dllEntry( syscall_t syscallptr ) {\n"
+		"\tvmSyscall = syscallptr;\n"
+		"\n"
+		"\tmemset( vmData, 0, sizeof( vmData ) );\n"
+		"\tmemcpy( vmData, vmDataInit, %i );\n"
+		"\tmemcpy( vmData + %i, vmLitInit, %i );\n"
+		"\tvmProgramStack = DATA_SIZE;\n"
+		"}\n"
+		"\n"
+		"// lets the engine treat syscall pointers as addresses in the data segment\n"
+		"Q_EXPORT void dllSandbox( void ( *error )( const char *message ), unsigned char **dataBase, int *dataMask ) {\n"
+		"\tvmError = error;\n"
+		"\t*dataBase = vmData;\n"
+		"\t*dataMask = DATA_MASK;\n"
+		"}\n"
+		"\n"
+		"Q_EXPORT intptr_t vmMain( int command, int arg0, int arg1, int arg2, int arg3, int arg4, int arg5,\n"
+		"\tint arg6, int arg7, int arg8, int arg9, int arg10, int arg11 ) {\n"
+		"\tint args[%i];\n"
+		"\tint stackOnEntry = vmProgramStack;\n"
+		"\tint ps, i, r;\n"
+		"\n"
+		"\targs[0] = command; args[1] = arg0; args[2] = arg1; args[3] = arg2;\n"
+		"\targs[4] = arg3; args[5] = arg4; args[6] = arg5; args[7] = arg6;\n"
+		"\targs[8] = arg7; args[9] = arg8; args[10] = arg9; args[11] = arg10; args[12] = arg11;\n"
+		"\n"
+		"\t// same frame as VM_CallInterpreted\n"
+		"\tps = stackOnEntry - ( 8 + 4 * %i );\n"
+		"\tfor ( i = 0 ; i < %i ; i++ ) {\n"
+		"\t\tST4( ps + 8 + i * 4, args[i] );\n"
+		"\t}\n"
+		"\tST4( ps + 4, 0 );\n"
+		"\tST4( ps, -1 );\n"
+		"\n"
+		"\tr = %s( ps );\n"
+		"\n"
+		"\tvmProgramStack = stackOnEntry;\n"
+		"\treturn r;\n"
+		"}\n",
+		header.dataLength, header.dataLength, header.litLength,
+		MAX_VMMAIN_ARGS, MAX_VMMAIN_ARGS, MAX_VMMAIN_ARGS, ProcName( 0 ) );
+}
+
+static void ShowHelp( char *argv0 ) {
+	Error("Usage: %s [OPTION]... QVM\n\
+Translate a Q3VM bytecode module into C for a sandboxed native module.\n\
+\n\
+  -o OUTPUT      Write the C source to file OUTPUT\n\
+  -m MAPFILE     Name the procedures after the map file written by q3asm -m\n\
+  -h --help -?   Show this help\n\
+", argv0);
+}
+
+/*
+==============
+main
+==============
+*/
+int main( int argc, char **argv ) {
+	int			i;
+
+	if ( argc < 2 ) {
+		ShowHelp( argv[0] );
+	}
+
+	for ( i = 1 ; i < argc ; i++ ) {
+		if ( argv[i][0] != '-' ) {
+			break;
+		}
+		if( !strcmp( argv[ i ], "-h" ) ||
+		    !strcmp( argv[ i ], "--help" ) ||
+		    !strcmp( argv[ i ], "-?") ) {
+			ShowHelp( argv[0] );
+		}
+
+		if ( !strcmp( argv[i], "-o" ) ) {
+			if ( i == argc - 1 ) {
+				Error( "-o must precede a filename" );
+			}
+			options.outputFile = argv[ ++i ];
+			continue;
+		}
+
+		if ( !strcmp( argv[i], "-m" ) ) {
+			if ( i == argc - 1 ) {
+				Error( "-m must precede a filename" );
+			}
+			options.mapFile = argv[ ++i ];
+			continue;
+		}
+
+		Error( "Unknown option: %s", argv[i] );
+	}
+
+	if ( i != argc - 1 ) {
+		ShowHelp( argv[0] );
+	}
+
+	LoadQVM( argv[i] );
+	FindProcedures();
+	if ( options.mapFile ) {
+		ReadMapFile( options.mapFile );
+	}
+
+	MarkTargets();
+	for ( i = 0 ; i < numProcs ; i++ ) {
+		AnalyzeProcedure( &procs[i] );
+	}
+
+	out = options.outputFile ? SafeOpenWrite( options.outputFile ) : stdout;
+
+	EmitPrologue( argv[argc - 1] );
+	for ( i = 0 ; i < numProcs ; i++ ) {
+		fprintf( out, "static int %s( int ps );\n", ProcName( i ) );
+	}
+	fprintf( out, "\n" );
+	for ( i = 0 ; i < numProcs ; i++ ) {
+		EmitProcedure( &procs[i] );
+	}
+	EmitEpilogue();
+
+	if ( out != stdout ) {
+		fclose( out );
+	}
+
+	return 0;
+}
@@ -29,6 +29,15 @@
 #  define PUP(a) *++(a)
 #endif
 
+/* Matches copied directly from the output buffer are moved eight bytes at a
+   time when the distance allows it, which may write up to seven bytes past
+   the end of the match.  Those bytes are always inside the caller's output
+   space (see limit below) and are overwritten by the following codes.
+   Define NO_WIDE_COPY to get the original byte-by-byte loop. */
+#if !defined(NO_WIDE_COPY) && defined(STDC)
+#  define WIDE_COPY
+#endif
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -74,6 +83,9 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     unsigned char FAR *out;     /* local strm->next_out */
     unsigned char FAR *beg;     /* inflate()'s initial strm->next_out */
     unsigned char FAR *end;     /* while out < end, enough space available */
+#ifdef WIDE_COPY
+    unsigned char FAR *limit;   /* one past the last writable output byte */
+#endif
 #ifdef INFLATE_STRICT
     unsigned dmax;              /* maximum distance from zlib header */
 #endif
@@ -101,6 +113,9 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     out = strm->next_out - OFF;
     beg = out - (start - strm->avail_out);
     end = out + (strm->avail_out - 257);
+#ifdef WIDE_COPY
+    limit = strm->next_out + strm->avail_out;
+#endif
 #ifdef INFLATE_STRICT
     dmax = state->dmax;
 #endif
@@ -245,6 +260,27 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                 }
                 else {
                     from = out - dist;          /* copy direct from output */
+#ifdef WIDE_COPY
+                    if (dist == 1) {            /* run of a single byte */
+                        memset(out + OFF, out[OFF - 1], len);
+                        out += len;
+                        continue;
+                    }
+                    if (dist >= 8 &&
+                        out + OFF + ((len + 7) & ~7U) <= limit) {
+                        unsigned char FAR *to = out + OFF;
+                        unsigned char FAR *stop = to + len;
+
+                        from += OFF;
+                        do {                    /* chunks never overlap */
+                            zmemcpy(to, from, 8);
+                            to += 8;
+                            from += 8;
+                        } while (to < stop);
+                        out = stop - OFF;
+                        continue;
+                    }
+#endif
                     do {                        /* minimum length is three */
                         PUP(out) = PUP(from);
                         PUP(out) = PUP(from);